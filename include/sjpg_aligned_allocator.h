@@ -0,0 +1,61 @@
+//
+// Created by user on 8/4/25.
+//
+
+#ifndef SJPG_ALIGNED_ALLOCATOR_H
+#define SJPG_ALIGNED_ALLOCATOR_H
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sjpg_codec {
+// std::vector storage aligned to `kAlignment` bytes whose elements are
+// default initialized, so resize() doesn't write memory that is about to be
+// overwritten anyway. assign() and value-initializing calls still zero it.
+template <typename T, size_t kAlignment> class AlignedAllocator {
+public:
+  static_assert(kAlignment >= alignof(T) &&
+                    (kAlignment & (kAlignment - 1)) == 0,
+                "alignment must be a power of 2 of at least alignof(T)");
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, kAlignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, kAlignment> &) noexcept {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t{kAlignment}));
+  }
+
+  void deallocate(T *p, size_t) noexcept {
+    ::operator delete(p, std::align_val_t{kAlignment});
+  }
+
+  template <typename U>
+  void construct(U *p) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new (static_cast<void *>(p)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U *p, Args &&...args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, kAlignment> &) const noexcept {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, kAlignment> &) const noexcept {
+    return false;
+  }
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_ALIGNED_ALLOCATOR_H
@@ -0,0 +1,354 @@
+//
+// Created by user on 7/28/25.
+//
+
+#ifndef SJPG_BATCH_DECODER_H
+#define SJPG_BATCH_DECODER_H
+#include "sjpg_jpeg_decoder.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sjpg_codec {
+// an image of a batch, either a file or a buffer that must stay alive until
+// its result is delivered
+struct BatchInput {
+  std::string path;
+  ByteSpan data;
+
+  static BatchInput fromFile(std::string path) { return {std::move(path), {}}; }
+  static BatchInput fromMemory(const uint8_t *data, size_t size) {
+    return {{}, {data, size}};
+  }
+  bool isFile() const { return !path.empty(); }
+};
+
+struct BatchResult {
+  size_t index{0}; // position of the input in the batch
+  // 0 on success, the JFIFParser::ParseResult or -1 if decoding failed
+  int status{0};
+  size_t width{0};
+  size_t height{0};
+  size_t stride{0};
+  PixelFormat format{PixelFormat::RGB};
+  std::vector<uint8_t> pixels;
+};
+
+struct BatchStats {
+  size_t images{0};
+  size_t failed{0};
+  uint64_t input_bytes{0}; // of the images decoded
+  uint64_t output_pixels{0};
+  size_t steals{0}; // images decoded by another worker than planned
+  double seconds{0.0};
+
+  double imagesPerSecond() const {
+    return seconds > 0 ? static_cast<double>(images) / seconds : 0.0;
+  }
+  double megapixelsPerSecond() const {
+    return seconds > 0 ? static_cast<double>(output_pixels) / 1e6 / seconds
+                       : 0.0;
+  }
+};
+
+// Decodes many independent images on a pool of worker threads. Every worker
+// owns a parser and a decoder that are reused from image to image, so the
+// steady state decode does not allocate apart from the result pixels.
+//
+// A batch is sorted by input size and dealt round-robin onto per-worker
+// queues, largest first, to keep a big image from being the last one
+// started. A worker that runs out of work steals the largest image left in
+// the other workers' queues, the largest of their fronts since every queue
+// is in decreasing size.
+class BatchDecoder {
+public:
+  struct Options {
+    PixelFormat format{PixelFormat::RGB};
+    DecodeScale scale{DecodeScale::Full};
+    IDCTMethod idct_method{IDCTMethod::Islow};
+    UpsampleMode upsample_mode{UpsampleMode::Fancy};
+  };
+
+  // called on a worker thread as soon as an image is done. An exception it
+  // throws is logged and the batch goes on.
+  using ResultCallback = std::function<void(BatchResult &&)>;
+
+  // 0 picks the number of hardware threads
+  explicit BatchDecoder(size_t thread_count = 0)
+      : BatchDecoder(thread_count, Options()) {}
+
+  BatchDecoder(size_t thread_count, Options options) : options_(options) {
+    if (thread_count == 0) {
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+      workers_.push_back(std::make_unique<Worker>());
+      workers_.back()->decoder.setScale(options_.scale);
+      workers_.back()->decoder.setIDCTMethod(options_.idct_method);
+      workers_.back()->decoder.setUpsampleMode(options_.upsample_mode);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+      threads_.emplace_back([this, i] { workerLoop(i); });
+    }
+  }
+
+  ~BatchDecoder() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  BatchDecoder(const BatchDecoder &) = delete;
+  BatchDecoder &operator=(const BatchDecoder &) = delete;
+
+  size_t size() const { return workers_.size(); }
+  const Options &getOptions() const { return options_; }
+
+  // decodes `inputs` and returns when all of them are done. Must not be
+  // called from `on_result` or another worker of this decoder. Nothing is
+  // decoded without `on_result`.
+  BatchStats decode(const std::vector<BatchInput> &inputs,
+                    const ResultCallback &on_result) {
+    if (!on_result) {
+      LOG_ERROR("Batch decoding needs a result callback\n");
+      return {};
+    }
+    auto batch = std::make_shared<Batch>(inputs);
+    batch->on_result = on_result;
+    enqueue(batch);
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->cv.wait(lock, [&] { return batch->remaining == 0; });
+    return batch->stats;
+  }
+
+  // starts decoding `inputs` and returns at once, with one future per input
+  // in input order. `stats`, if given, is filled when the last image is done.
+  std::vector<std::future<BatchResult>>
+  submit(const std::vector<BatchInput> &inputs,
+         std::shared_ptr<BatchStats> stats = nullptr) {
+    auto batch = std::make_shared<Batch>(inputs);
+    batch->promises.resize(inputs.size());
+    batch->stats_out = std::move(stats);
+    std::vector<std::future<BatchResult>> futures;
+    futures.reserve(inputs.size());
+    for (auto &promise : batch->promises) {
+      futures.push_back(promise.get_future());
+    }
+    enqueue(batch);
+    return futures;
+  }
+
+private:
+  struct Batch {
+    explicit Batch(const std::vector<BatchInput> &batch_inputs)
+        : inputs(batch_inputs), remaining(batch_inputs.size()),
+          start(std::chrono::steady_clock::now()) {}
+
+    std::vector<BatchInput> inputs;
+    ResultCallback on_result;
+    std::vector<std::promise<BatchResult>> promises;
+    std::shared_ptr<BatchStats> stats_out;
+
+    std::mutex mutex; // guards the members below
+    std::condition_variable cv;
+    size_t remaining;
+    BatchStats stats;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  struct Job {
+    std::shared_ptr<Batch> batch;
+    size_t index{0};
+    uint64_t cost{0}; // input bytes, the compressed size tracks the pixels
+  };
+
+  struct Worker {
+    std::deque<Job> jobs; // guarded by mutex_
+    JFIFParser parser;
+    JPEGDecoder decoder;
+  };
+
+  static uint64_t inputSize(const BatchInput &input) {
+    if (!input.isFile()) {
+      return input.data.size();
+    }
+    std::error_code error;
+    auto size = std::filesystem::file_size(input.path, error);
+    return error ? 0 : size;
+  }
+
+  void enqueue(const std::shared_ptr<Batch> &batch) {
+    if (batch->inputs.empty()) {
+      std::lock_guard<std::mutex> lock(batch->mutex);
+      finishStats(*batch);
+      return;
+    }
+    std::vector<Job> jobs(batch->inputs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      jobs[i] = {batch, i, inputSize(batch->inputs[i])};
+    }
+    std::stable_sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) {
+      return a.cost > b.cost;
+    });
+    {
+      // the jobs are queued and counted at once, a worker that sees them
+      // counted finds them queued
+      std::lock_guard<std::mutex> lock(mutex_);
+      // small batches don't all land on the first worker
+      const auto first = next_worker_;
+      next_worker_ += jobs.size();
+      for (size_t i = 0; i < jobs.size(); ++i) {
+        workers_[(first + i) % workers_.size()]->jobs.push_back(
+            std::move(jobs[i]));
+      }
+      pending_ += jobs.size();
+    }
+    cv_.notify_all();
+  }
+
+  // the next job of `self`, or else the largest front of the other queues.
+  // mutex_ is held and pending_ > 0, so some queue has a job.
+  Job takeJob(size_t self, bool &stolen) {
+    auto *queue = &workers_[self]->jobs;
+    stolen = queue->empty();
+    if (stolen) {
+      queue = nullptr;
+      for (auto &worker : workers_) {
+        if (!worker->jobs.empty() &&
+            (queue == nullptr ||
+             worker->jobs.front().cost > queue->front().cost)) {
+          queue = &worker->jobs;
+        }
+      }
+    }
+    Job job = std::move(queue->front());
+    queue->pop_front();
+    return job;
+  }
+
+  void workerLoop(size_t self) {
+    for (;;) {
+      Job job;
+      bool stolen = false;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+        if (pending_ == 0) {
+          return; // stopping
+        }
+        --pending_;
+        job = takeJob(self, stolen);
+      }
+      run(*workers_[self], job, stolen);
+    }
+  }
+
+  void run(Worker &worker, Job &job, bool stolen) {
+    auto &batch = *job.batch;
+    BatchResult result;
+    result.index = job.index;
+    result.format = options_.format;
+    try {
+      result.status = decodeOne(worker, batch.inputs[job.index], result);
+    } catch (const std::exception &e) {
+      // corrupt entropy-coded data, the batch goes on
+      LOG_ERROR("Decoding image %zu failed: %s\n", job.index, e.what());
+      result.status = -1;
+    }
+    if (result.status != 0) {
+      result.pixels.clear();
+    }
+
+    {
+      // the stats are complete before the last result is delivered
+      std::lock_guard<std::mutex> lock(batch.mutex);
+      if (result.status != 0) {
+        batch.stats.failed++;
+      } else {
+        batch.stats.input_bytes += job.cost;
+        batch.stats.output_pixels +=
+            static_cast<uint64_t>(result.width) * result.height;
+      }
+      if (stolen) {
+        batch.stats.steals++;
+      }
+      if (++batch.stats.images == batch.inputs.size()) {
+        finishStats(batch);
+      }
+    }
+    if (!batch.promises.empty()) {
+      batch.promises[job.index].set_value(std::move(result));
+    } else {
+      try {
+        batch.on_result(std::move(result));
+      } catch (const std::exception &e) {
+        // the worker and the rest of the batch carry on
+        LOG_ERROR("Result callback of image %zu failed: %s\n", job.index,
+                  e.what());
+      } catch (...) {
+        LOG_ERROR("Result callback of image %zu failed\n", job.index);
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (--batch.remaining == 0) {
+      batch.cv.notify_all();
+    }
+  }
+
+  int decodeOne(Worker &worker, const BatchInput &input, BatchResult &result) {
+    auto ret = input.isFile()
+                   ? worker.parser.parseFile(input.path)
+                   : worker.parser.parse(input.data.data(), input.data.size());
+    if (ret != JFIFParser::Success) {
+      return ret;
+    }
+    if (worker.decoder.decode(worker.parser) != 0) {
+      return -1;
+    }
+    result.width = worker.decoder.getWidth();
+    result.height = worker.decoder.getHeight();
+    result.stride =
+        result.width * ColorConverter::getBytesPerPixel(options_.format);
+    result.pixels.resize(result.stride * result.height);
+    return worker.decoder.convertColor(options_.format, result.pixels.data(),
+                                       result.stride);
+  }
+
+  // batch.mutex is held
+  static void finishStats(Batch &batch) {
+    batch.stats.seconds = std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - batch.start)
+                              .count();
+    if (batch.stats_out) {
+      *batch.stats_out = batch.stats;
+    }
+  }
+
+  Options options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_; // guards the queues, pending_, next_worker_ and stopping_
+  std::condition_variable cv_;
+  size_t pending_{0}; // jobs queued and not taken yet
+  size_t next_worker_{0};
+  bool stopping_{false};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_BATCH_DECODER_H
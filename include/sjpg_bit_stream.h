@@ -4,33 +4,168 @@
 
 # pragma once
 
-#include <string>
-#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 namespace sjpg_codec {
+// MSB-first bit reader over entropy-coded bytes. The data is not copied and
+// must outlive the stream. 0xFF00 stuffing is removed on the fly, reading
+// stops at the first marker (0xFF followed by a non-zero byte) and zero bits
+// are returned past a marker or the end of the data.
 class BitStream {
 public:
-  void append(const std::string &s) { data_.append(s); }
-  size_t getPosition() const { return pos_; }
-  size_t getSize() const { return data_.size(); }
-  char getBit() {
-    if(pos_ >= data_.size()){
-      throw std::out_of_range("BitStream out of range");
-    }
-    return data_[pos_++];
+  BitStream() = default;
+  BitStream(const uint8_t *data, size_t size) { reset(data, size); }
+
+  void reset(const uint8_t *data, size_t size) {
+    data_ = data;
+    size_ = size;
+    pos_ = 0;
+    acc_ = 0;
+    bits_ = 0;
+    consumed_bits_ = 0;
+    fed_bits_ = 0;
+    marker_ = 0;
+    exhausted_ = false;
   }
-  std::string getBitN(size_t n) {
-    std::string bits;
-    for (size_t i = 0; i < n; i++) {
-      bits.push_back(getBit());
+
+  // number of bits consumed so far
+  size_t getPosition() const { return consumed_bits_; }
+  // size of the underlying data in bytes
+  size_t getSize() const { return size_; }
+
+  // returns the next n(<=32) bits without consuming them
+  uint32_t peek(int n) {
+    if (bits_ < n) {
+      refill();
     }
+    // two shifts so that n == 0 is well defined
+    return static_cast<uint32_t>((acc_ >> (63 - n)) >> 1);
+  }
+
+  void consume(int n) {
+    acc_ <<= n;
+    bits_ -= n;
+    consumed_bits_ += n;
+  }
+
+  uint32_t getBits(int n) {
+    auto bits = peek(n);
+    consume(n);
     return bits;
   }
-  const std::string& getStringData() const {
-    return data_;
+
+  int getBit() { return static_cast<int>(getBits(1)); }
+
+  // true if more bits were consumed than the data holds
+  bool isOverrun() const { return exhausted_ && consumed_bits_ > fed_bits_; }
+
+  // the marker that stopped the reading, 0 if none was met yet
+  uint8_t getMarker() const { return marker_; }
+
+  // offset of the next byte not yet loaded into the accumulator
+  size_t getBytePosition() const { return pos_; }
+
+  // where the next bit to consume is in the data, in bits from its start
+  // with the stuffed bytes counted. A stream over the data from that byte
+  // on continues from there once the bits before it in the byte are read.
+  uint64_t getDataBitOffset() const {
+    if (consumed_bits_ >= fed_bits_) {
+      return static_cast<uint64_t>(pos_) * 8;
+    }
+    // the bits not consumed yet came from the last bytes before pos_
+    const auto pending = fed_bits_ - consumed_bits_;
+    auto pos = pos_;
+    for (auto bytes = (pending + 7) / 8; bytes > 0; --bytes) {
+      pos -= pos >= 2 && data_[pos - 1] == 0x00 && data_[pos - 2] == 0xFF ? 2
+                                                                           : 1;
+    }
+    return static_cast<uint64_t>(pos) * 8 + (8 - pending % 8) % 8;
   }
 
 private:
-  std::string data_;
+  void refill() {
+    while (bits_ <= 56) {
+      if (exhausted_) {
+        // feed zeros past a marker or the end of data
+        bits_ = 64;
+        return;
+      }
+
+      // fast path: take whole bytes while none of them is 0xFF. pos_ never
+      // passes size_, saying so lets the compiler see the load is in bounds.
+      if (pos_ <= size_ && size_ - pos_ >= 8) {
+        auto word = load64BigEndian(data_ + pos_);
+        if (!hasFFByte(word)) {
+          auto num_bytes = (64 - bits_) >> 3;
+          auto num_taken_bits = num_bytes * 8;
+          if (num_taken_bits < 64) {
+            word &= ~((uint64_t{1} << (64 - num_taken_bits)) - 1);
+          }
+          acc_ |= word >> bits_;
+          bits_ += num_taken_bits;
+          fed_bits_ += num_taken_bits;
+          pos_ += num_bytes;
+          continue;
+        }
+      }
+
+      if (pos_ >= size_) {
+        exhausted_ = true;
+        continue;
+      }
+      auto b = data_[pos_];
+      if (b == 0xFF) {
+        auto next = pos_ + 1 < size_ ? data_[pos_ + 1] : 0xFF;
+        if (next != 0x00) {
+          // a marker, keep pos_ on its 0xFF
+          marker_ = pos_ + 1 < size_ ? next : 0;
+          exhausted_ = true;
+          continue;
+        }
+        pos_ += 2; // stuffed 0x00
+      } else {
+        pos_ += 1;
+      }
+      acc_ |= static_cast<uint64_t>(b) << (56 - bits_);
+      bits_ += 8;
+      fed_bits_ += 8;
+    }
+  }
+
+  // one unaligned load and a byte swap
+  static uint64_t load64BigEndian(const uint8_t *p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+#if defined(__GNUC__) || defined(__clang__)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+#else
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&word);
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value = (value << 8) | bytes[i];
+    }
+    return value;
+#endif
+  }
+
+  static bool hasFFByte(uint64_t word) {
+    // a zero byte in ~word is a 0xFF byte in word
+    auto v = ~word;
+    return ((v - 0x0101010101010101ULL) & ~v & 0x8080808080808080ULL) != 0;
+  }
+
+  const uint8_t *data_{nullptr};
+  size_t size_{0};
   size_t pos_{0};
+  uint64_t acc_{0}; // left aligned, the next bit is the MSB
+  int bits_{0};     // valid bits in acc_
+  size_t consumed_bits_{0};
+  size_t fed_bits_{0};
+  uint8_t marker_{0};
+  bool exhausted_{false};
 };
 } // namespace sjpg_codec
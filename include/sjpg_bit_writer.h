@@ -0,0 +1,120 @@
+//
+// Created by user on 8/1/25.
+//
+
+#ifndef SJPG_BIT_WRITER_H
+#define SJPG_BIT_WRITER_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sjpg_codec {
+// MSB-first bit writer for entropy-coded data, the counterpart of BitStream.
+// Bits are collected in a 64-bit accumulator and stored 8 bytes at a time,
+// a 0x00 is stuffed after every 0xFF. The bytes are appended to a caller's
+// vector, which is grown in large steps and trimmed to the data written by
+// flush(). Nothing else may append to the vector between two flushes.
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out)
+      : out_(out), pos_(out.size()) {}
+
+  BitWriter(const BitWriter &) = delete;
+  BitWriter &operator=(const BitWriter &) = delete;
+
+  ~BitWriter() { flush(); }
+
+  // appends the low `count`(<= 32) bits of `bits`, the others must be 0
+  void write(uint32_t bits, int count) {
+    if (count < free_) {
+      acc_ = (acc_ << count) | bits;
+      free_ -= count;
+      return;
+    }
+    // fill the accumulator, keep the rest of the bits for the next one
+    count -= free_;
+    acc_ = (acc_ << free_) | (static_cast<uint64_t>(bits) >> count);
+    store(acc_);
+    acc_ = bits & ((static_cast<uint64_t>(1) << count) - 1);
+    free_ = kAccumulatorBits - count;
+  }
+
+  // pads the last byte with 1-bits(ITU-T.81 F.1.2.3) and trims the vector
+  void flush() {
+    align();
+    out_.resize(pos_);
+  }
+
+  // pads the last byte and appends a marker, e.g. RSTn
+  void writeMarker(uint8_t marker) {
+    align();
+    reserve(2);
+    out_[pos_++] = 0xFF;
+    out_[pos_++] = marker;
+  }
+
+  // bytes written so far, after stuffing, including the vector's initial
+  // contents
+  size_t getPosition() const { return pos_; }
+
+private:
+  constexpr static int kAccumulatorBits = 64;
+  constexpr static uint64_t kLowBits = 0x0101010101010101ull;
+  constexpr static uint64_t kHighBits = 0x8080808080808080ull;
+  constexpr static size_t kMinGrowth = 4096;
+
+  // room for at least `size` more bytes
+  void reserve(size_t size) {
+    if (pos_ + size > out_.size()) {
+      out_.resize(std::max(out_.size() * 2, pos_ + size + kMinGrowth));
+    }
+  }
+
+  void store(uint64_t bits) {
+    // a full accumulator is at most 16 bytes once stuffed
+    reserve(16);
+    auto inverted = ~bits;
+    bool has_ff = ((inverted - kLowBits) & ~inverted & kHighBits) != 0;
+    if (!has_ff) {
+      uint8_t *p = out_.data() + pos_;
+      for (int i = 0; i < 8; ++i) {
+        p[i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+      }
+      pos_ += 8;
+      return;
+    }
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      putByte(static_cast<uint8_t>(bits >> shift));
+    }
+  }
+
+  void align() {
+    int used = kAccumulatorBits - free_;
+    int pad = (8 - used % 8) % 8;
+    acc_ = (acc_ << pad) | ((1u << pad) - 1);
+    used += pad;
+    reserve(16);
+    for (int shift = used - 8; shift >= 0; shift -= 8) {
+      putByte(static_cast<uint8_t>(acc_ >> shift));
+    }
+    acc_ = 0;
+    free_ = kAccumulatorBits;
+  }
+
+  // there is room for 2 bytes
+  void putByte(uint8_t byte) {
+    out_[pos_++] = byte;
+    if (byte == 0xFF) {
+      out_[pos_++] = 0;
+    }
+  }
+
+  std::vector<uint8_t> &out_;
+  size_t pos_; // end of the data written, out_ may be longer
+  uint64_t acc_{0};
+  int free_{kAccumulatorBits}; // unused bits of acc_, 1 ~ 64
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_BIT_WRITER_H
@@ -0,0 +1,552 @@
+//
+// Created by user on 7/22/25.
+//
+
+#ifndef SJPG_COLOR_CONVERT_H
+#define SJPG_COLOR_CONVERT_H
+#include "sjpg_cpu_features.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(SJPG_ARCH_X86)
+#include <immintrin.h>
+#endif
+
+namespace sjpg_codec {
+enum class PixelFormat {
+  RGB = 0,
+  BGR = 1,
+  RGBA = 2,
+  BGRA = 3,
+  Gray = 4, // the luma only, one byte a pixel
+};
+
+// YCbCr -> RGB(JFIF, full range) in 14-bit fixed point:
+//   R = Y + 1.402 * (Cr - 128)
+//   G = Y - 0.344136 * (Cb - 128) - 0.714136 * (Cr - 128)
+//   B = Y + 1.772 * (Cb - 128)
+// Every kernel evaluates exactly these integer expressions, so all SIMD
+// levels produce identical pixels. Alpha is always 255. The row kernels
+// take the color formats, Gray output is a copy of Y, see selectGray().
+class ColorConverter {
+public:
+  using RowKernel = void (*)(const uint8_t *y, const uint8_t *cb,
+                             const uint8_t *cr, uint8_t *out, size_t width,
+                             PixelFormat format);
+
+  constexpr static int kFixBits = 14;
+  constexpr static int32_t kCrToR = 22970;  // 1.402 * 2^14
+  constexpr static int32_t kCbToG = -5638;  // -0.344136 * 2^14
+  constexpr static int32_t kCrToG = -11700; // -0.714136 * 2^14
+  constexpr static int32_t kCbToB = 29032;  // 1.772 * 2^14
+  constexpr static int32_t kRound = 1 << (kFixBits - 1);
+
+  static int getBytesPerPixel(PixelFormat format) {
+    if (format == PixelFormat::Gray) {
+      return 1;
+    }
+    return format == PixelFormat::RGBA || format == PixelFormat::BGRA ? 4 : 3;
+  }
+
+  // a row of a grayscale image, or the luma of a color one, in `format`:
+  // copied for Gray, R = G = B = Y otherwise. No conversion is needed.
+  using GrayRowKernel = void (*)(const uint8_t *y, uint8_t *out, size_t width,
+                                 PixelFormat format);
+
+  static GrayRowKernel selectGray(SIMDLevel level) {
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::AVX2) {
+      return &convertGrayRowAVX2;
+    }
+    if (level >= SIMDLevel::SSE2) {
+      return &convertGrayRowSSE2;
+    }
+#endif
+    (void)level;
+    return &convertGrayRowScalar;
+  }
+
+  static RowKernel select(SIMDLevel level) {
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::AVX2) {
+      return &convertRowAVX2;
+    }
+    if (level >= SIMDLevel::SSE2) {
+      return &convertRowSSE2;
+    }
+#endif
+    (void)level;
+    return &convertRowScalar;
+  }
+
+  // converts a width x height image, the three planes have the same size
+  static void convert(const uint8_t *y, size_t y_stride, const uint8_t *cb,
+                      size_t cb_stride, const uint8_t *cr, size_t cr_stride,
+                      size_t width, size_t height, uint8_t *out,
+                      size_t out_stride, PixelFormat format) {
+    auto kernel = select(CPUFeatures::getSIMDLevel());
+    for (size_t row = 0; row < height; ++row) {
+      kernel(y + row * y_stride, cb + row * cb_stride, cr + row * cr_stride,
+             out + row * out_stride, width, format);
+    }
+  }
+
+  static void convertRowScalar(const uint8_t *y, const uint8_t *cb,
+                               const uint8_t *cr, uint8_t *out, size_t width,
+                               PixelFormat format) {
+    const auto bpp = getBytesPerPixel(format);
+    const bool bgr = format == PixelFormat::BGR || format == PixelFormat::BGRA;
+    const auto r_offset = bgr ? 2 : 0;
+    const auto b_offset = bgr ? 0 : 2;
+    for (size_t i = 0; i < width; ++i) {
+      int32_t cb_value = cb[i] - 128;
+      int32_t cr_value = cr[i] - 128;
+      int32_t y_value = y[i];
+      uint8_t *pixel = out + i * bpp;
+      pixel[r_offset] =
+          clampToByte(y_value + ((cr_value * kCrToR + kRound) >> kFixBits));
+      pixel[1] = clampToByte(
+          y_value + ((cb_value * kCbToG + cr_value * kCrToG + kRound) >>
+                     kFixBits));
+      pixel[b_offset] =
+          clampToByte(y_value + ((cb_value * kCbToB + kRound) >> kFixBits));
+      if (bpp == 4) {
+        pixel[3] = 255;
+      }
+    }
+  }
+
+  static void convertGrayRowScalar(const uint8_t *y, uint8_t *out,
+                                   size_t width, PixelFormat format) {
+    const auto bpp = getBytesPerPixel(format);
+    if (bpp == 1) {
+      std::memcpy(out, y, width);
+      return;
+    }
+    for (size_t i = 0; i < width; ++i) {
+      uint8_t *pixel = out + i * bpp;
+      pixel[0] = pixel[1] = pixel[2] = y[i];
+      if (bpp == 4) {
+        pixel[3] = 255;
+      }
+    }
+  }
+
+#if defined(SJPG_ARCH_X86)
+  SJPG_TARGET_SSE2 static void convertGrayRowSSE2(const uint8_t *y,
+                                                  uint8_t *out, size_t width,
+                                                  PixelFormat format) {
+    constexpr size_t kStep = 16;
+    const auto bpp = getBytesPerPixel(format);
+    size_t i = 0;
+    if (bpp != 1) {
+      for (; i + kStep <= width; i += kStep) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+        storePixelsSSE2(v, v, v, out + i * bpp, bpp);
+      }
+    }
+    convertGrayRowScalar(y + i, out + i * bpp, width - i, format);
+  }
+
+  // 16 samples to 48 bytes in three shuffles
+  SJPG_TARGET_AVX2 static void convertGrayRowAVX2(const uint8_t *y,
+                                                  uint8_t *out, size_t width,
+                                                  PixelFormat format) {
+    constexpr size_t kStep = 16;
+    const auto bpp = getBytesPerPixel(format);
+    if (bpp != 3) {
+      convertGrayRowSSE2(y, out, width, format);
+      return;
+    }
+    const auto spread0 =
+        _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+    const auto spread1 =
+        _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+    const auto spread2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13,
+                                       14, 14, 14, 15, 15, 15);
+    size_t i = 0;
+    for (; i + kStep <= width; i += kStep) {
+      auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+      auto *dst = reinterpret_cast<__m128i *>(out + i * 3);
+      _mm_storeu_si128(dst, _mm_shuffle_epi8(v, spread0));
+      _mm_storeu_si128(dst + 1, _mm_shuffle_epi8(v, spread1));
+      _mm_storeu_si128(dst + 2, _mm_shuffle_epi8(v, spread2));
+    }
+    convertGrayRowScalar(y + i, out + i * 3, width - i, format);
+  }
+
+  SJPG_TARGET_SSE2 static void convertRowSSE2(const uint8_t *y,
+                                              const uint8_t *cb,
+                                              const uint8_t *cr, uint8_t *out,
+                                              size_t width,
+                                              PixelFormat format) {
+    constexpr size_t kStep = 16;
+    const auto bpp = getBytesPerPixel(format);
+    const bool bgr = format == PixelFormat::BGR || format == PixelFormat::BGRA;
+    const auto zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + kStep <= width; i += kStep) {
+      auto y16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+      auto cb16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cb + i));
+      auto cr16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cr + i));
+
+      __m128i r_words[2], g_words[2], b_words[2];
+      for (int half = 0; half < 2; ++half) {
+        auto y_words = unpack8SSE2(half, y16, zero);
+        auto cb_words = _mm_sub_epi16(unpack8SSE2(half, cb16, zero),
+                                      _mm_set1_epi16(128));
+        auto cr_words = _mm_sub_epi16(unpack8SSE2(half, cr16, zero),
+                                      _mm_set1_epi16(128));
+        convertWordsSSE2(y_words, cb_words, cr_words, r_words[half],
+                         g_words[half], b_words[half]);
+      }
+      auto r = _mm_packus_epi16(r_words[0], r_words[1]);
+      auto g = _mm_packus_epi16(g_words[0], g_words[1]);
+      auto b = _mm_packus_epi16(b_words[0], b_words[1]);
+      if (bgr) {
+        std::swap(r, b);
+      }
+      storePixelsSSE2(r, g, b, out + i * bpp, bpp);
+    }
+    convertRowScalar(y + i, cb + i, cr + i, out + i * bpp, width - i, format);
+  }
+
+  SJPG_TARGET_AVX2 static void convertRowAVX2(const uint8_t *y,
+                                              const uint8_t *cb,
+                                              const uint8_t *cr, uint8_t *out,
+                                              size_t width,
+                                              PixelFormat format) {
+    constexpr size_t kStep = 16;
+    const auto bpp = getBytesPerPixel(format);
+    const bool bgr = format == PixelFormat::BGR || format == PixelFormat::BGRA;
+    const auto offset = _mm256_set1_epi16(128);
+    const auto round = _mm256_set1_epi32(kRound);
+    const auto k_r = _mm256_set1_epi32(pair(0, kCrToR));
+    const auto k_g = _mm256_set1_epi32(pair(kCbToG, kCrToG));
+    const auto k_b = _mm256_set1_epi32(pair(kCbToB, 0));
+
+    size_t i = 0;
+    // the 3 bytes per pixel store writes 4 bytes past the 16 pixels
+    const size_t tail = bpp == 3 ? 2 : 0;
+    for (; i + kStep + tail <= width; i += kStep) {
+      auto y_words = _mm256_cvtepu8_epi16(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i)));
+      auto cb_words = _mm256_sub_epi16(
+          _mm256_cvtepu8_epi16(
+              _mm_loadu_si128(reinterpret_cast<const __m128i *>(cb + i))),
+          offset);
+      auto cr_words = _mm256_sub_epi16(
+          _mm256_cvtepu8_epi16(
+              _mm_loadu_si128(reinterpret_cast<const __m128i *>(cr + i))),
+          offset);
+
+      // unpack and packs both work per 128-bit lane, so the order is kept
+      auto lo = _mm256_unpacklo_epi16(cb_words, cr_words);
+      auto hi = _mm256_unpackhi_epi16(cb_words, cr_words);
+      auto r = channelAVX2(lo, hi, k_r, round, y_words);
+      auto g = channelAVX2(lo, hi, k_g, round, y_words);
+      auto b = channelAVX2(lo, hi, k_b, round, y_words);
+      if (bgr) {
+        std::swap(r, b);
+      }
+
+      uint8_t *dst = out + i * bpp;
+      if (bpp == 4) {
+        storePixelsSSE2(r, g, b, dst, bpp);
+        continue;
+      }
+      // RGBX groups of 4 pixels, shuffled to 12 bytes each
+      const auto alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+      const auto pack3 = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13,
+                                       14, -1, -1, -1, -1);
+      auto rg_lo = _mm_unpacklo_epi8(r, g);
+      auto rg_hi = _mm_unpackhi_epi8(r, g);
+      auto ba_lo = _mm_unpacklo_epi8(b, alpha);
+      auto ba_hi = _mm_unpackhi_epi8(b, alpha);
+      __m128i groups[4] = {
+          _mm_unpacklo_epi16(rg_lo, ba_lo), _mm_unpackhi_epi16(rg_lo, ba_lo),
+          _mm_unpacklo_epi16(rg_hi, ba_hi), _mm_unpackhi_epi16(rg_hi, ba_hi)};
+      for (int k = 0; k < 4; ++k) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + k * 12),
+                         _mm_shuffle_epi8(groups[k], pack3));
+      }
+    }
+    convertRowScalar(y + i, cb + i, cr + i, out + i * bpp, width - i, format);
+  }
+#endif
+
+private:
+  static uint8_t clampToByte(int32_t v) {
+    return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+  }
+
+  // two 16-bit constants for _mm_madd_epi16 on (cb, cr) pairs
+  static int32_t pair(int32_t cb_factor, int32_t cr_factor) {
+    return static_cast<int32_t>(
+        (static_cast<uint32_t>(static_cast<uint16_t>(cr_factor)) << 16) |
+        static_cast<uint16_t>(cb_factor));
+  }
+
+#if defined(SJPG_ARCH_X86)
+  SJPG_TARGET_SSE2 static __m128i unpack8SSE2(int half, __m128i a,
+                                              __m128i b) {
+    return half == 0 ? _mm_unpacklo_epi8(a, b) : _mm_unpackhi_epi8(a, b);
+  }
+
+  // 8 pixels in 16-bit lanes, cb and cr already centered
+  SJPG_TARGET_SSE2 static void convertWordsSSE2(__m128i y, __m128i cb,
+                                                __m128i cr, __m128i &r,
+                                                __m128i &g, __m128i &b) {
+    const auto round = _mm_set1_epi32(kRound);
+    auto lo = _mm_unpacklo_epi16(cb, cr);
+    auto hi = _mm_unpackhi_epi16(cb, cr);
+    r = channelSSE2(lo, hi, _mm_set1_epi32(pair(0, kCrToR)), round, y);
+    g = channelSSE2(lo, hi, _mm_set1_epi32(pair(kCbToG, kCrToG)), round, y);
+    b = channelSSE2(lo, hi, _mm_set1_epi32(pair(kCbToB, 0)), round, y);
+  }
+
+  SJPG_TARGET_SSE2 static __m128i channelSSE2(__m128i lo, __m128i hi,
+                                              __m128i factors, __m128i round,
+                                              __m128i y) {
+    auto l = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lo, factors), round),
+                            kFixBits);
+    auto h = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hi, factors), round),
+                            kFixBits);
+    return _mm_adds_epi16(_mm_packs_epi32(l, h), y);
+  }
+
+  SJPG_TARGET_AVX2 static __m128i channelAVX2(__m256i lo, __m256i hi,
+                                              __m256i factors, __m256i round,
+                                              __m256i y) {
+    auto l = _mm256_srai_epi32(
+        _mm256_add_epi32(_mm256_madd_epi16(lo, factors), round), kFixBits);
+    auto h = _mm256_srai_epi32(
+        _mm256_add_epi32(_mm256_madd_epi16(hi, factors), round), kFixBits);
+    auto words = _mm256_adds_epi16(_mm256_packs_epi32(l, h), y);
+    auto bytes =
+        _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+    return _mm256_castsi256_si128(bytes);
+  }
+
+  // 16 pixels, `r` and `b` are already swapped for BGR(A)
+  SJPG_TARGET_SSE2 static void storePixelsSSE2(__m128i r, __m128i g, __m128i b,
+                                               uint8_t *dst, int bpp) {
+    if (bpp == 4) {
+      const auto alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+      auto rg_lo = _mm_unpacklo_epi8(r, g);
+      auto rg_hi = _mm_unpackhi_epi8(r, g);
+      auto ba_lo = _mm_unpacklo_epi8(b, alpha);
+      auto ba_hi = _mm_unpackhi_epi8(b, alpha);
+      auto *p = reinterpret_cast<__m128i *>(dst);
+      _mm_storeu_si128(p + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+      _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+      return;
+    }
+    // SSE2 has no byte shuffle, interleave through a small buffer
+    alignas(16) uint8_t planes[3][16];
+    _mm_store_si128(reinterpret_cast<__m128i *>(planes[0]), r);
+    _mm_store_si128(reinterpret_cast<__m128i *>(planes[1]), g);
+    _mm_store_si128(reinterpret_cast<__m128i *>(planes[2]), b);
+    for (int k = 0; k < 16; ++k) {
+      dst[k * 3] = planes[0][k];
+      dst[k * 3 + 1] = planes[1][k];
+      dst[k * 3 + 2] = planes[2][k];
+    }
+  }
+#endif
+};
+
+// RGB -> YCbCr(JFIF, full range) for encoding, libjpeg jccolor.c in 16-bit
+// fixed point:
+//   Y  =  0.29900 * R + 0.58700 * G + 0.11400 * B
+//   Cb = -0.16874 * R - 0.33126 * G + 0.50000 * B + 128
+//   Cr =  0.50000 * R - 0.41869 * G - 0.08131 * B + 128
+// Y is rounded, Cb and Cr are rounded down on a tie like libjpeg's. All
+// kernels produce identical samples, alpha is ignored.
+class YCbCrConverter {
+public:
+  using RowKernel = void (*)(const uint8_t *in, uint8_t *y, uint8_t *cb,
+                             uint8_t *cr, size_t width, PixelFormat format);
+
+  constexpr static int kFixBits = 16;
+  constexpr static int32_t kRToY = 19595;   // 0.29900 * 2^16
+  constexpr static int32_t kGToY = 38470;   // 0.58700 * 2^16
+  constexpr static int32_t kBToY = 7471;    // 0.11400 * 2^16
+  constexpr static int32_t kRToCb = -11059; // -0.16874 * 2^16
+  constexpr static int32_t kGToCb = -21709; // -0.33126 * 2^16
+  constexpr static int32_t kGToCr = -27439; // -0.41869 * 2^16
+  constexpr static int32_t kBToCr = -5329;  // -0.08131 * 2^16
+  // 0.5 * B for Cb and 0.5 * R for Cr are shifts
+  constexpr static int kHalfShift = kFixBits - 1;
+  constexpr static int32_t kYRound = 1 << (kFixBits - 1);
+  constexpr static int32_t kCbCrOffset = (128 << kFixBits) + kYRound - 1;
+
+  static RowKernel select(SIMDLevel level) {
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::AVX2) {
+      return &convertRowAVX2;
+    }
+#endif
+    (void)level;
+    return &convertRowScalar;
+  }
+
+  static void convertRowScalar(const uint8_t *in, uint8_t *y, uint8_t *cb,
+                               uint8_t *cr, size_t width, PixelFormat format) {
+    const auto bpp = ColorConverter::getBytesPerPixel(format);
+    const bool bgr = format == PixelFormat::BGR || format == PixelFormat::BGRA;
+    const auto r_offset = bgr ? 2 : 0;
+    const auto b_offset = bgr ? 0 : 2;
+    for (size_t i = 0; i < width; ++i) {
+      const uint8_t *pixel = in + i * bpp;
+      int32_t r = pixel[r_offset];
+      int32_t g = pixel[1];
+      int32_t b = pixel[b_offset];
+      y[i] = static_cast<uint8_t>(
+          (kRToY * r + kGToY * g + kBToY * b + kYRound) >> kFixBits);
+      cb[i] = static_cast<uint8_t>(
+          (kRToCb * r + kGToCb * g + (b << kHalfShift) + kCbCrOffset) >>
+          kFixBits);
+      cr[i] = static_cast<uint8_t>(
+          ((r << kHalfShift) + kGToCr * g + kBToCr * b + kCbCrOffset) >>
+          kFixBits);
+    }
+  }
+
+#if defined(SJPG_ARCH_X86)
+  // 16 pixels at a time, the channels are split with byte shuffles and
+  // computed in 32-bit lanes
+  SJPG_TARGET_AVX2 static void convertRowAVX2(const uint8_t *in, uint8_t *y,
+                                              uint8_t *cb, uint8_t *cr,
+                                              size_t width,
+                                              PixelFormat format) {
+    constexpr size_t kStep = 16;
+    const auto bpp = ColorConverter::getBytesPerPixel(format);
+    const bool bgr = format == PixelFormat::BGR || format == PixelFormat::BGRA;
+
+    size_t i = 0;
+    for (; i + kStep <= width; i += kStep) {
+      __m128i r, g, b;
+      if (bpp == 3) {
+        splitRGBAVX2(in + i * 3, r, g, b);
+      } else {
+        splitRGBAAVX2(in + i * 4, r, g, b);
+      }
+      if (bgr) {
+        std::swap(r, b);
+      }
+      __m256i y_half[2], cb_half[2], cr_half[2];
+      for (int half = 0; half < 2; ++half) {
+        auto r32 = _mm256_cvtepu8_epi32(half == 0 ? r : _mm_srli_si128(r, 8));
+        auto g32 = _mm256_cvtepu8_epi32(half == 0 ? g : _mm_srli_si128(g, 8));
+        auto b32 = _mm256_cvtepu8_epi32(half == 0 ? b : _mm_srli_si128(b, 8));
+        y_half[half] = _mm256_srai_epi32(
+            _mm256_add_epi32(
+                _mm256_add_epi32(mul(r32, kRToY), mul(g32, kGToY)),
+                _mm256_add_epi32(mul(b32, kBToY), _mm256_set1_epi32(kYRound))),
+            kFixBits);
+        cb_half[half] = _mm256_srai_epi32(
+            _mm256_add_epi32(
+                _mm256_add_epi32(mul(r32, kRToCb), mul(g32, kGToCb)),
+                _mm256_add_epi32(_mm256_slli_epi32(b32, kHalfShift),
+                                 _mm256_set1_epi32(kCbCrOffset))),
+            kFixBits);
+        cr_half[half] = _mm256_srai_epi32(
+            _mm256_add_epi32(
+                _mm256_add_epi32(_mm256_slli_epi32(r32, kHalfShift),
+                                 mul(g32, kGToCr)),
+                _mm256_add_epi32(mul(b32, kBToCr),
+                                 _mm256_set1_epi32(kCbCrOffset))),
+            kFixBits);
+      }
+      storeBytesAVX2(y_half, y + i);
+      storeBytesAVX2(cb_half, cb + i);
+      storeBytesAVX2(cr_half, cr + i);
+    }
+    convertRowScalar(in + i * bpp, y + i, cb + i, cr + i, width - i, format);
+  }
+#endif
+
+private:
+#if defined(SJPG_ARCH_X86)
+  SJPG_TARGET_AVX2 static __m256i mul(__m256i v, int32_t c) {
+    return _mm256_mullo_epi32(v, _mm256_set1_epi32(c));
+  }
+
+  // 16 pixels of 3 bytes, the 48 bytes are read exactly
+  SJPG_TARGET_AVX2 static void splitRGBAVX2(const uint8_t *in, __m128i &r,
+                                            __m128i &g, __m128i &b) {
+    auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    auto m = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16));
+    auto z = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 32));
+    // channel c of pixel k is byte 3k + c of the 48
+    r = _mm_or_si128(
+        _mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1,
+                                                       -1, -1, -1, -1, -1, -1,
+                                                       -1, -1, -1)),
+                     _mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, -1,
+                                                       2, 5, 8, 11, 14, -1, -1,
+                                                       -1, -1, -1))),
+        _mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(
+        _mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1,
+                                                       -1, -1, -1, -1, -1, -1,
+                                                       -1, -1, -1)),
+                     _mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, 0,
+                                                       3, 6, 9, 12, 15, -1, -1,
+                                                       -1, -1, -1))),
+        _mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1, 2, 5, 8, 11, 14)));
+    b = _mm_or_si128(
+        _mm_or_si128(_mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1,
+                                                       -1, -1, -1, -1, -1, -1,
+                                                       -1, -1, -1)),
+                     _mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, 1,
+                                                       4, 7, 10, 13, -1, -1,
+                                                       -1, -1, -1, -1))),
+        _mm_shuffle_epi8(z, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, 0, 3, 6, 9, 12, 15)));
+  }
+
+  // 16 pixels of 4 bytes: each group of 4 pixels is shuffled to RRRR GGGG
+  // BBBB AAAA, then the groups are transposed
+  SJPG_TARGET_AVX2 static void splitRGBAAVX2(const uint8_t *in, __m128i &r,
+                                             __m128i &g, __m128i &b) {
+    const auto planar = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14,
+                                      3, 7, 11, 15);
+    __m128i s[4];
+    for (int k = 0; k < 4; ++k) {
+      s[k] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + k * 16)),
+          planar);
+    }
+    auto rg01 = _mm_unpacklo_epi32(s[0], s[1]);
+    auto ba01 = _mm_unpackhi_epi32(s[0], s[1]);
+    auto rg23 = _mm_unpacklo_epi32(s[2], s[3]);
+    auto ba23 = _mm_unpackhi_epi32(s[2], s[3]);
+    r = _mm_unpacklo_epi64(rg01, rg23);
+    g = _mm_unpackhi_epi64(rg01, rg23);
+    b = _mm_unpacklo_epi64(ba01, ba23);
+  }
+
+  // 16 values 0 ~ 255 in 32-bit lanes
+  SJPG_TARGET_AVX2 static void storeBytesAVX2(const __m256i halves[2],
+                                              uint8_t *out) {
+    auto words =
+        _mm256_permute4x64_epi64(_mm256_packs_epi32(halves[0], halves[1]), 0xD8);
+    auto bytes =
+        _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm256_castsi256_si128(bytes));
+  }
+#endif
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_COLOR_CONVERT_H
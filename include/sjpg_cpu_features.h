@@ -0,0 +1,149 @@
+//
+// Created by user on 7/21/25.
+//
+
+#ifndef SJPG_CPU_FEATURES_H
+#define SJPG_CPU_FEATURES_H
+#include "sjpg_log.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#if !defined(SJPG_NO_SIMD) &&                                                 \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||           \
+     defined(_M_IX86))
+#define SJPG_ARCH_X86 1
+#if defined(__GNUC__) || defined(__clang__)
+// kernels are compiled for their ISA regardless of the global -m flags and
+// are only called after the CPU has been checked
+#define SJPG_TARGET_SSE2 __attribute__((target("sse2")))
+#define SJPG_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#include <intrin.h>
+#define SJPG_TARGET_SSE2
+#define SJPG_TARGET_AVX2
+#endif
+#endif
+
+namespace sjpg_codec {
+enum class SIMDLevel {
+  Scalar = 0,
+  SSE2 = 1,
+  AVX2 = 2,
+};
+
+// Picks the SIMD kernels once at startup. The level can be lowered for
+// benchmarks and A/B tests with the SJPG_FORCE_ISA environment
+// variable(scalar, sse2 or avx2) or with setSIMDLevel().
+class CPUFeatures {
+public:
+  // the best level this CPU and OS support
+  static SIMDLevel getSupportedSIMDLevel() {
+    static const SIMDLevel supported = detect();
+    return supported;
+  }
+
+  // the level kernels are selected with
+  static SIMDLevel getSIMDLevel() {
+    auto level = activeLevel().load(std::memory_order_relaxed);
+    if (level < 0) {
+      level = static_cast<int>(levelFromEnvironment());
+      activeLevel().store(level, std::memory_order_relaxed);
+    }
+    return static_cast<SIMDLevel>(level);
+  }
+
+  // levels above the supported one are lowered to it, returns the level
+  // actually in use. Decoders pick their kernels in prepare(), so this
+  // applies to the images decoded afterwards.
+  static SIMDLevel setSIMDLevel(SIMDLevel level) {
+    if (level > getSupportedSIMDLevel()) {
+      LOG_WARN("%s is not supported, using %s\n", toString(level),
+               toString(getSupportedSIMDLevel()));
+      level = getSupportedSIMDLevel();
+    }
+    activeLevel().store(static_cast<int>(level), std::memory_order_relaxed);
+    return level;
+  }
+
+  static const char *toString(SIMDLevel level) {
+    switch (level) {
+    case SIMDLevel::SSE2:
+      return "sse2";
+    case SIMDLevel::AVX2:
+      return "avx2";
+    case SIMDLevel::Scalar:
+    default:
+      return "scalar";
+    }
+  }
+
+  static bool fromString(const char *name, SIMDLevel &level) {
+    for (auto candidate : {SIMDLevel::Scalar, SIMDLevel::SSE2, SIMDLevel::AVX2}) {
+      if (std::strcmp(name, toString(candidate)) == 0) {
+        level = candidate;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  constexpr static const char *kForceISAEnv = "SJPG_FORCE_ISA";
+
+private:
+  static std::atomic<int> &activeLevel() {
+    static std::atomic<int> level{-1};
+    return level;
+  }
+
+  static SIMDLevel levelFromEnvironment() {
+    auto level = getSupportedSIMDLevel();
+    const char *forced = std::getenv(kForceISAEnv);
+    if (forced == nullptr || forced[0] == '\0') {
+      return level;
+    }
+    SIMDLevel forced_level;
+    if (!fromString(forced, forced_level)) {
+      LOG_WARN("Unknown %s value: %s\n", kForceISAEnv, forced);
+      return level;
+    }
+    return forced_level < level ? forced_level : level;
+  }
+
+  static SIMDLevel detect() {
+#if defined(SJPG_ARCH_X86)
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    // also checks that the OS saves the AVX registers
+    if (__builtin_cpu_supports("avx2")) {
+      return SIMDLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return SIMDLevel::SSE2;
+    }
+#else
+    int info[4];
+    __cpuid(info, 0);
+    auto max_leaf = info[0];
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool os_avx = (info[2] & (1 << 27)) != 0 && // OSXSAVE
+                  (_xgetbv(0) & 0x6) == 0x6;    // XMM and YMM state
+    if (os_avx && max_leaf >= 7) {
+      __cpuidex(info, 7, 0);
+      if ((info[1] & (1 << 5)) != 0) {
+        return SIMDLevel::AVX2;
+      }
+    }
+    if (sse2) {
+      return SIMDLevel::SSE2;
+    }
+#endif
+#endif
+    return SIMDLevel::Scalar;
+  }
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_CPU_FEATURES_H
@@ -0,0 +1,470 @@
+//
+// Created by user on 8/1/25.
+//
+
+#ifndef SJPG_FDCT_H
+#define SJPG_FDCT_H
+#include "sjpg_cpu_features.h"
+#include "sjpg_idct.h"
+#include "sjpg_idct_simd.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(SJPG_ARCH_X86)
+#include <immintrin.h>
+#endif
+
+namespace sjpg_codec {
+// Divisors of one quantization table in natural order. The FDCT output is
+// scaled up by 8, so a coefficient is quantized by (|x| + d / 2) / d with
+// d = 8 * q, rounded half away from zero like libjpeg's.
+struct QuantDivisors {
+  alignas(32) std::array<int16_t, 64> divisor{};
+  alignas(32) std::array<int16_t, 64> half{};
+  // 1 / divisor. The quotient of an input below 2^15 is off by at most one
+  // below the exact one, which a multiply and compare corrects, so every
+  // kernel divides exactly.
+  alignas(32) std::array<float, 64> reciprocal{};
+
+  static QuantDivisors build(const uint8_t *natural) {
+    QuantDivisors divisors;
+    for (int i = 0; i < 64; ++i) {
+      int32_t d = natural[i] * 8;
+      divisors.divisor[i] = static_cast<int16_t>(d);
+      divisors.half[i] = static_cast<int16_t>(d >> 1);
+      divisors.reciprocal[i] = 1.0f / static_cast<float>(d);
+    }
+    return divisors;
+  }
+
+  int16_t quantize(int32_t value, int i) const {
+    int32_t n = std::abs(value) + half[i];
+    auto q = static_cast<int32_t>(static_cast<float>(n) * reciprocal[i]);
+    if (n - q * divisor[i] >= divisor[i]) {
+      ++q;
+    }
+    return static_cast<int16_t>(value < 0 ? -q : q);
+  }
+};
+
+// 8x8 forward DCT of samples, libjpeg jfdctint.c. The output is in natural
+// order and scaled up by 8.
+class FDCT {
+public:
+  static void computeIslow(const uint8_t *in, size_t stride, int32_t *out) {
+    constexpr int kConstBits = IDCT::kIslowConstBits;
+    constexpr int kPass1Bits = IDCT::kIslowPass1Bits;
+    int32_t workspace[64];
+
+    // pass 1: rows, results scaled up by 2^kPass1Bits
+    for (int row = 0; row < 8; ++row) {
+      const uint8_t *p = in + row * stride;
+      int32_t d[8];
+      for (int i = 0; i < 8; ++i) {
+        d[i] = p[i] - 128;
+      }
+      transform(d, 1, workspace + row * 8, 1, kPass1Bits, 0,
+                kConstBits - kPass1Bits);
+    }
+
+    // pass 2: columns, the kPass1Bits scaling is removed
+    for (int col = 0; col < 8; ++col) {
+      transform(workspace + col, 8, out + col, 8, 0, kPass1Bits,
+                kConstBits + kPass1Bits);
+    }
+  }
+
+private:
+  static int32_t descale(int32_t x, int n) {
+    return (x + (1 << (n - 1))) >> n;
+  }
+
+  // one 1-D pass, outputs 0 and 4 are shifted left by `dc_left` then right
+  // by `dc_right`, the others right by `shift`
+  static void transform(const int32_t *d, int step, int32_t *out,
+                        int out_step, int dc_left, int dc_right, int shift) {
+    int32_t tmp0 = d[0] + d[7 * step];
+    int32_t tmp7 = d[0] - d[7 * step];
+    int32_t tmp1 = d[step] + d[6 * step];
+    int32_t tmp6 = d[step] - d[6 * step];
+    int32_t tmp2 = d[2 * step] + d[5 * step];
+    int32_t tmp5 = d[2 * step] - d[5 * step];
+    int32_t tmp3 = d[3 * step] + d[4 * step];
+    int32_t tmp4 = d[3 * step] - d[4 * step];
+
+    // even part
+    int32_t tmp10 = tmp0 + tmp3;
+    int32_t tmp13 = tmp0 - tmp3;
+    int32_t tmp11 = tmp1 + tmp2;
+    int32_t tmp12 = tmp1 - tmp2;
+
+    if (dc_right > 0) {
+      out[0] = descale(tmp10 + tmp11, dc_right);
+      out[4 * out_step] = descale(tmp10 - tmp11, dc_right);
+    } else {
+      out[0] = (tmp10 + tmp11) * (1 << dc_left);
+      out[4 * out_step] = (tmp10 - tmp11) * (1 << dc_left);
+    }
+
+    int32_t z1 = (tmp12 + tmp13) * IDCT::kFix_0_541196100;
+    out[2 * out_step] =
+        descale(z1 + tmp13 * IDCT::kFix_0_765366865, shift);
+    out[6 * out_step] =
+        descale(z1 + tmp12 * (-IDCT::kFix_1_847759065), shift);
+
+    // odd part
+    z1 = tmp4 + tmp7;
+    int32_t z2 = tmp5 + tmp6;
+    int32_t z3 = tmp4 + tmp6;
+    int32_t z4 = tmp5 + tmp7;
+    int32_t z5 = (z3 + z4) * IDCT::kFix_1_175875602;
+
+    tmp4 *= IDCT::kFix_0_298631336;
+    tmp5 *= IDCT::kFix_2_053119869;
+    tmp6 *= IDCT::kFix_3_072711026;
+    tmp7 *= IDCT::kFix_1_501321110;
+    z1 *= -IDCT::kFix_0_899976223;
+    z2 *= -IDCT::kFix_2_562915447;
+    z3 = z3 * (-IDCT::kFix_1_961570560) + z5;
+    z4 = z4 * (-IDCT::kFix_0_390180644) + z5;
+
+    out[7 * out_step] = descale(tmp4 + z1 + z3, shift);
+    out[5 * out_step] = descale(tmp5 + z2 + z4, shift);
+    out[3 * out_step] = descale(tmp6 + z2 + z3, shift);
+    out[out_step] = descale(tmp7 + z1 + z4, shift);
+  }
+};
+
+// FDCT and quantization of a block of 8 rows `stride` bytes apart, the
+// quantized coefficients are written to `out` in natural order. Returns the
+// mask of the nonzero ones, bit i for natural index i.
+using FDCTKernel = uint64_t (*)(const uint8_t *in, size_t stride,
+                                const QuantDivisors &divisors, int16_t *out);
+
+// Block FDCT kernels per SIMD level. The SIMD kernels implement
+// FDCT::computeIslow with the same integer arithmetic, every level produces
+// identical coefficients.
+class FDCTKernels {
+public:
+  static FDCTKernel select(SIMDLevel level) {
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::AVX2) {
+      return &islowAVX2;
+    }
+    if (level >= SIMDLevel::SSE2) {
+      return &islowSSE2;
+    }
+#endif
+    (void)level;
+    return &islowScalar;
+  }
+
+  static uint64_t islowScalar(const uint8_t *in, size_t stride,
+                              const QuantDivisors &divisors, int16_t *out) {
+    int32_t coef[64];
+    FDCT::computeIslow(in, stride, coef);
+    uint64_t nonzero = 0;
+    for (int i = 0; i < 64; ++i) {
+      out[i] = divisors.quantize(coef[i], i);
+      nonzero |= static_cast<uint64_t>(out[i] != 0) << i;
+    }
+    return nonzero;
+  }
+
+#if defined(SJPG_ARCH_X86)
+  // 16-bit lanes like libjpeg-turbo's, every rotation is a pair of
+  // _mm_madd_epi16 whose constants are the sums of the scalar multipliers
+  // each input is scaled by
+  SJPG_TARGET_SSE2 static uint64_t islowSSE2(const uint8_t *in,
+                                             size_t stride,
+                                             const QuantDivisors &divisors,
+                                             int16_t *out) {
+    const auto zero = _mm_setzero_si128();
+    const auto center = _mm_set1_epi16(128);
+    __m128i r[8];
+    for (int i = 0; i < 8; ++i) {
+      auto samples =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i * stride));
+      r[i] = _mm_sub_epi16(_mm_unpacklo_epi8(samples, zero), center);
+    }
+
+    // pass 1: rows, each register is a column of 8 rows
+    IDCTKernels::transpose8x16SSE2(r);
+    islowPassSSE2<false>(r);
+    // pass 2: columns
+    IDCTKernels::transpose8x16SSE2(r);
+    islowPassSSE2<true>(r);
+
+    uint64_t zero_mask = 0;
+    for (int i = 0; i < 8; i += 2) {
+      auto q0 = quantizeSSE2(r[i], divisors, i * 8);
+      auto q1 = quantizeSSE2(r[i + 1], divisors, i * 8 + 8);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 8), q0);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i * 8 + 8), q1);
+      auto zeros = _mm_packs_epi16(_mm_cmpeq_epi16(q0, zero),
+                                   _mm_cmpeq_epi16(q1, zero));
+      zero_mask |= static_cast<uint64_t>(static_cast<uint16_t>(
+                       _mm_movemask_epi8(zeros)))
+                   << (i * 8);
+    }
+    return ~zero_mask;
+  }
+
+  // 32-bit lanes, the scalar algorithm on 8 rows or columns at a time
+  SJPG_TARGET_AVX2 static uint64_t islowAVX2(const uint8_t *in,
+                                             size_t stride,
+                                             const QuantDivisors &divisors,
+                                             int16_t *out) {
+    const auto center = _mm256_set1_epi32(128);
+    __m256i r[8];
+    for (int i = 0; i < 8; ++i) {
+      auto samples =
+          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i * stride));
+      r[i] = _mm256_sub_epi32(_mm256_cvtepu8_epi32(samples), center);
+    }
+
+    IDCTKernels::transpose8x32AVX2(r);
+    islowPassAVX2<false>(r);
+    IDCTKernels::transpose8x32AVX2(r);
+    islowPassAVX2<true>(r);
+
+    const auto zero = _mm256_setzero_si256();
+    __m256i words[4];
+    for (int i = 0; i < 8; i += 2) {
+      auto q0 = quantizeAVX2(r[i], divisors, i * 8);
+      auto q1 = quantizeAVX2(r[i + 1], divisors, i * 8 + 8);
+      words[i / 2] =
+          _mm256_permute4x64_epi64(_mm256_packs_epi32(q0, q1), 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i * 8),
+                          words[i / 2]);
+    }
+    uint64_t zero_mask = 0;
+    for (int i = 0; i < 4; i += 2) {
+      auto zeros = _mm256_permute4x64_epi64(
+          _mm256_packs_epi16(_mm256_cmpeq_epi16(words[i], zero),
+                             _mm256_cmpeq_epi16(words[i + 1], zero)),
+          0xD8);
+      zero_mask |= static_cast<uint64_t>(static_cast<uint32_t>(
+                       _mm256_movemask_epi8(zeros)))
+                   << (i * 16);
+    }
+    return ~zero_mask;
+  }
+
+private:
+  constexpr static int kConstBits = IDCT::kIslowConstBits;
+  constexpr static int kPass1Bits = IDCT::kIslowPass1Bits;
+
+  // one 1-D pass over r[0..7] (input k of every lane is r[k]). The first
+  // pass keeps kPass1Bits of extra precision, the second removes them.
+  template <bool kSecond>
+  SJPG_TARGET_SSE2 static void islowPassSSE2(__m128i r[8]) {
+    constexpr int kShift =
+        kSecond ? kConstBits + kPass1Bits : kConstBits - kPass1Bits;
+
+    auto tmp0 = _mm_add_epi16(r[0], r[7]);
+    auto tmp7 = _mm_sub_epi16(r[0], r[7]);
+    auto tmp1 = _mm_add_epi16(r[1], r[6]);
+    auto tmp6 = _mm_sub_epi16(r[1], r[6]);
+    auto tmp2 = _mm_add_epi16(r[2], r[5]);
+    auto tmp5 = _mm_sub_epi16(r[2], r[5]);
+    auto tmp3 = _mm_add_epi16(r[3], r[4]);
+    auto tmp4 = _mm_sub_epi16(r[3], r[4]);
+
+    // even part
+    auto tmp10 = _mm_add_epi16(tmp0, tmp3);
+    auto tmp13 = _mm_sub_epi16(tmp0, tmp3);
+    auto tmp11 = _mm_add_epi16(tmp1, tmp2);
+    auto tmp12 = _mm_sub_epi16(tmp1, tmp2);
+
+    constexpr int32_t kFix_0_541 = IDCT::kFix_0_541196100;
+    constexpr int32_t kFix_0_765 = IDCT::kFix_0_765366865;
+    constexpr int32_t kFix_1_847 = IDCT::kFix_1_847759065;
+    // the DC sum of the second pass is 32-bit, it reaches -32768 + 2
+    const auto k01_sum = IDCTKernels::pair(1, 1);
+    const auto k01_diff = IDCTKernels::pair(1, -1);
+    const auto k1213_out2 = IDCTKernels::pair(kFix_0_541, kFix_0_541 + kFix_0_765);
+    const auto k1213_out6 = IDCTKernels::pair(kFix_0_541 - kFix_1_847, kFix_0_541);
+
+    // odd part, inputs paired as (tmp4, tmp5) and (tmp6, tmp7)
+    constexpr int32_t kFix_0_298 = IDCT::kFix_0_298631336;
+    constexpr int32_t kFix_0_390 = IDCT::kFix_0_390180644;
+    constexpr int32_t kFix_0_899 = IDCT::kFix_0_899976223;
+    constexpr int32_t kFix_1_175 = IDCT::kFix_1_175875602;
+    constexpr int32_t kFix_1_501 = IDCT::kFix_1_501321110;
+    constexpr int32_t kFix_1_961 = IDCT::kFix_1_961570560;
+    constexpr int32_t kFix_2_053 = IDCT::kFix_2_053119869;
+    constexpr int32_t kFix_2_562 = IDCT::kFix_2_562915447;
+    constexpr int32_t kFix_3_072 = IDCT::kFix_3_072711026;
+    const auto k45_out7 = IDCTKernels::pair(
+        kFix_0_298 - kFix_0_899 - kFix_1_961 + kFix_1_175, kFix_1_175);
+    const auto k67_out7 =
+        IDCTKernels::pair(kFix_1_175 - kFix_1_961, kFix_1_175 - kFix_0_899);
+    const auto k45_out5 = IDCTKernels::pair(
+        kFix_1_175, kFix_2_053 - kFix_2_562 - kFix_0_390 + kFix_1_175);
+    const auto k67_out5 =
+        IDCTKernels::pair(kFix_1_175 - kFix_2_562, kFix_1_175 - kFix_0_390);
+    const auto k45_out3 =
+        IDCTKernels::pair(kFix_1_175 - kFix_1_961, kFix_1_175 - kFix_2_562);
+    const auto k67_out3 = IDCTKernels::pair(
+        kFix_3_072 - kFix_2_562 - kFix_1_961 + kFix_1_175, kFix_1_175);
+    const auto k45_out1 =
+        IDCTKernels::pair(kFix_1_175 - kFix_0_899, kFix_1_175 - kFix_0_390);
+    const auto k67_out1 = IDCTKernels::pair(
+        kFix_1_175, kFix_1_501 - kFix_0_899 - kFix_0_390 + kFix_1_175);
+
+    if (!kSecond) {
+      r[0] = _mm_slli_epi16(_mm_add_epi16(tmp10, tmp11), kPass1Bits);
+      r[4] = _mm_slli_epi16(_mm_sub_epi16(tmp10, tmp11), kPass1Bits);
+    }
+
+    __m128i results[2][8];
+    for (int half = 0; half < 2; ++half) {
+      auto &o = results[half];
+      if (kSecond) {
+        auto p1011 = IDCTKernels::unpack16SSE2(half, tmp10, tmp11);
+        o[0] = descaleSSE2<kPass1Bits>(_mm_madd_epi16(p1011, k01_sum));
+        o[4] = descaleSSE2<kPass1Bits>(_mm_madd_epi16(p1011, k01_diff));
+      }
+
+      auto p1213 = IDCTKernels::unpack16SSE2(half, tmp12, tmp13);
+      o[2] = descaleSSE2<kShift>(_mm_madd_epi16(p1213, k1213_out2));
+      o[6] = descaleSSE2<kShift>(_mm_madd_epi16(p1213, k1213_out6));
+
+      auto p45 = IDCTKernels::unpack16SSE2(half, tmp4, tmp5);
+      auto p67 = IDCTKernels::unpack16SSE2(half, tmp6, tmp7);
+      o[7] = descaleSSE2<kShift>(_mm_add_epi32(_mm_madd_epi16(p45, k45_out7),
+                                   _mm_madd_epi16(p67, k67_out7)));
+      o[5] = descaleSSE2<kShift>(_mm_add_epi32(_mm_madd_epi16(p45, k45_out5),
+                                   _mm_madd_epi16(p67, k67_out5)));
+      o[3] = descaleSSE2<kShift>(_mm_add_epi32(_mm_madd_epi16(p45, k45_out3),
+                                   _mm_madd_epi16(p67, k67_out3)));
+      o[1] = descaleSSE2<kShift>(_mm_add_epi32(_mm_madd_epi16(p45, k45_out1),
+                                   _mm_madd_epi16(p67, k67_out1)));
+    }
+    for (int i = 0; i < 8; ++i) {
+      if (!kSecond && (i == 0 || i == 4)) {
+        continue;
+      }
+      r[i] = _mm_packs_epi32(results[0][i], results[1][i]);
+    }
+  }
+
+  template <int kShift>
+  SJPG_TARGET_SSE2 static __m128i descaleSSE2(__m128i x) {
+    return _mm_srai_epi32(_mm_add_epi32(x, _mm_set1_epi32(1 << (kShift - 1))),
+                          kShift);
+  }
+
+  // 8 coefficients, |x| + d / 2 stays below 2^14 so the products fit in
+  // 16 bits
+  SJPG_TARGET_SSE2 static __m128i quantizeSSE2(__m128i x,
+                                               const QuantDivisors &divisors,
+                                               int offset) {
+    const auto zero = _mm_setzero_si128();
+    auto d = _mm_load_si128(
+        reinterpret_cast<const __m128i *>(divisors.divisor.data() + offset));
+    auto half = _mm_load_si128(
+        reinterpret_cast<const __m128i *>(divisors.half.data() + offset));
+    auto sign = _mm_srai_epi16(x, 15);
+    auto n = _mm_add_epi16(_mm_sub_epi16(_mm_xor_si128(x, sign), sign), half);
+
+    auto lo = _mm_cvttps_epi32(
+        _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(n, zero)),
+                   _mm_load_ps(divisors.reciprocal.data() + offset)));
+    auto hi = _mm_cvttps_epi32(
+        _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(n, zero)),
+                   _mm_load_ps(divisors.reciprocal.data() + offset + 4)));
+    auto q = _mm_packs_epi32(lo, hi);
+    auto rest = _mm_sub_epi16(n, _mm_mullo_epi16(q, d));
+    // +1 where the rest is still >= d
+    q = _mm_sub_epi16(q, _mm_cmpgt_epi16(rest, _mm_sub_epi16(d, _mm_set1_epi16(1))));
+    return _mm_sub_epi16(_mm_xor_si128(q, sign), sign);
+  }
+
+  template <bool kSecond>
+  SJPG_TARGET_AVX2 static void islowPassAVX2(__m256i r[8]) {
+    constexpr int kShift =
+        kSecond ? kConstBits + kPass1Bits : kConstBits - kPass1Bits;
+    auto tmp0 = _mm256_add_epi32(r[0], r[7]);
+    auto tmp7 = _mm256_sub_epi32(r[0], r[7]);
+    auto tmp1 = _mm256_add_epi32(r[1], r[6]);
+    auto tmp6 = _mm256_sub_epi32(r[1], r[6]);
+    auto tmp2 = _mm256_add_epi32(r[2], r[5]);
+    auto tmp5 = _mm256_sub_epi32(r[2], r[5]);
+    auto tmp3 = _mm256_add_epi32(r[3], r[4]);
+    auto tmp4 = _mm256_sub_epi32(r[3], r[4]);
+
+    // even part
+    auto tmp10 = _mm256_add_epi32(tmp0, tmp3);
+    auto tmp13 = _mm256_sub_epi32(tmp0, tmp3);
+    auto tmp11 = _mm256_add_epi32(tmp1, tmp2);
+    auto tmp12 = _mm256_sub_epi32(tmp1, tmp2);
+
+    if (kSecond) {
+      r[0] = descaleAVX2<kPass1Bits>(_mm256_add_epi32(tmp10, tmp11));
+      r[4] = descaleAVX2<kPass1Bits>(_mm256_sub_epi32(tmp10, tmp11));
+    } else {
+      r[0] = _mm256_slli_epi32(_mm256_add_epi32(tmp10, tmp11), kPass1Bits);
+      r[4] = _mm256_slli_epi32(_mm256_sub_epi32(tmp10, tmp11), kPass1Bits);
+    }
+
+    auto z1 = mul(_mm256_add_epi32(tmp12, tmp13), IDCT::kFix_0_541196100);
+    r[2] = descaleAVX2<kShift>(_mm256_add_epi32(z1, mul(tmp13, IDCT::kFix_0_765366865)));
+    r[6] = descaleAVX2<kShift>(_mm256_add_epi32(z1, mul(tmp12, -IDCT::kFix_1_847759065)));
+
+    // odd part
+    z1 = _mm256_add_epi32(tmp4, tmp7);
+    auto z2 = _mm256_add_epi32(tmp5, tmp6);
+    auto z3 = _mm256_add_epi32(tmp4, tmp6);
+    auto z4 = _mm256_add_epi32(tmp5, tmp7);
+    auto z5 = mul(_mm256_add_epi32(z3, z4), IDCT::kFix_1_175875602);
+
+    tmp4 = mul(tmp4, IDCT::kFix_0_298631336);
+    tmp5 = mul(tmp5, IDCT::kFix_2_053119869);
+    tmp6 = mul(tmp6, IDCT::kFix_3_072711026);
+    tmp7 = mul(tmp7, IDCT::kFix_1_501321110);
+    z1 = mul(z1, -IDCT::kFix_0_899976223);
+    z2 = mul(z2, -IDCT::kFix_2_562915447);
+    z3 = _mm256_add_epi32(mul(z3, -IDCT::kFix_1_961570560), z5);
+    z4 = _mm256_add_epi32(mul(z4, -IDCT::kFix_0_390180644), z5);
+
+    r[7] = descaleAVX2<kShift>(_mm256_add_epi32(tmp4, _mm256_add_epi32(z1, z3)));
+    r[5] = descaleAVX2<kShift>(_mm256_add_epi32(tmp5, _mm256_add_epi32(z2, z4)));
+    r[3] = descaleAVX2<kShift>(_mm256_add_epi32(tmp6, _mm256_add_epi32(z2, z3)));
+    r[1] = descaleAVX2<kShift>(_mm256_add_epi32(tmp7, _mm256_add_epi32(z1, z4)));
+  }
+
+  SJPG_TARGET_AVX2 static __m256i mul(__m256i v, int32_t c) {
+    return IDCTKernels::mul(v, c);
+  }
+
+  template <int kShift>
+  SJPG_TARGET_AVX2 static __m256i descaleAVX2(__m256i x) {
+    return _mm256_srai_epi32(
+        _mm256_add_epi32(x, _mm256_set1_epi32(1 << (kShift - 1))), kShift);
+  }
+
+  SJPG_TARGET_AVX2 static __m256i quantizeAVX2(__m256i x,
+                                               const QuantDivisors &divisors,
+                                               int offset) {
+    auto d = _mm256_cvtepi16_epi32(_mm_load_si128(
+        reinterpret_cast<const __m128i *>(divisors.divisor.data() + offset)));
+    auto half = _mm256_cvtepi16_epi32(_mm_load_si128(
+        reinterpret_cast<const __m128i *>(divisors.half.data() + offset)));
+    auto n = _mm256_add_epi32(_mm256_abs_epi32(x), half);
+    auto q = _mm256_cvttps_epi32(
+        _mm256_mul_ps(_mm256_cvtepi32_ps(n),
+                      _mm256_loadu_ps(divisors.reciprocal.data() + offset)));
+    auto rest = _mm256_sub_epi32(n, _mm256_mullo_epi32(q, d));
+    q = _mm256_sub_epi32(
+        q, _mm256_cmpgt_epi32(rest, _mm256_sub_epi32(d, _mm256_set1_epi32(1))));
+    return _mm256_sign_epi32(q, x);
+  }
+#endif
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_FDCT_H
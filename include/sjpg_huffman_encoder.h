@@ -0,0 +1,345 @@
+//
+// Created by user on 8/3/25.
+//
+
+#ifndef SJPG_HUFFMAN_ENCODER_H
+#define SJPG_HUFFMAN_ENCODER_H
+#include "sjpg_bit_writer.h"
+#include "sjpg_cpu_features.h"
+#include "sjpg_markers.h"
+#include "sjpg_segment_writer.h"
+#include "sjpg_segments.h"
+#include "sjpg_standard_tables.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(SJPG_ARCH_X86)
+#include <emmintrin.h>
+#endif
+
+namespace sjpg_codec {
+// code and length of every symbol of a DHT table, ITU-T.81 C.2
+struct HuffmanCodes {
+  std::array<uint16_t, 256> code{};
+  std::array<uint8_t, 256> length{};
+
+  void build(const std::vector<uint8_t> &symbol_counts,
+             const std::vector<uint8_t> &symbols) {
+    code.fill(0);
+    length.fill(0);
+    uint16_t next = 0;
+    size_t k = 0;
+    for (int i = 0; i < 16; ++i) {
+      for (int n = 0; n < symbol_counts[i]; ++n) {
+        code[symbols[k]] = next++;
+        length[symbols[k]] = static_cast<uint8_t>(i + 1);
+        ++k;
+      }
+      next <<= 1;
+    }
+  }
+
+  // a table for symbols seen `frequencies` times, ITU-T.81 K.2 and libjpeg's
+  // jpeg_gen_optimal_table: codes are at most 16 bits long and none is all
+  // 1-bits
+  static void buildOptimal(const std::array<uint32_t, 256> &frequencies,
+                           segments::DHTSegment &dht) {
+    constexpr int kMaxLength = 32;
+    constexpr int kReserved = 256;
+    std::array<int64_t, 257> freq{};
+    std::copy(frequencies.begin(), frequencies.end(), freq.begin());
+    freq[kReserved] = 1;
+    std::array<int, 257> code_size{};
+    std::array<int, 257> others;
+    others.fill(-1);
+
+    for (;;) {
+      // the two least frequent, the larger symbol on ties
+      int c1 = -1;
+      int c2 = -1;
+      auto v1 = std::numeric_limits<int64_t>::max();
+      auto v2 = v1;
+      for (int i = 0; i <= kReserved; ++i) {
+        if (freq[i] != 0 && freq[i] <= v1) {
+          v1 = freq[i];
+          c1 = i;
+        }
+      }
+      for (int i = 0; i <= kReserved; ++i) {
+        if (freq[i] != 0 && freq[i] <= v2 && i != c1) {
+          v2 = freq[i];
+          c2 = i;
+        }
+      }
+      if (c2 < 0) {
+        break;
+      }
+
+      freq[c1] += freq[c2];
+      freq[c2] = 0;
+      ++code_size[c1];
+      while (others[c1] >= 0) {
+        c1 = others[c1];
+        ++code_size[c1];
+      }
+      others[c1] = c2;
+      ++code_size[c2];
+      while (others[c2] >= 0) {
+        c2 = others[c2];
+        ++code_size[c2];
+      }
+    }
+
+    std::array<int, kMaxLength + 1> bits{};
+    for (int i = 0; i <= kReserved; ++i) {
+      if (code_size[i] > 0) {
+        ++bits[code_size[i]];
+      }
+    }
+    // shorten codes longer than 16 bits, K.3
+    for (int i = kMaxLength; i > 16; --i) {
+      while (bits[i] > 0) {
+        int j = i - 2;
+        while (bits[j] == 0) {
+          --j;
+        }
+        bits[i] -= 2;
+        ++bits[i - 1];
+        bits[j + 1] += 2;
+        --bits[j];
+      }
+    }
+    // drop the reserved code, the longest one
+    int longest = 16;
+    while (bits[longest] == 0) {
+      --longest;
+    }
+    --bits[longest];
+
+    dht.symbol_counts.assign(bits.begin() + 1, bits.begin() + 17);
+    dht.symbols.clear();
+    for (int length = 1; length <= kMaxLength; ++length) {
+      for (int i = 0; i < kReserved; ++i) {
+        if (code_size[i] == length) {
+          dht.symbols.push_back(static_cast<uint8_t>(i));
+        }
+      }
+    }
+  }
+};
+
+// The four Huffman tables of a baseline image, DC and AC of luminance(id 0)
+// and of chrominance(id 1), and the coding of quantized blocks with them.
+// Shared by JPEGEncoder and JPEGTransformer.
+class HuffmanEncoder {
+public:
+  // in the order of the DHT segments
+  enum Table { kDCLuminance = 0, kACLuminance, kDCChrominance, kACChrominance };
+  constexpr static int kTableCount = 4;
+
+  // an Output of codeBlock() writing the codes of the symbols
+  struct SymbolWriter {
+    BitWriter &writer;
+    const std::array<HuffmanCodes, kTableCount> &codes;
+
+    void emit(int table, int symbol, uint32_t bits, int count) {
+      const auto &c = codes[table];
+      writer.write((static_cast<uint32_t>(c.code[symbol]) << count) | bits,
+                   c.length[symbol] + count);
+    }
+  };
+
+  // an Output of codeBlock() counting the symbols for optimal tables
+  struct SymbolCounter {
+    std::array<std::array<uint32_t, 256>, kTableCount> frequencies{};
+
+    void emit(int table, int symbol, uint32_t, int) {
+      ++frequencies[table][symbol];
+    }
+  };
+
+  // resets the DC predictors at every restart interval, writing the RSTn
+  // marker if there is a writer
+  struct Restarts {
+    uint16_t interval;
+    BitWriter *writer;
+
+    template <size_t kCount>
+    void next(size_t mcu, std::array<int16_t, kCount> &predictors) const {
+      if (mcu == 0 || interval == 0 || mcu % interval != 0) {
+        return;
+      }
+      predictors.fill(0);
+      if (writer != nullptr) {
+        writer->writeMarker(
+            static_cast<uint8_t>(JFIF_RST0 + (mcu / interval - 1) % 8));
+      }
+    }
+  };
+
+  void useAnnexKTables() {
+    setTable(kDCLuminance, annex_k::kDCLuminanceCounts,
+             annex_k::kDCLuminanceSymbols);
+    setTable(kACLuminance, annex_k::kACLuminanceCounts,
+             annex_k::kACLuminanceSymbols);
+    setTable(kDCChrominance, annex_k::kDCChrominanceCounts,
+             annex_k::kDCChrominanceSymbols);
+    setTable(kACChrominance, annex_k::kACChrominanceCounts,
+             annex_k::kACChrominanceSymbols);
+  }
+
+  // the first `table_count` tables, the luminance ones alone are those of a
+  // grayscale image and the others have no symbols to build a code from
+  void useOptimalTables(const SymbolCounter &counter,
+                        int table_count = kTableCount) {
+    for (int table = 0; table < table_count; ++table) {
+      HuffmanCodes::buildOptimal(counter.frequencies[table], dht_[table]);
+      finishTable(table);
+    }
+  }
+
+  // the DHT segments of the first `table_count` tables
+  void writeTables(std::vector<uint8_t> &out,
+                   int table_count = kTableCount) const {
+    for (int table = 0; table < table_count; ++table) {
+      SegmentWriter::write(out, dht_[table]);
+    }
+  }
+
+  SymbolWriter symbolWriter(BitWriter &writer) const {
+    return {writer, codes_};
+  }
+
+  // ITU-T.81 F.1.2, `coef` in natural order and `natural_mask` its nonzero
+  // coefficients. The mask is moved to zigzag order one set bit at a time,
+  // the zero runs are then the gaps between its bits.
+  template <typename Output>
+  static void codeBlock(const int16_t *coef, uint64_t natural_mask,
+                        int16_t &predictor, int dc_table, int ac_table,
+                        Output &output) {
+    int diff = coef[0] - predictor;
+    predictor = coef[0];
+    codeValue(diff, 0, dc_table, output);
+
+    uint64_t nonzero = 0;
+    natural_mask &= ~static_cast<uint64_t>(1);
+    while (natural_mask != 0) {
+      nonzero |= static_cast<uint64_t>(1) << kZigzagOrder[lowestBit(natural_mask)];
+      natural_mask &= natural_mask - 1;
+    }
+    int last = 0;
+    while (nonzero != 0) {
+      int k = lowestBit(nonzero);
+      nonzero &= nonzero - 1;
+      int run = k - last - 1;
+      while (run > 15) {
+        output.emit(ac_table, 0xF0, 0, 0); // ZRL
+        run -= 16;
+      }
+      codeValue(coef[kNaturalOrder[k]], run << 4, ac_table, output);
+      last = k;
+    }
+    if (last != 63) {
+      output.emit(ac_table, 0x00, 0, 0); // EOB
+    }
+  }
+
+  // the mask of the nonzero coefficients of a block, bit i for
+  // coefficient i
+  using MaskKernel = uint64_t (*)(const int16_t *coef);
+
+  static MaskKernel selectMask(SIMDLevel level) {
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::SSE2) {
+      return &nonzeroMaskSSE2;
+    }
+#endif
+    (void)level;
+    return &nonzeroMaskScalar;
+  }
+
+  static uint64_t nonzeroMaskScalar(const int16_t *coef) {
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; ++i) {
+      mask |= static_cast<uint64_t>(coef[i] != 0) << i;
+    }
+    return mask;
+  }
+
+#if defined(SJPG_ARCH_X86)
+  SJPG_TARGET_SSE2 static uint64_t nonzeroMaskSSE2(const int16_t *coef) {
+    const auto zero = _mm_setzero_si128();
+    uint64_t zeros = 0;
+    for (int i = 0; i < 64; i += 16) {
+      auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(coef + i));
+      auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(coef + i + 8));
+      auto bytes =
+          _mm_packs_epi16(_mm_cmpeq_epi16(a, zero), _mm_cmpeq_epi16(b, zero));
+      zeros |= static_cast<uint64_t>(_mm_movemask_epi8(bytes)) << i;
+    }
+    return ~zeros;
+  }
+#endif
+
+  static int lowestBit(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#else
+    int bit = 0;
+    for (; (mask & 1) == 0; mask >>= 1) {
+      ++bit;
+    }
+    return bit;
+#endif
+  }
+
+private:
+  template <size_t kSymbolCount>
+  void setTable(int table, const uint8_t (&counts)[16],
+                const uint8_t (&symbols)[kSymbolCount]) {
+    auto &dht = dht_[table];
+    dht.symbol_counts.assign(std::begin(counts), std::end(counts));
+    dht.symbols.assign(std::begin(symbols), std::end(symbols));
+    finishTable(table);
+  }
+
+  void finishTable(int table) {
+    auto &dht = dht_[table];
+    dht.dc_or_ac = table % 2;
+    dht.table_id = table / 2;
+    codes_[table].build(dht.symbol_counts, dht.symbols);
+  }
+
+  // the category `ssss` of `value` or'ed to `run_bits` is the symbol, the
+  // value follows in `ssss` bits, one's complement if negative
+  template <typename Output>
+  static void codeValue(int value, int run_bits, int table, Output &output) {
+    auto magnitude = static_cast<uint32_t>(value < 0 ? -value : value);
+    int count = bitLength(magnitude);
+    auto bits = static_cast<uint32_t>(value < 0 ? value - 1 : value) &
+                ((1u << count) - 1);
+    output.emit(table, run_bits | count, bits, count);
+  }
+
+  static int bitLength(uint32_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+#else
+    int length = 0;
+    for (; value != 0; value >>= 1) {
+      ++length;
+    }
+    return length;
+#endif
+  }
+
+  std::array<segments::DHTSegment, kTableCount> dht_;
+  std::array<HuffmanCodes, kTableCount> codes_;
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_HUFFMAN_ENCODER_H
@@ -4,9 +4,11 @@
 # pragma once
 #include "sjpg_log.h"
 #include "sjpg_bit_stream.h"
-#include <bitset>
-#include <map>
+#include <array>
+#include <climits>
 #include <numeric>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <cstdint>
 #include <cassert>
@@ -14,38 +16,106 @@
 namespace sjpg_codec {
 class HuffmanTable {
 public:
+  // codes up to kLookupBits long are decoded with a single table probe,
+  // longer codes fall back to the canonical maxcode/valoffset search
+  constexpr static int kLookupBits = 9;
+  constexpr static int kLookupSize = 1 << kLookupBits;
+  constexpr static int kMaxCodeLength = 16;
+
+  // AC symbol(rrrr_ssss) and its magnitude bits decoded in one probe
+  struct FastAC {
+    int16_t value{0};  // the extended coefficient value
+    uint8_t run{0};    // rrrr, the zeros before the coefficient
+    uint8_t length{0}; // code length + magnitude bits, 0 if not available
+  };
+
+  // a DHT whose codes don't fit their lengths makes a table of no codes,
+  // see isValid()
   explicit HuffmanTable(std::vector<uint8_t> symbol_counts,
                         std::vector<uint8_t> symbols)
       : symbol_counts_(std::move(symbol_counts)), symbols_(std::move(symbols)) {
-    buildHuffmanTree();
+    valid_ = isValid(symbol_counts_, symbols_);
+    if (!valid_) {
+      maxcode_.fill(-1);
+      return;
+    }
+    buildHuffmanTable();
+    buildFastACTable();
+  }
+
+  // whether the DHT was a canonical code, an invalid table decodes nothing
+  bool isValid() const { return valid_; }
 
-    code_symbol_map = buildHuffmanTable(symbol_counts_, symbols_);
+  // 16 counts of at most 256 symbols in all, and at each length no more
+  // codes than are left after the shorter ones, ITU-T.81 C
+  static bool isValid(const std::vector<uint8_t> &symbol_counts,
+                      const std::vector<uint8_t> &symbols) {
+    if (symbol_counts.size() != kMaxCodeLength) {
+      return false;
+    }
+    int32_t code = 0;
+    size_t total = 0;
+    for (int length = 1; length <= kMaxCodeLength; ++length) {
+      const int num_codes = symbol_counts[length - 1];
+      if (code + num_codes > (1 << length)) {
+        return false;
+      }
+      code = (code + num_codes) << 1;
+      total += num_codes;
+    }
+    return total <= 256 && total == symbols.size();
   }
 
-  bool contains(const std::string &code) const {
-    return code_symbol_map.find(code) != code_symbol_map.end();
+  bool contains(uint16_t code, int length) const {
+    if (length < 1 || length > kMaxCodeLength) {
+      return false;
+    }
+    return static_cast<int32_t>(code) >= mincode_[length] &&
+           static_cast<int32_t>(code) <= maxcode_[length];
   }
 
-  uint16_t getSymbol(const std::string &code) const {
-    if (!contains(code)) {
+  uint16_t getSymbol(uint16_t code, int length) const {
+    if (!contains(code, length)) {
       throw std::out_of_range("Code not found");
     }
-    return code_symbol_map.at(code);
+    return symbols_[code + valoffset_[length]];
   }
 
   uint16_t getSymbol(BitStream &st) const {
-    std::string code;
-    while (true) {
-      code.push_back(st.getBit());
-      if (contains(code)) {
-        return getSymbol(code);
+    auto look = st.peek(kLookupBits);
+    auto entry = lookup_[look];
+    if (entry != 0) {
+      st.consume(entry >> 8);
+      return entry & 0xFF;
+    }
+
+    // code longer than kLookupBits
+    auto code = static_cast<int32_t>(st.peek(kMaxCodeLength));
+    for (int length = kLookupBits + 1; length <= kMaxCodeLength; ++length) {
+      auto c = code >> (kMaxCodeLength - length);
+      if (c <= maxcode_[length]) {
+        st.consume(length);
+        return symbols_[c + valoffset_[length]];
       }
     }
+    throw std::out_of_range("Code not found");
   }
 
+  // `look` is the next kLookupBits of the stream
+  const FastAC &getFastAC(uint32_t look) const { return fast_ac_[look]; }
+
   void print() const {
-    for (auto const &[key, val] : code_symbol_map) {
-      LOG_INFO("Code: %s Symbol: %d\n", key.c_str(), val);
+    int symbol_index = 0;
+    for (int length = 1; length <= kMaxCodeLength; ++length) {
+      for (int i = 0; i < symbol_counts_[length - 1]; ++i) {
+        auto code = mincode_[length] + i;
+        std::string code_str;
+        for (int b = length - 1; b >= 0; --b) {
+          code_str.push_back((code >> b) & 1 ? '1' : '0');
+        }
+        LOG_INFO("Code: %s Symbol: %d\n", code_str.c_str(),
+                 symbols_[symbol_index++]);
+      }
     }
   }
 
@@ -54,55 +124,69 @@ public:
   const std::vector<uint8_t> &getSymbols() const { return symbols_; }
 
 private:
-  void buildHuffmanTree() {
-    assert(symbol_counts_.size() == 16);
-
-    constexpr static auto kTreeHeight = 16;
-
-    uint16_t code = 0;
+  // canonical huffman code, see ITU-T.81 Annex C and F.2.2.3
+  void buildHuffmanTable() {
+    int32_t code = 0;
     int symbol_index = 0;
-    for (auto height = 1; height <= kTreeHeight; height++) {
-      auto count_in_this_height = symbol_counts_[height - 1];
-      for (auto i = 0; i < count_in_this_height; i++) {
-        auto symbol = symbols_[symbol_index++];
-        auto code_str = std::bitset<kTreeHeight>(code).to_string();
-        auto code_str_trimmed = code_str.substr(kTreeHeight - height);
-        code_symbol_map[code_str_trimmed] = symbol;
-
-        code += 1;
+    // length: 1 ~ 16 (JPEG哈夫曼表的码长范围)
+    for (int length = 1; length <= kMaxCodeLength; ++length) {
+      int num_codes = symbol_counts_[length - 1];
+      mincode_[length] = code;
+      valoffset_[length] = symbol_index - code;
+      maxcode_[length] = num_codes > 0 ? code + num_codes - 1 : -1;
+
+      for (int i = 0; i < num_codes; ++i) {
+        if (length <= kLookupBits) {
+          // every lookahead value starting with this code maps to it
+          auto shift = kLookupBits - length;
+          auto first = code << shift;
+          for (int k = 0; k < (1 << shift); ++k) {
+            lookup_[first + k] =
+                static_cast<uint16_t>((length << 8) | symbols_[symbol_index]);
+          }
+        }
+        ++symbol_index;
+        ++code;
       }
-      code *= 2;
+      code <<= 1;
     }
+    maxcode_[kMaxCodeLength + 1] = INT32_MAX; // sentinel
   }
 
-  static std::map<std::string, uint16_t> buildHuffmanTable(
-    const std::vector<uint8_t>& counts, // counts[16]
-    const std::vector<uint8_t>& symbols // n个
-) {
-    constexpr static auto kMaxHuffmanCodeLength = 16;
-    assert(counts.size() == kMaxHuffmanCodeLength);
-
-    std::map<std::string, uint16_t> table;
-    int code = 0;
-    int symInd = 0;
-    // length: 1 ~ 16 (JPEG哈夫曼表的码长范围)
-    for (int length = 1; length <= kMaxHuffmanCodeLength; ++length) {
-      int numCodes = counts[length - 1];
-      for (int i = 0; i < numCodes; ++i) {
-        // 生成指定位长的二进制字符串
-        std::string codeStr = std::bitset<16>(code).to_string().substr(16 - length, length);
-        table[codeStr] = symbols[symInd++];
-        code++;
+  void buildFastACTable() {
+    for (int look = 0; look < kLookupSize; ++look) {
+      auto entry = lookup_[look];
+      if (entry == 0) {
+        continue;
       }
-      code <<= 1;
+      int code_length = entry >> 8;
+      int rrrr_ssss = entry & 0xFF;
+      int run = rrrr_ssss >> 4;
+      int category = rrrr_ssss & 0x0F;
+      // EOB and ZRL carry no magnitude bits
+      if (category == 0 || code_length + category > kLookupBits) {
+        continue;
+      }
+      int bits = (look >> (kLookupBits - code_length - category)) &
+                 ((1 << category) - 1);
+      int value = bits;
+      if (bits < (1 << (category - 1))) {
+        value = bits - (1 << category) + 1;
+      }
+      fast_ac_[look].value = static_cast<int16_t>(value);
+      fast_ac_[look].run = static_cast<uint8_t>(run);
+      fast_ac_[look].length = static_cast<uint8_t>(code_length + category);
     }
-    return table;
   }
 
-
   std::vector<uint8_t> symbol_counts_;
   std::vector<uint8_t> symbols_;
-  std::map<std::string, uint16_t> code_symbol_map;
+  bool valid_{false};
+  // (code_length << 8) | symbol, 0 means the code is longer than kLookupBits
+  std::array<uint16_t, kLookupSize> lookup_{};
+  std::array<FastAC, kLookupSize> fast_ac_{};
+  std::array<int32_t, kMaxCodeLength + 2> mincode_{};
+  std::array<int32_t, kMaxCodeLength + 2> maxcode_{};
+  std::array<int32_t, kMaxCodeLength + 2> valoffset_{};
 };
 } // namespace sjpg_codec
-
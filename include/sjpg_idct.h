@@ -0,0 +1,696 @@
+//
+// Created by user on 7/20/25.
+//
+
+#ifndef SJPG_IDCT_H
+#define SJPG_IDCT_H
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sjpg_codec {
+enum class IDCTMethod {
+  Islow = 0, // accurate separable integer IDCT, comparable to libjpeg ISLOW
+  Ifast = 1, // AAN integer IDCT, dequantization folded into the multipliers
+  Float = 2, // AAN float IDCT, kept for reference
+};
+
+// Dequantization multipliers of one quantization table for every IDCT
+// method, all in natural(row major) order.
+struct DequantTable {
+  alignas(32) std::array<int16_t, 64> islow{};
+  alignas(32) std::array<int16_t, 64> ifast{};
+  alignas(32) std::array<float, 64> fp{};
+
+  // `zigzag_data` is the quantization table as stored in DQT
+  static DequantTable build(const std::vector<uint8_t> &zigzag_data) {
+    // natural index -> zigzag index
+    constexpr static int zz_order[64] = {
+        0,  1,  5,  6,  14, 15, 27, 28, 2,  4,  7,  13, 16, 26, 29, 42,
+        3,  8,  12, 17, 25, 30, 41, 43, 9,  11, 18, 24, 31, 40, 44, 53,
+        10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
+        21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
+    // AAN scale factors * 2^14, see libjpeg jddctmgr.c
+    constexpr static int16_t aan_scales[64] = {
+        16384, 22725, 21407, 19266, 16384, 12873, 8867,  4520,
+        22725, 31521, 29692, 26722, 22725, 17855, 12299, 6270,
+        21407, 29692, 27969, 25172, 21407, 16819, 11585, 5906,
+        19266, 26722, 25172, 22654, 19266, 15137, 10426, 5315,
+        16384, 22725, 21407, 19266, 16384, 12873, 8867,  4520,
+        12873, 17855, 16819, 15137, 12873, 10114, 6967,  3552,
+        8867,  12299, 11585, 10426, 8867,  6967,  4799,  2446,
+        4520,  6270,  5906,  5315,  4520,  3552,  2446,  1247};
+    constexpr static double aan_scale_factors[8] = {
+        1.0, 1.387039845, 1.306562965, 1.175875602,
+        1.0, 0.785694958, 0.541196100, 0.275899379};
+
+    DequantTable table;
+    for (int i = 0; i < 64; ++i) {
+      int32_t q = zigzag_data[zz_order[i]];
+      table.islow[i] = static_cast<int16_t>(q);
+      // keep 2 fraction bits(kIfastScaleBits) for the first pass
+      table.ifast[i] = static_cast<int16_t>(
+          (q * aan_scales[i] + (1 << (13 - kIfastScaleBits))) >>
+          (14 - kIfastScaleBits));
+      // the final 1/8 scaling of the 2-D IDCT is folded in as well
+      table.fp[i] = static_cast<float>(q * aan_scale_factors[i / 8] *
+                                       aan_scale_factors[i % 8] * 0.125);
+    }
+    return table;
+  }
+
+  constexpr static int kIfastScaleBits = 2;
+};
+
+// 8x8 inverse DCT of quantized coefficients in natural order. Dequantization,
+// level shift(+128) and clamping are done in the same pass and the pixels
+// are written to `out`, `stride` bytes apart.
+class IDCT {
+public:
+  static void transform(IDCTMethod method, const int16_t *coef,
+                        const DequantTable &table, uint8_t *out,
+                        size_t stride) {
+    switch (method) {
+    case IDCTMethod::Ifast:
+      computeIfast(coef, table.ifast.data(), out, stride);
+      break;
+    case IDCTMethod::Float:
+      computeFloat(coef, table.fp.data(), out, stride);
+      break;
+    case IDCTMethod::Islow:
+    default:
+      computeIslow(coef, table.islow.data(), out, stride);
+      break;
+    }
+  }
+
+  static uint8_t clampToByte(int32_t v) {
+    return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+  }
+
+  // libjpeg jidctint.c
+  constexpr static int kIslowConstBits = 13;
+  constexpr static int kIslowPass1Bits = 2;
+  constexpr static int32_t kFix_0_298631336 = 2446;
+  constexpr static int32_t kFix_0_390180644 = 3196;
+  constexpr static int32_t kFix_0_541196100 = 4433;
+  constexpr static int32_t kFix_0_765366865 = 6270;
+  constexpr static int32_t kFix_0_899976223 = 7373;
+  constexpr static int32_t kFix_1_175875602 = 9633;
+  constexpr static int32_t kFix_1_501321110 = 12299;
+  constexpr static int32_t kFix_1_847759065 = 15137;
+  constexpr static int32_t kFix_1_961570560 = 16069;
+  constexpr static int32_t kFix_2_053119869 = 16819;
+  constexpr static int32_t kFix_2_562915447 = 20995;
+  constexpr static int32_t kFix_3_072711026 = 25172;
+  // reduced size IDCTs, libjpeg jidctred.c
+  constexpr static int32_t kFix_0_211164243 = 1730;
+  constexpr static int32_t kFix_0_509795579 = 4176;
+  constexpr static int32_t kFix_0_601344887 = 4926;
+  constexpr static int32_t kFix_0_720959822 = 5906;
+  constexpr static int32_t kFix_0_850430095 = 6967;
+  constexpr static int32_t kFix_1_061594337 = 8697;
+  constexpr static int32_t kFix_1_272758580 = 10426;
+  constexpr static int32_t kFix_1_451774981 = 11893;
+  constexpr static int32_t kFix_2_172734803 = 17799;
+  constexpr static int32_t kFix_3_624509785 = 29692;
+
+  // `kCorner` is for blocks whose nonzero coefficients are all in the
+  // top-left 4x4, the others are known to be 0 and skipped. The pixels are
+  // the same either way.
+  template <bool kCorner = false>
+  static void computeIslow(const int16_t *coef, const int16_t *quant,
+                           uint8_t *out, size_t stride) {
+    constexpr int kConstBits = kIslowConstBits;
+    constexpr int kPass1Bits = kIslowPass1Bits;
+    constexpr int kColumns = kCorner ? 4 : 8;
+    int32_t workspace[64];
+    // coefficient `i` of a column or row, 0 beyond the corner
+    auto at = [](const auto *v, int i, int step) -> int32_t {
+      return kCorner && i >= 4 ? 0 : v[i * step];
+    };
+
+    if (kCorner) {
+      for (int row = 0; row < 8; ++row) {
+        std::fill_n(workspace + row * 8 + 4, 4, 0);
+      }
+    }
+
+    // pass 1: columns, results scaled up by 2^kPass1Bits
+    for (int col = 0; col < kColumns; ++col) {
+      const int16_t *in = coef + col;
+      const int16_t *q = quant + col;
+      int32_t *ws = workspace + col;
+
+      if (in[8] == 0 && in[16] == 0 && in[24] == 0 && at(in, 4, 8) == 0 &&
+          at(in, 5, 8) == 0 && at(in, 6, 8) == 0 && at(in, 7, 8) == 0) {
+        int32_t dc = (in[0] * q[0]) * (1 << kPass1Bits);
+        for (int row = 0; row < 8; ++row) {
+          ws[row * 8] = dc;
+        }
+        continue;
+      }
+
+      int32_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+      int32_t z1, z2, z3, z4, z5;
+
+      // even part
+      z2 = in[16] * q[16];
+      z3 = at(in, 6, 8) * at(q, 6, 8);
+      z1 = (z2 + z3) * kFix_0_541196100;
+      tmp2 = z1 + z3 * (-kFix_1_847759065);
+      tmp3 = z1 + z2 * kFix_0_765366865;
+
+      z2 = in[0] * q[0];
+      z3 = at(in, 4, 8) * at(q, 4, 8);
+      tmp0 = (z2 + z3) * (1 << kConstBits);
+      tmp1 = (z2 - z3) * (1 << kConstBits);
+
+      tmp10 = tmp0 + tmp3;
+      tmp13 = tmp0 - tmp3;
+      tmp11 = tmp1 + tmp2;
+      tmp12 = tmp1 - tmp2;
+
+      // odd part
+      tmp0 = at(in, 7, 8) * at(q, 7, 8);
+      tmp1 = at(in, 5, 8) * at(q, 5, 8);
+      tmp2 = in[24] * q[24];
+      tmp3 = in[8] * q[8];
+
+      z1 = tmp0 + tmp3;
+      z2 = tmp1 + tmp2;
+      z3 = tmp0 + tmp2;
+      z4 = tmp1 + tmp3;
+      z5 = (z3 + z4) * kFix_1_175875602;
+
+      tmp0 = tmp0 * kFix_0_298631336;
+      tmp1 = tmp1 * kFix_2_053119869;
+      tmp2 = tmp2 * kFix_3_072711026;
+      tmp3 = tmp3 * kFix_1_501321110;
+      z1 = z1 * (-kFix_0_899976223);
+      z2 = z2 * (-kFix_2_562915447);
+      z3 = z3 * (-kFix_1_961570560);
+      z4 = z4 * (-kFix_0_390180644);
+
+      z3 += z5;
+      z4 += z5;
+
+      tmp0 += z1 + z3;
+      tmp1 += z2 + z4;
+      tmp2 += z2 + z3;
+      tmp3 += z1 + z4;
+
+      constexpr int kShift = kConstBits - kPass1Bits;
+      constexpr int32_t kRound = 1 << (kShift - 1);
+      ws[0] = (tmp10 + tmp3 + kRound) >> kShift;
+      ws[56] = (tmp10 - tmp3 + kRound) >> kShift;
+      ws[8] = (tmp11 + tmp2 + kRound) >> kShift;
+      ws[48] = (tmp11 - tmp2 + kRound) >> kShift;
+      ws[16] = (tmp12 + tmp1 + kRound) >> kShift;
+      ws[40] = (tmp12 - tmp1 + kRound) >> kShift;
+      ws[24] = (tmp13 + tmp0 + kRound) >> kShift;
+      ws[32] = (tmp13 - tmp0 + kRound) >> kShift;
+    }
+
+    // pass 2: rows, remove the pass 1 scaling and the 8x of the 2-D IDCT
+    constexpr int kShift = kConstBits + kPass1Bits + 3;
+    // rounding and level shift in one constant
+    constexpr int32_t kBias = (1 << (kShift - 1)) + (128 << kShift);
+    for (int row = 0; row < 8; ++row) {
+      const int32_t *ws = workspace + row * 8;
+      uint8_t *o = out + row * stride;
+
+      int32_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+      int32_t z1, z2, z3, z4, z5;
+
+      z2 = ws[2];
+      z3 = at(ws, 6, 1);
+      z1 = (z2 + z3) * kFix_0_541196100;
+      tmp2 = z1 + z3 * (-kFix_1_847759065);
+      tmp3 = z1 + z2 * kFix_0_765366865;
+
+      tmp0 = (ws[0] + at(ws, 4, 1)) * (1 << kConstBits) + kBias;
+      tmp1 = (ws[0] - at(ws, 4, 1)) * (1 << kConstBits) + kBias;
+
+      tmp10 = tmp0 + tmp3;
+      tmp13 = tmp0 - tmp3;
+      tmp11 = tmp1 + tmp2;
+      tmp12 = tmp1 - tmp2;
+
+      tmp0 = at(ws, 7, 1);
+      tmp1 = at(ws, 5, 1);
+      tmp2 = ws[3];
+      tmp3 = ws[1];
+
+      z1 = tmp0 + tmp3;
+      z2 = tmp1 + tmp2;
+      z3 = tmp0 + tmp2;
+      z4 = tmp1 + tmp3;
+      z5 = (z3 + z4) * kFix_1_175875602;
+
+      tmp0 = tmp0 * kFix_0_298631336;
+      tmp1 = tmp1 * kFix_2_053119869;
+      tmp2 = tmp2 * kFix_3_072711026;
+      tmp3 = tmp3 * kFix_1_501321110;
+      z1 = z1 * (-kFix_0_899976223);
+      z2 = z2 * (-kFix_2_562915447);
+      z3 = z3 * (-kFix_1_961570560);
+      z4 = z4 * (-kFix_0_390180644);
+
+      z3 += z5;
+      z4 += z5;
+
+      tmp0 += z1 + z3;
+      tmp1 += z2 + z4;
+      tmp2 += z2 + z3;
+      tmp3 += z1 + z4;
+
+      o[0] = clampToByte((tmp10 + tmp3) >> kShift);
+      o[7] = clampToByte((tmp10 - tmp3) >> kShift);
+      o[1] = clampToByte((tmp11 + tmp2) >> kShift);
+      o[6] = clampToByte((tmp11 - tmp2) >> kShift);
+      o[2] = clampToByte((tmp12 + tmp1) >> kShift);
+      o[5] = clampToByte((tmp12 - tmp1) >> kShift);
+      o[3] = clampToByte((tmp13 + tmp0) >> kShift);
+      o[4] = clampToByte((tmp13 - tmp0) >> kShift);
+    }
+  }
+
+  // libjpeg jidctfst.c, `quant` is DequantTable::ifast
+  static void computeIfast(const int16_t *coef, const int16_t *quant,
+                           uint8_t *out, size_t stride) {
+    constexpr int kConstBits = 8;
+    constexpr int32_t kFix_1_082392200 = 277;
+    constexpr int32_t kFix_1_414213562 = 362;
+    constexpr int32_t kFix_1_847759065 = 473;
+    constexpr int32_t kFix_2_613125930 = 669;
+    auto multiply = [](int32_t v, int32_t c) { return (v * c) >> kConstBits; };
+    int32_t workspace[64];
+
+    // pass 1: columns, the table keeps kIfastScaleBits fraction bits
+    for (int col = 0; col < 8; ++col) {
+      const int16_t *in = coef + col;
+      const int16_t *q = quant + col;
+      int32_t *ws = workspace + col;
+
+      if (in[8] == 0 && in[16] == 0 && in[24] == 0 && in[32] == 0 &&
+          in[40] == 0 && in[48] == 0 && in[56] == 0) {
+        int32_t dc = in[0] * q[0];
+        for (int row = 0; row < 8; ++row) {
+          ws[row * 8] = dc;
+        }
+        continue;
+      }
+
+      int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+      int32_t tmp10, tmp11, tmp12, tmp13;
+      int32_t z5, z10, z11, z12, z13;
+
+      // even part
+      tmp0 = in[0] * q[0];
+      tmp1 = in[16] * q[16];
+      tmp2 = in[32] * q[32];
+      tmp3 = in[48] * q[48];
+
+      tmp10 = tmp0 + tmp2;
+      tmp11 = tmp0 - tmp2;
+      tmp13 = tmp1 + tmp3;
+      tmp12 = multiply(tmp1 - tmp3, kFix_1_414213562) - tmp13;
+
+      tmp0 = tmp10 + tmp13;
+      tmp3 = tmp10 - tmp13;
+      tmp1 = tmp11 + tmp12;
+      tmp2 = tmp11 - tmp12;
+
+      // odd part
+      tmp4 = in[8] * q[8];
+      tmp5 = in[24] * q[24];
+      tmp6 = in[40] * q[40];
+      tmp7 = in[56] * q[56];
+
+      z13 = tmp6 + tmp5;
+      z10 = tmp6 - tmp5;
+      z11 = tmp4 + tmp7;
+      z12 = tmp4 - tmp7;
+
+      tmp7 = z11 + z13;
+      tmp11 = multiply(z11 - z13, kFix_1_414213562);
+      z5 = multiply(z10 + z12, kFix_1_847759065);
+      tmp10 = multiply(z12, kFix_1_082392200) - z5;
+      tmp12 = multiply(z10, -kFix_2_613125930) + z5;
+
+      tmp6 = tmp12 - tmp7;
+      tmp5 = tmp11 - tmp6;
+      tmp4 = tmp10 + tmp5;
+
+      ws[0] = tmp0 + tmp7;
+      ws[56] = tmp0 - tmp7;
+      ws[8] = tmp1 + tmp6;
+      ws[48] = tmp1 - tmp6;
+      ws[16] = tmp2 + tmp5;
+      ws[40] = tmp2 - tmp5;
+      ws[32] = tmp3 + tmp4;
+      ws[24] = tmp3 - tmp4;
+    }
+
+    // pass 2: rows
+    constexpr int kShift = DequantTable::kIfastScaleBits + 3;
+    constexpr int32_t kBias = (1 << (kShift - 1)) + (128 << kShift);
+    for (int row = 0; row < 8; ++row) {
+      const int32_t *ws = workspace + row * 8;
+      uint8_t *o = out + row * stride;
+
+      int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+      int32_t tmp10, tmp11, tmp12, tmp13;
+      int32_t z5, z10, z11, z12, z13;
+
+      tmp10 = ws[0] + ws[4] + kBias;
+      tmp11 = ws[0] - ws[4] + kBias;
+      tmp13 = ws[2] + ws[6];
+      tmp12 = multiply(ws[2] - ws[6], kFix_1_414213562) - tmp13;
+
+      tmp0 = tmp10 + tmp13;
+      tmp3 = tmp10 - tmp13;
+      tmp1 = tmp11 + tmp12;
+      tmp2 = tmp11 - tmp12;
+
+      z13 = ws[5] + ws[3];
+      z10 = ws[5] - ws[3];
+      z11 = ws[1] + ws[7];
+      z12 = ws[1] - ws[7];
+
+      tmp7 = z11 + z13;
+      tmp11 = multiply(z11 - z13, kFix_1_414213562);
+      z5 = multiply(z10 + z12, kFix_1_847759065);
+      tmp10 = multiply(z12, kFix_1_082392200) - z5;
+      tmp12 = multiply(z10, -kFix_2_613125930) + z5;
+
+      tmp6 = tmp12 - tmp7;
+      tmp5 = tmp11 - tmp6;
+      tmp4 = tmp10 + tmp5;
+
+      o[0] = clampToByte((tmp0 + tmp7) >> kShift);
+      o[7] = clampToByte((tmp0 - tmp7) >> kShift);
+      o[1] = clampToByte((tmp1 + tmp6) >> kShift);
+      o[6] = clampToByte((tmp1 - tmp6) >> kShift);
+      o[2] = clampToByte((tmp2 + tmp5) >> kShift);
+      o[5] = clampToByte((tmp2 - tmp5) >> kShift);
+      o[4] = clampToByte((tmp3 + tmp4) >> kShift);
+      o[3] = clampToByte((tmp3 - tmp4) >> kShift);
+    }
+  }
+
+  // libjpeg jidctflt.c, `quant` is DequantTable::fp
+  static void computeFloat(const int16_t *coef, const float *quant,
+                           uint8_t *out, size_t stride) {
+    float workspace[64];
+
+    // pass 1: columns
+    for (int col = 0; col < 8; ++col) {
+      const int16_t *in = coef + col;
+      const float *q = quant + col;
+      float *ws = workspace + col;
+
+      if (in[8] == 0 && in[16] == 0 && in[24] == 0 && in[32] == 0 &&
+          in[40] == 0 && in[48] == 0 && in[56] == 0) {
+        float dc = in[0] * q[0];
+        for (int row = 0; row < 8; ++row) {
+          ws[row * 8] = dc;
+        }
+        continue;
+      }
+
+      float tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+      float tmp10, tmp11, tmp12, tmp13;
+      float z5, z10, z11, z12, z13;
+
+      // even part
+      tmp0 = in[0] * q[0];
+      tmp1 = in[16] * q[16];
+      tmp2 = in[32] * q[32];
+      tmp3 = in[48] * q[48];
+
+      tmp10 = tmp0 + tmp2;
+      tmp11 = tmp0 - tmp2;
+      tmp13 = tmp1 + tmp3;
+      tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+
+      tmp0 = tmp10 + tmp13;
+      tmp3 = tmp10 - tmp13;
+      tmp1 = tmp11 + tmp12;
+      tmp2 = tmp11 - tmp12;
+
+      // odd part
+      tmp4 = in[8] * q[8];
+      tmp5 = in[24] * q[24];
+      tmp6 = in[40] * q[40];
+      tmp7 = in[56] * q[56];
+
+      z13 = tmp6 + tmp5;
+      z10 = tmp6 - tmp5;
+      z11 = tmp4 + tmp7;
+      z12 = tmp4 - tmp7;
+
+      tmp7 = z11 + z13;
+      tmp11 = (z11 - z13) * 1.414213562f;
+      z5 = (z10 + z12) * 1.847759065f;
+      tmp10 = z12 * 1.082392200f - z5;
+      tmp12 = z10 * -2.613125930f + z5;
+
+      tmp6 = tmp12 - tmp7;
+      tmp5 = tmp11 - tmp6;
+      tmp4 = tmp10 + tmp5;
+
+      ws[0] = tmp0 + tmp7;
+      ws[56] = tmp0 - tmp7;
+      ws[8] = tmp1 + tmp6;
+      ws[48] = tmp1 - tmp6;
+      ws[16] = tmp2 + tmp5;
+      ws[40] = tmp2 - tmp5;
+      ws[32] = tmp3 + tmp4;
+      ws[24] = tmp3 - tmp4;
+    }
+
+    // pass 2: rows
+    for (int row = 0; row < 8; ++row) {
+      const float *ws = workspace + row * 8;
+      uint8_t *o = out + row * stride;
+
+      float tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+      float tmp10, tmp11, tmp12, tmp13;
+      float z5, z10, z11, z12, z13;
+
+      tmp10 = ws[0] + ws[4];
+      tmp11 = ws[0] - ws[4];
+      tmp13 = ws[2] + ws[6];
+      tmp12 = (ws[2] - ws[6]) * 1.414213562f - tmp13;
+
+      tmp0 = tmp10 + tmp13;
+      tmp3 = tmp10 - tmp13;
+      tmp1 = tmp11 + tmp12;
+      tmp2 = tmp11 - tmp12;
+
+      z13 = ws[5] + ws[3];
+      z10 = ws[5] - ws[3];
+      z11 = ws[1] + ws[7];
+      z12 = ws[1] - ws[7];
+
+      tmp7 = z11 + z13;
+      tmp11 = (z11 - z13) * 1.414213562f;
+      z5 = (z10 + z12) * 1.847759065f;
+      tmp10 = z12 * 1.082392200f - z5;
+      tmp12 = z10 * -2.613125930f + z5;
+
+      tmp6 = tmp12 - tmp7;
+      tmp5 = tmp11 - tmp6;
+      tmp4 = tmp10 + tmp5;
+
+      o[0] = roundToByte(tmp0 + tmp7);
+      o[7] = roundToByte(tmp0 - tmp7);
+      o[1] = roundToByte(tmp1 + tmp6);
+      o[6] = roundToByte(tmp1 - tmp6);
+      o[2] = roundToByte(tmp2 + tmp5);
+      o[5] = roundToByte(tmp2 - tmp5);
+      o[4] = roundToByte(tmp3 + tmp4);
+      o[3] = roundToByte(tmp3 - tmp4);
+    }
+  }
+
+  // 4x4 pixels from the 8x8 coefficients(libjpeg jpeg_idct_4x4), row and
+  // column 4 don't contribute. `quant` is DequantTable::islow.
+  static void computeIslow4x4(const int16_t *coef, const int16_t *quant,
+                              uint8_t *out, size_t stride) {
+    constexpr int kConstBits = kIslowConstBits;
+    constexpr int kPass1Bits = kIslowPass1Bits;
+    int32_t workspace[8 * 4];
+
+    // pass 1: columns
+    constexpr int kShift1 = kConstBits - kPass1Bits + 1;
+    for (int col = 0; col < 8; ++col) {
+      if (col == 4) {
+        continue;
+      }
+      const int16_t *in = coef + col;
+      const int16_t *q = quant + col;
+      int32_t *ws = workspace + col;
+
+      if (in[8] == 0 && in[16] == 0 && in[24] == 0 && in[40] == 0 &&
+          in[48] == 0 && in[56] == 0) {
+        int32_t dc = (in[0] * q[0]) * (1 << kPass1Bits);
+        for (int row = 0; row < 4; ++row) {
+          ws[row * 8] = dc;
+        }
+        continue;
+      }
+
+      int32_t tmp0, tmp2, tmp10, tmp12;
+      // even part
+      tmp0 = (in[0] * q[0]) * (1 << (kConstBits + 1));
+      tmp2 = (in[16] * q[16]) * kFix_1_847759065 +
+             (in[48] * q[48]) * (-kFix_0_765366865);
+      tmp10 = tmp0 + tmp2;
+      tmp12 = tmp0 - tmp2;
+      // odd part
+      reducedOdd4(in[56] * q[56], in[40] * q[40], in[24] * q[24],
+                  in[8] * q[8], tmp0, tmp2);
+
+      constexpr int32_t kRound = 1 << (kShift1 - 1);
+      ws[0] = (tmp10 + tmp2 + kRound) >> kShift1;
+      ws[24] = (tmp10 - tmp2 + kRound) >> kShift1;
+      ws[8] = (tmp12 + tmp0 + kRound) >> kShift1;
+      ws[16] = (tmp12 - tmp0 + kRound) >> kShift1;
+    }
+
+    // pass 2: rows
+    constexpr int kShift2 = kConstBits + kPass1Bits + 3 + 1;
+    constexpr int32_t kBias = (1 << (kShift2 - 1)) + (128 << kShift2);
+    for (int row = 0; row < 4; ++row) {
+      const int32_t *ws = workspace + row * 8;
+      uint8_t *o = out + row * stride;
+
+      int32_t tmp0, tmp2, tmp10, tmp12;
+      tmp0 = ws[0] * (1 << (kConstBits + 1)) + kBias;
+      tmp2 = ws[2] * kFix_1_847759065 + ws[6] * (-kFix_0_765366865);
+      tmp10 = tmp0 + tmp2;
+      tmp12 = tmp0 - tmp2;
+      reducedOdd4(ws[7], ws[5], ws[3], ws[1], tmp0, tmp2);
+
+      o[0] = clampToByte((tmp10 + tmp2) >> kShift2);
+      o[3] = clampToByte((tmp10 - tmp2) >> kShift2);
+      o[1] = clampToByte((tmp12 + tmp0) >> kShift2);
+      o[2] = clampToByte((tmp12 - tmp0) >> kShift2);
+    }
+  }
+
+  // 2x2 pixels from the 8x8 coefficients(libjpeg jpeg_idct_2x2), only the
+  // DC and the odd rows and columns contribute
+  static void computeIslow2x2(const int16_t *coef, const int16_t *quant,
+                              uint8_t *out, size_t stride) {
+    constexpr int kConstBits = kIslowConstBits;
+    constexpr int kPass1Bits = kIslowPass1Bits;
+    int32_t workspace[8 * 2];
+
+    // pass 1: columns 0, 1, 3, 5 and 7
+    constexpr int kShift1 = kConstBits - kPass1Bits + 2;
+    for (int col = 0; col < 8; ++col) {
+      if (col == 2 || col == 4 || col == 6) {
+        continue;
+      }
+      const int16_t *in = coef + col;
+      const int16_t *q = quant + col;
+      int32_t *ws = workspace + col;
+
+      if (in[8] == 0 && in[24] == 0 && in[40] == 0 && in[56] == 0) {
+        int32_t dc = (in[0] * q[0]) * (1 << kPass1Bits);
+        ws[0] = dc;
+        ws[8] = dc;
+        continue;
+      }
+
+      int32_t tmp10 = (in[0] * q[0]) * (1 << (kConstBits + 2));
+      int32_t tmp0 = reducedOdd2(in[56] * q[56], in[40] * q[40],
+                                 in[24] * q[24], in[8] * q[8]);
+
+      constexpr int32_t kRound = 1 << (kShift1 - 1);
+      ws[0] = (tmp10 + tmp0 + kRound) >> kShift1;
+      ws[8] = (tmp10 - tmp0 + kRound) >> kShift1;
+    }
+
+    // pass 2: rows
+    constexpr int kShift2 = kConstBits + kPass1Bits + 3 + 2;
+    constexpr int32_t kBias = (1 << (kShift2 - 1)) + (128 << kShift2);
+    for (int row = 0; row < 2; ++row) {
+      const int32_t *ws = workspace + row * 8;
+      uint8_t *o = out + row * stride;
+
+      int32_t tmp10 = ws[0] * (1 << (kConstBits + 2)) + kBias;
+      int32_t tmp0 = reducedOdd2(ws[7], ws[5], ws[3], ws[1]);
+
+      o[0] = clampToByte((tmp10 + tmp0) >> kShift2);
+      o[1] = clampToByte((tmp10 - tmp0) >> kShift2);
+    }
+  }
+
+  // a block whose only nonzero coefficient is DC is flat, these are the
+  // pixels the full transforms produce for it
+  static uint8_t dcIslow(int16_t coef, int16_t quant) {
+    return clampToByte(((coef * quant + 4) >> 3) + 128);
+  }
+
+  static uint8_t dcIfast(int16_t coef, int16_t quant) {
+    constexpr int kShift = DequantTable::kIfastScaleBits + 3;
+    return clampToByte(((coef * quant + (1 << (kShift - 1))) >> kShift) + 128);
+  }
+
+  static uint8_t dcFloat(int16_t coef, float quant) {
+    return roundToByte(coef * quant);
+  }
+
+  static void fillBlock(uint8_t value, int size, uint8_t *out,
+                        size_t stride) {
+    for (int row = 0; row < size; ++row) {
+      std::fill_n(out + row * stride, size, value);
+    }
+  }
+
+  // the block average, libjpeg jpeg_idct_1x1
+  static void computeIslow1x1(const int16_t *coef, const int16_t *quant,
+                              uint8_t *out, size_t) {
+    out[0] = clampToByte(((coef[0] * quant[0] + 4) >> 3) + 128);
+  }
+
+private:
+  // odd part of the 4-point IDCT, inputs are the values of rows/columns
+  // 7, 5, 3 and 1
+  static void reducedOdd4(int32_t z1, int32_t z2, int32_t z3, int32_t z4,
+                          int32_t &tmp0, int32_t &tmp2) {
+    tmp0 = z1 * (-kFix_0_211164243) + z2 * kFix_1_451774981 +
+           z3 * (-kFix_2_172734803) + z4 * kFix_1_061594337;
+    tmp2 = z1 * (-kFix_0_509795579) + z2 * (-kFix_0_601344887) +
+           z3 * kFix_0_899976223 + z4 * kFix_2_562915447;
+  }
+
+  // odd part of the 2-point IDCT
+  static int32_t reducedOdd2(int32_t z7, int32_t z5, int32_t z3,
+                             int32_t z1) {
+    return z7 * (-kFix_0_720959822) + z5 * kFix_0_850430095 +
+           z3 * (-kFix_1_272758580) + z1 * kFix_3_624509785;
+  }
+
+  // level shift, round to nearest and clamp
+  static uint8_t roundToByte(float v) {
+    v += 128.5f;
+    if (v <= 0.0f) {
+      return 0;
+    }
+    if (v >= 255.0f) {
+      return 255;
+    }
+    return static_cast<uint8_t>(v);
+  }
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_IDCT_H
@@ -0,0 +1,461 @@
+//
+// Created by user on 7/21/25.
+//
+
+#ifndef SJPG_IDCT_SIMD_H
+#define SJPG_IDCT_SIMD_H
+#include "sjpg_cpu_features.h"
+#include "sjpg_idct.h"
+
+#if defined(SJPG_ARCH_X86)
+#include <immintrin.h>
+#endif
+
+namespace sjpg_codec {
+using IDCTKernel = void (*)(const int16_t *coef, const DequantTable &table,
+                            uint8_t *out, size_t stride);
+
+// Block IDCT kernels for every method and SIMD level. The SIMD kernels
+// implement IDCT::computeIslow with the same integer arithmetic and produce
+// identical pixels for every valid(16-bit dequantized) input.
+class IDCTKernels {
+public:
+  // `block_size` < 8 selects the reduced size IDCTs of scaled decoding, they
+  // are islow based for every method like libjpeg's
+  static IDCTKernel select(IDCTMethod method, SIMDLevel level,
+                           int block_size = 8) {
+    switch (block_size) {
+    case 4:
+      return &islow4x4Scalar;
+    case 2:
+      return &islow2x2Scalar;
+    case 1:
+      return &islow1x1Scalar;
+    default:
+      break;
+    }
+    switch (method) {
+    case IDCTMethod::Ifast:
+      return &ifastScalar;
+    case IDCTMethod::Float:
+      return &floatScalar;
+    case IDCTMethod::Islow:
+    default:
+      break;
+    }
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::AVX2) {
+      return &islowAVX2;
+    }
+    if (level >= SIMDLevel::SSE2) {
+      return &islowSSE2;
+    }
+#endif
+    (void)level;
+    return &islowScalar;
+  }
+
+  // for blocks with a DC coefficient only, they are flat
+  static IDCTKernel selectDCOnly(IDCTMethod method, int block_size = 8) {
+    switch (block_size) {
+    case 4:
+      return &dcIslow<4>;
+    case 2:
+      return &dcIslow<2>;
+    case 1:
+      return &islow1x1Scalar;
+    default:
+      break;
+    }
+    switch (method) {
+    case IDCTMethod::Ifast:
+      return &dcIfast;
+    case IDCTMethod::Float:
+      return &dcFloat;
+    case IDCTMethod::Islow:
+    default:
+      return &dcIslow<8>;
+    }
+  }
+
+  // for blocks whose nonzero coefficients are in the top-left 4x4. The
+  // pairs of 16-bit lanes of SSE2 gain nothing from the zeros, ifast, float
+  // and the reduced sizes use their full kernels as well.
+  static IDCTKernel selectCorner(IDCTMethod method, SIMDLevel level,
+                                 int block_size = 8) {
+    if (block_size != 8 || method != IDCTMethod::Islow) {
+      return select(method, level, block_size);
+    }
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::AVX2) {
+      return &islowAVX2<true>;
+    }
+    if (level >= SIMDLevel::SSE2) {
+      return &islowSSE2;
+    }
+#endif
+    return &islowCornerScalar;
+  }
+
+  static void islowScalar(const int16_t *coef, const DequantTable &table,
+                          uint8_t *out, size_t stride) {
+    IDCT::computeIslow(coef, table.islow.data(), out, stride);
+  }
+
+  static void islowCornerScalar(const int16_t *coef, const DequantTable &table,
+                                uint8_t *out, size_t stride) {
+    IDCT::computeIslow<true>(coef, table.islow.data(), out, stride);
+  }
+
+  template <int kSize>
+  static void dcIslow(const int16_t *coef, const DequantTable &table,
+                      uint8_t *out, size_t stride) {
+    IDCT::fillBlock(IDCT::dcIslow(coef[0], table.islow[0]), kSize, out,
+                    stride);
+  }
+
+  static void dcIfast(const int16_t *coef, const DequantTable &table,
+                      uint8_t *out, size_t stride) {
+    IDCT::fillBlock(IDCT::dcIfast(coef[0], table.ifast[0]), 8, out, stride);
+  }
+
+  static void dcFloat(const int16_t *coef, const DequantTable &table,
+                      uint8_t *out, size_t stride) {
+    IDCT::fillBlock(IDCT::dcFloat(coef[0], table.fp[0]), 8, out, stride);
+  }
+
+  static void islow4x4Scalar(const int16_t *coef, const DequantTable &table,
+                             uint8_t *out, size_t stride) {
+    IDCT::computeIslow4x4(coef, table.islow.data(), out, stride);
+  }
+
+  static void islow2x2Scalar(const int16_t *coef, const DequantTable &table,
+                             uint8_t *out, size_t stride) {
+    IDCT::computeIslow2x2(coef, table.islow.data(), out, stride);
+  }
+
+  static void islow1x1Scalar(const int16_t *coef, const DequantTable &table,
+                             uint8_t *out, size_t stride) {
+    IDCT::computeIslow1x1(coef, table.islow.data(), out, stride);
+  }
+
+  static void ifastScalar(const int16_t *coef, const DequantTable &table,
+                          uint8_t *out, size_t stride) {
+    IDCT::computeIfast(coef, table.ifast.data(), out, stride);
+  }
+
+  static void floatScalar(const int16_t *coef, const DequantTable &table,
+                          uint8_t *out, size_t stride) {
+    IDCT::computeFloat(coef, table.fp.data(), out, stride);
+  }
+
+#if defined(SJPG_ARCH_X86)
+  // 16-bit lanes, every rotation is a pair of _mm_madd_epi16 whose constants
+  // are the sums of the scalar multipliers each input is scaled by
+  SJPG_TARGET_SSE2 static void islowSSE2(const int16_t *coef,
+                                         const DequantTable &table,
+                                         uint8_t *out, size_t stride) {
+    __m128i r[8];
+    for (int i = 0; i < 8; ++i) {
+      auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(coef + i * 8));
+      auto q = _mm_load_si128(
+          reinterpret_cast<const __m128i *>(table.islow.data() + i * 8));
+      r[i] = _mm_mullo_epi16(c, q);
+    }
+
+    constexpr int kConstBits = IDCT::kIslowConstBits;
+    constexpr int kPass1Bits = IDCT::kIslowPass1Bits;
+
+    // pass 1: columns, each register is a row of 8 columns
+    islowPassSSE2(r, _mm_set1_epi32(1 << (kConstBits - kPass1Bits - 1)),
+                  kConstBits - kPass1Bits);
+    transpose8x16SSE2(r);
+
+    // pass 2: rows, rounding and level shift in the bias
+    constexpr int kShift = kConstBits + kPass1Bits + 3;
+    islowPassSSE2(r, _mm_set1_epi32((1 << (kShift - 1)) + (128 << kShift)),
+                  kShift);
+    transpose8x16SSE2(r);
+
+    for (int i = 0; i < 8; i += 2) {
+      auto pixels = _mm_packus_epi16(r[i], r[i + 1]);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i * stride), pixels);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + (i + 1) * stride),
+                       _mm_srli_si128(pixels, 8));
+    }
+  }
+
+  // 32-bit lanes, the scalar algorithm on 8 columns at a time. `kCorner`
+  // is for blocks with coefficients in the top-left 4x4 only, the known
+  // zeros are folded away.
+  template <bool kCorner = false>
+  SJPG_TARGET_AVX2 static void islowAVX2(const int16_t *coef,
+                                         const DequantTable &table,
+                                         uint8_t *out, size_t stride) {
+    __m256i r[8];
+    for (int i = 0; i < 8; ++i) {
+      if (kCorner && i >= 4) {
+        r[i] = _mm256_setzero_si256();
+        continue;
+      }
+      auto c = _mm256_cvtepi16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(coef + i * 8)));
+      auto q = _mm256_cvtepi16_epi32(_mm_load_si128(
+          reinterpret_cast<const __m128i *>(table.islow.data() + i * 8)));
+      r[i] = _mm256_mullo_epi32(c, q);
+    }
+
+    constexpr int kConstBits = IDCT::kIslowConstBits;
+    constexpr int kPass1Bits = IDCT::kIslowPass1Bits;
+
+    islowPassAVX2(r, _mm256_set1_epi32(1 << (kConstBits - kPass1Bits - 1)),
+                  kConstBits - kPass1Bits);
+    transpose8x32AVX2(r);
+    if (kCorner) {
+      // the columns 4 ~ 7 were 0 and still are
+      for (int i = 4; i < 8; ++i) {
+        r[i] = _mm256_setzero_si256();
+      }
+    }
+
+    constexpr int kShift = kConstBits + kPass1Bits + 3;
+    islowPassAVX2(r,
+                  _mm256_set1_epi32((1 << (kShift - 1)) + (128 << kShift)),
+                  kShift);
+    transpose8x32AVX2(r);
+
+    for (int i = 0; i < 8; i += 2) {
+      // lane order of packs is fixed by the permute: row i then row i+1
+      auto words = _mm256_permute4x64_epi64(_mm256_packs_epi32(r[i], r[i + 1]),
+                                            0xD8);
+      auto pixels = _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                     _mm256_extracti128_si256(words, 1));
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i * stride), pixels);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + (i + 1) * stride),
+                       _mm_srli_si128(pixels, 8));
+    }
+  }
+
+private:
+  // the FDCT kernels share the transposes and constant helpers
+  friend class FDCTKernels;
+
+  // one 1-D pass over r[0..7] (input k of every lane is r[k]), `bias` is
+  // added before the final right shift
+  SJPG_TARGET_SSE2 static void islowPassSSE2(__m128i r[8], __m128i bias,
+                                             int shift) {
+    // even part
+    constexpr int32_t kFix_0_541 = IDCT::kFix_0_541196100;
+    constexpr int32_t kFix_0_765 = IDCT::kFix_0_765366865;
+    constexpr int32_t kFix_1_847 = IDCT::kFix_1_847759065;
+    const auto k26_tmp2 = pair(kFix_0_541, kFix_0_541 - kFix_1_847);
+    const auto k26_tmp3 = pair(kFix_0_541 + kFix_0_765, kFix_0_541);
+    const auto k04_sum = pair(1 << IDCT::kIslowConstBits,
+                              1 << IDCT::kIslowConstBits);
+    const auto k04_diff = pair(1 << IDCT::kIslowConstBits,
+                               -(1 << IDCT::kIslowConstBits));
+
+    // odd part, inputs paired as (r7, r5) and (r3, r1)
+    constexpr int32_t kFix_0_298 = IDCT::kFix_0_298631336;
+    constexpr int32_t kFix_0_390 = IDCT::kFix_0_390180644;
+    constexpr int32_t kFix_0_899 = IDCT::kFix_0_899976223;
+    constexpr int32_t kFix_1_175 = IDCT::kFix_1_175875602;
+    constexpr int32_t kFix_1_501 = IDCT::kFix_1_501321110;
+    constexpr int32_t kFix_1_961 = IDCT::kFix_1_961570560;
+    constexpr int32_t kFix_2_053 = IDCT::kFix_2_053119869;
+    constexpr int32_t kFix_2_562 = IDCT::kFix_2_562915447;
+    constexpr int32_t kFix_3_072 = IDCT::kFix_3_072711026;
+    const auto k75_tmp0 =
+        pair(kFix_0_298 - kFix_0_899 - kFix_1_961 + kFix_1_175, kFix_1_175);
+    const auto k31_tmp0 =
+        pair(kFix_1_175 - kFix_1_961, kFix_1_175 - kFix_0_899);
+    const auto k75_tmp1 =
+        pair(kFix_1_175, kFix_2_053 - kFix_2_562 - kFix_0_390 + kFix_1_175);
+    const auto k31_tmp1 =
+        pair(kFix_1_175 - kFix_2_562, kFix_1_175 - kFix_0_390);
+    const auto k75_tmp2 =
+        pair(kFix_1_175 - kFix_1_961, kFix_1_175 - kFix_2_562);
+    const auto k31_tmp2 =
+        pair(kFix_3_072 - kFix_2_562 - kFix_1_961 + kFix_1_175, kFix_1_175);
+    const auto k75_tmp3 =
+        pair(kFix_1_175 - kFix_0_899, kFix_1_175 - kFix_0_390);
+    const auto k31_tmp3 =
+        pair(kFix_1_175, kFix_1_501 - kFix_0_899 - kFix_0_390 + kFix_1_175);
+
+    __m128i results[2][8];
+    for (int half = 0; half < 2; ++half) {
+      auto p04 = unpack16SSE2(half, r[0], r[4]);
+      auto p26 = unpack16SSE2(half, r[2], r[6]);
+      auto p75 = unpack16SSE2(half, r[7], r[5]);
+      auto p31 = unpack16SSE2(half, r[3], r[1]);
+
+      auto tmp0 = _mm_add_epi32(_mm_madd_epi16(p04, k04_sum), bias);
+      auto tmp1 = _mm_add_epi32(_mm_madd_epi16(p04, k04_diff), bias);
+      auto tmp2 = _mm_madd_epi16(p26, k26_tmp2);
+      auto tmp3 = _mm_madd_epi16(p26, k26_tmp3);
+
+      auto tmp10 = _mm_add_epi32(tmp0, tmp3);
+      auto tmp13 = _mm_sub_epi32(tmp0, tmp3);
+      auto tmp11 = _mm_add_epi32(tmp1, tmp2);
+      auto tmp12 = _mm_sub_epi32(tmp1, tmp2);
+
+      auto odd0 = _mm_add_epi32(_mm_madd_epi16(p75, k75_tmp0),
+                                _mm_madd_epi16(p31, k31_tmp0));
+      auto odd1 = _mm_add_epi32(_mm_madd_epi16(p75, k75_tmp1),
+                                _mm_madd_epi16(p31, k31_tmp1));
+      auto odd2 = _mm_add_epi32(_mm_madd_epi16(p75, k75_tmp2),
+                                _mm_madd_epi16(p31, k31_tmp2));
+      auto odd3 = _mm_add_epi32(_mm_madd_epi16(p75, k75_tmp3),
+                                _mm_madd_epi16(p31, k31_tmp3));
+
+      auto &o = results[half];
+      o[0] = _mm_sra_epi32(_mm_add_epi32(tmp10, odd3), _mm_cvtsi32_si128(shift));
+      o[7] = _mm_sra_epi32(_mm_sub_epi32(tmp10, odd3), _mm_cvtsi32_si128(shift));
+      o[1] = _mm_sra_epi32(_mm_add_epi32(tmp11, odd2), _mm_cvtsi32_si128(shift));
+      o[6] = _mm_sra_epi32(_mm_sub_epi32(tmp11, odd2), _mm_cvtsi32_si128(shift));
+      o[2] = _mm_sra_epi32(_mm_add_epi32(tmp12, odd1), _mm_cvtsi32_si128(shift));
+      o[5] = _mm_sra_epi32(_mm_sub_epi32(tmp12, odd1), _mm_cvtsi32_si128(shift));
+      o[3] = _mm_sra_epi32(_mm_add_epi32(tmp13, odd0), _mm_cvtsi32_si128(shift));
+      o[4] = _mm_sra_epi32(_mm_sub_epi32(tmp13, odd0), _mm_cvtsi32_si128(shift));
+    }
+    for (int i = 0; i < 8; ++i) {
+      r[i] = _mm_packs_epi32(results[0][i], results[1][i]);
+    }
+  }
+
+  SJPG_TARGET_SSE2 static __m128i unpack16SSE2(int half, __m128i a,
+                                               __m128i b) {
+    return half == 0 ? _mm_unpacklo_epi16(a, b) : _mm_unpackhi_epi16(a, b);
+  }
+
+  SJPG_TARGET_SSE2 static __m128i pair(int32_t a, int32_t b) {
+    return _mm_set1_epi32(static_cast<int32_t>(
+        (static_cast<uint32_t>(static_cast<uint16_t>(b)) << 16) |
+        static_cast<uint16_t>(a)));
+  }
+
+  SJPG_TARGET_SSE2 static void transpose8x16SSE2(__m128i r[8]) {
+    auto a0 = _mm_unpacklo_epi16(r[0], r[1]);
+    auto a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    auto a2 = _mm_unpacklo_epi16(r[2], r[3]);
+    auto a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    auto a4 = _mm_unpacklo_epi16(r[4], r[5]);
+    auto a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    auto a6 = _mm_unpacklo_epi16(r[6], r[7]);
+    auto a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+    auto b0 = _mm_unpacklo_epi32(a0, a2);
+    auto b1 = _mm_unpackhi_epi32(a0, a2);
+    auto b2 = _mm_unpacklo_epi32(a1, a3);
+    auto b3 = _mm_unpackhi_epi32(a1, a3);
+    auto b4 = _mm_unpacklo_epi32(a4, a6);
+    auto b5 = _mm_unpackhi_epi32(a4, a6);
+    auto b6 = _mm_unpacklo_epi32(a5, a7);
+    auto b7 = _mm_unpackhi_epi32(a5, a7);
+
+    r[0] = _mm_unpacklo_epi64(b0, b4);
+    r[1] = _mm_unpackhi_epi64(b0, b4);
+    r[2] = _mm_unpacklo_epi64(b1, b5);
+    r[3] = _mm_unpackhi_epi64(b1, b5);
+    r[4] = _mm_unpacklo_epi64(b2, b6);
+    r[5] = _mm_unpackhi_epi64(b2, b6);
+    r[6] = _mm_unpacklo_epi64(b3, b7);
+    r[7] = _mm_unpackhi_epi64(b3, b7);
+  }
+
+  SJPG_TARGET_AVX2 static void islowPassAVX2(__m256i r[8], __m256i bias,
+                                             int shift) {
+    auto shift_count = _mm_cvtsi32_si128(shift);
+
+    // even part
+    auto z2 = r[2];
+    auto z3 = r[6];
+    auto z1 = mul(_mm256_add_epi32(z2, z3), IDCT::kFix_0_541196100);
+    auto tmp2 = _mm256_add_epi32(z1, mul(z3, -IDCT::kFix_1_847759065));
+    auto tmp3 = _mm256_add_epi32(z1, mul(z2, IDCT::kFix_0_765366865));
+
+    auto tmp0 = _mm256_add_epi32(
+        _mm256_slli_epi32(_mm256_add_epi32(r[0], r[4]), IDCT::kIslowConstBits),
+        bias);
+    auto tmp1 = _mm256_add_epi32(
+        _mm256_slli_epi32(_mm256_sub_epi32(r[0], r[4]), IDCT::kIslowConstBits),
+        bias);
+
+    auto tmp10 = _mm256_add_epi32(tmp0, tmp3);
+    auto tmp13 = _mm256_sub_epi32(tmp0, tmp3);
+    auto tmp11 = _mm256_add_epi32(tmp1, tmp2);
+    auto tmp12 = _mm256_sub_epi32(tmp1, tmp2);
+
+    // odd part
+    tmp0 = r[7];
+    tmp1 = r[5];
+    tmp2 = r[3];
+    tmp3 = r[1];
+
+    z1 = _mm256_add_epi32(tmp0, tmp3);
+    z2 = _mm256_add_epi32(tmp1, tmp2);
+    z3 = _mm256_add_epi32(tmp0, tmp2);
+    auto z4 = _mm256_add_epi32(tmp1, tmp3);
+    auto z5 = mul(_mm256_add_epi32(z3, z4), IDCT::kFix_1_175875602);
+
+    tmp0 = mul(tmp0, IDCT::kFix_0_298631336);
+    tmp1 = mul(tmp1, IDCT::kFix_2_053119869);
+    tmp2 = mul(tmp2, IDCT::kFix_3_072711026);
+    tmp3 = mul(tmp3, IDCT::kFix_1_501321110);
+    z1 = mul(z1, -IDCT::kFix_0_899976223);
+    z2 = mul(z2, -IDCT::kFix_2_562915447);
+    z3 = _mm256_add_epi32(mul(z3, -IDCT::kFix_1_961570560), z5);
+    z4 = _mm256_add_epi32(mul(z4, -IDCT::kFix_0_390180644), z5);
+
+    tmp0 = _mm256_add_epi32(tmp0, _mm256_add_epi32(z1, z3));
+    tmp1 = _mm256_add_epi32(tmp1, _mm256_add_epi32(z2, z4));
+    tmp2 = _mm256_add_epi32(tmp2, _mm256_add_epi32(z2, z3));
+    tmp3 = _mm256_add_epi32(tmp3, _mm256_add_epi32(z1, z4));
+
+    r[0] = _mm256_sra_epi32(_mm256_add_epi32(tmp10, tmp3), shift_count);
+    r[7] = _mm256_sra_epi32(_mm256_sub_epi32(tmp10, tmp3), shift_count);
+    r[1] = _mm256_sra_epi32(_mm256_add_epi32(tmp11, tmp2), shift_count);
+    r[6] = _mm256_sra_epi32(_mm256_sub_epi32(tmp11, tmp2), shift_count);
+    r[2] = _mm256_sra_epi32(_mm256_add_epi32(tmp12, tmp1), shift_count);
+    r[5] = _mm256_sra_epi32(_mm256_sub_epi32(tmp12, tmp1), shift_count);
+    r[3] = _mm256_sra_epi32(_mm256_add_epi32(tmp13, tmp0), shift_count);
+    r[4] = _mm256_sra_epi32(_mm256_sub_epi32(tmp13, tmp0), shift_count);
+  }
+
+  SJPG_TARGET_AVX2 static __m256i mul(__m256i v, int32_t c) {
+    return _mm256_mullo_epi32(v, _mm256_set1_epi32(c));
+  }
+
+  SJPG_TARGET_AVX2 static void transpose8x32AVX2(__m256i r[8]) {
+    auto t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    auto t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    auto t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    auto t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    auto t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    auto t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    auto t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    auto t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+    auto u0 = _mm256_unpacklo_epi64(t0, t2);
+    auto u1 = _mm256_unpackhi_epi64(t0, t2);
+    auto u2 = _mm256_unpacklo_epi64(t1, t3);
+    auto u3 = _mm256_unpackhi_epi64(t1, t3);
+    auto u4 = _mm256_unpacklo_epi64(t4, t6);
+    auto u5 = _mm256_unpackhi_epi64(t4, t6);
+    auto u6 = _mm256_unpacklo_epi64(t5, t7);
+    auto u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+  }
+#endif
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_IDCT_SIMD_H
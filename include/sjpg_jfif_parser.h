@@ -4,13 +4,23 @@
 
 #ifndef SJPG_JFIF_PARSER_H
 #define SJPG_JFIF_PARSER_H
+#include "sjpg_mapped_file.h"
 #include "sjpg_markers.h"
+#include "sjpg_memory_reader.h"
 #include "sjpg_segments.h"
-#include "sjpg_stream_reader.h"
+#include <array>
+#include <cstring>
+#include <istream>
+#include <memory>
 #include <numeric>
+#include <string>
 
 
 namespace sjpg_codec {
+// Parses a JFIF file held in memory. Segments are reported as views into the
+// parsed data and the entropy-coded data is not copied, so the data passed to
+// parse(const uint8_t *, size_t) must outlive the parser. parse(std::istream&)
+// and parseFile() keep the data alive themselves.
 class JFIFParser {
 public:
   enum ParseResult {
@@ -20,52 +30,48 @@ public:
     NoSOIMark = -3
   };
 
+  // a scan and the state of the segments before it. Progressive images have
+  // several scans and may define new huffman tables between them.
+  struct Scan {
+    segments::SOSSegment header;
+    // the scan uses getDHTSegments()[0, dht_count), later ones override
+    // earlier ones with the same id
+    size_t dht_count{0};
+    uint16_t restart_interval{0}; // from the last DRI before the scan
+    ByteSpan encoded_data;        // a view into getData()
+    // the entropy-coded data between restart markers, without the markers
+    std::vector<ByteSpan> restart_intervals;
+  };
+
   int parse(std::istream &stream) {
+    releaseData();
     if (stream.fail()) {
-      soi_.reset();
+      clear();
       return StreamInvalid;
     }
-
-    if (stream.peek() == EOF) {
-      soi_.reset();
-      return StreamEmpty;
+    // one bulk read, the parser then works on memory
+    std::vector<uint8_t> data;
+    char buf[64 * 1024];
+    while (stream.read(buf, sizeof(buf)) || stream.gcount() > 0) {
+      data.insert(data.end(), buf, buf + stream.gcount());
     }
+    owned_data_ = std::move(data);
+    return parseData({owned_data_.data(), owned_data_.size()});
+  }
 
-    if (!hasSOIMark(stream)) {
-      soi_.reset();
-      return NoSOIMark;
+  // maps the file instead of reading it
+  int parseFile(const std::string &path) {
+    releaseData();
+    if (!mapped_file_.open(path)) {
+      clear();
+      return StreamInvalid;
     }
-    // 解析成功，创建 SOISegment，并设置 file_pos
-    soi_ = buildSOISegment(stream);
-
-    for (;;) {
-      if (stream.eof()) {
-        LOG_INFO("End of file reached\n");
-        break;
-      }
+    return parseData(mapped_file_.span());
+  }
 
-      auto b = StreamReader::readByte(stream);
-      if (b == JFIF_BYTE_FF) {
-        b = StreamReader::readByte(stream);
-        if (b == JFIF_APP0) {
-          parseAPP0Segment(stream);
-        } else if (b == JFIF_COM) {
-          parseCOMSegment(stream);
-        } else if (b == JFIF_DQT) {
-          parseDQTSegment(stream);
-        } else if (b == JFIF_SOF0) {
-          parseSOF0Segment(stream);
-        } else if (b == JFIF_DHT) {
-          parseDHTSegment(stream);
-        } else if (b == JFIF_SOS) {
-          parseSOSSegment(stream);
-          scanImageDataAndEOI(stream);
-        }
-      }
-    }
-    LOG_INFO("Image data scanned, size: %zu bytes\n",
-             encoded_data_.size());
-    return Success;
+  int parse(const uint8_t *data, size_t size) {
+    releaseData();
+    return parseData({data, size});
   }
 
   segments::SOISegment *getSOISegment()  { return soi_.get(); }
@@ -82,43 +88,159 @@ public:
     return dht_segments_;
   }
 
-  segments::SOSSegment *getSOSSegment()  { return sos_.get(); }
+  segments::DRISegment *getDRISegment()  { return dri_.get(); }
+  // the first scan
+  segments::SOSSegment *getSOSSegment() {
+    return scans_.empty() ? nullptr : &scans_.front().header;
+  }
   segments::EOISegment* getEOISegment()  {
     return eoi_.get();
   }
-  std::vector<uint8_t>& getEncodedData()  {
-    return encoded_data_;
+  // the entropy-coded data of the first scan, a view into getData()
+  const ByteSpan &getEncodedData() const {
+    static const ByteSpan empty;
+    return scans_.empty() ? empty : scans_.front().encoded_data;
+  }
+
+  // the entropy-coded data of the first scan between restart markers,
+  // without the markers. Holds the whole scan when it has no restart markers.
+  const std::vector<ByteSpan> &getRestartIntervals() const {
+    static const std::vector<ByteSpan> empty;
+    return scans_.empty() ? empty : scans_.front().restart_intervals;
+  }
+
+  // every scan in file order
+  const std::vector<Scan> &getScans() const { return scans_; }
+
+  // the data the segments and views refer to
+  const ByteSpan &getData() const { return data_; }
+
+  // every marker segment in file order
+  const std::vector<segments::SegmentView> &getSegments() const {
+    return segments_;
+  }
+
+  // the segment bytes after the marker, including the length field
+  ByteSpan getSegmentData(const segments::SegmentView &segment) const {
+    return data_.subspan(segment.offset, segment.length);
   }
 
 private:
-  static bool hasSOIMark(std::istream &stream) {
-    // 记录当前位置
-    unsigned char soi[2];
-    stream.read(reinterpret_cast<char *>(soi), 2);
-    bool result =
-        (stream.gcount() == 2 && soi[0] == JFIF_BYTE_FF && soi[1] == JFIF_SOI);
-    return result;
+  int parseData(ByteSpan data) {
+    clear();
+    data_ = data;
+    if (data_.data() == nullptr || data_.empty()) {
+      return StreamEmpty;
+    }
+
+    MemoryReader reader(data_);
+    if (!hasSOIMark(reader)) {
+      return NoSOIMark;
+    }
+    // 解析成功，创建 SOISegment，并设置 file_pos
+    soi_ = buildSOISegment(reader);
+
+    while (!reader.eof()) {
+      if (reader.readByte() != JFIF_BYTE_FF) {
+        continue;
+      }
+      auto b = reader.readByte();
+      while (b == JFIF_BYTE_FF) { // fill bytes
+        b = reader.readByte();
+      }
+      if (b == JFIF_BYTE_0 || b == JFIF_SOI || isRSTMarker(b)) {
+        continue;
+      }
+      if (b == JFIF_EOI) {
+        eoi_ = std::make_unique<segments::EOISegment>();
+        eoi_->file_pos = reader.tell();
+        segments_.push_back({b, reader.tell(), 0});
+        break;
+      }
+
+      // every other marker carries its length, unknown ones are skipped
+      segments::SegmentView segment{b, reader.tell(), 0};
+      segment.length = reader.read2BytesBigEndian();
+      segments_.push_back(segment);
+      reader.seek(segment.offset);
+
+      if (b == JFIF_APP0) {
+        parseAPP0Segment(reader);
+      } else if (b == JFIF_COM) {
+        parseCOMSegment(reader);
+      } else if (b == JFIF_DQT) {
+        parseDQTSegment(reader);
+      } else if (isSOFMarker(b)) {
+        parseSOFSegment(reader, b);
+      } else if (b == JFIF_DHT) {
+        parseDHTSegment(reader);
+      } else if (b == JFIF_DRI) {
+        parseDRISegment(reader);
+      } else if (b == JFIF_SOS) {
+        parseSOSSegment(reader);
+      }
+      reader.seek(segment.offset + segment.length);
+      if (b == JFIF_SOS) {
+        scanImageData(reader);
+      }
+    }
+    if (eoi_ == nullptr) {
+      LOG_INFO("End of file reached\n");
+    }
+    LOG_INFO("Image data scanned, %zu scans\n", scans_.size());
+    return Success;
+  }
+
+  void clear() {
+    soi_.reset();
+    app0_.reset();
+    com_.reset();
+    dqt_segments_.clear();
+    q_table_refs.fill(nullptr);
+    sof0_.reset();
+    dht_segments_.clear();
+    dri_.reset();
+    scans_.clear();
+    eoi_.reset();
+    segments_.clear();
+    data_ = {};
+  }
+
+  void releaseData() {
+    owned_data_.clear();
+    owned_data_.shrink_to_fit();
+    mapped_file_.close();
+  }
+
+  static bool isRSTMarker(uint8_t marker) {
+    return marker >= JFIF_RST0 && marker <= JFIF_RST7;
+  }
+
+  static bool hasSOIMark(MemoryReader &reader) {
+    auto b0 = reader.readByte();
+    auto b1 = reader.readByte();
+    return !reader.eof() && b0 == JFIF_BYTE_FF && b1 == JFIF_SOI;
   }
 
   static std::unique_ptr<segments::SOISegment>
-  buildSOISegment(std::istream &stream) {
+  buildSOISegment(MemoryReader &reader) {
     auto soi = std::make_unique<segments::SOISegment>();
-    soi->file_pos = static_cast<unsigned long>(stream.tellg());
+    soi->file_pos = reader.tell();
     return soi;
   }
 
-  void parseAPP0Segment(std::istream &stream) {
+  void parseAPP0Segment(MemoryReader &reader) {
     app0_ = std::make_unique<segments::APP0Segment>();
-    app0_->file_pos = stream.tellg();
-    app0_->length = StreamReader::read2BytesBigEndian(stream);
-    StreamReader::readTo(stream, app0_->identifier, 5);
-    app0_->major_version = StreamReader::readByte(stream);
-    app0_->minor_version = StreamReader::readByte(stream);
-    app0_->pixel_units = StreamReader::readByte(stream);
-    app0_->x_density = StreamReader::read2BytesBigEndian(stream);
-    app0_->y_density = StreamReader::read2BytesBigEndian(stream);
-    app0_->thumbnail_width = StreamReader::readByte(stream);
-    app0_->thumbnail_height = StreamReader::readByte(stream);
+    app0_->file_pos = reader.tell();
+    app0_->length = reader.read2BytesBigEndian();
+    reader.readTo(app0_->identifier, 5);
+    app0_->major_version = reader.readByte();
+    app0_->minor_version = reader.readByte();
+    app0_->pixel_units = reader.readByte();
+    app0_->x_density = reader.read2BytesBigEndian();
+    app0_->y_density = reader.read2BytesBigEndian();
+    app0_->thumbnail_width = reader.readByte();
+    app0_->thumbnail_height = reader.readByte();
 
     static constexpr int kRGBChannels = 3;
     static constexpr int kRGBBits = 8; // 每个RGB通道8位
@@ -130,42 +252,43 @@ private:
         kRGBBytesPerPixel * thumbnail_image_pixel_count;
     app0_->thumbnail_data.resize(thumbnail_data_length);
     if (thumbnail_data_length > 0) {
-      StreamReader::readTo(
-          stream, reinterpret_cast<char *>(app0_->thumbnail_data.data()),
-          thumbnail_data_length);
+      reader.readTo(app0_->thumbnail_data.data(), thumbnail_data_length);
     }
 
     app0_->print();
   }
 
-  void parseCOMSegment(std::istream &stream) {
+  void parseCOMSegment(MemoryReader &reader) {
     com_ = std::make_unique<segments::COMSegment>();
-    com_->file_pos = stream.tellg();
-    com_->length = StreamReader::read2BytesBigEndian(stream);
-    auto commentSize = com_->length - 2; // 减去长度字段的2个字节
-    com_->comment.resize(commentSize);   // 减去长度字段的2个字节
-    StreamReader::readTo(stream, reinterpret_cast<char *>(com_->comment.data()),
-                         commentSize);
+    com_->file_pos = reader.tell();
+    com_->length = reader.read2BytesBigEndian();
+    auto commentSize = com_->length >= 2 ? com_->length - 2 : 0; // 减去长度字段的2个字节
+    com_->comment.resize(commentSize);
+    reader.readTo(com_->comment.data(), commentSize);
 
     com_->print();
   }
 
-  void parseDQTSegment(std::istream &stream) {
-    // TODO: multiple table in a dqt segment
+  void parseDQTSegment(MemoryReader &reader) {
     segments::DQTSegment dqt;
-    dqt.file_pos = static_cast<unsigned long>(stream.tellg());
-    dqt.length = StreamReader::read2BytesBigEndian(stream);
-    auto tmp = StreamReader::readByte(stream);
-
-    segments::QuantizationTable table;
-    table.precision = tmp >> 4;
-    table.id = tmp & 0x0F;
-
-    constexpr static int kQuantizationTableSize = 64; // 8x8 matrix
-    table.data.resize(kQuantizationTableSize);
-    StreamReader::readTo(stream, reinterpret_cast<char *>(table.data.data()),
-                         kQuantizationTableSize);
-    dqt.tables.emplace_back(table);
+    dqt.file_pos = reader.tell();
+    dqt.length = reader.read2BytesBigEndian();
+    const auto segment_end = dqt.file_pos + dqt.length;
+
+    // a segment may define several tables
+    while (reader.tell() < segment_end && !reader.eof()) {
+      auto tmp = reader.readByte();
+
+      segments::QuantizationTable table;
+      table.precision = tmp >> 4;
+      table.id = tmp & 0x0F;
+      table.segment_pos = dqt.file_pos;
+
+      constexpr static int kQuantizationTableSize = 64; // 8x8 matrix
+      table.data.resize(kQuantizationTableSize);
+      reader.readTo(table.data.data(), kQuantizationTableSize);
+      dqt.tables.emplace_back(table);
+    }
     dqt.print();
 
     dqt_segments_.emplace_back(dqt);
@@ -177,19 +300,25 @@ private:
     }
   }
 
-  void parseSOF0Segment(std::istream &stream) {
+  // every SOFn is read, the decoder decides which ones it supports
+  void parseSOFSegment(MemoryReader &reader, uint8_t marker) {
+    if (sof0_ != nullptr) {
+      LOG_WARN("Ignoring a second frame header\n");
+      return;
+    }
     sof0_ = std::make_unique<segments::SOF0Segment>();
-    sof0_->file_pos = stream.tellg();
-    sof0_->length = StreamReader::read2BytesBigEndian(stream);
-    sof0_->bitPerSample = StreamReader::readByte(stream);
-    sof0_->height = StreamReader::read2BytesBigEndian(stream);
-    sof0_->width = StreamReader::read2BytesBigEndian(stream);
-    sof0_->num_components = StreamReader::readByte(stream);
+    sof0_->frame_marker = marker;
+    sof0_->file_pos = reader.tell();
+    sof0_->length = reader.read2BytesBigEndian();
+    sof0_->bitPerSample = reader.readByte();
+    sof0_->height = reader.read2BytesBigEndian();
+    sof0_->width = reader.read2BytesBigEndian();
+    sof0_->num_components = reader.readByte();
 
     for (int i = 0; i < sof0_->num_components; i++) {
-      auto b0 = StreamReader::readByte(stream);
-      auto b1 = StreamReader::readByte(stream);
-      auto b2 = StreamReader::readByte(stream);
+      auto b0 = reader.readByte();
+      auto b1 = reader.readByte();
+      auto b2 = reader.readByte();
 
       sof0_->component_id.push_back(b0);
       sof0_->sampling_factor.push_back(b1);
@@ -199,72 +328,111 @@ private:
     sof0_->print();
   }
 
-  void parseSOSSegment(std::istream &stream) {
-    sos_ = std::make_unique<segments::SOSSegment>();
-    sos_->file_pos = static_cast<unsigned long>(stream.tellg());
-    sos_->length = StreamReader::read2BytesBigEndian(stream);
-    sos_->num_components = StreamReader::readByte(stream);
+  void parseDRISegment(MemoryReader &reader) {
+    dri_ = std::make_unique<segments::DRISegment>();
+    dri_->file_pos = reader.tell();
+    dri_->length = reader.read2BytesBigEndian();
+    dri_->restart_interval = reader.read2BytesBigEndian();
+
+    dri_->print();
+  }
 
-    for (int i = 0; i < sos_->num_components; i++) {
-      auto b0 = StreamReader::readByte(stream);
-      auto b1 = StreamReader::readByte(stream);
-      sos_->component_id.push_back(b0);
+  void parseSOSSegment(MemoryReader &reader) {
+    auto &scan = scans_.emplace_back();
+    scan.dht_count = dht_segments_.size();
+    scan.restart_interval = dri_ != nullptr ? dri_->restart_interval : 0;
+    auto *sos = &scan.header;
+    sos->file_pos = reader.tell();
+    sos->length = reader.read2BytesBigEndian();
+    sos->num_components = reader.readByte();
+
+    for (int i = 0; i < sos->num_components; i++) {
+      auto b0 = reader.readByte();
+      auto b1 = reader.readByte();
+      sos->component_id.push_back(b0);
 
       auto huffman_table_id_dc = b1 >> 4;
       auto huffman_table_id_ac = b1 & 0x0F;
-      sos_->huffman_table_id_ac.push_back(huffman_table_id_ac);
-      sos_->huffman_table_id_dc.push_back(huffman_table_id_dc);
+      sos->huffman_table_id_ac.push_back(huffman_table_id_ac);
+      sos->huffman_table_id_dc.push_back(huffman_table_id_dc);
     }
 
-    // skip 3 bytes
-    for (int j = 0; j < 3; j++) {
-      StreamReader::readByte(stream);
-    }
-    sos_->print();
+    sos->spectral_start = reader.readByte();
+    sos->spectral_end = reader.readByte();
+    auto approx = reader.readByte();
+    sos->approx_high = approx >> 4;
+    sos->approx_low = approx & 0x0F;
+    sos->print();
   }
 
-  void scanImageDataAndEOI(std::istream &stream) {
+  // entropy-coded data is kept as is, byte stuffing(0xFF00) is removed by
+  // BitStream while decoding. The data runs up to the first marker that is
+  // not a restart marker, the reader is left on that marker. The restart
+  // markers are located in the same pass.
+  void scanImageData(MemoryReader &reader) {
+    const auto start = reader.tell();
+    const auto *begin = data_.data();
+    auto pos = start;
+    auto interval_start = start;
+    auto &scan = scans_.back();
     for (;;) {
-      auto b = StreamReader::readByte(stream);
-      if (b == JFIF_BYTE_FF) {
-        auto next_b = StreamReader::readByte(stream);
-        if (next_b == JFIF_EOI) {
-          // build eoi segment
-          eoi_ = std::make_unique<segments::EOISegment>();
-          eoi_->file_pos = static_cast<unsigned long>(stream.tellg());
-          return;
-        }else {
-          // it is encoded data
-          encoded_data_.push_back(b);
-        }
-      }else {
-        encoded_data_.push_back(b);
+      const auto *ff = static_cast<const uint8_t *>(
+          std::memchr(begin + pos, JFIF_BYTE_FF, data_.size() - pos));
+      if (ff == nullptr || ff + 1 >= begin + data_.size()) {
+        pos = data_.size();
+        break;
+      }
+      pos = ff - begin;
+      auto next_b = ff[1];
+      if (next_b == JFIF_BYTE_0) {
+        pos += 2;
+        continue;
       }
+      if (isRSTMarker(next_b)) {
+        scan.restart_intervals.push_back(
+            data_.subspan(interval_start, pos - interval_start));
+        pos += 2;
+        interval_start = pos;
+        continue;
+      }
+      if (next_b == JFIF_BYTE_FF) { // fill byte before a marker
+        pos += 1;
+        continue;
+      }
+      break;
     }
+    scan.restart_intervals.push_back(
+        data_.subspan(interval_start, pos - interval_start));
+    scan.encoded_data = data_.subspan(start, pos - start);
+    reader.seek(pos);
   }
 
-  void parseDHTSegment(std::istream &stream) {
-    auto dht = segments::DHTSegment();
-    dht.file_pos = static_cast<unsigned long>(stream.tellg());
-    dht.length = StreamReader::read2BytesBigEndian(stream);
-    auto b = StreamReader::readByte(stream);
-    dht.dc_or_ac = b >> 4;
-    dht.table_id = b & 0x0F;
-
-    static constexpr int kHuffmanTableSize = 16;
-    dht.symbol_counts.resize(kHuffmanTableSize);
-    StreamReader::readTo(stream,
-                         reinterpret_cast<char *>(dht.symbol_counts.data()),
-                         kHuffmanTableSize);
-
-    auto num_total_symbols =
-        std::accumulate(dht.symbol_counts.begin(), dht.symbol_counts.end(), 0);
-    dht.symbols.resize(num_total_symbols);
-    StreamReader::readTo(stream, reinterpret_cast<char *>(dht.symbols.data()),
-                         num_total_symbols);
-    dht.print();
-
-    dht_segments_.emplace_back(dht);
+  void parseDHTSegment(MemoryReader &reader) {
+    const auto file_pos = reader.tell();
+    const auto length = reader.read2BytesBigEndian();
+    const auto segment_end = file_pos + length;
+
+    // a segment may define several tables
+    while (reader.tell() < segment_end && !reader.eof()) {
+      auto dht = segments::DHTSegment();
+      dht.file_pos = file_pos;
+      dht.length = length;
+      auto b = reader.readByte();
+      dht.dc_or_ac = b >> 4;
+      dht.table_id = b & 0x0F;
+
+      static constexpr int kHuffmanTableSize = 16;
+      dht.symbol_counts.resize(kHuffmanTableSize);
+      reader.readTo(dht.symbol_counts.data(), kHuffmanTableSize);
+
+      auto num_total_symbols = std::accumulate(dht.symbol_counts.begin(),
+                                               dht.symbol_counts.end(), 0);
+      dht.symbols.resize(num_total_symbols);
+      reader.readTo(dht.symbols.data(), num_total_symbols);
+      dht.print();
+
+      dht_segments_.emplace_back(dht);
+    }
   }
 
   std::unique_ptr<segments::SOISegment> soi_;
@@ -275,9 +443,14 @@ private:
       nullptr}; // 快速访问引用
   std::unique_ptr<segments::SOF0Segment> sof0_;
   std::vector<segments::DHTSegment> dht_segments_;
-  std::unique_ptr<segments::SOSSegment> sos_;
-  std::vector<uint8_t> encoded_data_; // 存储编码后的数据
+  std::unique_ptr<segments::DRISegment> dri_;
+  std::vector<Scan> scans_;
   std::unique_ptr<segments::EOISegment> eoi_;
+  std::vector<segments::SegmentView> segments_;
+  ByteSpan data_;
+  // backing storage for parse(std::istream&) and parseFile()
+  std::vector<uint8_t> owned_data_;
+  MappedFile mapped_file_;
 };
 } // namespace sjpg_codec
 
@@ -5,92 +5,520 @@
 #ifndef SJPG_JPEG_DECODER_H
 #define SJPG_JPEG_DECODER_H
 
+#include "sjpg_aligned_allocator.h"
+#include "sjpg_color_convert.h"
 #include "sjpg_huffman_table.h"
+#include "sjpg_idct_simd.h"
 #include "sjpg_jfif_parser.h"
+#include "sjpg_scan_index.h"
+#include "sjpg_speculative_decoder.h"
+#include "sjpg_table_cache.h"
+#include "sjpg_thread_pool.h"
+#include "sjpg_upsample.h"
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <unordered_map>
 
 namespace sjpg_codec {
+// output size relative to the image, scale_num / scale_denom in libjpeg
+enum class DecodeScale {
+  Full = 1,
+  Half = 2,
+  Quarter = 4,
+  Eighth = 8,
+};
+
+// the quantized coefficients of one component, blocks of 64 coefficients in
+// natural order, the blocks in raster order over whole MCUs. `data` is
+// aligned to kCoefficientAlignment, and so is every block.
+struct CoefficientView {
+  constexpr static size_t kCoefficientAlignment = 64;
+
+  const int16_t *data{nullptr};
+  size_t blocks_per_line{0};
+  size_t block_rows{0};
+  size_t width_in_blocks{0}; // blocks inside the image
+  size_t height_in_blocks{0};
+  int h_factor{1};
+  int v_factor{1};
+  // the quantization table of the component in natural order, a
+  // coefficient times its entry is the dequantized value
+  const int16_t *quant_table{nullptr};
+
+  const int16_t *block(size_t x, size_t y) const {
+    return data + (y * blocks_per_line + x) * 64;
+  }
+};
+
+class PushDecoder;
+
+// The decoder is a reusable context: its planes, tables and scratch memory
+// are kept from one decode to the next, so decoding images of the same or a
+// smaller size does not allocate once the first one is done.
 class JPEGDecoder {
 public:
+  constexpr static int kMaxComponents = 3;
+  // DHT table ids per class, ITU-T.81 B.2.4.2
+  constexpr static int kMaxHuffmanTables = 4;
+  constexpr static size_t kDefaultSpeculativeChunkSize = 64 * 1024;
+  // feeds the decoder's internals with data as it arrives
+  friend class PushDecoder;
+
+  // receives `row_count` converted rows starting at image row `first_row`,
+  // rows are `stride` bytes apart. The rows are only valid during the call.
+  using RowSink = std::function<void(size_t first_row, size_t row_count,
+                                     const uint8_t *rows, size_t stride)>;
+
   int decode(JFIFParser& parser) {
-    if (!isSupported(parser)) {
+    speculative_stats_ = {};
+    if (!isSupported(parser) || !prepare(parser)) {
       return -1;
     }
+    if (progressive_) {
+      if (decodeProgressiveScans(parser) != 0) {
+        return -1;
+      }
+      reconstruct();
+      return 0;
+    }
 
-    prepare(parser);
+    // a sequential image is decoded scan by scan straight into the planes,
+    // each component is in one scan only
+    const auto *index = cropped_ ? matchingScanIndex(parser) : nullptr;
+    for (const auto &scan : parser.getScans()) {
+      if (!prepareScan(parser, scan)) {
+        return -1;
+      }
+      const auto layout = layoutScan(scan);
+      if (cropped_) {
+        decodeCrop(scan, layout, index);
+        continue;
+      }
+      if (speculative_ && thread_pool_ != nullptr &&
+          layout.interval_count == 1 && decodeSpeculatively(scan, layout)) {
+        LOG_INFO("%zu mcu decoded in chunks\n", layout.mcu_total);
+        continue;
+      }
+      if (isPipelined() && layout.interval_count == 1) {
+        decodePipelined(scan, layout);
+        LOG_INFO("%zu mcu decoded in a pipeline\n", layout.mcu_total);
+        continue;
+      }
+      auto decode_interval = [&](size_t i) {
+        auto first_mcu = i * layout.mcus_per_interval;
+        auto mcu_count =
+            std::min(layout.mcus_per_interval, layout.mcu_total - first_mcu);
+        auto bit_stream = buildBitStream(scan.restart_intervals[i]);
+        std::array<int16_t, kMaxComponents> pre_dc_values{};
+        decodeMCUs(bit_stream, pre_dc_values, first_mcu, mcu_count,
+                   layout.mcus_per_row);
+      };
+      forEachInterval(layout, decode_interval);
 
-    auto sof0 = parser.getSOF0Segment();
-    auto mcu_size = getMCUSize(parser);
-    auto h_block_size = mcu_size.first;
-    auto v_block_size = mcu_size.second;
-    if (h_block_size != 8 || v_block_size != 8) {
-      LOG_ERROR("JPEG decoder only supports MCU size of 8x8 pixels");
-      return -1; // Unsupported MCU size
+      LOG_INFO("%zu mcu decoded in %zu intervals",
+               std::min(layout.mcu_total,
+                        layout.interval_count * layout.mcus_per_interval),
+               layout.interval_count);
     }
+    return 0;
+  }
 
-    auto num_block_in_x_dir = sof0->width / h_block_size;
-    auto num_block_in_y_dir = sof0->height / v_block_size;
+  // decodes one MCU row at a time and hands the converted pixels to `sink`
+  // a band of rows at a time, so the first rows are out before the image is
+  // done. Only a window of three MCU rows per component is kept instead of
+  // the whole planes. A sequential image needs a single interleaved scan, a
+  // progressive one has all its scans decoded to coefficients first.
+  int decodeRows(JFIFParser &parser, PixelFormat format, const RowSink &sink) {
+    const bool pipelined = isPipelined();
+    const auto window = pipelined ? pipelineWindow() : kStreamingMCURows;
+    if (!isSupported(parser) || !prepare(parser, window)) {
+      return -1;
+    }
+    if (cropped_) {
+      LOG_ERROR("Row decoding doesn't crop\n");
+      return -1;
+    }
+    const auto &scans = parser.getScans();
+    if (progressive_) {
+      if (decodeProgressiveScans(parser) != 0) {
+        return -1;
+      }
+    } else if (scans.size() != 1 || !prepareScan(parser, scans[0]) ||
+               scan_component_count_ != component_count_) {
+      LOG_ERROR("Row decoding needs an interleaved scan\n");
+      return -1;
+    }
 
-    int16_t pre_dc_value_y = 0;
-    int16_t pre_dc_value_u = 0;
-    int16_t pre_dc_value_v = 0;
+    const auto layout = layoutScan(scans[0]);
+    auto bands =
+        prepareRowBands(format, pipelined ? pipelineBandSlots() : 1);
+    // the upsampler reads a chroma row beyond the band, so a band is
+    // converted once the MCU row below it is decoded
+    auto convert_band = [&](size_t mcu_row, size_t slot) {
+      convertBand(bands, mcu_row, slot);
+    };
+    auto emit_band = [&](size_t mcu_row, size_t slot) {
+      emitBand(bands, mcu_row, slot, sink);
+    };
 
-    auto mcu_count = 0;
+    EntropyState state;
+    if (pipelined) {
+      preparePipelineSlots(layout);
+      auto entropy = [&](size_t mcu_row, size_t slot) {
+        if (!progressive_) {
+          decodeMCURowToSlot(scans[0], layout, state, mcu_row, slot);
+        }
+      };
+      auto reconstruct = [&](size_t mcu_row, size_t slot) {
+        if (progressive_) {
+          reconstructMCURow(mcu_row);
+          return;
+        }
+        clearMCURow(mcu_row);
+        reconstructSlot(layout, mcu_row, slot);
+      };
+      runPipeline(mcus_y_, entropy, reconstruct, convert_band, emit_band);
+      return 0;
+    }
 
-    for (auto y = 0; y < num_block_in_y_dir; ++y) {
-      for (auto x = 0; x < num_block_in_x_dir; ++x) {
-        mcu_count++;
+    for (size_t mcu_row = 0; mcu_row < mcus_y_; ++mcu_row) {
+      if (progressive_) {
+        reconstructMCURow(mcu_row);
+      } else {
+        clearMCURow(mcu_row);
+        decodeMCURow(scans[0], layout, state, mcu_row,
+                     [&](BitStream &bit_stream,
+                         std::array<int16_t, kMaxComponents> &pre_dc_values,
+                         size_t first_mcu, size_t mcu_count) {
+                       decodeMCUs(bit_stream, pre_dc_values, first_mcu,
+                                  mcu_count, layout.mcus_per_row);
+                     });
+      }
+      if (mcu_row > 0) {
+        convert_band(mcu_row - 1, 0);
+        emit_band(mcu_row - 1, 0);
+      }
+    }
+    if (mcus_y_ > 0) {
+      convert_band(mcus_y_ - 1, 0);
+      emit_band(mcus_y_ - 1, 0);
+    }
+    return 0;
+  }
 
-        auto y_data = deHuffman(parser, 0, pre_dc_value_y);
-        auto u_data = deHuffman(parser, 1, pre_dc_value_u);
-        auto v_data = deHuffman(parser, 2, pre_dc_value_v);
+  // entropy decodes the image into its quantized coefficients and stops
+  // there, see getCoefficients(). Nothing is dequantized or transformed and
+  // no planes are allocated, so convertColor() has nothing to convert.
+  int decodeCoefficients(JFIFParser &parser) {
+    speculative_stats_ = {};
+    if (!isSupported(parser) || !prepare(parser, 0, Storage::Coefficients)) {
+      return -1;
+    }
+    if (progressive_) {
+      return decodeProgressiveScans(parser);
+    }
+    // the coefficients aren't cleared by prepare(), a block is written
+    // whole when decoded and interleaved scans decode every block. Other
+    // scans may leave some blocks out.
+    std::array<bool, kMaxComponents> decoded{};
+    for (const auto &scan : parser.getScans()) {
+      if (!prepareScan(parser, scan)) {
+        return -1;
+      }
+      const auto layout = layoutScan(scan);
+      const bool partial =
+          scan_component_count_ == 1 ||
+          layout.interval_count * layout.mcus_per_interval < layout.mcu_total;
+      for (int c = 0; c < scan_component_count_; ++c) {
+        const auto component = scan_components_[c].component;
+        if (partial && !decoded[component]) {
+          clearCoefficients(component);
+        }
+        decoded[component] = true;
+      }
+      forEachInterval(layout, [&](size_t i) {
+        auto first_mcu = i * layout.mcus_per_interval;
+        auto mcu_count =
+            std::min(layout.mcus_per_interval, layout.mcu_total - first_mcu);
+        auto bit_stream = buildBitStream(scan.restart_intervals[i]);
+        std::array<int16_t, kMaxComponents> pre_dc_values{};
+        forEachBlock(first_mcu, mcu_count, layout.mcus_per_row,
+                     [&](int c, size_t block_x, size_t block_y) {
+                       const auto &scan_component = scan_components_[c];
+                       deHuffman(bit_stream, scan_component, pre_dc_values[c],
+                                 blockCoefficients(scan_component.component,
+                                                   block_x, block_y));
+                     });
+      });
+    }
+    for (int i = 0; i < component_count_; ++i) {
+      if (!decoded[i]) {
+        clearCoefficients(i);
+      }
+    }
+    return 0;
+  }
 
-        // LOG_INFO("%d y[16]%d, u[16]%d, v[16]%d\n",mcu_count, y_data[16], u_data[16], v_data[16]);
+  // one pass over the scan of a sequential image with a single interleaved
+  // scan, the kind decodeRows() takes, recording where its entropy decoding
+  // can start over into `index`: every `checkpoint_mcus` MCUs and at every
+  // restart interval. Nothing is dequantized, transformed or stored.
+  int buildScanIndex(JFIFParser &parser, size_t checkpoint_mcus,
+                     ScanIndex &index) {
+    if (checkpoint_mcus == 0 || !isSupported(parser) ||
+        !prepare(parser, 0, Storage::None)) {
+      return -1;
+    }
+    const auto &scans = parser.getScans();
+    if (progressive_ || scans.size() != 1 || !prepareScan(parser, scans[0]) ||
+        scan_component_count_ != component_count_) {
+      LOG_ERROR("Scan index needs a single interleaved scan\n");
+      return -1;
+    }
+    const auto &scan = scans[0];
+    const auto layout = layoutScan(scan);
+    auto header = ScanIndex::headerOf(parser);
+    header.checkpoint_mcus = static_cast<uint32_t>(checkpoint_mcus);
+    index.reset(header);
+    for (size_t i = 0; i < layout.interval_count; ++i) {
+      const auto &interval = scan.restart_intervals[i];
+      const auto interval_offset =
+          static_cast<uint64_t>(interval.data() - scan.encoded_data.data()) * 8;
+      auto bit_stream = buildBitStream(interval);
+      std::array<int16_t, kMaxComponents> pre_dc_values{};
+      const auto first_mcu = i * layout.mcus_per_interval;
+      const auto end_mcu =
+          std::min(first_mcu + layout.mcus_per_interval, layout.mcu_total);
+      for (auto mcu = first_mcu; mcu < end_mcu; ++mcu) {
+        if (mcu == first_mcu || mcu % checkpoint_mcus == 0) {
+          index.add({mcu, interval_offset + bit_stream.getDataBitOffset(),
+                     pre_dc_values});
+        }
+        forEachBlock(mcu, 1, layout.mcus_per_row,
+                     [&](int c, size_t, size_t) {
+                       skipBlock(bit_stream, scan_components_[c],
+                                 pre_dc_values[c]);
+                     });
+      }
+    }
+    return 0;
+  }
 
+  // the coefficients of a component after decodeCoefficients(), or of a
+  // progressive image after decode(). Empty for a component the image
+  // doesn't have.
+  CoefficientView getCoefficients(int component) const {
+    if (component >= component_count_) {
+      return {};
+    }
+    const auto &info = components_[component];
+    return {coefficients_[component].data(),
+            mcus_x_ * info.h_factor,
+            mcus_y_ * info.v_factor,
+            info.blocks_per_line,
+            info.blocks_per_column,
+            info.h_factor,
+            info.v_factor,
+            dequant_tables_[component] != nullptr
+                ? dequant_tables_[component]->islow.data()
+                : nullptr};
+  }
 
-        auto zig_zag_y = deZigZag(y_data);
-        auto zig_zag_u = deZigZag(u_data);
-        auto zig_zag_v = deZigZag(v_data);
+  // 1 for a grayscale image, 3 for YCbCr, once decoded
+  int getComponentCount() const { return component_count_; }
 
-        // LOG_INFO("%d zy[0]%d, zu[0]%d, zv[0]%d\n",mcu_count, zig_zag_y[0], zig_zag_u[0], zig_zag_v[0]);
+  // forgets the decoded image but keeps the memory holding it for the next
+  // decode. The settings(scale, IDCT method...) are kept as well.
+  void reset() {
+    width_ = 0;
+    height_ = 0;
+    mcus_x_ = 0;
+    mcus_y_ = 0;
+    region_ = {};
+    crop_x_ = 0;
+    crop_y_ = 0;
+    cropped_ = false;
+    plane_mcu_rows_ = 0;
+    components_.fill({});
+    for (auto &plane : planes_) {
+      plane.clear();
+    }
+    scan_component_count_ = 0;
+    progressive_ = false;
+    for (auto &coefficients : coefficients_) {
+      coefficients.clear();
+    }
+    huffman_tables_.fill(nullptr);
+    built_dht_count_ = 0;
+    q_table_refs_.fill(nullptr);
+  }
 
-        auto idct_y = idct(zig_zag_y);
-        auto idct_u = idct(zig_zag_u);
-        auto idct_v = idct(zig_zag_v);
+  // restart intervals are spread over `pool`, nullptr decodes on the calling
+  // thread. The pool is not owned and must outlive the decodes using it.
+  void setThreadPool(ThreadPool *pool) { thread_pool_ = pool; }
+  ThreadPool *getThreadPool() const { return thread_pool_; }
 
-        // LOG_INFO("%d iy[0]%lf, iu[0]%lf, iv[0]%lf\n",mcu_count, idct_y[0], idct_u[0], idct_v[0]);
+  // lets decode() spread a scan without restart markers over the thread
+  // pool too, in chunks of at least `min_chunk_size` bytes decoded from
+  // guessed positions, see SpeculativeScanDecoder. The image is the same as
+  // decoded sequentially, which is what happens when the chunks don't line
+  // up. Off by default as the guesses cost extra work.
+  void setSpeculativeDecoding(
+      bool enabled, size_t min_chunk_size = kDefaultSpeculativeChunkSize) {
+    speculative_ = enabled;
+    speculative_chunk_size_ = std::max<size_t>(min_chunk_size, 1);
+  }
+  bool getSpeculativeDecoding() const { return speculative_; }
 
-        levelShift(idct_y);
-        levelShift(idct_u);
-        levelShift(idct_v);
+  // of the last decode()
+  const SpeculativeDecodeStats &getSpeculativeStats() const {
+    return speculative_stats_;
+  }
 
-        // fill mcu to decoded data
-        auto left_top_x = x * 8;
-        auto left_top_y = y * 8;
-        for (int j = 0; j < kMCUPixelSize; j++) {
-          auto img_pos_x = left_top_x + j % 8;
-          auto img_pos_y = left_top_y + j / 8;
-          auto img_index = img_pos_y * sof0->width + img_pos_x;
-          y_decoded_data_[img_index] = static_cast<uint8_t>(idct_y[j]);
-          u_decoded_data_[img_index] = static_cast<uint8_t>(idct_u[j]);
-          v_decoded_data_[img_index] = static_cast<uint8_t>(idct_v[j]);
-        }
+  // runs decode() and decodeRows() as a pipeline on the thread pool: the
+  // calling thread does the entropy decoding, the one serial stage, while
+  // the IDCT, upsampling and color conversion of the MCU rows decoded so far
+  // run on the pool. convertColor() converts bands of rows on the pool too.
+  // Images with restart markers still have decode() split them into
+  // intervals, which scales better.
+  void setPipelinedDecoding(bool enabled) { pipelined_ = enabled; }
+  bool getPipelinedDecoding() const { return pipelined_; }
+
+  // where the Huffman and dequantization tables come from, the process-wide
+  // TableCache::global() unless set. Not owned.
+  void setTableCache(TableCache *cache) { table_cache_ = cache; }
+  TableCache *getTableCache() const { return table_cache_; }
+
+  // writes the decoded image into `dst` as interleaved pixels, rows are
+  // `dst_stride` bytes apart. Subsampled chroma is upsampled on the fly. A
+  // grayscale image is copied as is, or to every color channel.
+  // Returns -1 if nothing was decoded by decode() or `dst_stride` is too
+  // small.
+  int convertColor(PixelFormat format, uint8_t *dst, size_t dst_stride) const {
+    const auto row_bytes = width_ * ColorConverter::getBytesPerPixel(format);
+    if (planes_[0].empty() || plane_mcu_rows_ < region_.height ||
+        dst_stride < row_bytes) {
+      return -1;
+    }
+    std::array<PlaneView, 3> planes;
+    std::array<int, 3> h_expand{};
+    std::array<int, 3> v_expand{};
+    for (int i = 0; i < component_count_; ++i) {
+      planes[i] = getPlane(i);
+      h_expand[i] = components_[i].h_expand;
+      v_expand[i] = components_[i].v_expand;
+    }
+    // like libjpeg, 1x1 blocks are too small to filter
+    auto mode = min_block_size_ > 1 ? upsample_mode_ : UpsampleMode::Fast;
+    // a grayscale image or Gray output needs the luma only
+    const bool gray = component_count_ == 1 || format == PixelFormat::Gray;
+    auto convert_rows = [&](size_t first_row, size_t row_count, uint8_t *out) {
+      if (gray) {
+        Upsampler::convertGrayRows(planes[0], h_expand[0], v_expand[0], mode,
+                                   width_, crop_y_ + first_row, row_count,
+                                   out, dst_stride, format, crop_x_);
+      } else {
+        Upsampler::convertRows(planes, h_expand, v_expand, mode, width_,
+                               crop_y_ + first_row, row_count, out,
+                               dst_stride, format, crop_x_);
       }
+    };
+    if (!isPipelined()) {
+      convert_rows(0, height_, dst);
+      return 0;
     }
-
-    LOG_INFO("%d mcu decoded", mcu_count);
+    // a few bands per thread, in whole MCU rows
+    const auto band_rows = static_cast<size_t>(mcu_rows_);
+    const auto bands_per_task =
+        std::max<size_t>(1, region_.height / (4 * (thread_pool_->size() + 1)));
+    const auto task_rows = band_rows * bands_per_task;
+    const auto task_count = (height_ + task_rows - 1) / task_rows;
+    thread_pool_->parallelFor(task_count, [&](size_t task) {
+      const auto first_row = task * task_rows;
+      convert_rows(first_row, std::min(task_rows, height_ - first_row),
+                   dst + first_row * dst_stride);
+    });
     return 0;
   }
 
+  // the output size, the image size divided by the scale and rounded up
+  size_t getWidth() const { return width_; }
+  size_t getHeight() const { return height_; }
+
+  // decodes with reduced size IDCTs(4x4, 2x2, 1x1) straight to a smaller
+  // image, the entropy decoding is the same
+  void setScale(DecodeScale scale) { scale_ = scale; }
+  DecodeScale getScale() const { return scale_; }
+
+  // decode() keeps only `width` x `height` pixels at `x`, `y` of the output
+  // image, scaled if setScale() is, and getWidth(), getHeight() and
+  // convertColor() give that crop. The planes hold the MCUs around it only.
+  // Blocks of the other MCUs are entropy decoded, which the DC predictions
+  // need, but neither dequantized nor transformed, restart intervals
+  // without a block of the crop are skipped and the decoding stops after its
+  // last MCU. A size of 0 extends to the edge. decodeRows() doesn't crop and
+  // decodeCoefficients() ignores it.
+  void setCrop(size_t x, size_t y, size_t width, size_t height) {
+    crop_ = {x, y, width, height};
+  }
+  void clearCrop() { crop_ = {}; }
+
+  // lets a cropped decode start the entropy decoding of each MCU row of the
+  // crop at the nearest checkpoint of `index`, instead of the start of the
+  // scan or of a restart interval, see buildScanIndex(). Not owned.
+  // `index` must be that of the image of `parser`, which is checked here
+  // once, scan hash included: false and no index if it isn't. The decodes
+  // only compare the image size and scan length with it.
+  bool setScanIndex(const ScanIndex *index, JFIFParser &parser) {
+    scan_index_ = nullptr;
+    if (index == nullptr || index->empty() ||
+        !(index->getHeader() == ScanIndex::headerOf(parser))) {
+      LOG_WARN("The scan index is not of this image, it is ignored\n");
+      return false;
+    }
+    scan_index_ = index;
+    return true;
+  }
+  void clearScanIndex() { scan_index_ = nullptr; }
+  const ScanIndex *getScanIndex() const { return scan_index_; }
+
+  void setIDCTMethod(IDCTMethod method) { idct_method_ = method; }
+  IDCTMethod getIDCTMethod() const { return idct_method_; }
+
+  void setUpsampleMode(UpsampleMode mode) { upsample_mode_ = mode; }
+  UpsampleMode getUpsampleMode() const { return upsample_mode_; }
+
+  // stops a progressive decode after the first `count` scans and shows the
+  // image as refined so far, 0 decodes all of them. Sequential images are
+  // always decoded in full.
+  void setScanLimit(size_t count) { scan_limit_ = count; }
+  size_t getScanLimit() const { return scan_limit_; }
+
+  bool isProgressive() const { return progressive_; }
+
+  // the decoded samples of a component at its own resolution. Rows are
+  // padded to whole MCUs, so the stride can be larger than the width.
+  // After decodeRows() only the last MCU rows are left, see
+  // PlaneView::ring_rows. With a crop the plane starts at the first MCU
+  // kept, see setCrop().
+  PlaneView getPlane(int component) const {
+    const auto &info = components_[component];
+    return {planes_[component].data(), info.width, info.height, info.stride,
+            plane_mcu_rows_ < region_.height ? info.rows : 0};
+  }
+
   const std::vector<uint8_t>& getYDecodedData() const {
-    return y_decoded_data_;
+    return planes_[0];
   }
 
   const std::vector<uint8_t>& getUDecodedData() const {
-    return u_decoded_data_;
+    return planes_[1];
   }
 
   const std::vector<uint8_t>& getVDecodedData() const {
-    return v_decoded_data_;
+    return planes_[2];
   }
 
   // for testing
@@ -100,7 +528,7 @@ public:
     for (const auto& dht : dht_segments) {
       uint16_t key = (static_cast<uint16_t>(dht.dc_or_ac) << 8) | dht.table_id;
       auto table = HuffmanTable(dht.symbol_counts, dht.symbols);
-      huffman_table_indies.insert({key, table});
+      huffman_table_indies.insert_or_assign(key, table);
     }
     return huffman_table_indies;
   }
@@ -111,66 +539,772 @@ public:
     auto max_h = 0;
     auto max_v = 0;
 
-    for (auto factor : sof0->sampling_factor) {
-      auto h_sampling_factor = factor >> 4;
-      auto v_sampling_factor = factor & 0x0F;
-      max_h = std::max(max_h, h_sampling_factor);
-      max_v = std::max(max_v, v_sampling_factor);
+    for (auto i = 0; i < sof0->num_components; ++i) {
+      max_h = std::max(max_h, hFactor(*sof0, i));
+      max_v = std::max(max_v, vFactor(*sof0, i));
     }
 
     return {8 * max_h, 8 * max_v}; // MCU size in pixels
   }
 
+  // the sampling factors of a component. A single component is coded block
+  // by block whatever they say(ITU-T.81 A.2.1), so they are 1 then.
+  static int hFactor(const segments::SOF0Segment &sof0, int i) {
+    return sof0.num_components == 1 ? 1 : sof0.sampling_factor[i] >> 4;
+  }
+  static int vFactor(const segments::SOF0Segment &sof0, int i) {
+    return sof0.num_components == 1 ? 1 : sof0.sampling_factor[i] & 0x0F;
+  }
+
+  // the returned stream refers to `data`, it does not copy it
   static BitStream buildBitStream(const std::vector<uint8_t>& data) {
-    auto bit_stream = BitStream();
-    for (auto b : data) {
-      std::bitset<8> bits(b);
-      bit_stream.append(bits.to_string());
-    }
-    return bit_stream;
+    return BitStream(data.data(), data.size());
+  }
+
+  static BitStream buildBitStream(const ByteSpan& data) {
+    return BitStream(data.data(), data.size());
   }
 
 private:
+  struct Crop {
+    size_t x{0};
+    size_t y{0};
+    size_t width{0};
+    size_t height{0};
+  };
+
+  // a rectangle of MCUs
+  struct MCURegion {
+    size_t x{0};
+    size_t y{0};
+    size_t width{0};
+    size_t height{0};
+
+    bool contains(size_t mcu_x, size_t mcu_y) const {
+      return mcu_x >= x && mcu_x < x + width && mcu_y >= y &&
+             mcu_y < y + height;
+    }
+  };
+
+  // a frame component and its layout in planes_
+  struct Component {
+    int h_factor{1};
+    int v_factor{1};
+    size_t blocks_per_line{0}; // blocks inside the image
+    size_t blocks_per_column{0};
+    int block_size{8}; // IDCT output size
+    int h_expand{1};   // upsampling to the output size
+    int v_expand{1};
+    size_t width{0};  // samples inside the image
+    size_t height{0};
+    size_t stride{0}; // whole MCUs
+    size_t rows{0};
+    IDCTKernel idct{&IDCTKernels::islowScalar};
+    // cheaper kernels for blocks with few coefficients, see idct()
+    IDCTKernel idct_corner{&IDCTKernels::islowScalar};
+    IDCTKernel idct_dc{&IDCTKernels::islowScalar};
+  };
+
+  // a component of the current scan, in SOS order
+  struct ScanComponent {
+    int component{0}; // index into components_
+    const HuffmanTable *dc_table{nullptr};
+    const HuffmanTable *ac_table{nullptr};
+  };
+
   static bool isSupported(JFIFParser& parser) {
     auto* sof0 = parser.getSOF0Segment();
+    if (sof0 == nullptr || parser.getScans().empty()) {
+      LOG_ERROR("JPEG decoder needs a SOF and a SOS segment");
+      return false;
+    }
+    // baseline, extended and progressive huffman coded 8-bit frames
+    if ((sof0->frame_marker != JFIF_SOF0 && sof0->frame_marker != JFIF_SOF1 &&
+         sof0->frame_marker != JFIF_SOF2) ||
+        sof0->bitPerSample != 8) {
+      LOG_ERROR("Unsupported frame SOF%d with %d bits per sample\n",
+                sof0->frame_marker - JFIF_SOF0, sof0->bitPerSample);
+      return false;
+    }
+    if (sof0->num_components != 1 && sof0->num_components != kMaxComponents) {
+      LOG_ERROR("JPEG decoder supports grayscale and YCbCr images, not %d "
+                "components\n",
+                sof0->num_components);
+      return false;
+    }
+    auto mcu_size = getMCUSize(parser);
+    auto max_h = static_cast<int>(mcu_size.first / 8);
+    auto max_v = static_cast<int>(mcu_size.second / 8);
     for (auto i = 0; i < sof0->num_components; ++i) {
-      auto h_sampling_factor = sof0->sampling_factor[i] >> 4;
-      auto v_sampling_factor = sof0->sampling_factor[i] & 0x0F;
-      if (h_sampling_factor != 1 || v_sampling_factor != 1) {
-        LOG_ERROR("JPEG decoder only supports YUV 4:4:4 format");
+      auto h_sampling_factor = hFactor(*sof0, i);
+      auto v_sampling_factor = vFactor(*sof0, i);
+      // ITU-T.81 B.2.2 allows 1 ~ 4, the upsampler needs integral ratios
+      if (h_sampling_factor < 1 || h_sampling_factor > 4 ||
+          v_sampling_factor < 1 || v_sampling_factor > 4 ||
+          max_h % h_sampling_factor != 0 || max_v % v_sampling_factor != 0) {
+        LOG_ERROR("Unsupported sampling factor %d:%d\n", h_sampling_factor,
+                  v_sampling_factor);
         return false; // Unsupported sampling factor
       }
     }
+    for (const auto &scan : parser.getScans()) {
+      const auto &sos = scan.header;
+      if (sos.num_components < 1 ||
+          sos.num_components > sof0->num_components) {
+        LOG_ERROR("Invalid scan with %d components\n", sos.num_components);
+        return false;
+      }
+      for (auto i = 0; i < sos.num_components; ++i) {
+        if (findComponent(*sof0, sos.component_id[i]) < 0) {
+          LOG_ERROR("Scan component %d is not in the frame\n",
+                    sos.component_id[i]);
+          return false;
+        }
+      }
+    }
     return true;
   }
 
-  std::vector<int16_t> deHuffman(JFIFParser& parser, int component_id, int16_t &pre_dc_value) {
-    auto* sos = parser.getSOSSegment();
-    auto* sof0 = parser.getSOF0Segment();
+  static int findComponent(const segments::SOF0Segment &sof0, uint8_t id) {
+    for (int i = 0; i < sof0.num_components; ++i) {
+      if (sof0.component_id[i] == id) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // how the scan is split into MCUs and restart intervals
+  struct ScanLayout {
+    size_t mcus_per_row{0};
+    size_t mcu_total{0};
+    size_t mcus_per_interval{0};
+    size_t interval_count{0};
+  };
+
+  ScanLayout layoutScan(const JFIFParser::Scan &scan) const {
+    // an interleaved scan codes whole MCUs, a scan with one component codes
+    // its blocks one by one(ITU-T.81 A.2)
+    ScanLayout layout;
+    layout.mcus_per_row = mcus_x_;
+    layout.mcu_total = mcus_x_ * mcus_y_;
+    if (scan_component_count_ == 1) {
+      const auto &component = components_[scan_components_[0].component];
+      layout.mcus_per_row = component.blocks_per_line;
+      layout.mcu_total = layout.mcus_per_row * component.blocks_per_column;
+    }
+
+    // restart intervals are decoded independently of each other, the DC
+    // predictors start from 0 in every interval
+    layout.mcus_per_interval = layout.mcu_total;
+    if (scan.restart_interval > 0) {
+      layout.mcus_per_interval = scan.restart_interval;
+    }
+    const auto &intervals = scan.restart_intervals;
+    layout.interval_count =
+        (layout.mcu_total + layout.mcus_per_interval - 1) /
+        layout.mcus_per_interval;
+    if (intervals.size() < layout.interval_count) {
+      LOG_WARN("Found %zu of %zu restart intervals\n", intervals.size(),
+               layout.interval_count);
+      layout.interval_count = intervals.size();
+    }
+    return layout;
+  }
+
+  // restart intervals don't depend on each other and go to the thread pool
+  template <typename F> void forEachInterval(const ScanLayout &layout, F &&f) {
+    forEachTask(layout.interval_count, f);
+  }
+
+  template <typename F> void forEachTask(size_t count, F &&f) {
+    if (thread_pool_ != nullptr && count > 1) {
+      thread_pool_->parallelFor(count, f);
+    } else {
+      for (size_t i = 0; i < count; ++i) {
+        f(i);
+      }
+    }
+  }
 
-    auto htable_ac_id = sos->huffman_table_id_ac[component_id];
-    auto htable_dc_id = sos->huffman_table_id_dc[component_id];
+  // calls `f(scan_component, block_x, block_y)` for the blocks of `count`
+  // MCUs from `first_mcu` on, in coding order. Block coordinates count the
+  // blocks of the component's whole MCUs.
+  template <typename F>
+  void forEachBlock(size_t first_mcu, size_t mcu_count, size_t mcus_per_row,
+                    F &&f) {
+    for (auto mcu = first_mcu; mcu < first_mcu + mcu_count; ++mcu) {
+      const auto mcu_x = mcu % mcus_per_row;
+      const auto mcu_y = mcu / mcus_per_row;
+      if (scan_component_count_ == 1) {
+        f(0, mcu_x, mcu_y);
+        continue;
+      }
+      for (int i = 0; i < scan_component_count_; ++i) {
+        const auto &component = components_[scan_components_[i].component];
+        // blocks of a component are in raster order inside the MCU
+        for (int v = 0; v < component.v_factor; ++v) {
+          for (int h = 0; h < component.h_factor; ++h) {
+            f(i, mcu_x * component.h_factor + h,
+              mcu_y * component.v_factor + v);
+          }
+        }
+      }
+    }
+  }
 
-    // get dc huffman table
-    auto dc_or_ac = 0;
-    const auto dc_table_key = (static_cast<uint16_t>(dc_or_ac) << 8) | htable_dc_id;
-    const auto& dc_htable = huffman_table_indies_.at(dc_table_key);
+  bool isPipelined() const { return pipelined_ && thread_pool_ != nullptr; }
 
-    // get ac huffman table
-    dc_or_ac = 1;
-    const auto ac_table_key = (static_cast<uint16_t>(dc_or_ac) << 8) | htable_ac_id;
-    const auto& ac_table = huffman_table_indies_.at(ac_table_key);
+  // MCU rows in flight between the entropy decoding and the IDCT, and
+  // converted bands waiting for the sink
+  size_t pipelineDepth() const {
+    return std::max<size_t>(2, thread_pool_->size() + 1);
+  }
+  size_t pipelineBandSlots() const { return pipelineDepth(); }
+  // the MCU rows the planes have to hold, see runPipeline()
+  size_t pipelineWindow() const {
+    return pipelineDepth() + pipelineBandSlots() + 1;
+  }
+
+  using PipelineStage = std::function<void(size_t index, size_t slot)>;
+
+  // Runs a decode as a pipeline over the thread pool. `entropy` decodes MCU
+  // row r into coefficient slot r % pipelineDepth() on the calling thread,
+  // `reconstruct` then takes the row to the planes on the pool. Band b(the
+  // output rows of MCU row b) is converted by `convert` on the pool into band
+  // slot b % pipelineBandSlots() once the rows next to it are reconstructed,
+  // and handed to `emit` on the calling thread in band order. The stages
+  // share fixed rings of slots, a stage waits for the one behind it to free
+  // a slot, so at most pipelineWindow() MCU rows of the planes are in use.
+  // `convert` and `emit` may be empty.
+  void runPipeline(size_t rows, const PipelineStage &entropy,
+                   const PipelineStage &reconstruct,
+                   const PipelineStage &convert, const PipelineStage &emit) {
+    const auto depth = pipelineDepth();
+    const auto band_slots = pipelineBandSlots();
+    std::vector<std::future<void>> reconstructed(depth);
+    std::vector<std::future<void>> converted(band_slots);
+    size_t reconstructed_rows = 0;
+    auto wait_reconstructed = [&](size_t row) {
+      for (; reconstructed_rows <= row; ++reconstructed_rows) {
+        reconstructed[reconstructed_rows % depth].get();
+      }
+    };
 
-    // get quantization table
-    const auto qtable_id = sof0->quantization_table_id[component_id];
-    const auto* qtable = q_table_refs_[qtable_id];
+    try {
+      for (size_t step = 0; step < rows + depth + band_slots - 1; ++step) {
+        if (step < rows) {
+          const auto slot = step % depth;
+          if (step >= depth) {
+            wait_reconstructed(step - depth);
+          }
+          entropy(step, slot);
+          reconstructed[slot] = thread_pool_->submit(
+              [&reconstruct, step, slot] { reconstruct(step, slot); });
+        }
+        if (step >= depth && step - depth < rows) {
+          const auto band = step - depth;
+          wait_reconstructed(std::min(band + 1, rows - 1));
+          if (convert) {
+            const auto slot = band % band_slots;
+            converted[slot] = thread_pool_->submit(
+                [&convert, band, slot] { convert(band, slot); });
+          }
+        }
+        const auto lag = depth + band_slots - 1;
+        if (convert && step >= lag && step - lag < rows) {
+          const auto band = step - lag;
+          converted[band % band_slots].get();
+          emit(band, band % band_slots);
+        }
+      }
+    } catch (...) {
+      // the tasks use the stages and the planes, let them finish first
+      for (auto &future : reconstructed) {
+        if (future.valid()) {
+          future.wait();
+        }
+      }
+      for (auto &future : converted) {
+        if (future.valid()) {
+          future.wait();
+        }
+      }
+      throw;
+    }
+  }
+
+  // turns MCU rows of the planes into bands of converted rows, for
+  // decodeRows() and PushDecoder
+  struct RowBands {
+    PixelFormat format{PixelFormat::RGB};
+    ColorConverter::RowKernel kernel{nullptr}; // none for grayscale rows
+    ColorConverter::GrayRowKernel gray_kernel{nullptr};
+    int components{kMaxComponents};
+    // upsamplers keep a row of their own, one set per band slot
+    std::vector<Upsampler> upsamplers;
+    size_t band_rows{0};
+    size_t row_stride{0};
+    size_t band_bytes{0};
+  };
+
+  RowBands prepareRowBands(PixelFormat format, size_t band_slots) {
+    RowBands bands;
+    bands.format = format;
+    bands.band_rows = static_cast<size_t>(mcu_rows_);
+    bands.row_stride = width_ * ColorConverter::getBytesPerPixel(format);
+    bands.band_bytes = bands.row_stride * bands.band_rows;
+    band_.resize(bands.band_bytes * band_slots);
+
+    // like libjpeg, 1x1 blocks are too small to filter
+    auto mode = min_block_size_ > 1 ? upsample_mode_ : UpsampleMode::Fast;
+    const auto level = CPUFeatures::getSIMDLevel();
+    const bool gray = component_count_ == 1 || format == PixelFormat::Gray;
+    bands.kernel = gray ? nullptr : ColorConverter::select(level);
+    bands.gray_kernel = ColorConverter::selectGray(level);
+    bands.components = gray ? 1 : kMaxComponents;
+    bands.upsamplers.reserve(band_slots * bands.components);
+    for (size_t slot = 0; slot < band_slots; ++slot) {
+      for (int i = 0; i < bands.components; ++i) {
+        bands.upsamplers.emplace_back(getPlane(i), components_[i].h_expand,
+                                      components_[i].v_expand, mode, width_,
+                                      level);
+      }
+    }
+    return bands;
+  }
+
+  void convertBand(RowBands &bands, size_t mcu_row, size_t slot) {
+    auto *band = band_.data() + slot * bands.band_bytes;
+    auto *upsampler = &bands.upsamplers[slot * bands.components];
+    const auto first_row = mcu_row * bands.band_rows;
+    const auto row_count = std::min(bands.band_rows, height_ - first_row);
+    for (size_t row = 0; row < row_count; ++row) {
+      const auto y = first_row + row;
+      auto *out = band + row * bands.row_stride;
+      if (bands.kernel == nullptr) {
+        bands.gray_kernel(upsampler[0].row(y), out, width_, bands.format);
+        continue;
+      }
+      bands.kernel(upsampler[0].row(y), upsampler[1].row(y),
+                   upsampler[2].row(y), out, width_, bands.format);
+    }
+  }
+
+  void emitBand(const RowBands &bands, size_t mcu_row, size_t slot,
+                const RowSink &sink) {
+    const auto first_row = mcu_row * bands.band_rows;
+    sink(first_row, std::min(bands.band_rows, height_ - first_row),
+         band_.data() + slot * bands.band_bytes, bands.row_stride);
+  }
+
+  // where the entropy decoding of a scan is, from one MCU row to the next
+  struct EntropyState {
+    BitStream bit_stream;
+    std::array<int16_t, kMaxComponents> pre_dc_values{};
+    size_t mcu{0};
+  };
+
+  // calls `decode(bit_stream, pre_dc_values, first_mcu, mcu_count)` for the
+  // MCUs of `mcu_row`, a new restart interval starts a new stream. Returns
+  // the MCUs decoded, those of missing intervals are left out.
+  template <typename F>
+  size_t decodeMCURow(const JFIFParser::Scan &scan, const ScanLayout &layout,
+                      EntropyState &state, size_t mcu_row, F &&decode) {
+    const auto row_end =
+        std::min((mcu_row + 1) * layout.mcus_per_row, layout.mcu_total);
+    size_t decoded = 0;
+    while (state.mcu < row_end) {
+      const auto interval = state.mcu / layout.mcus_per_interval;
+      if (interval >= layout.interval_count) {
+        state.mcu = layout.mcu_total; // missing data stays 0
+        break;
+      }
+      if (state.mcu % layout.mcus_per_interval == 0) {
+        state.bit_stream = buildBitStream(scan.restart_intervals[interval]);
+        state.pre_dc_values.fill(0);
+      }
+      const auto count =
+          std::min(row_end, (interval + 1) * layout.mcus_per_interval) -
+          state.mcu;
+      decode(state.bit_stream, state.pre_dc_values, state.mcu, count);
+      state.mcu += count;
+      decoded += count;
+    }
+    return decoded;
+  }
+
+  // sizes the coefficient slots of the pipeline for an MCU row of the scan
+  void preparePipelineSlots(const ScanLayout &layout) {
+    size_t blocks_per_mcu = 1;
+    if (scan_component_count_ > 1) {
+      blocks_per_mcu = 0;
+      for (int i = 0; i < scan_component_count_; ++i) {
+        const auto &component = components_[scan_components_[i].component];
+        blocks_per_mcu += component.h_factor * component.v_factor;
+      }
+    }
+    slot_blocks_ = layout.mcus_per_row * blocks_per_mcu;
+    const auto depth = pipelineDepth();
+    slot_coefficients_.resize(depth * slot_blocks_ * kMCUPixelSize);
+    slot_last_indexes_.resize(depth * slot_blocks_);
+    slot_mcus_.resize(depth);
+  }
+
+  void decodeMCURowToSlot(const JFIFParser::Scan &scan,
+                          const ScanLayout &layout, EntropyState &state,
+                          size_t mcu_row, size_t slot) {
+    const auto blocks_per_mcu = slot_blocks_ / layout.mcus_per_row;
+    auto *coefficients =
+        slot_coefficients_.data() + slot * slot_blocks_ * kMCUPixelSize;
+    auto *last_indexes = slot_last_indexes_.data() + slot * slot_blocks_;
+    slot_mcus_[slot] = decodeMCURow(
+        scan, layout, state, mcu_row,
+        [&](BitStream &bit_stream,
+            std::array<int16_t, kMaxComponents> &pre_dc_values,
+            size_t first_mcu, size_t mcu_count) {
+          auto block = first_mcu % layout.mcus_per_row * blocks_per_mcu;
+          forEachBlock(first_mcu, mcu_count, layout.mcus_per_row,
+                       [&](int i, size_t, size_t) {
+                         last_indexes[block] = static_cast<uint8_t>(deHuffman(
+                             bit_stream, scan_components_[i], pre_dc_values[i],
+                             coefficients + block * kMCUPixelSize));
+                         ++block;
+                       });
+        });
+  }
+
+  // the IDCT of the MCU row in `slot` into the planes
+  void reconstructSlot(const ScanLayout &layout, size_t mcu_row,
+                       size_t slot) {
+    const auto *coefficients =
+        slot_coefficients_.data() + slot * slot_blocks_ * kMCUPixelSize;
+    const auto *last_indexes = slot_last_indexes_.data() + slot * slot_blocks_;
+    size_t block = 0;
+    forEachBlock(mcu_row * layout.mcus_per_row, slot_mcus_[slot],
+                 layout.mcus_per_row,
+                 [&](int i, size_t block_x, size_t block_y) {
+                   const auto component = scan_components_[i].component;
+                   idct(coefficients + block * kMCUPixelSize,
+                        last_indexes[block], component,
+                        blockOutput(component, block_x, block_y),
+                        components_[component].stride);
+                   ++block;
+                 });
+  }
+
+  void decodePipelined(const JFIFParser::Scan &scan,
+                       const ScanLayout &layout) {
+    preparePipelineSlots(layout);
+    const auto rows =
+        (layout.mcu_total + layout.mcus_per_row - 1) / layout.mcus_per_row;
+    EntropyState state;
+    runPipeline(
+        rows,
+        [&](size_t mcu_row, size_t slot) {
+          decodeMCURowToSlot(scan, layout, state, mcu_row, slot);
+        },
+        [&](size_t mcu_row, size_t slot) {
+          reconstructSlot(layout, mcu_row, slot);
+        },
+        nullptr, nullptr);
+  }
+
+  // the blocks of an MCU in coding order
+  struct MCUBlock {
+    int scan_component{0};
+    int h{0};
+    int v{0};
+    int h_factor{1}; // 1 in a scan with one component
+    int v_factor{1};
+  };
+
+  // the scan's chunks are decoded to coefficients first, the IDCT waits
+  // until the DC predictors are known
+  bool decodeSpeculatively(const JFIFParser::Scan &scan,
+                           const ScanLayout &layout) {
+    const auto data = scan.restart_intervals[0];
+    const auto chunk_count = std::min(data.size() / speculative_chunk_size_,
+                                      thread_pool_->size() + 1);
+    if (chunk_count < 2) {
+      return false;
+    }
+
+    mcu_blocks_.clear();
+    if (scan_component_count_ == 1) {
+      mcu_blocks_.push_back({});
+    }
+    for (int i = 0; scan_component_count_ > 1 && i < scan_component_count_;
+         ++i) {
+      const auto &component = components_[scan_components_[i].component];
+      for (int v = 0; v < component.v_factor; ++v) {
+        for (int h = 0; h < component.h_factor; ++h) {
+          mcu_blocks_.push_back(
+              {i, h, v, component.h_factor, component.v_factor});
+        }
+      }
+    }
+    const auto block_count = static_cast<int>(mcu_blocks_.size());
+    auto &pattern = mcu_pattern_;
+    pattern.block_count = block_count;
+    pattern.dc_slots.resize(block_count);
+    pattern.same_tables.assign(block_count * block_count, 1);
+    for (int p = 0; p < block_count; ++p) {
+      pattern.dc_slots[p] =
+          static_cast<uint8_t>(mcu_blocks_[p].scan_component);
+      for (int q = 0; q < block_count; ++q) {
+        for (int i = 0; i < block_count; ++i) {
+          const auto &a = scan_components_
+              [mcu_blocks_[(p + i) % block_count].scan_component];
+          const auto &b = scan_components_
+              [mcu_blocks_[(q + i) % block_count].scan_component];
+          if (a.dc_table != b.dc_table || a.ac_table != b.ac_table) {
+            pattern.same_tables[p * block_count + q] = 0;
+          }
+        }
+      }
+    }
+
+    ++speculative_stats_.scans;
+    speculative_stats_.chunks += chunk_count;
+    auto decode_block = [this](BitStream &bit_stream, int phase,
+                               int16_t *coefficients) {
+      int16_t pre_dc_value = 0;
+      return deHuffman(bit_stream,
+                       scan_components_[mcu_blocks_[phase].scan_component],
+                       pre_dc_value, coefficients);
+    };
+    if (!speculative_decoder_.decode(data, chunk_count,
+                                     layout.mcu_total * mcu_blocks_.size(),
+                                     pattern, *thread_pool_, decode_block)) {
+      LOG_INFO("chunks didn't line up, decoding sequentially\n");
+      ++speculative_stats_.fallbacks;
+      return false;
+    }
+    speculative_stats_.discarded_bits +=
+        speculative_decoder_.getDiscardedBits();
+
+    speculative_decoder_.forEachBlock(
+        *thread_pool_,
+        [&](size_t index, const int16_t *coefficients, int last_index) {
+          const auto mcu = index / mcu_blocks_.size();
+          const auto &block = mcu_blocks_[index % mcu_blocks_.size()];
+          const auto component_index =
+              scan_components_[block.scan_component].component;
+          const auto block_x =
+              mcu % layout.mcus_per_row * block.h_factor + block.h;
+          const auto block_y =
+              mcu / layout.mcus_per_row * block.v_factor + block.v;
+          idct(coefficients, last_index, component_index,
+               blockOutput(component_index, block_x, block_y),
+               components_[component_index].stride);
+        });
+    return true;
+  }
+
+  // the planes' slot of an MCU row, they may hold only a window of the image
+  void clearMCURow(size_t mcu_row) {
+    for (int i = 0; i < component_count_; ++i) {
+      const auto &component = components_[i];
+      const auto mcu_bytes =
+          component.stride * component.v_factor * component.block_size;
+      std::fill_n(planes_[i].begin() + (mcu_row % plane_mcu_rows_) * mcu_bytes,
+                  mcu_bytes, 0);
+    }
+  }
+
+  // `count` MCUs from `first_mcu` on, the stream and predictors carry over
+  // to the next call
+  void decodeMCUs(BitStream &bit_stream,
+                  std::array<int16_t, kMaxComponents> &pre_dc_values,
+                  size_t first_mcu, size_t mcu_count, size_t mcus_per_row) {
+    forEachBlock(first_mcu, mcu_count, mcus_per_row,
+                 [&](int i, size_t block_x, size_t block_y) {
+                   const auto &scan = scan_components_[i];
+                   auto *out = blockOutput(scan.component, block_x, block_y);
+                   decodeBlock(bit_stream, scan, pre_dc_values[i], out,
+                               components_[scan.component].stride);
+                 });
+  }
+
+  // decode() of a scan with a crop, see setCrop(). The scan's region is in
+  // its own units, MCUs or the blocks of a single component. The decoding
+  // starts over at restart intervals, or at the checkpoints of an index.
+  void decodeCrop(const JFIFParser::Scan &scan, const ScanLayout &layout,
+                  const ScanIndex *index) {
+    size_t unit_width = 1;
+    size_t unit_height = 1;
+    if (scan_component_count_ == 1) {
+      const auto &component = components_[scan_components_[0].component];
+      unit_width = static_cast<size_t>(component.h_factor);
+      unit_height = static_cast<size_t>(component.v_factor);
+    }
+    const auto units_per_row = layout.mcus_per_row;
+    const auto first_x = region_.x * unit_width;
+    const auto end_x =
+        std::min((region_.x + region_.width) * unit_width, units_per_row);
+    const auto first_y = region_.y * unit_height;
+    const auto end_y = std::min((region_.y + region_.height) * unit_height,
+                                layout.mcu_total / units_per_row);
+    if (first_x >= end_x || first_y >= end_y) {
+      return;
+    }
+    // where decoding units first ~ end - 1 can stop, 0 if none of them is
+    // in the region
+    auto needed_end = [&](size_t first, size_t end) -> size_t {
+      if (first >= end) {
+        return 0;
+      }
+      const auto top = std::max(first / units_per_row, first_y);
+      for (auto row = std::min((end - 1) / units_per_row, end_y - 1) + 1;
+           row > top; --row) {
+        const auto row_start = (row - 1) * units_per_row;
+        const auto begin = std::max(first, row_start + first_x);
+        const auto row_end = std::min(end, row_start + end_x);
+        if (begin < row_end) {
+          return row_end;
+        }
+      }
+      return 0;
+    };
+    auto decode_units = [&](BitStream &bit_stream,
+                            std::array<int16_t, kMaxComponents> &pre_dc_values,
+                            size_t first, size_t end) {
+      forEachBlock(first, end - first, units_per_row,
+                   [&](int c, size_t block_x, size_t block_y) {
+                     const auto &scan_component = scan_components_[c];
+                     const auto &component =
+                         components_[scan_component.component];
+                     if (region_.contains(block_x / component.h_factor,
+                                          block_y / component.v_factor)) {
+                       decodeBlock(bit_stream, scan_component,
+                                   pre_dc_values[c],
+                                   blockOutput(scan_component.component,
+                                               block_x, block_y),
+                                   component.stride);
+                     } else {
+                       skipBlock(bit_stream, scan_component,
+                                 pre_dc_values[c]);
+                     }
+                   });
+    };
+
+    if (index == nullptr) {
+      // an interval without a unit of the region isn't decoded at all
+      forEachInterval(layout, [&](size_t i) {
+        const auto first_mcu = i * layout.mcus_per_interval;
+        const auto end_mcu = needed_end(
+            first_mcu,
+            std::min(first_mcu + layout.mcus_per_interval, layout.mcu_total));
+        if (end_mcu == 0) {
+          return;
+        }
+        auto bit_stream = buildBitStream(scan.restart_intervals[i]);
+        std::array<int16_t, kMaxComponents> pre_dc_values{};
+        decode_units(bit_stream, pre_dc_values, first_mcu, end_mcu);
+      });
+      return;
+    }
+
+    // the checkpoints from the nearest one before each row of the region
+    // to its end
+    crop_checkpoints_.clear();
+    const auto checkpoint_count = index->getCheckpointCount();
+    for (auto row = first_y; row < end_y; ++row) {
+      auto checkpoint = index->findCheckpoint(row * units_per_row + first_x);
+      if (!crop_checkpoints_.empty() && crop_checkpoints_.back() >= checkpoint) {
+        checkpoint = crop_checkpoints_.back() + 1;
+      }
+      for (; checkpoint < checkpoint_count &&
+             index->getCheckpoint(checkpoint).mcu < row * units_per_row + end_x;
+           ++checkpoint) {
+        crop_checkpoints_.push_back(checkpoint);
+      }
+    }
+    const auto &scan_data = scan.encoded_data;
+    forEachTask(crop_checkpoints_.size(), [&](size_t i) {
+      const auto checkpoint_index = crop_checkpoints_[i];
+      const auto checkpoint = index->getCheckpoint(checkpoint_index);
+      const auto next_mcu =
+          checkpoint_index + 1 < checkpoint_count
+              ? index->getCheckpoint(checkpoint_index + 1).mcu
+              : layout.mcu_total;
+      const auto end_mcu = needed_end(checkpoint.mcu, next_mcu);
+      if (end_mcu == 0) {
+        return;
+      }
+      const auto byte = std::min<uint64_t>(checkpoint.bit_offset / 8,
+                                           scan_data.size());
+      auto bit_stream =
+          BitStream(scan_data.data() + byte, scan_data.size() - byte);
+      bit_stream.getBits(static_cast<int>(checkpoint.bit_offset % 8));
+      auto pre_dc_values = checkpoint.dc_predictors;
+      decode_units(bit_stream, pre_dc_values, checkpoint.mcu, end_mcu);
+    });
+  }
+
+  // where the block's samples go in the planes, which may hold only a window
+  // of the MCU rows
+  uint8_t *blockOutput(int component_index, size_t block_x, size_t block_y) {
+    const auto &component = components_[component_index];
+    const auto size = static_cast<size_t>(component.block_size);
+    const auto block_rows = plane_mcu_rows_ * component.v_factor;
+    const auto x = block_x - region_.x * component.h_factor;
+    const auto y = block_y - region_.y * component.v_factor;
+    return planes_[component_index].data() +
+           (y % block_rows) * size * component.stride + x * size;
+  }
+
+  // the coefficients live on the stack, a block costs no allocation
+  void decodeBlock(BitStream &bit_stream, const ScanComponent &scan,
+                   int16_t &pre_dc_value, uint8_t *out, size_t stride) {
+    alignas(32) int16_t data[kMCUPixelSize];
+    const auto last_index = deHuffman(bit_stream, scan, pre_dc_value, data);
+    // dequant, idct and level shift, straight into the decoded data
+    idct(data, last_index, scan.component, out, stride);
+  }
+
+  // deHuffman() of a block that isn't kept, only the DC prediction is
+  // followed and nothing is written
+  void skipBlock(BitStream &bit_stream, const ScanComponent &scan,
+                 int16_t &pre_dc_value) {
+    const auto &ac_table = *scan.ac_table;
+    auto dc_category = scan.dc_table->getSymbol(bit_stream);
+    auto dc_value = decodeNumber(dc_category, bit_stream.getBits(dc_category));
+    dc_value += pre_dc_value;
+    pre_dc_value = dc_value;
+
+    for (auto index = 1; index < kMCUPixelSize;) {
+      const auto &fast_ac =
+          ac_table.getFastAC(bit_stream.peek(HuffmanTable::kLookupBits));
+      if (fast_ac.length != 0) {
+        bit_stream.consume(fast_ac.length);
+        index += fast_ac.run + 1;
+        continue;
+      }
+      auto rrrr_ssss = ac_table.getSymbol(bit_stream);
+      if (rrrr_ssss == 0) {
+        break; // EOB
+      }
+      bit_stream.getBits(rrrr_ssss & 0x0F);
+      index += (rrrr_ssss >> 4) + 1;
+    }
+  }
+
+  // `decoded_data` receives the 64 coefficients in natural order. Returns
+  // the zigzag index of the last nonzero AC coefficient, 0 if there is none.
+  int deHuffman(BitStream &bit_stream, const ScanComponent &scan,
+                int16_t &pre_dc_value, int16_t *decoded_data) {
+    const auto& dc_htable = *scan.dc_table;
+    const auto& ac_table = *scan.ac_table;
 
     // everything ready, let's decode the data
     // dc value always the first
-    std::vector<int16_t> decoded_data(kMCUPixelSize, 0);
+    std::fill(decoded_data, decoded_data + kMCUPixelSize, 0);
     auto index = 0;
-    auto dc_category = dc_htable.getSymbol(bit_stream_);
-    auto dc_value_bits = bit_stream_.getBitN(dc_category);
+    auto last_index = 0;
+    auto dc_category = dc_htable.getSymbol(bit_stream);
+    auto dc_value_bits = bit_stream.getBits(dc_category);
     auto dc_value = decodeNumber(dc_category, dc_value_bits);
     dc_value += pre_dc_value; // add previous DC value
     pre_dc_value = dc_value;
@@ -179,14 +1313,28 @@ private:
     // decode ac value
     // start from index 1, index 0 is dc value
     for (; index < kMCUPixelSize;) {
-      auto rrrr_ssss = ac_table.getSymbol(bit_stream_);
+      // short code and magnitude bits, decoded with one probe
+      const auto &fast_ac =
+          ac_table.getFastAC(bit_stream.peek(HuffmanTable::kLookupBits));
+      if (fast_ac.length != 0) {
+        bit_stream.consume(fast_ac.length);
+        index += fast_ac.run;
+        if (index >= kMCUPixelSize) {
+          break;
+        }
+        last_index = index;
+        decoded_data[kNaturalOrder[index++]] = fast_ac.value;
+        continue;
+      }
+
+      auto rrrr_ssss = ac_table.getSymbol(bit_stream);
       if (rrrr_ssss == 0) {
         // EOF, no more AC values
         break;
       }
       auto zero_count = rrrr_ssss >> 4; // rrrr is the number of zeros
       auto category = rrrr_ssss & 0x0F;
-      auto bits = bit_stream_.getBitN(category);
+      auto bits = bit_stream.getBits(category);
       auto non_zero_value = decodeNumber(category, bits);
 
       if (zero_count == 15 && category == 0) {
@@ -195,90 +1343,268 @@ private:
       }
 
       index += zero_count;
+      if (index >= kMCUPixelSize) {
+        break; // corrupt data, the run leaves the block
+      }
 
-      decoded_data[index++] = non_zero_value;
+      last_index = index;
+      decoded_data[kNaturalOrder[index++]] = non_zero_value;
     }
+    return last_index;
+  }
 
-    // dequant
-    for (int i = 0; i < kMCUPixelSize; ++i) {
-      decoded_data[i] *= qtable->data[i];
+  // most blocks of smooth areas and of chroma have a few low frequency
+  // coefficients or only DC, their IDCT skips what is known to be 0
+  void idct(const int16_t *data, int last_index, int component_id,
+            uint8_t *out, size_t stride) {
+    const auto &component = components_[component_id];
+    const auto &table = *dequant_tables_[component_id];
+    if (last_index == 0) {
+      component.idct_dc(data, table, out, stride);
+    } else if (last_index <= kCornerLastIndex) {
+      component.idct_corner(data, table, out, stride);
+    } else {
+      component.idct(data, table, out, stride);
     }
-
-    return decoded_data;
   }
 
-  std::vector<int16_t> deZigZag(const std::vector<int16_t> &data) {
-    constexpr static int zz_order[kMCUPixelSize] = {
-      0,  1,  5,  6,  14, 15, 27, 28, 2,  4,  7,  13, 16, 26, 29, 42,
-      3,  8,  12, 17, 25, 30, 41, 43, 9,  11, 18, 24, 31, 40, 44, 53,
-      10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
-      21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63};
-
-    std::vector<int16_t> zigzag_data(kMCUPixelSize, 0);
-    for (int i = 0; i < kMCUPixelSize; i++) {
-      zigzag_data[i] = data[zz_order[i]];
+  // zigzag index of the last nonzero coefficient of a block in natural order
+  static int lastNonZeroIndex(const int16_t *data) {
+    for (int k = kMCUPixelSize - 1; k > 0; --k) {
+      if (data[kNaturalOrder[k]] != 0) {
+        return k;
+      }
     }
-    return zigzag_data;
+    return 0;
   }
 
-  std::vector<float> idct(const std::vector<int16_t> &data) {
+  // what prepare() allocates
+  enum class Storage { Planes, Coefficients, None };
+
+  // sets up the frame, false if a quantization table isn't defined or the
+  // crop is outside the image. The planes hold `plane_mcu_rows` MCU rows of
+  // the crop, 0 for all of them. Storage::Coefficients allocates the
+  // coefficients of the whole image instead.
+  bool prepare(JFIFParser &parser, size_t plane_mcu_rows = 0,
+               Storage storage = Storage::Planes) {
+    huffman_tables_.fill(nullptr);
+    built_dht_count_ = 0;
+    q_table_refs_ = parser.getQTableRefs();
 
-    std::vector<float> result(kMCUPixelSize, 0.0f);
-    for (auto y = 0; y < 8; ++y) {
-      for (auto x = 0; x < 8; ++x) {
-        auto sum = 0.0f;
+    auto* sof0 = parser.getSOF0Segment();
+    progressive_ = sof0->isProgressive();
+    component_count_ = sof0->num_components;
+    for (auto i = 0; i < sof0->num_components; ++i) {
+      const auto* qtable = q_table_refs_[sof0->quantization_table_id[i] & 0x0F];
+      if (qtable == nullptr) {
+        LOG_ERROR("Quantization table %d is not defined\n",
+                  sof0->quantization_table_id[i]);
+        return false;
+      }
+      dequant_tables_[i] = table_cache_->getDequantTable(qtable->data);
+    }
 
-        for (auto u = 0; u < 8; ++u) {
-          for (auto v = 0; v < 8; ++v) {
-            float cu = (u == 0) ? 1.0f / std::sqrt(2.0f) : 1.0f;
-            float cv = (v == 0) ? 1.0f / std::sqrt(2.0f) : 1.0f;
-            float t0 = cu * std::cos((2 * x + 1) * u * M_PI / 16.0);
-            float t1 = cv * std::cos((2 * y + 1) * v * M_PI / 16.0);
+    const size_t image_width = sof0->width;
+    const size_t image_height = sof0->height;
+    auto mcu_size = getMCUSize(parser);
+    const auto max_h = static_cast<int>(mcu_size.first / 8);
+    const auto max_v = static_cast<int>(mcu_size.second / 8);
+    mcus_x_ = (image_width + mcu_size.first - 1) / mcu_size.first;
+    mcus_y_ = (image_height + mcu_size.second - 1) / mcu_size.second;
+    // rounded up like libjpeg's jdiv_round_up(image_width, scale_denom)
+    const auto denom = static_cast<size_t>(scale_);
+    min_block_size_ = static_cast<int>(8 / denom);
+    width_ = (image_width + denom - 1) / denom;
+    height_ = (image_height + denom - 1) / denom;
+    mcu_rows_ = max_v * min_block_size_;
+    if (!prepareCrop(max_h * min_block_size_, storage != Storage::Planes)) {
+      return false;
+    }
+    plane_mcu_rows_ = plane_mcu_rows == 0
+                          ? region_.height
+                          : std::min(plane_mcu_rows, region_.height);
 
-            // colum major
-            auto data_value = data[u * 8 + v];
+    const auto level = CPUFeatures::getSIMDLevel();
+    // component size per ITU-T.81 A.1.1, planes hold whole MCUs
+    for (auto i = 0; i < sof0->num_components; ++i) {
+      auto &component = components_[i];
+      const auto h = hFactor(*sof0, i);
+      const auto v = vFactor(*sof0, i);
+      component.h_factor = h;
+      component.v_factor = v;
+      component.blocks_per_line =
+          ((image_width * h + max_h - 1) / max_h + 7) / 8;
+      component.blocks_per_column =
+          ((image_height * v + max_v - 1) / max_v + 7) / 8;
 
-            sum += (data_value * t0 * t1);
-          }
-        }
+      // subsampled components get larger IDCTs instead of upsampling where
+      // the ratio allows it, as libjpeg's jpeg_core_output_dimensions does
+      auto size = min_block_size_;
+      while (size < 8 && (max_h * min_block_size_) % (h * size * 2) == 0 &&
+             (max_v * min_block_size_) % (v * size * 2) == 0) {
+        size *= 2;
+      }
+      component.block_size = size;
+      component.h_expand = (max_h * min_block_size_) / (h * size);
+      component.v_expand = (max_v * min_block_size_) / (v * size);
+      component.idct = IDCTKernels::select(idct_method_, level, size);
+      component.idct_corner =
+          IDCTKernels::selectCorner(idct_method_, level, size);
+      component.idct_dc = IDCTKernels::selectDCOnly(idct_method_, size);
 
-        sum *= 0.25;
-        result[x * 8 + y] = sum;
+      const auto width_scale = static_cast<size_t>(max_h * 8);
+      const auto height_scale = static_cast<size_t>(max_v * 8);
+      component.width = (image_width * h * size + width_scale - 1) / width_scale;
+      component.height =
+          (image_height * v * size + height_scale - 1) / height_scale;
+      component.stride = region_.width * h * size;
+      component.rows = plane_mcu_rows_ * v * size;
+      // the samples of the region inside the image
+      component.width = std::min(component.width - region_.x * h * size,
+                                 component.stride);
+      component.height = std::min(component.height - region_.y * v * size,
+                                  region_.height * v * size);
+      if (storage == Storage::Planes) {
+        planes_[i].assign(component.stride * component.rows, 0);
+      } else {
+        planes_[i].clear();
+      }
+      // whole MCUs of coefficients in natural order, kept across decodes
+      const auto coefficient_count = mcus_x_ * h * mcus_y_ * v * kMCUPixelSize;
+      if (storage == Storage::None) {
+        coefficients_[i].clear();
+      } else if (progressive_) {
+        coefficients_[i].assign(coefficient_count, 0);
+      } else if (storage == Storage::Coefficients) {
+        // not cleared, see decodeCoefficients()
+        coefficients_[i].resize(coefficient_count);
       }
     }
+    for (auto i = component_count_; i < kMaxComponents; ++i) {
+      components_[i] = {};
+      dequant_tables_[i].reset();
+      planes_[i].clear();
+      coefficients_[i].clear();
+    }
+    return true;
+  }
 
-    return result;
+  const ScanIndex *matchingScanIndex(JFIFParser &parser) const {
+    if (scan_index_ == nullptr || scan_index_->empty()) {
+      return nullptr;
+    }
+    if (progressive_ || parser.getScans().size() != 1 ||
+        !scan_index_->getHeader().hasLayoutOf(
+            ScanIndex::headerOf(parser, false))) {
+      LOG_WARN("The scan index is not of this image, it is ignored\n");
+      return nullptr;
+    }
+    return scan_index_;
   }
 
-  static void levelShift(std::vector<float> &data) {
-    for (auto i = 0; i < data.size(); ++i) {
-      data[i] += 128;
+  // the MCUs around the crop, `mcu_width` output pixels wide. They reach 2
+  // pixels beyond the crop, so the fancy upsampling of its edges sees the
+  // same neighbours as in the whole image.
+  bool prepareCrop(size_t mcu_width, bool whole_image) {
+    region_ = {0, 0, mcus_x_, mcus_y_};
+    crop_x_ = 0;
+    crop_y_ = 0;
+    cropped_ = false;
+    if (whole_image) {
+      return true;
     }
+    if (crop_.x >= width_ || crop_.y >= height_) {
+      LOG_ERROR("The crop at %zu, %zu is outside the %zux%zu image\n", crop_.x,
+                crop_.y, width_, height_);
+      return false;
+    }
+    const auto x_end = crop_.width == 0
+                           ? width_
+                           : std::min(crop_.x + crop_.width, width_);
+    const auto y_end = crop_.height == 0
+                           ? height_
+                           : std::min(crop_.y + crop_.height, height_);
+    const auto mcu_height = static_cast<size_t>(mcu_rows_);
+    constexpr size_t kMargin = 2;
+    region_.x = (crop_.x - std::min(crop_.x, kMargin)) / mcu_width;
+    region_.y = (crop_.y - std::min(crop_.y, kMargin)) / mcu_height;
+    region_.width =
+        std::min((x_end + kMargin + mcu_width - 1) / mcu_width, mcus_x_) -
+        region_.x;
+    region_.height =
+        std::min((y_end + kMargin + mcu_height - 1) / mcu_height, mcus_y_) -
+        region_.y;
+    crop_x_ = crop_.x - region_.x * mcu_width;
+    crop_y_ = crop_.y - region_.y * mcu_height;
+    cropped_ = x_end - crop_.x != width_ || y_end - crop_.y != height_;
+    width_ = x_end - crop_.x;
+    height_ = y_end - crop_.y;
+    return true;
   }
 
-  void prepare(JFIFParser& parser) {
-    huffman_table_indies_ = buildHuffmanTableIndies(parser);
-    bit_stream_ = buildBitStream(parser.getEncodedData());
-    q_table_refs_ = parser.getQTableRefs();
+  // sets up the components and tables of `scan`, false if it refers to a
+  // table that isn't defined or a DHT before it isn't a valid code
+  bool prepareScan(JFIFParser &parser, const JFIFParser::Scan &scan) {
+    // tables are looked up in the cache as the scans come, a later
+    // definition of an id replaces the earlier one
+    const auto &dht_segments = parser.getDHTSegments();
+    for (; built_dht_count_ < scan.dht_count; ++built_dht_count_) {
+      const auto &dht = dht_segments[built_dht_count_];
+      if (dht.dc_or_ac > 1 || dht.table_id >= kMaxHuffmanTables) {
+        LOG_WARN("Invalid huffman table %d:%d\n", dht.dc_or_ac, dht.table_id);
+        continue;
+      }
+      auto slot = dht.dc_or_ac * kMaxHuffmanTables + dht.table_id;
+      huffman_tables_[slot] =
+          table_cache_->getHuffmanTable(dht.symbol_counts, dht.symbols);
+      if (huffman_tables_[slot] == nullptr) {
+        LOG_ERROR("Huffman table %d:%d is not a valid code\n", dht.dc_or_ac,
+                  dht.table_id);
+        return false;
+      }
+    }
 
-    // YUV444, all components have the same width and height
-    auto* sof0 = parser.getSOF0Segment();
-    const auto pixel_count = sof0->width * sof0->height;
-    allocateYUVData(pixel_count);
+    // progressive scans code either DC or AC, and DC refinement needs no
+    // table at all
+    const auto &sos = scan.header;
+    const bool needs_dc =
+        !progressive_ || (sos.spectral_start == 0 && sos.approx_high == 0);
+    const bool needs_ac = !progressive_ || sos.spectral_start > 0;
+    auto *sof0 = parser.getSOF0Segment();
+    scan_component_count_ = sos.num_components;
+    for (auto i = 0; i < sos.num_components; ++i) {
+      auto &scan_component = scan_components_[i];
+      scan_component.component = findComponent(*sof0, sos.component_id[i]);
+      scan_component.dc_table = needs_dc ? findHuffmanTable(
+                                               0, sos.huffman_table_id_dc[i])
+                                         : nullptr;
+      scan_component.ac_table = needs_ac ? findHuffmanTable(
+                                               1, sos.huffman_table_id_ac[i])
+                                         : nullptr;
+      if ((needs_dc && scan_component.dc_table == nullptr) ||
+          (needs_ac && scan_component.ac_table == nullptr)) {
+        LOG_ERROR("Huffman table of scan component %d is not defined\n",
+                  sos.component_id[i]);
+        return false;
+      }
+    }
+    return true;
   }
 
-  void allocateYUVData(size_t pixel_count) {
-    y_decoded_data_.resize(pixel_count, 0);
-    u_decoded_data_.resize(pixel_count, 0);
-    v_decoded_data_.resize(pixel_count, 0);
+  const HuffmanTable *findHuffmanTable(int dc_or_ac, uint8_t table_id) const {
+    if (table_id >= kMaxHuffmanTables) {
+      return nullptr;
+    }
+    const auto slot = dc_or_ac * kMaxHuffmanTables + table_id;
+    return huffman_tables_[slot].get();
   }
 
-  static int16_t decodeNumber(uint16_t code_length, const std::string &bits) {
-    if (bits.empty()) {
+  static int16_t decodeNumber(uint16_t code_length, uint32_t bits) {
+    if (code_length == 0) {
       return 0;
     }
     auto l = 1 << (code_length - 1); // 2**(code_length-1)
-    auto v = std::bitset<16>(bits).to_ulong();
+    auto v = static_cast<int>(bits);
     if (v >= l) {
       return v;
     } else {
@@ -286,14 +1612,293 @@ private:
     }
   }
 
-  std::vector<uint8_t> y_decoded_data_;
-  std::vector<uint8_t> u_decoded_data_;
-  std::vector<uint8_t> v_decoded_data_;
-  std::unordered_map<uint16_t, HuffmanTable> huffman_table_indies_;
+  // entropy decodes the scans of a progressive image into coefficients_,
+  // up to the scan limit. Every scan adds bits to the coefficients, so
+  // nothing can be reconstructed before the last one.
+  int decodeProgressiveScans(JFIFParser &parser) {
+    const auto &scans = parser.getScans();
+    const auto scan_count = scan_limit_ == 0
+                                ? scans.size()
+                                : std::min(scan_limit_, scans.size());
+    for (size_t n = 0; n < scan_count; ++n) {
+      const auto &scan = scans[n];
+      if (!isValidProgressiveScan(scan.header) || !prepareScan(parser, scan)) {
+        return -1;
+      }
+      const auto layout = layoutScan(scan);
+      auto decode_interval = [&](size_t i) {
+        auto first_mcu = i * layout.mcus_per_interval;
+        auto mcu_count =
+            std::min(layout.mcus_per_interval, layout.mcu_total - first_mcu);
+        auto bit_stream = buildBitStream(scan.restart_intervals[i]);
+        // the end-of-band run and the predictors restart with the interval
+        std::array<int16_t, kMaxComponents> pre_dc_values{};
+        uint32_t eob_run = 0;
+        decodeProgressiveMCUs(bit_stream, scan.header, pre_dc_values, eob_run,
+                              first_mcu, mcu_count, layout.mcus_per_row);
+      };
+      forEachInterval(layout, decode_interval);
+    }
+    LOG_INFO("%zu of %zu scans decoded\n", scan_count, scans.size());
+    return 0;
+  }
+
+  // ITU-T.81 G.1.1.1.1, a DC scan may be interleaved, an AC scan may not
+  static bool isValidProgressiveScan(const segments::SOSSegment &sos) {
+    const bool dc_scan = sos.spectral_start == 0;
+    if ((dc_scan && sos.spectral_end != 0) ||
+        (!dc_scan && (sos.spectral_end < sos.spectral_start ||
+                      sos.spectral_end >= kMCUPixelSize ||
+                      sos.num_components != 1)) ||
+        sos.approx_low > 13) {
+      LOG_ERROR("Invalid progressive scan Ss=%d Se=%d Ah=%d Al=%d\n",
+                sos.spectral_start, sos.spectral_end, sos.approx_high,
+                sos.approx_low);
+      return false;
+    }
+    return true;
+  }
+
+  void decodeProgressiveMCUs(BitStream &bit_stream,
+                             const segments::SOSSegment &sos,
+                             std::array<int16_t, kMaxComponents> &pre_dc_values,
+                             uint32_t &eob_run, size_t first_mcu,
+                             size_t mcu_count, size_t mcus_per_row) {
+    const bool first = sos.approx_high == 0;
+    const int al = sos.approx_low;
+    forEachBlock(
+        first_mcu, mcu_count, mcus_per_row,
+        [&](int i, size_t block_x, size_t block_y) {
+          const auto &scan = scan_components_[i];
+          auto *coef = blockCoefficients(scan.component, block_x, block_y);
+          if (sos.spectral_start == 0) {
+            if (first) {
+              decodeDCFirst(bit_stream, *scan.dc_table, pre_dc_values[i], al,
+                            coef);
+            } else if (bit_stream.getBit()) {
+              coef[0] = static_cast<int16_t>(coef[0] | (1 << al));
+            }
+          } else if (first) {
+            decodeACFirst(bit_stream, *scan.ac_table, sos.spectral_start,
+                          sos.spectral_end, al, eob_run, coef);
+          } else {
+            decodeACRefine(bit_stream, *scan.ac_table, sos.spectral_start,
+                           sos.spectral_end, al, eob_run, coef);
+          }
+        });
+  }
+
+  void clearCoefficients(int component_index) {
+    std::fill(coefficients_[component_index].begin(),
+              coefficients_[component_index].end(), 0);
+  }
+
+  int16_t *blockCoefficients(int component_index, size_t block_x,
+                             size_t block_y) {
+    const auto &component = components_[component_index];
+    const auto blocks_per_row = mcus_x_ * component.h_factor;
+    return coefficients_[component_index].data() +
+           (block_y * blocks_per_row + block_x) * kMCUPixelSize;
+  }
+
+  // ITU-T.81 G.1.2.1, the DC value scaled by the point transform
+  void decodeDCFirst(BitStream &bit_stream, const HuffmanTable &dc_table,
+                     int16_t &pre_dc_value, int al, int16_t *coef) {
+    auto category = dc_table.getSymbol(bit_stream);
+    auto diff = decodeNumber(category, bit_stream.getBits(category));
+    pre_dc_value = static_cast<int16_t>(pre_dc_value + diff);
+    coef[0] = static_cast<int16_t>(pre_dc_value * (1 << al));
+  }
+
+  // ITU-T.81 G.1.2.2, the first bits of band [ss, se]. An EOB run skips
+  // this block and the next eob_run - 1 ones.
+  void decodeACFirst(BitStream &bit_stream, const HuffmanTable &ac_table,
+                     int ss, int se, int al, uint32_t &eob_run,
+                     int16_t *coef) {
+    if (eob_run > 0) {
+      --eob_run;
+      return;
+    }
+    for (int k = ss; k <= se; ++k) {
+      auto rrrr_ssss = ac_table.getSymbol(bit_stream);
+      auto zero_count = rrrr_ssss >> 4;
+      auto category = rrrr_ssss & 0x0F;
+      if (category == 0) {
+        if (zero_count != 15) {
+          eob_run = (1u << zero_count) - 1; // this block ends the band too
+          if (zero_count != 0) {
+            eob_run += bit_stream.getBits(zero_count);
+          }
+          return;
+        }
+        k += 15; // ZRL
+        continue;
+      }
+      k += zero_count;
+      if (k > se) {
+        return; // corrupt data, the run leaves the band
+      }
+      auto value = decodeNumber(category, bit_stream.getBits(category));
+      coef[kNaturalOrder[k]] = static_cast<int16_t>(value * (1 << al));
+    }
+  }
+
+  // ITU-T.81 G.1.2.3, one more bit of every coefficient that is already
+  // nonzero, and the coefficients that become nonzero at this bit. Follows
+  // libjpeg's decode_mcu_AC_refine.
+  void decodeACRefine(BitStream &bit_stream, const HuffmanTable &ac_table,
+                      int ss, int se, int al, uint32_t &eob_run,
+                      int16_t *coef) {
+    const int p1 = 1 << al;
+    const int m1 = -p1;
+    // a correction bit for a nonzero coefficient moves it away from 0
+    auto refine = [&](int16_t &value) {
+      if (bit_stream.getBit() && (value & p1) == 0) {
+        value = static_cast<int16_t>(value + (value >= 0 ? p1 : m1));
+      }
+    };
+
+    int k = ss;
+    if (eob_run == 0) {
+      for (; k <= se; ++k) {
+        auto rrrr_ssss = ac_table.getSymbol(bit_stream);
+        int zero_count = rrrr_ssss >> 4;
+        int category = rrrr_ssss & 0x0F;
+        int value = 0;
+        if (category != 0) {
+          // the new coefficient is always +-1 at this bit
+          value = bit_stream.getBit() ? p1 : m1;
+        } else if (zero_count != 15) {
+          eob_run = 1u << zero_count;
+          if (zero_count != 0) {
+            eob_run += bit_stream.getBits(zero_count);
+          }
+          break; // the rest of the band is refined below
+        }
+        // skip zero_count zero coefficients, refining the nonzero ones
+        // passed on the way
+        for (; k <= se; ++k) {
+          auto &c = coef[kNaturalOrder[k]];
+          if (c != 0) {
+            refine(c);
+          } else if (--zero_count < 0) {
+            break;
+          }
+        }
+        if (value != 0 && k <= se) {
+          coef[kNaturalOrder[k]] = static_cast<int16_t>(value);
+        }
+      }
+    }
+    if (eob_run > 0) {
+      // the block is in an EOB run, only its nonzero coefficients get a bit
+      for (; k <= se; ++k) {
+        auto &c = coef[kNaturalOrder[k]];
+        if (c != 0) {
+          refine(c);
+        }
+      }
+      --eob_run;
+    }
+  }
+
+  // dequant and IDCT of the coefficients of the region into the planes
+  void reconstruct() {
+    for (int i = 0; i < component_count_; ++i) {
+      const auto v_factor = static_cast<size_t>(components_[i].v_factor);
+      const auto first_row = region_.y * v_factor;
+      const auto block_rows = region_.height * v_factor;
+      auto reconstruct_row = [&, i](size_t row) {
+        reconstructBlockRow(i, first_row + row);
+      };
+      if (thread_pool_ != nullptr && block_rows > 1) {
+        thread_pool_->parallelFor(block_rows, reconstruct_row);
+      } else {
+        for (size_t row = 0; row < block_rows; ++row) {
+          reconstruct_row(row);
+        }
+      }
+    }
+  }
+
+  void reconstructMCURow(size_t mcu_row) {
+    for (int i = 0; i < component_count_; ++i) {
+      const auto v_factor = static_cast<size_t>(components_[i].v_factor);
+      for (size_t v = 0; v < v_factor; ++v) {
+        reconstructBlockRow(i, mcu_row * v_factor + v);
+      }
+    }
+  }
+
+  void reconstructBlockRow(int component_index, size_t block_y) {
+    const auto &component = components_[component_index];
+    const auto h_factor = static_cast<size_t>(component.h_factor);
+    const auto end_x = (region_.x + region_.width) * h_factor;
+    for (size_t block_x = region_.x * h_factor; block_x < end_x; ++block_x) {
+      const auto *coef = blockCoefficients(component_index, block_x, block_y);
+      idct(coef, lastNonZeroIndex(coef), component_index,
+           blockOutput(component_index, block_x, block_y), component.stride);
+    }
+  }
+
+  size_t width_{0};
+  size_t height_{0};
+  int min_block_size_{8};
+  size_t mcus_x_{0};
+  size_t mcus_y_{0};
+  int component_count_{kMaxComponents}; // 1 for grayscale
+  Crop crop_;
+  MCURegion region_; // the MCUs in the planes
+  size_t crop_x_{0}; // the crop's offset in the region, in output pixels
+  size_t crop_y_{0};
+  bool cropped_{false};
+  const ScanIndex *scan_index_{nullptr};
+  std::vector<size_t> crop_checkpoints_; // of scan_index_ to decode from
+  size_t plane_mcu_rows_{0}; // MCU rows the planes hold
+  int mcu_rows_{8};          // output rows per MCU row
+  std::array<Component, kMaxComponents> components_;
+  std::array<std::vector<uint8_t>, kMaxComponents> planes_;
+  std::array<ScanComponent, kMaxComponents> scan_components_;
+  int scan_component_count_{0};
+  bool progressive_{false};
+  size_t scan_limit_{0};
+  // coefficients of a progressive image, see decodeProgressiveScans(), or of
+  // decodeCoefficients()
+  using CoefficientBuffer =
+      std::vector<int16_t, AlignedAllocator<int16_t,
+                                            CoefficientView::kCoefficientAlignment>>;
+  std::array<CoefficientBuffer, kMaxComponents> coefficients_;
+  // DC, AC, nullptr if not defined
+  std::array<std::shared_ptr<const HuffmanTable>, 2 * kMaxHuffmanTables>
+      huffman_tables_;
+  size_t built_dht_count_{0}; // DHT segments applied to huffman_tables_
   std::array<segments::QuantizationTable*, 16> q_table_refs_{nullptr}; // 快速访问引用
-  BitStream bit_stream_;
+  IDCTMethod idct_method_{IDCTMethod::Islow};
+  std::array<std::shared_ptr<const DequantTable>, kMaxComponents>
+      dequant_tables_;
+  TableCache *table_cache_{&TableCache::global()};
+  DecodeScale scale_{DecodeScale::Full};
+  UpsampleMode upsample_mode_{UpsampleMode::Fancy};
+  ThreadPool *thread_pool_{nullptr};
+  bool speculative_{false};
+  size_t speculative_chunk_size_{kDefaultSpeculativeChunkSize};
+  SpeculativeDecodeStats speculative_stats_;
+  SpeculativeScanDecoder speculative_decoder_;
+  std::vector<MCUBlock> mcu_blocks_;
+  SpeculativeScanDecoder::MCUPattern mcu_pattern_;
+  bool pipelined_{false};
+  // coefficient slots of the pipeline, an MCU row each
+  size_t slot_blocks_{0};
+  std::vector<int16_t> slot_coefficients_;
+  std::vector<uint8_t> slot_last_indexes_;
+  std::vector<size_t> slot_mcus_;
+  std::vector<uint8_t> band_; // converted rows of decodeRows()
 
   constexpr static int kMCUPixelSize = 64;
+  // zigzag indexes 0 ~ 9 are all in the top-left 4x4 of a block
+  constexpr static int kCornerLastIndex = 9;
+  // the MCU row being decoded and the two around the band being converted
+  constexpr static size_t kStreamingMCURows = 3;
 };
 }
 
@@ -0,0 +1,412 @@
+//
+// Created by user on 8/1/25.
+//
+
+#ifndef SJPG_JPEG_ENCODER_H
+#define SJPG_JPEG_ENCODER_H
+#include "sjpg_bit_writer.h"
+#include "sjpg_color_convert.h"
+#include "sjpg_cpu_features.h"
+#include "sjpg_fdct.h"
+#include "sjpg_huffman_encoder.h"
+#include "sjpg_log.h"
+#include "sjpg_markers.h"
+#include "sjpg_segment_writer.h"
+#include "sjpg_segments.h"
+#include "sjpg_standard_tables.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace sjpg_codec {
+enum class ChromaSubsampling {
+  YCbCr444 = 0, // no subsampling
+  YCbCr422 = 1, // chroma halved horizontally
+  YCbCr420 = 2, // chroma halved in both directions
+};
+
+// Baseline JFIF encoder for RGB(A) pixels. The image is converted to YCbCr
+// by YCbCrConverter, chroma is downsampled to 4:4:4, 4:2:2 or 4:2:0, and
+// quantized with the Annex K tables scaled by a quality factor like
+// libjpeg's. The encoder works on one MCU row at a time, its buffers are
+// reused by the next image and nothing is allocated per block.
+class JPEGEncoder {
+public:
+  constexpr static int kDefaultQuality = 75;
+
+  // 1 ~ 100
+  void setQuality(int quality) { quality_ = std::clamp(quality, 1, 100); }
+  int getQuality() const { return quality_; }
+
+  void setSubsampling(ChromaSubsampling subsampling) {
+    subsampling_ = subsampling;
+  }
+  ChromaSubsampling getSubsampling() const { return subsampling_; }
+
+  // Huffman tables made for the image instead of the Annex K ones. This
+  // takes two passes: the first keeps the quantized coefficients of the
+  // whole image and counts the symbols, the second codes them.
+  void setOptimizeHuffman(bool enabled) { optimize_huffman_ = enabled; }
+  bool getOptimizeHuffman() const { return optimize_huffman_; }
+
+  // MCUs per restart interval, 0 writes no restart markers
+  void setRestartInterval(uint16_t mcus) { restart_interval_ = mcus; }
+  uint16_t getRestartInterval() const { return restart_interval_; }
+
+  // appends a JFIF file of `width` x `height` pixels, rows `stride` bytes
+  // apart, to `out`. Alpha is ignored. Returns 0, or -1 if the arguments
+  // are invalid.
+  int encode(const uint8_t *pixels, size_t width, size_t height,
+             size_t stride, PixelFormat format, std::vector<uint8_t> &out) {
+    if (pixels == nullptr || width == 0 || height == 0 || width > 65535 ||
+        height > 65535) {
+      LOG_ERROR("Invalid image size %zux%zu\n", width, height);
+      return -1;
+    }
+    if (format == PixelFormat::Gray) {
+      LOG_ERROR("Grayscale pixels can't be encoded\n");
+      return -1;
+    }
+    if (stride < width * ColorConverter::getBytesPerPixel(format)) {
+      LOG_ERROR("Stride %zu is too small for width %zu\n", stride, width);
+      return -1;
+    }
+
+    prepare(width, height, format);
+    kernel_ = FDCTKernels::select(CPUFeatures::getSIMDLevel());
+    convert_row_ = YCbCrConverter::select(CPUFeatures::getSIMDLevel());
+    downsample_row_ = selectDownsample(CPUFeatures::getSIMDLevel());
+
+    if (!optimize_huffman_) {
+      huffman_.useAnnexKTables();
+      writeHeaders(out);
+      BitWriter writer(out);
+      auto output = huffman_.symbolWriter(writer);
+      HuffmanEncoder::Restarts restarts{restart_interval_, &writer};
+      forEachMCU(pixels, stride,
+                 [&](size_t mcu, const int16_t *blocks, const uint64_t *masks) {
+                   restarts.next(mcu, predictors_);
+                   codeMCU(blocks, masks, output);
+                 });
+      writer.flush();
+    } else {
+      // pass 1: keep the coefficients and count the symbols
+      coefficients_.resize(mcu_count_ * blocks_per_mcu_ * 64);
+      masks_.resize(mcu_count_ * blocks_per_mcu_);
+      HuffmanEncoder::SymbolCounter counter;
+      HuffmanEncoder::Restarts restarts{restart_interval_, nullptr};
+      forEachMCU(pixels, stride,
+                 [&](size_t mcu, const int16_t *blocks, const uint64_t *masks) {
+                   restarts.next(mcu, predictors_);
+                   std::copy_n(blocks, blocks_per_mcu_ * 64,
+                               coefficients_.data() +
+                                   mcu * blocks_per_mcu_ * 64);
+                   std::copy_n(masks, blocks_per_mcu_,
+                               masks_.data() + mcu * blocks_per_mcu_);
+                   codeMCU(blocks, masks, counter);
+                 });
+      huffman_.useOptimalTables(counter);
+      writeHeaders(out);
+
+      // pass 2
+      BitWriter writer(out);
+      auto output = huffman_.symbolWriter(writer);
+      restarts = {restart_interval_, &writer};
+      predictors_.fill(0);
+      for (size_t mcu = 0; mcu < mcu_count_; ++mcu) {
+        restarts.next(mcu, predictors_);
+        codeMCU(coefficients_.data() + mcu * blocks_per_mcu_ * 64,
+                masks_.data() + mcu * blocks_per_mcu_, output);
+      }
+      writer.flush();
+    }
+    SegmentWriter::writeEOI(out);
+    return 0;
+  }
+
+  // `base` scaled by libjpeg's quality factor and limited to 1 ~ 255
+  static void scaleQuantTable(const uint8_t *base, int quality,
+                              uint8_t *out) {
+    quality = std::clamp(quality, 1, 100);
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; ++i) {
+      int value = (base[i] * scale + 50) / 100;
+      out[i] = static_cast<uint8_t>(std::clamp(value, 1, 255));
+    }
+  }
+
+private:
+  void prepare(size_t width, size_t height, PixelFormat format) {
+    width_ = width;
+    height_ = height;
+    format_ = format;
+    h_factor_ = subsampling_ == ChromaSubsampling::YCbCr444 ? 1 : 2;
+    v_factor_ = subsampling_ == ChromaSubsampling::YCbCr420 ? 2 : 1;
+    mcu_width_ = 8 * h_factor_;
+    mcu_height_ = 8 * v_factor_;
+    mcus_per_row_ = (width + mcu_width_ - 1) / mcu_width_;
+    mcu_rows_ = (height + mcu_height_ - 1) / mcu_height_;
+    mcu_count_ = mcus_per_row_ * mcu_rows_;
+    blocks_per_mcu_ = h_factor_ * v_factor_ + 2;
+    padded_width_ = mcus_per_row_ * mcu_width_;
+    chroma_width_ = mcus_per_row_ * 8;
+
+    for (auto &band : bands_) {
+      band.resize(padded_width_ * mcu_height_);
+    }
+    for (auto &band : chroma_bands_) {
+      band.resize(chroma_width_ * 8);
+    }
+    predictors_.fill(0);
+
+    uint8_t natural[64];
+    scaleQuantTable(annex_k::kLuminanceQuantization, quality_, natural);
+    divisors_[0] = QuantDivisors::build(natural);
+    setQuantTable(0, natural);
+    scaleQuantTable(annex_k::kChrominanceQuantization, quality_, natural);
+    divisors_[1] = QuantDivisors::build(natural);
+    setQuantTable(1, natural);
+  }
+
+  void setQuantTable(uint8_t id, const uint8_t *natural) {
+    dqt_.tables.resize(2);
+    auto &table = dqt_.tables[id];
+    table.id = id;
+    table.precision = 0;
+    table.data.resize(64);
+    for (int i = 0; i < 64; ++i) {
+      table.data[i] = natural[kNaturalOrder[i]];
+    }
+  }
+
+  void writeHeaders(std::vector<uint8_t> &out) {
+    SegmentWriter::writeSOI(out);
+
+    segments::APP0Segment app0;
+    std::memcpy(app0.identifier, "JFIF", 5);
+    app0.major_version = 1;
+    app0.minor_version = 1;
+    app0.x_density = 1;
+    app0.y_density = 1;
+    SegmentWriter::write(out, app0);
+    SegmentWriter::write(out, dqt_);
+
+    segments::SOF0Segment sof0;
+    sof0.bitPerSample = 8;
+    sof0.height = static_cast<uint16_t>(height_);
+    sof0.width = static_cast<uint16_t>(width_);
+    sof0.num_components = 3;
+    sof0.component_id = {1, 2, 3};
+    sof0.sampling_factor = {
+        static_cast<uint8_t>((h_factor_ << 4) | v_factor_), 0x11, 0x11};
+    sof0.quantization_table_id = {0, 1, 1};
+    SegmentWriter::write(out, sof0);
+
+    huffman_.writeTables(out);
+    if (restart_interval_ > 0) {
+      segments::DRISegment dri;
+      dri.restart_interval = restart_interval_;
+      SegmentWriter::write(out, dri);
+    }
+
+    segments::SOSSegment sos;
+    sos.num_components = 3;
+    sos.component_id = {1, 2, 3};
+    sos.huffman_table_id_dc = {0, 1, 1};
+    sos.huffman_table_id_ac = {0, 1, 1};
+    SegmentWriter::write(out, sos);
+  }
+
+  // converts and transforms the image one MCU row at a time, `f(mcu,
+  // blocks, masks)` gets the quantized blocks of every MCU in scan order and
+  // their masks of nonzero coefficients
+  template <typename F>
+  void forEachMCU(const uint8_t *pixels, size_t stride, F &&f) {
+    alignas(32) int16_t blocks[6 * 64];
+    uint64_t masks[6];
+    for (size_t mcu_row = 0; mcu_row < mcu_rows_; ++mcu_row) {
+      convertBand(pixels, stride, mcu_row);
+      const uint8_t *cb = chromaBand(1);
+      const uint8_t *cr = chromaBand(2);
+      for (size_t mcu_x = 0; mcu_x < mcus_per_row_; ++mcu_x) {
+        int i = 0;
+        for (int v = 0; v < v_factor_; ++v) {
+          for (int h = 0; h < h_factor_; ++h, ++i) {
+            masks[i] = kernel_(bands_[0].data() + v * 8 * padded_width_ +
+                                   mcu_x * mcu_width_ + h * 8,
+                               padded_width_, divisors_[0], blocks + i * 64);
+          }
+        }
+        masks[i] = kernel_(cb + mcu_x * 8, chroma_width_, divisors_[1],
+                           blocks + i * 64);
+        masks[i + 1] = kernel_(cr + mcu_x * 8, chroma_width_, divisors_[1],
+                               blocks + (i + 1) * 64);
+        f(mcu_row * mcus_per_row_ + mcu_x, blocks, masks);
+      }
+    }
+  }
+
+  // the chroma samples of the band, downsampled or not
+  const uint8_t *chromaBand(int component) const {
+    if (subsampling_ == ChromaSubsampling::YCbCr444) {
+      return bands_[component].data();
+    }
+    return chroma_bands_[component - 1].data();
+  }
+
+  // YCbCr of the MCU row, the edge pixels are repeated to whole MCUs
+  void convertBand(const uint8_t *pixels, size_t stride, size_t mcu_row) {
+    for (size_t row = 0; row < mcu_height_; ++row) {
+      auto y = std::min(mcu_row * mcu_height_ + row, height_ - 1);
+      auto offset = row * padded_width_;
+      uint8_t *planes[3] = {bands_[0].data() + offset,
+                            bands_[1].data() + offset,
+                            bands_[2].data() + offset};
+      convert_row_(pixels + y * stride, planes[0], planes[1], planes[2],
+                   width_, format_);
+      for (auto *plane : planes) {
+        std::fill(plane + width_, plane + padded_width_, plane[width_ - 1]);
+      }
+    }
+    if (subsampling_ != ChromaSubsampling::YCbCr444) {
+      for (int c = 0; c < 2; ++c) {
+        downsample(bands_[c + 1].data(), chroma_bands_[c].data());
+      }
+    }
+  }
+
+  void downsample(const uint8_t *in, uint8_t *out) const {
+    for (size_t row = 0; row < 8; ++row) {
+      const uint8_t *in0 = in + row * v_factor_ * padded_width_;
+      const uint8_t *in1 = v_factor_ == 2 ? in0 + padded_width_ : nullptr;
+      downsample_row_(in0, in1, out + row * chroma_width_, chroma_width_);
+    }
+  }
+
+  // libjpeg jcsample.c, 2 x 1 or 2 x 2 samples(`in1` is the second row or
+  // null) to one. The bias alternates between outputs so that the rounding
+  // doesn't drift.
+  static void downsampleRowScalar(const uint8_t *in0, const uint8_t *in1,
+                                  uint8_t *out, size_t width) {
+    if (in1 == nullptr) {
+      for (size_t x = 0; x < width; ++x) {
+        out[x] = static_cast<uint8_t>(
+            (in0[2 * x] + in0[2 * x + 1] + (x & 1)) >> 1);
+      }
+      return;
+    }
+    for (size_t x = 0; x < width; ++x) {
+      out[x] = static_cast<uint8_t>((in0[2 * x] + in0[2 * x + 1] + in1[2 * x] +
+                                     in1[2 * x + 1] + 1 + (x & 1)) >>
+                                    2);
+    }
+  }
+
+#if defined(SJPG_ARCH_X86)
+  // 32 outputs at a time, the pairs are summed by _mm256_maddubs_epi16
+  SJPG_TARGET_AVX2 static void downsampleRowAVX2(const uint8_t *in0,
+                                                 const uint8_t *in1,
+                                                 uint8_t *out, size_t width) {
+    constexpr size_t kStep = 32;
+    const auto ones = _mm256_set1_epi8(1);
+    const auto bias = in1 == nullptr ? _mm256_set1_epi32(1 << 16)
+                                     : _mm256_set1_epi32((2 << 16) | 1);
+    const int shift = in1 == nullptr ? 1 : 2;
+    size_t x = 0;
+    for (; x + kStep <= width; x += kStep) {
+      __m256i sums[2];
+      for (int k = 0; k < 2; ++k) {
+        auto offset = 2 * x + k * 32;
+        sums[k] = _mm256_maddubs_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in0 + offset)),
+            ones);
+        if (in1 != nullptr) {
+          sums[k] = _mm256_add_epi16(
+              sums[k], _mm256_maddubs_epi16(
+                           _mm256_loadu_si256(
+                               reinterpret_cast<const __m256i *>(in1 + offset)),
+                           ones));
+        }
+        sums[k] = _mm256_srl_epi16(_mm256_add_epi16(sums[k], bias),
+                                   _mm_cvtsi32_si128(shift));
+      }
+      auto bytes = _mm256_permute4x64_epi64(
+          _mm256_packus_epi16(sums[0], sums[1]), 0xD8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), bytes);
+    }
+    // x is even, the bias pattern continues
+    downsampleRowScalar(in0 + 2 * x, in1 == nullptr ? nullptr : in1 + 2 * x,
+                        out + x, width - x);
+  }
+#endif
+
+  using DownsampleRow = void (*)(const uint8_t *in0, const uint8_t *in1,
+                                 uint8_t *out, size_t width);
+
+  static DownsampleRow selectDownsample(SIMDLevel level) {
+#if defined(SJPG_ARCH_X86)
+    if (level >= SIMDLevel::AVX2) {
+      return &downsampleRowAVX2;
+    }
+#endif
+    (void)level;
+    return &downsampleRowScalar;
+  }
+
+  template <typename Output>
+  void codeMCU(const int16_t *blocks, const uint64_t *masks, Output &output) {
+    int luminance_blocks = blocks_per_mcu_ - 2;
+    for (int i = 0; i < luminance_blocks; ++i) {
+      HuffmanEncoder::codeBlock(blocks + i * 64, masks[i], predictors_[0],
+                                HuffmanEncoder::kDCLuminance,
+                                HuffmanEncoder::kACLuminance, output);
+    }
+    for (int c = 1; c < 3; ++c) {
+      int i = luminance_blocks + c - 1;
+      HuffmanEncoder::codeBlock(blocks + i * 64, masks[i], predictors_[c],
+                                HuffmanEncoder::kDCChrominance,
+                                HuffmanEncoder::kACChrominance, output);
+    }
+  }
+
+  int quality_{kDefaultQuality};
+  ChromaSubsampling subsampling_{ChromaSubsampling::YCbCr420};
+  bool optimize_huffman_{false};
+  uint16_t restart_interval_{0};
+
+  size_t width_{0};
+  size_t height_{0};
+  PixelFormat format_{PixelFormat::RGB};
+  int h_factor_{1}; // luminance sampling factors, chroma is always 1x1
+  int v_factor_{1};
+  size_t mcu_width_{8};
+  size_t mcu_height_{8};
+  size_t mcus_per_row_{0};
+  size_t mcu_rows_{0};
+  size_t mcu_count_{0};
+  int blocks_per_mcu_{3};
+  size_t padded_width_{0}; // of the full resolution bands
+  size_t chroma_width_{0}; // of the downsampled bands
+  FDCTKernel kernel_{nullptr};
+  YCbCrConverter::RowKernel convert_row_{nullptr};
+  DownsampleRow downsample_row_{nullptr};
+
+  // Y, Cb and Cr of one MCU row at full resolution, and Cb and Cr
+  // downsampled
+  std::array<std::vector<uint8_t>, 3> bands_;
+  std::array<std::vector<uint8_t>, 2> chroma_bands_;
+  std::array<QuantDivisors, 2> divisors_;
+  std::array<int16_t, 3> predictors_{};
+  // of the whole image with their masks, when optimizing only
+  std::vector<int16_t> coefficients_;
+  std::vector<uint64_t> masks_;
+
+  segments::DQTSegment dqt_;
+  HuffmanEncoder huffman_;
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_JPEG_ENCODER_H
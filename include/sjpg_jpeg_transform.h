@@ -0,0 +1,402 @@
+//
+// Created by user on 8/3/25.
+//
+
+#ifndef SJPG_JPEG_TRANSFORM_H
+#define SJPG_JPEG_TRANSFORM_H
+#include "sjpg_bit_writer.h"
+#include "sjpg_huffman_encoder.h"
+#include "sjpg_jfif_parser.h"
+#include "sjpg_jpeg_decoder.h"
+#include "sjpg_log.h"
+#include "sjpg_segment_writer.h"
+#include "sjpg_segments.h"
+#include "sjpg_standard_tables.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace sjpg_codec {
+// lossless transforms of jpegtran, rotations are clockwise
+enum class Transform {
+  None = 0,
+  FlipHorizontal = 1,
+  FlipVertical = 2,
+  Transpose = 3,  // across the top-left to bottom-right diagonal
+  Transverse = 4, // across the top-right to bottom-left diagonal
+  Rotate90 = 5,
+  Rotate180 = 6,
+  Rotate270 = 7,
+};
+
+// Rotates, flips and crops a JPEG without decoding its pixels, like
+// jpegtran. The image is entropy decoded to quantized coefficients, whole
+// blocks are moved and their coefficients transposed and negated, and the
+// result is Huffman coded again as a baseline image with the same
+// quantization tables. Nothing is requantized, so there is no loss.
+//
+// Only whole MCUs can be moved: an edge that is flipped and doesn't fill an
+// MCU is dropped, like jpegtran -trim, and the crop origin is rounded down
+// to the MCU grid.
+class JPEGTransformer {
+public:
+  void setTransform(Transform transform) { transform_ = transform; }
+  Transform getTransform() const { return transform_; }
+
+  // keeps `width` x `height` pixels at `x`, `y` of the transformed image.
+  // The origin is moved up and left to the MCU grid, the size grows by as
+  // much and is clipped to the image. A size of 0 extends to the edge.
+  void setCrop(size_t x, size_t y, size_t width, size_t height) {
+    crop_ = {x, y, width, height};
+  }
+  void clearCrop() { crop_ = {}; }
+
+  // Huffman tables made for the output instead of the Annex K ones, takes
+  // a second pass over the coefficients
+  void setOptimizeHuffman(bool enabled) { optimize_huffman_ = enabled; }
+  bool getOptimizeHuffman() const { return optimize_huffman_; }
+
+  // MCUs per restart interval of the output, 0 writes no restart markers
+  void setRestartInterval(uint16_t mcus) { restart_interval_ = mcus; }
+  uint16_t getRestartInterval() const { return restart_interval_; }
+
+  // appends the transformed image to `out`. Returns 0, or -1 if the image
+  // can't be decoded or nothing is left of it after trimming and cropping.
+  int transform(JFIFParser &parser, std::vector<uint8_t> &out) {
+    if (decoder_.decodeCoefficients(parser) != 0) {
+      return -1;
+    }
+    if (!prepare(*parser.getSOF0Segment())) {
+      return -1;
+    }
+
+    writeHeaders(parser, out);
+    // a grayscale image codes with the luminance tables only
+    const int table_count = component_count_ == 1
+                                ? HuffmanEncoder::kDCChrominance
+                                : HuffmanEncoder::kTableCount;
+    if (optimize_huffman_) {
+      HuffmanEncoder::SymbolCounter counter;
+      codeImage(counter, nullptr);
+      huffman_.useOptimalTables(counter, table_count);
+    } else {
+      huffman_.useAnnexKTables();
+    }
+    huffman_.writeTables(out, table_count);
+    writeScanHeader(out);
+    BitWriter writer(out);
+    auto output = huffman_.symbolWriter(writer);
+    codeImage(output, &writer);
+    writer.flush();
+    SegmentWriter::writeEOI(out);
+    return 0;
+  }
+
+  // the size of the last output
+  size_t getWidth() const { return width_; }
+  size_t getHeight() const { return height_; }
+
+private:
+  struct Crop {
+    size_t x{0};
+    size_t y{0};
+    size_t width{0};
+    size_t height{0};
+  };
+
+  // an output component and where its blocks come from
+  struct Component {
+    uint8_t id{0};
+    uint8_t quant_table{0};
+    int h_factor{1}; // in the output
+    int v_factor{1};
+    // blocks of the transformed image left of and above the output
+    size_t x_offset{0};
+    size_t y_offset{0};
+    // blocks of the transformed image in whole MCUs, flipped axes only
+    size_t flip_width{0};
+    size_t flip_height{0};
+    CoefficientView source;
+  };
+
+  // the transform as a transpose followed by flips of the output axes
+  bool transposes() const {
+    return transform_ == Transform::Transpose ||
+           transform_ == Transform::Transverse ||
+           transform_ == Transform::Rotate90 ||
+           transform_ == Transform::Rotate270;
+  }
+  bool flipsX() const {
+    return transform_ == Transform::FlipHorizontal ||
+           transform_ == Transform::Transverse ||
+           transform_ == Transform::Rotate90 ||
+           transform_ == Transform::Rotate180;
+  }
+  bool flipsY() const {
+    return transform_ == Transform::FlipVertical ||
+           transform_ == Transform::Transverse ||
+           transform_ == Transform::Rotate180 ||
+           transform_ == Transform::Rotate270;
+  }
+
+  bool prepare(const segments::SOF0Segment &sof0) {
+    transpose_ = transposes();
+    flip_x_ = flipsX();
+    flip_y_ = flipsY();
+    component_count_ = sof0.num_components;
+    int max_h = 1;
+    int max_v = 1;
+    for (int i = 0; i < component_count_; ++i) {
+      max_h = std::max(max_h, sof0.sampling_factor[i] >> 4);
+      max_v = std::max(max_v, sof0.sampling_factor[i] & 0x0F);
+    }
+    if (transpose_) {
+      std::swap(max_h, max_v);
+    }
+    // a single component is coded block by block, ITU-T.81 A.2.2
+    if (component_count_ == 1) {
+      max_h = 1;
+      max_v = 1;
+    }
+    const size_t mcu_width = 8 * max_h;
+    const size_t mcu_height = 8 * max_v;
+
+    // the transformed image, trimmed to whole MCUs along flipped axes
+    size_t width = transpose_ ? sof0.height : sof0.width;
+    size_t height = transpose_ ? sof0.width : sof0.height;
+    if (flip_x_) {
+      width = width / mcu_width * mcu_width;
+    }
+    if (flip_y_) {
+      height = height / mcu_height * mcu_height;
+    }
+    const size_t flip_mcus_x = width / mcu_width;
+    const size_t flip_mcus_y = height / mcu_height;
+
+    const size_t x = crop_.x / mcu_width * mcu_width;
+    const size_t y = crop_.y / mcu_height * mcu_height;
+    if (x >= width || y >= height) {
+      LOG_ERROR("Nothing is left of a %zux%zu image to transform\n", width,
+                height);
+      return false;
+    }
+    width_ = crop_.width == 0 ? width - x
+                              : std::min(crop_.x + crop_.width, width) - x;
+    height_ = crop_.height == 0 ? height - y
+                                : std::min(crop_.y + crop_.height, height) - y;
+    mcus_x_ = (width_ + mcu_width - 1) / mcu_width;
+    mcus_y_ = (height_ + mcu_height - 1) / mcu_height;
+
+    for (int i = 0; i < component_count_; ++i) {
+      auto &component = components_[i];
+      component.id = sof0.component_id[i];
+      component.quant_table = sof0.quantization_table_id[i] & 0x0F;
+      component.h_factor = sof0.sampling_factor[i] >> 4;
+      component.v_factor = sof0.sampling_factor[i] & 0x0F;
+      if (transpose_) {
+        std::swap(component.h_factor, component.v_factor);
+      }
+      if (component_count_ == 1) {
+        component.h_factor = 1;
+        component.v_factor = 1;
+      }
+      component.x_offset = x / mcu_width * component.h_factor;
+      component.y_offset = y / mcu_height * component.v_factor;
+      component.flip_width = flip_mcus_x * component.h_factor;
+      component.flip_height = flip_mcus_y * component.v_factor;
+      component.source = decoder_.getCoefficients(i);
+    }
+    buildPermutation();
+    mask_kernel_ = HuffmanEncoder::selectMask(CPUFeatures::getSIMDLevel());
+    return true;
+  }
+
+  // source coefficient j is output coefficient destinations_[j] times
+  // signs_[destinations_[j]]. A flip negates the odd frequencies along its
+  // axis.
+  void buildPermutation() {
+    for (int v = 0; v < 8; ++v) {
+      for (int u = 0; u < 8; ++u) {
+        const int i = v * 8 + u;
+        destinations_[transpose_ ? u * 8 + v : i] = static_cast<uint8_t>(i);
+        const bool negate =
+            (flip_x_ && (u & 1) != 0) != (flip_y_ && (v & 1) != 0);
+        signs_[i] = static_cast<int16_t>(negate ? -1 : 1);
+      }
+    }
+  }
+
+  // the source block of output block `x`, `y`, null for padding outside
+  // the source
+  const int16_t *sourceBlock(const Component &component, size_t x,
+                             size_t y) const {
+    x += component.x_offset;
+    y += component.y_offset;
+    if (flip_x_) {
+      x = component.flip_width - 1 - x;
+    }
+    if (flip_y_) {
+      y = component.flip_height - 1 - y;
+    }
+    if (transpose_) {
+      std::swap(x, y);
+    }
+    const auto &source = component.source;
+    if (x >= source.blocks_per_line || y >= source.block_rows) {
+      return nullptr;
+    }
+    return source.block(x, y);
+  }
+
+  // the output block, returns its mask of nonzero coefficients. Most
+  // coefficients are 0, only the others are moved.
+  uint64_t transformBlock(const int16_t *source, int16_t *out) const {
+    std::fill_n(out, 64, 0);
+    if (source == nullptr) {
+      return 0;
+    }
+    uint64_t mask = 0;
+    for (auto nonzero = mask_kernel_(source); nonzero != 0;
+         nonzero &= nonzero - 1) {
+      const int j = HuffmanEncoder::lowestBit(nonzero);
+      const int i = destinations_[j];
+      out[i] = static_cast<int16_t>(source[j] * signs_[i]);
+      mask |= static_cast<uint64_t>(1) << i;
+    }
+    return mask;
+  }
+
+  // codes the MCUs of the output, restart markers go to `writer` if any
+  template <typename Output> void codeImage(Output &output, BitWriter *writer) {
+    std::array<int16_t, JPEGDecoder::kMaxComponents> predictors{};
+    HuffmanEncoder::Restarts restarts{restart_interval_, writer};
+    alignas(32) int16_t block[64];
+    for (size_t mcu_y = 0; mcu_y < mcus_y_; ++mcu_y) {
+      for (size_t mcu_x = 0; mcu_x < mcus_x_; ++mcu_x) {
+        restarts.next(mcu_y * mcus_x_ + mcu_x, predictors);
+        for (int i = 0; i < component_count_; ++i) {
+          const auto &component = components_[i];
+          const int dc_table = i == 0 ? HuffmanEncoder::kDCLuminance
+                                      : HuffmanEncoder::kDCChrominance;
+          for (int v = 0; v < component.v_factor; ++v) {
+            for (int h = 0; h < component.h_factor; ++h) {
+              const auto mask = transformBlock(
+                  sourceBlock(component, mcu_x * component.h_factor + h,
+                              mcu_y * component.v_factor + v),
+                  block);
+              HuffmanEncoder::codeBlock(block, mask, predictors[i], dc_table,
+                                        dc_table + 1, output);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  void writeHeaders(JFIFParser &parser, std::vector<uint8_t> &out) const {
+    SegmentWriter::writeSOI(out);
+    if (parser.getAPP0Segment() != nullptr) {
+      SegmentWriter::write(out, *parser.getAPP0Segment());
+    } else {
+      segments::APP0Segment app0;
+      std::memcpy(app0.identifier, "JFIF", 5);
+      app0.major_version = 1;
+      app0.minor_version = 1;
+      app0.x_density = 1;
+      app0.y_density = 1;
+      SegmentWriter::write(out, app0);
+    }
+
+    // the tables of the components, transposed with the blocks
+    segments::DQTSegment dqt;
+    bool extended = false;
+    const auto &refs = parser.getQTableRefs();
+    for (int i = 0; i < component_count_; ++i) {
+      const auto *table = refs[components_[i].quant_table];
+      bool written = false;
+      for (const auto &t : dqt.tables) {
+        written = written || t.id == table->id;
+      }
+      if (written) {
+        continue;
+      }
+      dqt.tables.push_back(*table);
+      extended = extended || table->precision != 0;
+      if (transpose_) {
+        transposeTable(*table, dqt.tables.back());
+      }
+    }
+    SegmentWriter::write(out, dqt);
+
+    segments::SOF0Segment sof0;
+    // baseline allows 8-bit quantization tables only
+    sof0.frame_marker = extended ? JFIF_SOF1 : JFIF_SOF0;
+    sof0.bitPerSample = 8;
+    sof0.width = static_cast<uint16_t>(width_);
+    sof0.height = static_cast<uint16_t>(height_);
+    sof0.num_components = static_cast<uint8_t>(component_count_);
+    for (int i = 0; i < component_count_; ++i) {
+      const auto &component = components_[i];
+      sof0.component_id.push_back(component.id);
+      sof0.sampling_factor.push_back(
+          static_cast<uint8_t>((component.h_factor << 4) | component.v_factor));
+      sof0.quantization_table_id.push_back(component.quant_table);
+    }
+    SegmentWriter::write(out, sof0);
+  }
+
+  void writeScanHeader(std::vector<uint8_t> &out) const {
+    if (restart_interval_ > 0) {
+      segments::DRISegment dri;
+      dri.restart_interval = restart_interval_;
+      SegmentWriter::write(out, dri);
+    }
+    segments::SOSSegment sos;
+    sos.num_components = static_cast<uint8_t>(component_count_);
+    for (int i = 0; i < component_count_; ++i) {
+      const uint8_t table = i == 0 ? 0 : 1;
+      sos.component_id.push_back(components_[i].id);
+      sos.huffman_table_id_dc.push_back(table);
+      sos.huffman_table_id_ac.push_back(table);
+    }
+    SegmentWriter::write(out, sos);
+  }
+
+  // `data` is in zigzag order, 1 or 2 bytes per value
+  static void transposeTable(const segments::QuantizationTable &in,
+                             segments::QuantizationTable &out) {
+    const size_t size = in.precision != 0 ? 2 : 1;
+    for (int k = 0; k < 64; ++k) {
+      const int natural = kNaturalOrder[k];
+      const int transposed = kZigzagOrder[(natural % 8) * 8 + natural / 8];
+      std::copy_n(in.data.begin() + transposed * size, size,
+                  out.data.begin() + k * size);
+    }
+  }
+
+  Transform transform_{Transform::None};
+  Crop crop_;
+  bool optimize_huffman_{false};
+  uint16_t restart_interval_{0};
+
+  JPEGDecoder decoder_;
+  HuffmanEncoder huffman_;
+  bool transpose_{false};
+  bool flip_x_{false};
+  bool flip_y_{false};
+  int component_count_{0};
+  std::array<Component, JPEGDecoder::kMaxComponents> components_;
+  size_t width_{0};
+  size_t height_{0};
+  size_t mcus_x_{0};
+  size_t mcus_y_{0};
+  std::array<uint8_t, 64> destinations_{};
+  std::array<int16_t, 64> signs_{};
+  HuffmanEncoder::MaskKernel mask_kernel_{&HuffmanEncoder::nonzeroMaskScalar};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_JPEG_TRANSFORM_H
@@ -3,6 +3,7 @@
 //
 
 # pragma once
+#include <cstdio>
 
 #define LOG_INFO(...) printf(__VA_ARGS__)
 #define LOG_ERROR(...) printf(__VA_ARGS__)
@@ -0,0 +1,121 @@
+//
+// Created by user on 7/23/25.
+//
+
+#ifndef SJPG_MAPPED_FILE_H
+#define SJPG_MAPPED_FILE_H
+#include "sjpg_log.h"
+#include "sjpg_memory_reader.h"
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SJPG_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <vector>
+#endif
+
+namespace sjpg_codec {
+// Read-only view of a whole file. The file is mmap'd where available, other
+// platforms read it into memory once.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path) { open(path); }
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+  MappedFile &operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+      close();
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+      std::swap(open_, other.open_);
+#if !defined(SJPG_HAS_MMAP)
+      std::swap(buffer_, other.buffer_);
+#endif
+    }
+    return *this;
+  }
+
+  bool open(const std::string &path) {
+    close();
+#if defined(SJPG_HAS_MMAP)
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      LOG_ERROR("Failed to open file: %s\n", path.c_str());
+      return false;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      auto *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        LOG_ERROR("Failed to map file: %s\n", path.c_str());
+        ::close(fd);
+        size_ = 0;
+        return false;
+      }
+      // the parser and the entropy decoder walk the file front to back
+      ::madvise(addr, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const uint8_t *>(addr);
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+#else
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream.is_open()) {
+      LOG_ERROR("Failed to open file: %s\n", path.c_str());
+      return false;
+    }
+    buffer_.resize(static_cast<size_t>(stream.tellg()));
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char *>(buffer_.data()), buffer_.size());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+    open_ = true;
+    return true;
+  }
+
+  void close() {
+#if defined(SJPG_HAS_MMAP)
+    if (data_ != nullptr) {
+      ::munmap(const_cast<uint8_t *>(data_), size_);
+    }
+#else
+    buffer_.clear();
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+  }
+
+  bool isOpen() const { return open_; }
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+  ByteSpan span() const { return {data_, size_}; }
+
+private:
+  const uint8_t *data_{nullptr};
+  size_t size_{0};
+  bool open_{false};
+#if !defined(SJPG_HAS_MMAP)
+  std::vector<uint8_t> buffer_;
+#endif
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_MAPPED_FILE_H
@@ -28,12 +28,21 @@ const uint8_t JFIF_SOF11      = 0xCB; // Lossless (Sequential), Arithmetic Codin
 const uint8_t JFIF_SOF13      = 0xCD; // Differential Sequential DCT, Arithmetic Coding
 const uint8_t JFIF_SOF14      = 0xCE; // Differential Progressive DCT, Arithmetic Coding
 const uint8_t JFIF_SOF15      = 0xCF; // Differential Lossless (Sequential), Arithmetic Coding
+const uint8_t JFIF_RST0       = 0xD0; // Restart Marker 0
+const uint8_t JFIF_RST7       = 0xD7; // Restart Marker 7
 const uint8_t JFIF_SOI        = 0xD8; // Start of Image
 const uint8_t JFIF_EOI        = 0xD9; // End of Image
 const uint8_t JFIF_SOS        = 0xDA; // Start of Scan
 const uint8_t JFIF_DQT        = 0xDB; // Define Quantization Table
+const uint8_t JFIF_DRI        = 0xDD; // Define Restart Interval
 const uint8_t JFIF_APP0       = 0xE0; // Application Segment 0, JPEG-JFIF Image
 const uint8_t JFIF_COM        = 0xFE; // Comment
+
+// SOFn, without DHT(C4), JPG(C8) and DAC(CC) that share the range
+inline bool isSOFMarker(uint8_t marker) {
+  return marker >= JFIF_SOF0 && marker <= JFIF_SOF15 && marker != JFIF_DHT &&
+         marker != 0xC8 && marker != 0xCC;
+}
 }
 
 #endif //SJPG_MARKERS_H
@@ -0,0 +1,96 @@
+//
+// Created by user on 7/23/25.
+//
+
+#ifndef SJPG_MEMORY_READER_H
+#define SJPG_MEMORY_READER_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace sjpg_codec {
+// non-owning view of contiguous bytes, a minimal std::span<const uint8_t>
+class ByteSpan {
+public:
+  ByteSpan() = default;
+  ByteSpan(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const uint8_t *begin() const { return data_; }
+  const uint8_t *end() const { return data_ + size_; }
+  uint8_t operator[](size_t i) const { return data_[i]; }
+
+  // clamped to the view
+  ByteSpan subspan(size_t offset, size_t length) const {
+    if (offset > size_) {
+      offset = size_;
+    }
+    if (length > size_ - offset) {
+      length = size_ - offset;
+    }
+    return {data_ + offset, length};
+  }
+
+private:
+  const uint8_t *data_{nullptr};
+  size_t size_{0};
+};
+
+// StreamReader counterpart over a ByteSpan. Reads past the end return
+// zeros and set eof(), like a failed stream read.
+class MemoryReader {
+public:
+  MemoryReader() = default;
+  explicit MemoryReader(ByteSpan data) : data_(data) {}
+
+  uint8_t readByte() {
+    if (pos_ >= data_.size()) {
+      eof_ = true;
+      return 0x00;
+    }
+    return data_.data()[pos_++];
+  }
+
+  uint16_t read2BytesBigEndian() {
+    auto b0 = readByte();
+    auto b1 = readByte();
+    return static_cast<uint16_t>((b0 << 8) | b1);
+  }
+
+  void readTo(void *dest, size_t length) {
+    auto available = remaining() < length ? remaining() : length;
+    std::memcpy(dest, data_.data() + pos_, available);
+    if (available < length) {
+      std::memset(static_cast<uint8_t *>(dest) + available, 0,
+                  length - available);
+      eof_ = true;
+    }
+    pos_ += available;
+  }
+
+  void skip(size_t length) {
+    if (length > remaining()) {
+      length = remaining();
+      eof_ = true;
+    }
+    pos_ += length;
+  }
+
+  void seek(size_t pos) { pos_ = pos < data_.size() ? pos : data_.size(); }
+
+  size_t tell() const { return pos_; }
+  size_t remaining() const { return data_.size() - pos_; }
+  bool eof() const { return eof_ || pos_ >= data_.size(); }
+  const uint8_t *current() const { return data_.data() + pos_; }
+  const ByteSpan &data() const { return data_; }
+
+private:
+  ByteSpan data_;
+  size_t pos_{0};
+  bool eof_{false};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_MEMORY_READER_H
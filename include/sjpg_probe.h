@@ -0,0 +1,192 @@
+//
+// Created by user on 7/26/25.
+//
+
+#ifndef SJPG_PROBE_H
+#define SJPG_PROBE_H
+#include "sjpg_markers.h"
+#include "sjpg_memory_reader.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace sjpg_codec {
+enum class ProbeStatus {
+  Ok = 0,
+  // the prefix ends before the header does, see ImageInfo::bytes_needed
+  NeedMoreData = 1,
+  NotJPEG = -1,
+  Invalid = -2,
+};
+
+// what the header says about the image, filled by JPEGProbe
+struct ImageInfo {
+  struct ComponentInfo {
+    uint8_t id{0};
+    uint8_t h_factor{0};
+    uint8_t v_factor{0};
+    uint8_t q_table_id{0};
+  };
+  constexpr static int kMaxComponents = 4;
+
+  uint16_t width{0};
+  uint16_t height{0}; // 0 when it's defined by a DNL segment later
+  uint8_t precision{0};
+  // components beyond kMaxComponents are counted but not described
+  uint8_t component_count{0};
+  ComponentInfo components[kMaxComponents];
+  uint8_t sof_marker{0}; // JFIF_SOF0, JFIF_SOF2...
+  bool progressive{false};
+  bool arithmetic{false};
+  bool lossless{false};
+  // from DRI, 0 when the scan has no restart markers. Only final when
+  // scan_found is set, DRI usually comes after SOF.
+  uint16_t restart_interval{0};
+  bool frame_found{false};
+  bool scan_found{false};
+  // bytes read, the offset of the first SOS(or of the end of SOF when
+  // probing stopped there)
+  size_t header_size{0};
+  // NeedMoreData: the prefix has to be at least this long to get further
+  size_t bytes_needed{0};
+
+  bool hasRestartMarkers() const { return restart_interval != 0; }
+};
+
+// Reads the image properties from the markers before the entropy-coded
+// data, without parsing or copying the rest of the file. Works on a prefix
+// of the file(a few KiB are enough unless there are large APPn segments),
+// which are skipped by their length fields. Allocates nothing and logs
+// nothing, so it's cheap enough for scanning many files.
+class JPEGProbe {
+public:
+  enum class StopAt {
+    Frame, // right after SOF, restart_interval is not known yet
+    Scan,  // at the first SOS
+  };
+
+  static ProbeStatus probe(const uint8_t *data, size_t size, ImageInfo &info,
+                           StopAt stop_at = StopAt::Scan) {
+    info = ImageInfo();
+    MemoryReader reader({data, size});
+    if (size < 2) {
+      return needMoreData(info, 2);
+    }
+    if (reader.readByte() != JFIF_BYTE_FF || reader.readByte() != JFIF_SOI) {
+      return ProbeStatus::NotJPEG;
+    }
+
+    for (;;) {
+      // markers may be preceded by any number of fill bytes, anything else
+      // between segments is skipped like libjpeg does
+      if (reader.remaining() == 0) {
+        return needMoreData(info, size + 2);
+      }
+      if (reader.readByte() != JFIF_BYTE_FF) {
+        continue;
+      }
+      auto marker = JFIF_BYTE_FF;
+      while (marker == JFIF_BYTE_FF) {
+        if (reader.remaining() == 0) {
+          return needMoreData(info, size + 1);
+        }
+        marker = reader.readByte();
+      }
+      if (marker == JFIF_BYTE_0 || marker == JFIF_SOI ||
+          (marker >= JFIF_RST0 && marker <= JFIF_RST7)) {
+        continue;
+      }
+      if (marker == JFIF_EOI) {
+        return ProbeStatus::Invalid;
+      }
+
+      const auto segment_start = reader.tell();
+      if (reader.remaining() < 2) {
+        return needMoreData(info, segment_start + 2);
+      }
+      const auto length = reader.read2BytesBigEndian();
+      if (length < 2) {
+        return ProbeStatus::Invalid;
+      }
+      const auto segment_end = segment_start + length;
+      const bool parsed = isSOFMarker(marker) || marker == JFIF_DRI ||
+                          marker == JFIF_SOS;
+      if (parsed && segment_end > size) {
+        return needMoreData(info, segment_end);
+      }
+
+      if (isSOFMarker(marker)) {
+        if (!parseSOF(reader, marker, length, info)) {
+          return ProbeStatus::Invalid;
+        }
+        if (stop_at == StopAt::Frame) {
+          info.header_size = segment_end;
+          return ProbeStatus::Ok;
+        }
+      } else if (marker == JFIF_DRI) {
+        if (length < 4) {
+          return ProbeStatus::Invalid;
+        }
+        info.restart_interval = reader.read2BytesBigEndian();
+      } else if (marker == JFIF_SOS) {
+        if (!info.frame_found) {
+          return ProbeStatus::Invalid;
+        }
+        info.scan_found = true;
+        info.header_size = segment_start - 2;
+        return ProbeStatus::Ok;
+      }
+      // APPn, COM, DQT, DHT... the next marker may lie beyond the prefix
+      if (segment_end >= size) {
+        return needMoreData(info, segment_end + 2);
+      }
+      reader.seek(segment_end);
+    }
+  }
+
+  static ProbeStatus probe(ByteSpan data, ImageInfo &info,
+                           StopAt stop_at = StopAt::Scan) {
+    return probe(data.data(), data.size(), info, stop_at);
+  }
+
+private:
+  static ProbeStatus needMoreData(ImageInfo &info, size_t bytes_needed) {
+    info.bytes_needed = bytes_needed;
+    return ProbeStatus::NeedMoreData;
+  }
+
+  static bool parseSOF(MemoryReader &reader, uint8_t marker, uint16_t length,
+                       ImageInfo &info) {
+    if (info.frame_found || length < 8) {
+      return false;
+    }
+    info.sof_marker = marker;
+    info.precision = reader.readByte();
+    info.height = reader.read2BytesBigEndian();
+    info.width = reader.read2BytesBigEndian();
+    info.component_count = reader.readByte();
+    if (info.width == 0 || info.component_count == 0 ||
+        length < 8 + 3 * info.component_count) {
+      return false;
+    }
+    for (int i = 0; i < info.component_count; ++i) {
+      auto id = reader.readByte();
+      auto factors = reader.readByte();
+      auto q_table_id = reader.readByte();
+      if (i < ImageInfo::kMaxComponents) {
+        info.components[i] = {id, static_cast<uint8_t>(factors >> 4),
+                              static_cast<uint8_t>(factors & 0x0F),
+                              q_table_id};
+      }
+    }
+    // C0-C3 and C5-C7 are Huffman coded, C9-CB and CD-CF arithmetic coded
+    auto type = marker & 0x03;
+    info.progressive = type == 2;
+    info.lossless = type == 3;
+    info.arithmetic = marker >= JFIF_SOF9;
+    info.frame_found = true;
+    return true;
+  }
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_PROBE_H
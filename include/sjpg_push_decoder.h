@@ -0,0 +1,291 @@
+//
+// Created by user on 8/6/25.
+//
+
+#ifndef SJPG_PUSH_DECODER_H
+#define SJPG_PUSH_DECODER_H
+#include "sjpg_jpeg_decoder.h"
+#include <cstring>
+#include <vector>
+
+namespace sjpg_codec {
+// Decodes an image whose bytes arrive over time, a chunk per feed(), and
+// hands its rows to a RowSink as soon as the MCU rows below them are
+// decoded, like JPEGDecoder::decodeRows(). feed() stops at the last whole
+// segment while reading the headers and at the last whole MCU in the scan,
+// and resumes from there with the next chunk: earlier bytes aren't read
+// again, and only the bytes not decoded yet are kept, never the whole file.
+//
+// A sequential image with a single interleaved scan only, the kind
+// decodeRows() takes. The decoder settings, the scale for one, are those
+// of getDecoder().
+class PushDecoder {
+public:
+  enum FeedResult { Finished = 0, NeedMoreData = 1, Failed = -1 };
+
+  // starts a new image
+  void start(PixelFormat format, JPEGDecoder::RowSink sink) {
+    format_ = format;
+    sink_ = std::move(sink);
+    stage_ = Stage::Headers;
+    headers_.clear();
+    header_pos_ = 0;
+    pending_.clear();
+    stream_base_ = 0;
+    bit_offset_ = 0;
+    pre_dc_values_.fill(0);
+    mcu_ = 0;
+    restart_pending_ = false;
+  }
+
+  // a chunk of the file, returns NeedMoreData until the last row is out
+  int feed(const uint8_t *data, size_t size) {
+    if (stage_ == Stage::Headers) {
+      headers_.insert(headers_.end(), data, data + size);
+      const auto result = readHeaders();
+      if (result != Finished) {
+        return result;
+      }
+    } else if (stage_ == Stage::Scan) {
+      pending_.insert(pending_.end(), data, data + size);
+    }
+    if (stage_ == Stage::Scan) {
+      decodeScan();
+    }
+    return result();
+  }
+
+  // the file ended early, the rows not decoded yet are output with the
+  // samples of the MCUs that are missing left 0, green in RGB, as
+  // JPEGDecoder::decode() leaves them
+  int finish() {
+    if (stage_ == Stage::Scan) {
+      endScan();
+    }
+    return result();
+  }
+
+  JPEGDecoder &getDecoder() { return decoder_; }
+  // the headers once feed() is past them
+  JFIFParser &getParser() { return parser_; }
+  bool hasHeaders() const { return stage_ != Stage::Headers; }
+  size_t getWidth() const { return decoder_.getWidth(); }
+  size_t getHeight() const { return decoder_.getHeight(); }
+  // how many bytes are held, those of the headers and those not decoded yet
+  size_t getBufferedSize() const { return headers_.size() + pending_.size(); }
+
+private:
+  enum class Stage { Headers, Scan, Done, Error };
+
+  int result() const {
+    switch (stage_) {
+    case Stage::Done:
+      return Finished;
+    case Stage::Error:
+      return Failed;
+    default:
+      return NeedMoreData;
+    }
+  }
+
+  // walks the marker segments from header_pos_ on until the SOS segment is
+  // whole, then parses them and moves what follows to the scan data
+  int readHeaders() {
+    if (header_pos_ == 0) {
+      if (headers_.size() < 2) {
+        return NeedMoreData;
+      }
+      if (headers_[0] != JFIF_BYTE_FF || headers_[1] != JFIF_SOI) {
+        return fail("No SOI marker\n");
+      }
+      header_pos_ = 2;
+    }
+    for (;;) {
+      if (headers_.size() - header_pos_ < 2) {
+        return NeedMoreData;
+      }
+      const auto marker = headers_[header_pos_ + 1];
+      if (headers_[header_pos_] != JFIF_BYTE_FF || marker == JFIF_BYTE_FF) {
+        ++header_pos_; // not a marker yet, or a fill byte
+        continue;
+      }
+      if (marker == JFIF_EOI) {
+        return fail("No scan before EOI\n");
+      }
+      if (marker == JFIF_BYTE_0 || marker == JFIF_SOI ||
+          (marker >= JFIF_RST0 && marker <= JFIF_RST7)) {
+        header_pos_ += 2;
+        continue;
+      }
+      if (headers_.size() - header_pos_ < 4) {
+        return NeedMoreData;
+      }
+      const auto end = header_pos_ + 2 +
+                       ((headers_[header_pos_ + 2] << 8) |
+                        headers_[header_pos_ + 3]);
+      if (headers_.size() < end) {
+        return NeedMoreData;
+      }
+      header_pos_ = end;
+      if (marker == JFIF_SOS) {
+        break;
+      }
+    }
+
+    // the parser keeps views into headers_, which isn't touched from here
+    pending_.assign(headers_.begin() + header_pos_, headers_.end());
+    headers_.resize(header_pos_);
+    if (parser_.parse(headers_.data(), headers_.size()) != 0 ||
+        !startScan()) {
+      stage_ = Stage::Error;
+      return Failed;
+    }
+    stage_ = mcu_total_ > 0 ? Stage::Scan : Stage::Done;
+    return Finished;
+  }
+
+  bool startScan() {
+    if (!JPEGDecoder::isSupported(parser_) ||
+        !decoder_.prepare(parser_, JPEGDecoder::kStreamingMCURows)) {
+      return false;
+    }
+    const auto &scans = parser_.getScans();
+    if (decoder_.cropped_ || decoder_.progressive_ || scans.size() != 1 ||
+        !decoder_.prepareScan(parser_, scans[0]) ||
+        decoder_.scan_component_count_ != decoder_.component_count_) {
+      LOG_ERROR("Push decoding needs an interleaved sequential scan\n");
+      return false;
+    }
+    mcus_per_row_ = decoder_.mcus_x_;
+    mcu_total_ = decoder_.mcus_x_ * decoder_.mcus_y_;
+    mcus_per_interval_ =
+        scans[0].restart_interval > 0 ? scans[0].restart_interval : mcu_total_;
+    bands_ = decoder_.prepareRowBands(format_, 1);
+    if (mcu_total_ > 0) {
+      decoder_.clearMCURow(0);
+    }
+    return true;
+  }
+
+  // decodes MCU by MCU until the data runs out in the middle of one, which
+  // is decoded again with the next chunk
+  void decodeScan() {
+    auto stream = streamAt(stream_base_, bit_offset_);
+    while (mcu_ < mcu_total_) {
+      if (restart_pending_) {
+        auto pos = stream_base_ + (stream.getDataBitOffset() + 7) / 8;
+        const auto marker = findMarker(pos);
+        if (marker == 0) {
+          break;
+        }
+        if (marker < JFIF_RST0 || marker > JFIF_RST7) {
+          endScan(); // the rest of the scan is missing
+          return;
+        }
+        restart_pending_ = false;
+        stream_base_ = pos + 2;
+        stream = streamAt(stream_base_, 0);
+        pre_dc_values_.fill(0);
+      }
+      const auto saved_stream = stream;
+      const auto saved_pre_dc_values = pre_dc_values_;
+      decoder_.decodeMCUs(stream, pre_dc_values_, mcu_, 1, mcus_per_row_);
+      if (stream.isOverrun() && stream.getMarker() == 0) {
+        stream = saved_stream;
+        pre_dc_values_ = saved_pre_dc_values;
+        break;
+      }
+      ++mcu_;
+      restart_pending_ = mcu_ % mcus_per_interval_ == 0;
+      if (mcu_ % mcus_per_row_ == 0 || mcu_ == mcu_total_) {
+        endMCURow();
+      }
+    }
+    if (stage_ != Stage::Scan) {
+      return;
+    }
+    // drops the bytes decoded, what is kept is at most an MCU and a chunk
+    const auto offset = stream.getDataBitOffset();
+    const auto consumed = std::min(stream_base_ + offset / 8, pending_.size());
+    pending_.erase(pending_.begin(), pending_.begin() + consumed);
+    stream_base_ = stream_base_ + offset / 8 - consumed;
+    bit_offset_ = offset % 8;
+  }
+
+  BitStream streamAt(size_t byte, size_t bit) {
+    byte = std::min(byte, pending_.size());
+    BitStream stream(pending_.data() + byte, pending_.size() - byte);
+    stream.getBits(static_cast<int>(bit));
+    return stream;
+  }
+
+  // the marker from `pos` on, fill bytes and stray data skipped, 0 if the
+  // data ends first. `pos` is left on its 0xFF.
+  uint8_t findMarker(size_t &pos) const {
+    for (; pos + 1 < pending_.size(); ++pos) {
+      const auto marker = pending_[pos + 1];
+      if (pending_[pos] == JFIF_BYTE_FF && marker != JFIF_BYTE_FF &&
+          marker != JFIF_BYTE_0) {
+        return marker;
+      }
+    }
+    return 0;
+  }
+
+  // the band above a decoded MCU row is converted now that the row below
+  // it, which the upsampler reads, is there
+  void endMCURow() {
+    const auto mcu_row = (mcu_ - 1) / mcus_per_row_;
+    if (mcu_row > 0) {
+      emitBand(mcu_row - 1);
+    }
+    if (mcu_ == mcu_total_) {
+      emitBand(mcu_row);
+      stage_ = Stage::Done;
+      return;
+    }
+    decoder_.clearMCURow(mcu_row + 1);
+  }
+
+  void emitBand(size_t mcu_row) {
+    decoder_.convertBand(bands_, mcu_row, 0);
+    decoder_.emitBand(bands_, mcu_row, 0, sink_);
+  }
+
+  // the MCU rows left are output, the samples of the MCUs not decoded
+  // stay 0, see clearMCURow()
+  void endScan() {
+    while (stage_ == Stage::Scan) {
+      mcu_ = std::min((mcu_ / mcus_per_row_ + 1) * mcus_per_row_, mcu_total_);
+      endMCURow();
+    }
+    pending_.clear();
+  }
+
+  int fail(const char *message) {
+    LOG_ERROR("%s", message);
+    stage_ = Stage::Error;
+    return Failed;
+  }
+
+  JFIFParser parser_;
+  JPEGDecoder decoder_;
+  PixelFormat format_{PixelFormat::RGB};
+  JPEGDecoder::RowSink sink_;
+  JPEGDecoder::RowBands bands_;
+  Stage stage_{Stage::Headers};
+  std::vector<uint8_t> headers_; // up to the end of the SOS segment
+  size_t header_pos_{0};         // where readHeaders() goes on
+  std::vector<uint8_t> pending_; // scan data not decoded yet
+  size_t stream_base_{0};        // of the stream in pending_
+  size_t bit_offset_{0};         // of the next MCU in its first byte
+  std::array<int16_t, JPEGDecoder::kMaxComponents> pre_dc_values_{};
+  size_t mcu_{0};
+  bool restart_pending_{false}; // a restart marker comes before mcu_
+  size_t mcus_per_row_{0};
+  size_t mcu_total_{0};
+  size_t mcus_per_interval_{0};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_PUSH_DECODER_H
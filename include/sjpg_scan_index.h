@@ -0,0 +1,298 @@
+//
+// Created by user on 8/5/25.
+//
+
+#ifndef SJPG_SCAN_INDEX_H
+#define SJPG_SCAN_INDEX_H
+#include "sjpg_jfif_parser.h"
+#include "sjpg_log.h"
+#include "sjpg_mapped_file.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace sjpg_codec {
+// where the entropy decoding of a scan can start over: the MCU, the bit of
+// the scan data holding its first block, stuffed bytes counted, and the DC
+// predictions before it
+struct ScanCheckpoint {
+  uint64_t mcu{0};
+  uint64_t bit_offset{0};
+  std::array<int16_t, 3> dc_predictors{};
+};
+
+// Random access into the scan of a large sequential image, built by
+// JPEGDecoder::buildScanIndex() and used by cropped decodes, see
+// JPEGDecoder::setScanIndex(). It is kept in the file format itself, so a
+// saved index is opened by mapping it with nothing to parse:
+//
+//   header, little endian
+//     char[8]  "SJPGIDX\0"
+//     uint32   version
+//     uint32   component count
+//     uint32   image width, uint32 image height
+//     uint64   scan data size in bytes
+//     uint64   MCU count
+//     uint32   MCUs between checkpoints, uint32 restart interval
+//     uint64   checkpoint count
+//     uint64   hash of the scan data
+//   checkpoints, kCheckpointSize bytes each in MCU order
+//     uint64   MCU, uint64 bit offset, int16[3] DC predictions, 2 bytes 0
+//
+// A checkpoint is recorded every N MCUs and at the start of every restart
+// interval. The scan hash tells apart images of the same size and scan
+// length, whose checkpoints would point into the wrong bits.
+class ScanIndex {
+public:
+  constexpr static uint32_t kVersion = 2;
+  constexpr static size_t kHeaderSize = 64;
+  constexpr static size_t kCheckpointSize = 24;
+
+  // the image the index is for, to tell whether it belongs to a file
+  struct Header {
+    uint32_t component_count{0};
+    uint32_t width{0};
+    uint32_t height{0};
+    uint64_t scan_size{0};
+    uint64_t mcu_count{0};
+    uint32_t checkpoint_mcus{0};
+    uint32_t restart_interval{0};
+    uint64_t scan_hash{0};
+
+    // the fields that cost nothing to get from the headers
+    bool hasLayoutOf(const Header &other) const {
+      return component_count == other.component_count &&
+             width == other.width && height == other.height &&
+             scan_size == other.scan_size && mcu_count == other.mcu_count &&
+             restart_interval == other.restart_interval;
+    }
+
+    bool operator==(const Header &other) const {
+      return hasLayoutOf(other) && scan_hash == other.scan_hash;
+    }
+  };
+
+  // starts an index of no checkpoint, see add()
+  void reset(const Header &header) {
+    file_.close();
+    buffer_.assign(kHeaderSize, 0);
+    std::memcpy(buffer_.data(), kMagic, sizeof(kMagic));
+    store32(buffer_.data() + 8, kVersion);
+    store32(buffer_.data() + 12, header.component_count);
+    store32(buffer_.data() + 16, header.width);
+    store32(buffer_.data() + 20, header.height);
+    store64(buffer_.data() + 24, header.scan_size);
+    store64(buffer_.data() + 32, header.mcu_count);
+    store32(buffer_.data() + 40, header.checkpoint_mcus);
+    store32(buffer_.data() + 44, header.restart_interval);
+    store64(buffer_.data() + 56, header.scan_hash);
+    header_ = header;
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    count_ = 0;
+  }
+
+  // checkpoints come in MCU order
+  void add(const ScanCheckpoint &checkpoint) {
+    const auto offset = buffer_.size();
+    buffer_.resize(offset + kCheckpointSize, 0);
+    auto *p = buffer_.data() + offset;
+    store64(p, checkpoint.mcu);
+    store64(p + 8, checkpoint.bit_offset);
+    for (size_t i = 0; i < checkpoint.dc_predictors.size(); ++i) {
+      store16(p + 16 + 2 * i, static_cast<uint16_t>(checkpoint.dc_predictors[i]));
+    }
+    ++count_;
+    store64(buffer_.data() + 48, count_);
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+  }
+
+  // uses `size` bytes of an index at `data` in place, they must outlive it.
+  // False if they aren't an index of this version.
+  bool load(const uint8_t *data, size_t size) {
+    clear();
+    if (data == nullptr || size < kHeaderSize ||
+        std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+      LOG_ERROR("Not a scan index\n");
+      return false;
+    }
+    if (load32(data + 8) != kVersion) {
+      LOG_ERROR("Unsupported scan index version %u\n", load32(data + 8));
+      return false;
+    }
+    Header header;
+    header.component_count = load32(data + 12);
+    header.width = load32(data + 16);
+    header.height = load32(data + 20);
+    header.scan_size = load64(data + 24);
+    header.mcu_count = load64(data + 32);
+    header.checkpoint_mcus = load32(data + 40);
+    header.restart_interval = load32(data + 44);
+    header.scan_hash = load64(data + 56);
+    const auto count = load64(data + 48);
+    if (count > (size - kHeaderSize) / kCheckpointSize) {
+      LOG_ERROR("Truncated scan index\n");
+      return false;
+    }
+    header_ = header;
+    data_ = data;
+    size_ = size;
+    count_ = count;
+    return true;
+  }
+
+  // maps a file written by save()
+  bool open(const std::string &path) {
+    MappedFile file;
+    if (!file.open(path)) {
+      return false;
+    }
+    if (!load(file.data(), file.size())) {
+      return false;
+    }
+    file_ = std::move(file);
+    return true;
+  }
+
+  bool save(const std::string &path) const {
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char *>(data_),
+                 static_cast<std::streamsize>(size_));
+    if (!stream) {
+      LOG_ERROR("Failed to write scan index: %s\n", path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  void clear() {
+    file_.close();
+    buffer_.clear();
+    header_ = {};
+    data_ = nullptr;
+    size_ = 0;
+    count_ = 0;
+  }
+
+  bool empty() const { return count_ == 0; }
+  const Header &getHeader() const { return header_; }
+  // the index as saved
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+
+  size_t getCheckpointCount() const { return static_cast<size_t>(count_); }
+
+  ScanCheckpoint getCheckpoint(size_t i) const {
+    const auto *p = data_ + kHeaderSize + i * kCheckpointSize;
+    ScanCheckpoint checkpoint;
+    checkpoint.mcu = load64(p);
+    checkpoint.bit_offset = load64(p + 8);
+    for (size_t c = 0; c < checkpoint.dc_predictors.size(); ++c) {
+      checkpoint.dc_predictors[c] = static_cast<int16_t>(load16(p + 16 + 2 * c));
+    }
+    return checkpoint;
+  }
+
+  // the last checkpoint at or before `mcu`
+  size_t findCheckpoint(uint64_t mcu) const {
+    size_t low = 0;
+    size_t high = getCheckpointCount();
+    while (high - low > 1) {
+      const auto middle = low + (high - low) / 2;
+      if (load64(data_ + kHeaderSize + middle * kCheckpointSize) <= mcu) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  }
+
+  // the header an index of the first scan of `parser` has, but for
+  // checkpoint_mcus which isn't compared. The scan is read to hash it
+  // unless `hash_scan` is false.
+  static Header headerOf(JFIFParser &parser, bool hash_scan = true) {
+    Header header;
+    const auto *sof0 = parser.getSOF0Segment();
+    if (sof0 == nullptr || parser.getScans().empty()) {
+      return header;
+    }
+    int max_h = 1;
+    int max_v = 1;
+    // a single component is coded block by block, ITU-T.81 A.2.1
+    if (sof0->num_components > 1) {
+      for (auto factor : sof0->sampling_factor) {
+        max_h = std::max(max_h, factor >> 4);
+        max_v = std::max(max_v, factor & 0x0F);
+      }
+    }
+    const auto mcu_width = static_cast<uint64_t>(8 * max_h);
+    const auto mcu_height = static_cast<uint64_t>(8 * max_v);
+    header.component_count = sof0->num_components;
+    header.width = sof0->width;
+    header.height = sof0->height;
+    header.scan_size = parser.getEncodedData().size();
+    header.mcu_count = ((sof0->width + mcu_width - 1) / mcu_width) *
+                       ((sof0->height + mcu_height - 1) / mcu_height);
+    header.restart_interval = parser.getScans().front().restart_interval;
+    if (hash_scan) {
+      header.scan_hash = hashScan(parser.getEncodedData());
+    }
+    return header;
+  }
+
+  // FNV-1a like TableCache's, over 8-byte words
+  static uint64_t hashScan(ByteSpan scan) {
+    uint64_t hash = kFNVOffset;
+    size_t i = 0;
+    for (; i + 8 <= scan.size(); i += 8) {
+      hash = (hash ^ load64(scan.data() + i)) * kFNVPrime;
+    }
+    for (; i < scan.size(); ++i) {
+      hash = (hash ^ scan.data()[i]) * kFNVPrime;
+    }
+    return hash;
+  }
+
+private:
+  constexpr static char kMagic[8] = {'S', 'J', 'P', 'G', 'I', 'D', 'X', '\0'};
+  constexpr static uint64_t kFNVOffset = 14695981039346656037ull;
+  constexpr static uint64_t kFNVPrime = 1099511628211ull;
+
+  static void store16(uint8_t *p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+  }
+  static void store32(uint8_t *p, uint32_t v) {
+    store16(p, static_cast<uint16_t>(v));
+    store16(p + 2, static_cast<uint16_t>(v >> 16));
+  }
+  static void store64(uint8_t *p, uint64_t v) {
+    store32(p, static_cast<uint32_t>(v));
+    store32(p + 4, static_cast<uint32_t>(v >> 32));
+  }
+  static uint16_t load16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+  }
+  static uint32_t load32(const uint8_t *p) {
+    return load16(p) | (static_cast<uint32_t>(load16(p + 2)) << 16);
+  }
+  static uint64_t load64(const uint8_t *p) {
+    return load32(p) | (static_cast<uint64_t>(load32(p + 4)) << 32);
+  }
+
+  Header header_;
+  std::vector<uint8_t> buffer_; // a built index
+  MappedFile file_;             // an opened one
+  const uint8_t *data_{nullptr};
+  size_t size_{0};
+  uint64_t count_{0};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_SCAN_INDEX_H
@@ -0,0 +1,118 @@
+//
+// Created by user on 8/1/25.
+//
+
+#ifndef SJPG_SEGMENT_WRITER_H
+#define SJPG_SEGMENT_WRITER_H
+#include "sjpg_markers.h"
+#include "sjpg_segments.h"
+#include <cstdint>
+#include <vector>
+
+namespace sjpg_codec {
+// Serializes the segments the parser reads, marker included. The length
+// fields are computed from the contents, `length` and `file_pos` of the
+// structs are ignored.
+class SegmentWriter {
+public:
+  static void writeSOI(std::vector<uint8_t> &out) {
+    writeMarker(out, JFIF_SOI);
+  }
+
+  static void writeEOI(std::vector<uint8_t> &out) {
+    writeMarker(out, JFIF_EOI);
+  }
+
+  static void write(std::vector<uint8_t> &out,
+                    const segments::APP0Segment &app0) {
+    writeMarker(out, JFIF_APP0);
+    writeWord(out, 16 + app0.thumbnail_data.size());
+    out.insert(out.end(), app0.identifier, app0.identifier + 5);
+    out.push_back(static_cast<uint8_t>(app0.major_version));
+    out.push_back(static_cast<uint8_t>(app0.minor_version));
+    out.push_back(static_cast<uint8_t>(app0.pixel_units));
+    writeWord(out, app0.x_density);
+    writeWord(out, app0.y_density);
+    out.push_back(static_cast<uint8_t>(app0.thumbnail_width));
+    out.push_back(static_cast<uint8_t>(app0.thumbnail_height));
+    out.insert(out.end(), app0.thumbnail_data.begin(),
+               app0.thumbnail_data.end());
+  }
+
+  // all tables in one segment, `data` is in zigzag order and holds 2 bytes
+  // per value for 16-bit tables
+  static void write(std::vector<uint8_t> &out,
+                    const segments::DQTSegment &dqt) {
+    size_t length = 2;
+    for (const auto &table : dqt.tables) {
+      length += 1 + table.data.size();
+    }
+    writeMarker(out, JFIF_DQT);
+    writeWord(out, length);
+    for (const auto &table : dqt.tables) {
+      out.push_back(static_cast<uint8_t>((table.precision << 4) | table.id));
+      out.insert(out.end(), table.data.begin(), table.data.end());
+    }
+  }
+
+  static void write(std::vector<uint8_t> &out,
+                    const segments::SOF0Segment &sof0) {
+    writeMarker(out, sof0.frame_marker);
+    writeWord(out, 8 + 3 * sof0.num_components);
+    out.push_back(sof0.bitPerSample);
+    writeWord(out, sof0.height);
+    writeWord(out, sof0.width);
+    out.push_back(sof0.num_components);
+    for (size_t i = 0; i < sof0.num_components; ++i) {
+      out.push_back(sof0.component_id[i]);
+      out.push_back(sof0.sampling_factor[i]);
+      out.push_back(sof0.quantization_table_id[i]);
+    }
+  }
+
+  static void write(std::vector<uint8_t> &out,
+                    const segments::DHTSegment &dht) {
+    writeMarker(out, JFIF_DHT);
+    writeWord(out, 3 + dht.symbol_counts.size() + dht.symbols.size());
+    out.push_back(static_cast<uint8_t>((dht.dc_or_ac << 4) | dht.table_id));
+    out.insert(out.end(), dht.symbol_counts.begin(), dht.symbol_counts.end());
+    out.insert(out.end(), dht.symbols.begin(), dht.symbols.end());
+  }
+
+  static void write(std::vector<uint8_t> &out,
+                    const segments::DRISegment &dri) {
+    writeMarker(out, JFIF_DRI);
+    writeWord(out, 4);
+    writeWord(out, dri.restart_interval);
+  }
+
+  static void write(std::vector<uint8_t> &out,
+                    const segments::SOSSegment &sos) {
+    writeMarker(out, JFIF_SOS);
+    writeWord(out, 6 + 2 * sos.num_components);
+    out.push_back(sos.num_components);
+    for (size_t i = 0; i < sos.num_components; ++i) {
+      out.push_back(sos.component_id[i]);
+      out.push_back(static_cast<uint8_t>((sos.huffman_table_id_dc[i] << 4) |
+                                         sos.huffman_table_id_ac[i]));
+    }
+    out.push_back(sos.spectral_start);
+    out.push_back(sos.spectral_end);
+    out.push_back(static_cast<uint8_t>((sos.approx_high << 4) |
+                                       sos.approx_low));
+  }
+
+private:
+  static void writeMarker(std::vector<uint8_t> &out, uint8_t marker) {
+    out.push_back(JFIF_BYTE_FF);
+    out.push_back(marker);
+  }
+
+  static void writeWord(std::vector<uint8_t> &out, size_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+  }
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_SEGMENT_WRITER_H
@@ -5,9 +5,18 @@
 
 #include "sjpg_log.h"
 #include "sjpg_markers.h"
+#include <string>
 #include <vector>
 namespace sjpg_codec::segments {
 
+// where a marker segment sits in the parsed data, nothing is copied
+class SegmentView {
+public:
+  uint8_t marker{0};
+  size_t offset{0}; // segment start position in data(without marker)
+  size_t length{0}; // the segment length field, 0 for markers without one
+};
+
 class SOISegment {
 public:
   size_t file_pos{0}; // segment start position in file(without marker)
@@ -120,10 +129,17 @@ public:
   std::vector<uint8_t> component_id;
   std::vector<uint8_t> sampling_factor;
   std::vector<uint8_t> quantization_table_id;
+  // the SOFn marker the frame was read from, every SOFn has this layout
+  uint8_t frame_marker{JFIF_SOF0};
   static const uint8_t marker = JFIF_SOF0;
 
+  bool isProgressive() const {
+    return frame_marker == JFIF_SOF2 || frame_marker == JFIF_SOF6 ||
+           frame_marker == JFIF_SOF10 || frame_marker == JFIF_SOF14;
+  }
+
   void print() const {
-    LOG_INFO("SOF0 segment\n");
+    LOG_INFO("SOF%d segment\n", frame_marker - JFIF_SOF0);
     LOG_INFO("\tFile position: %zu\n", file_pos);
     LOG_INFO("\tLength: %d\n", length);
     LOG_INFO("\tBitPerSample: %d\n", bitPerSample);
@@ -171,6 +187,21 @@ public:
   }
 };
 
+class DRISegment {
+public:
+  size_t file_pos{0}; // segment start position in file(without marker)
+  uint16_t length{0};
+  uint16_t restart_interval{0}; // MCUs per restart interval, 0: disabled
+  static const uint8_t marker = JFIF_DRI;
+
+  void print() const {
+    LOG_INFO("DRI segment\n");
+    LOG_INFO("\tFile position: %zu\n", file_pos);
+    LOG_INFO("\tLength: %d\n", length);
+    LOG_INFO("\tRestart interval: %d\n", restart_interval);
+  }
+};
+
 class SOSSegment {
 public:
   size_t file_pos{0}; // segment start position in file(without marker)
@@ -179,6 +210,11 @@ public:
   std::vector<uint8_t> component_id;
   std::vector<uint8_t> huffman_table_id_dc;
   std::vector<uint8_t> huffman_table_id_ac;
+  // progressive parameters(ITU-T.81 G.1.1.1), 0, 63, 0, 0 for sequential
+  uint8_t spectral_start{0};
+  uint8_t spectral_end{63};
+  uint8_t approx_high{0};
+  uint8_t approx_low{0};
   static const uint8_t marker = JFIF_SOS;
 
   void print() {
@@ -191,6 +227,8 @@ public:
       LOG_INFO("\tHuffman table ID DC: %d\n", huffman_table_id_dc[i]);
       LOG_INFO("\tHuffman table ID AC: %d\n", huffman_table_id_ac[i]);
     }
+    LOG_INFO("\tSpectral selection: %d ~ %d\n", spectral_start, spectral_end);
+    LOG_INFO("\tSuccessive approximation: %d %d\n", approx_high, approx_low);
   }
 };
 
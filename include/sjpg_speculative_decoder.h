@@ -0,0 +1,348 @@
+//
+// Created by user on 7/31/25.
+//
+
+#ifndef SJPG_SPECULATIVE_DECODER_H
+#define SJPG_SPECULATIVE_DECODER_H
+#include "sjpg_bit_stream.h"
+#include "sjpg_memory_reader.h"
+#include "sjpg_thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace sjpg_codec {
+struct SpeculativeDecodeStats {
+  size_t scans{0}; // scans decoded in chunks
+  size_t chunks{0};
+  // scans the chunks of which didn't line up, decoded sequentially instead
+  size_t fallbacks{0};
+  // decoded from a wrong guess before the chunk lined up with the stream
+  uint64_t discarded_bits{0};
+};
+
+// Decodes the entropy-coded data of a scan without restart markers on
+// several threads, after Klein and Wiseman, "Parallel Huffman decoding with
+// applications to JPEG files". The data is cut into chunks decoded at the
+// same time, all but the first from a guess: a block of the MCU's first
+// component starts at the chunk's first bit. The guess is most likely
+// wrong, but Huffman codes resynchronize, a few hundred bits later the
+// guessed decode usually meets a block boundary of the real stream and
+// decodes the same blocks from there on. To find that point each chunk goes
+// on decoding into the next one until it reaches a block the next chunk
+// decoded too. DC coefficients are kept as differences until all chunks are
+// lined up and the predictors are known.
+class SpeculativeScanDecoder {
+public:
+  // how the blocks of an MCU repeat in the scan, a block's phase is its
+  // index in the MCU
+  struct MCUPattern {
+    int block_count{1};
+    // [p * block_count + q] is set when decoding from phase p on reads the
+    // stream like decoding from phase q on, i.e. with the same tables
+    std::vector<uint8_t> same_tables;
+    std::vector<uint8_t> dc_slots; // the DC predictor of each phase
+  };
+  constexpr static int kMaxDCSlots = 4;
+
+  // decodes `data` in `chunk_count` chunks on `pool`.
+  // `decode_block(bit_stream, phase, coefficients)` decodes a block with 0
+  // as DC predictor and returns its last zigzag index, it throws
+  // std::out_of_range on invalid codes. Returns false if the chunks don't
+  // line up, the scan has to be decoded sequentially then.
+  template <typename DecodeBlock>
+  bool decode(ByteSpan data, size_t chunk_count, size_t block_count,
+              const MCUPattern &pattern, ThreadPool &pool,
+              const DecodeBlock &decode_block) {
+    data_ = data;
+    pattern_ = &pattern;
+    block_count_ = block_count;
+    split(chunk_count);
+    pool.parallelFor(chunks_.size(),
+                     [&](size_t c) { guess(c, decode_block); });
+    for (size_t c = 1; c < chunks_.size(); ++c) {
+      const auto &previous = chunks_[c - 1];
+      chunks_[c].base = previous.base + previous.bits;
+    }
+    pool.parallelFor(chunks_.size() - 1,
+                     [&](size_t c) { follow(c, decode_block); });
+    return lineUp(pool);
+  }
+
+  // calls `f(block_index, coefficients, last_index)` for each block of the
+  // scan decoded by decode(), in parallel over the chunks
+  template <typename F> void forEachBlock(ThreadPool &pool, F &&f) {
+    pool.parallelFor(used_chunks_, [&](size_t c) {
+      auto &chunk = chunks_[c];
+      auto dc = chunk.dc;
+      forEachOwnedBlock(chunk, [&](size_t index, int16_t *coefficients,
+                                   int last_index) {
+        auto &predictor = dc[pattern_->dc_slots[index % blockCount()]];
+        predictor = static_cast<int16_t>(predictor + coefficients[0]);
+        coefficients[0] = predictor;
+        f(index, static_cast<const int16_t *>(coefficients), last_index);
+      });
+    });
+  }
+
+  uint64_t getDiscardedBits() const { return discarded_bits_; }
+
+private:
+  constexpr static size_t kNone = SIZE_MAX;
+  constexpr static int kCoefficients = 64;
+
+  struct Block {
+    uint64_t position{0}; // bits from the start of the chunk
+    uint8_t phase{0};
+    uint8_t last_index{0};
+  };
+
+  // blocks decoded in a row
+  struct Run {
+    std::vector<Block> blocks;
+    std::vector<int16_t> coefficients; // natural order, DC as difference
+
+    void clear() {
+      blocks.clear();
+      coefficients.clear();
+    }
+  };
+
+  struct Chunk {
+    size_t start{0}; // bytes of data_
+    size_t end{0};
+    uint64_t base{0}; // bits before the chunk, stuffing removed
+    uint64_t bits{0};
+    Run guessed;  // from the start of the chunk to its end
+    Run followed; // past the end, up to where the next chunk lines up
+    // where guess() stopped, follow() carries on from there
+    BitStream stream;
+    size_t stream_start{0}; // byte of data_ the stream starts at
+    uint64_t stream_base{0}; // bits of the chunk before stream_start
+    int phase{0};
+    bool broken{false};  // the stream met an invalid code
+    size_t restarted{0}; // guessed blocks before the last new guess
+    size_t synced{kNone}; // the first guessed block of the real stream
+    size_t first_block{0}; // its index in the scan
+    std::array<int16_t, kMaxDCSlots> dc{}; // predictors before it
+  };
+
+  int blockCount() const { return pattern_->block_count; }
+
+  bool sameTables(int p, int q) const {
+    return pattern_->same_tables[p * blockCount() + q] != 0;
+  }
+
+  // the stream never starts on the 0x00 stuffed after 0xFF
+  size_t alignStart(size_t offset) const {
+    if (offset > 0 && offset < data_.size() && data_[offset - 1] == 0xFF) {
+      ++offset;
+    }
+    return offset;
+  }
+
+  // in entropy-coded data every 0xFF is followed by a stuffed 0x00
+  size_t stuffedBytes(size_t from, size_t to) const {
+    return static_cast<size_t>(
+        std::count(data_.data() + from, data_.data() + to, uint8_t{0xFF}));
+  }
+
+  void split(size_t chunk_count) {
+    chunks_.resize(chunk_count);
+    const auto chunk_size = data_.size() / chunk_count;
+    for (size_t c = 0; c < chunk_count; ++c) {
+      chunks_[c].start = alignStart(c * chunk_size);
+    }
+    for (size_t c = 0; c < chunk_count; ++c) {
+      chunks_[c].end =
+          c + 1 < chunk_count ? chunks_[c + 1].start : data_.size();
+    }
+  }
+
+  void startStream(Chunk &chunk, size_t offset) {
+    chunk.stream_start = offset;
+    chunk.stream_base =
+        (offset - chunk.start - stuffedBytes(chunk.start, offset)) * 8;
+    chunk.stream.reset(data_.data() + offset, data_.size() - offset);
+  }
+
+  uint64_t streamPosition(const Chunk &chunk) const {
+    return chunk.stream_base + chunk.stream.getPosition();
+  }
+
+  template <typename DecodeBlock>
+  void decodeBlock(Chunk &chunk, Run &run, int phase,
+                   const DecodeBlock &decode_block) {
+    const auto position = streamPosition(chunk);
+    run.coefficients.resize(run.coefficients.size() + kCoefficients);
+    auto *coefficients =
+        run.coefficients.data() + run.coefficients.size() - kCoefficients;
+    try {
+      const auto last_index = decode_block(chunk.stream, phase, coefficients);
+      run.blocks.push_back({position, static_cast<uint8_t>(phase),
+                            static_cast<uint8_t>(last_index)});
+    } catch (const std::out_of_range &) {
+      run.coefficients.resize(run.blocks.size() * kCoefficients);
+      throw;
+    }
+  }
+
+  template <typename DecodeBlock>
+  void guess(size_t c, const DecodeBlock &decode_block) {
+    auto &chunk = chunks_[c];
+    chunk.guessed.clear();
+    chunk.followed.clear();
+    chunk.base = 0;
+    chunk.bits =
+        (chunk.end - chunk.start - stuffedBytes(chunk.start, chunk.end)) * 8;
+    chunk.broken = false;
+    chunk.restarted = 0;
+    // the first chunk starts where the real stream does
+    chunk.synced = c == 0 ? 0 : kNone;
+    startStream(chunk, chunk.start);
+
+    int phase = 0;
+    while (streamPosition(chunk) < chunk.bits) {
+      try {
+        decodeBlock(chunk, chunk.guessed, phase, decode_block);
+      } catch (const std::out_of_range &) {
+        // the real stream is corrupt, or a wrong guess met bits that are
+        // no code: guess again past them
+        auto offset = alignStart(
+            chunk.stream_start +
+            std::max<size_t>(chunk.stream.getBytePosition(), 1));
+        if (c == 0 || offset >= chunk.end) {
+          chunk.broken = true;
+          return;
+        }
+        startStream(chunk, offset);
+        chunk.restarted = chunk.guessed.blocks.size();
+        phase = 0;
+        continue;
+      }
+      phase = phase + 1 == blockCount() ? 0 : phase + 1;
+    }
+    chunk.phase = phase;
+  }
+
+  // the guessed block of `chunk` at `position` if decoding from there is
+  // decoding the real stream, which is at `phase`
+  size_t findBlock(const Chunk &chunk, uint64_t position, int phase) const {
+    const auto &blocks = chunk.guessed.blocks;
+    auto found = std::lower_bound(
+        blocks.begin() + chunk.restarted, blocks.end(), position,
+        [](const Block &block, uint64_t p) { return block.position < p; });
+    if (found == blocks.end() || found->position != position ||
+        !sameTables(phase, found->phase)) {
+      return kNone;
+    }
+    return static_cast<size_t>(found - blocks.begin());
+  }
+
+  // decodes from the end of chunk `c` into the next one up to the first
+  // block the next chunk has decoded too. Only the result for a chunk that
+  // has lined up itself is used.
+  template <typename DecodeBlock>
+  void follow(size_t c, const DecodeBlock &decode_block) {
+    auto &chunk = chunks_[c];
+    auto &next = chunks_[c + 1];
+    if (chunk.broken) {
+      return;
+    }
+    const auto end = next.base + next.bits;
+    auto phase = chunk.phase;
+    for (;;) {
+      const auto position = chunk.base + streamPosition(chunk);
+      if (position >= end) {
+        return;
+      }
+      if (position >= next.base) {
+        auto found = findBlock(next, position - next.base, phase);
+        if (found != kNone) {
+          next.synced = found;
+          return;
+        }
+      }
+      try {
+        decodeBlock(chunk, chunk.followed, phase, decode_block);
+      } catch (const std::out_of_range &) {
+        return;
+      }
+      phase = phase + 1 == blockCount() ? 0 : phase + 1;
+    }
+  }
+
+  // `f(index, coefficients, last_index)` for the blocks of the chunk that
+  // belong to the real stream
+  template <typename F> void forEachOwnedBlock(Chunk &chunk, F &&f) {
+    auto index = chunk.first_block;
+    auto visit = [&](Run &run, size_t from) {
+      for (auto i = from; i < run.blocks.size() && index < block_count_;
+           ++i, ++index) {
+        f(index, run.coefficients.data() + i * kCoefficients,
+          static_cast<int>(run.blocks[i].last_index));
+      }
+    };
+    visit(chunk.guessed, chunk.synced);
+    visit(chunk.followed, 0);
+  }
+
+  // numbers the blocks of the chunks that lined up and finds the DC
+  // predictors each of them starts with
+  bool lineUp(ThreadPool &pool) {
+    size_t index = 0;
+    used_chunks_ = 0;
+    discarded_bits_ = 0;
+    for (auto &chunk : chunks_) {
+      if (index >= block_count_) {
+        break;
+      }
+      if (chunk.synced == kNone) {
+        return false;
+      }
+      chunk.first_block = index;
+      index += chunk.guessed.blocks.size() - chunk.synced +
+               chunk.followed.blocks.size();
+      if (chunk.synced < chunk.guessed.blocks.size()) {
+        discarded_bits_ += chunk.guessed.blocks[chunk.synced].position;
+      }
+      ++used_chunks_;
+    }
+    if (index < block_count_) {
+      // the data ends early, left to the sequential decode
+      return false;
+    }
+
+    dc_sums_.assign(used_chunks_, {});
+    pool.parallelFor(used_chunks_, [&](size_t c) {
+      auto &sums = dc_sums_[c];
+      forEachOwnedBlock(chunks_[c], [&](size_t i, int16_t *coefficients,
+                                        int) {
+        auto &sum = sums[pattern_->dc_slots[i % blockCount()]];
+        sum = static_cast<int16_t>(sum + coefficients[0]);
+      });
+    });
+    std::array<int16_t, kMaxDCSlots> dc{};
+    for (size_t c = 0; c < used_chunks_; ++c) {
+      chunks_[c].dc = dc;
+      for (int i = 0; i < kMaxDCSlots; ++i) {
+        dc[i] = static_cast<int16_t>(dc[i] + dc_sums_[c][i]);
+      }
+    }
+    return true;
+  }
+
+  ByteSpan data_;
+  const MCUPattern *pattern_{nullptr};
+  size_t block_count_{0};
+  // kept from one scan to the next, like the decoder's planes
+  std::vector<Chunk> chunks_;
+  std::vector<std::array<int16_t, kMaxDCSlots>> dc_sums_;
+  size_t used_chunks_{0};
+  uint64_t discarded_bits_{0};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_SPECULATIVE_DECODER_H
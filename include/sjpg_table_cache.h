@@ -0,0 +1,266 @@
+//
+// Created by user on 7/30/25.
+//
+
+#ifndef SJPG_TABLE_CACHE_H
+#define SJPG_TABLE_CACHE_H
+#include "sjpg_huffman_table.h"
+#include "sjpg_idct.h"
+#include "sjpg_memory_reader.h"
+#include "sjpg_standard_tables.h"
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace sjpg_codec {
+struct TableCacheStats {
+  uint64_t hits{0};
+  uint64_t misses{0};
+  uint64_t evictions{0};
+  size_t size{0}; // tables held
+};
+
+// Compiled tables by the raw bytes they were built from, least recently
+// used first out. Lookups hash the bytes and compare them with the entry, so
+// a hash collision costs a rebuild and never returns the wrong table.
+template <typename Table> class LRUTableCache {
+public:
+  explicit LRUTableCache(size_t capacity) : capacity_(capacity) {}
+
+  // the table built from `first` followed by `second`, `build()` is called
+  // on a miss. A hit takes a lock and doesn't allocate. Null if `build()`
+  // returns null.
+  template <typename Build>
+  std::shared_ptr<const Table> get(ByteSpan first, ByteSpan second,
+                                   Build &&build) {
+    const auto hash = hashBytes(second, hashBytes(first, kFNVOffset));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = index_.find(hash);
+      if (found != index_.end() && matches(*found->second, first, second)) {
+        // most recently used first
+        entries_.splice(entries_.begin(), entries_, found->second);
+        ++stats_.hits;
+        return found->second->table;
+      }
+      ++stats_.misses;
+    }
+
+    // built outside the lock, two threads may build the same table once
+    std::shared_ptr<const Table> table = build();
+    if (table == nullptr) {
+      return nullptr; // not a valid table, nothing to keep
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert(hash, first, second, table);
+    return table;
+  }
+
+  // adds a table that doesn't count as a miss
+  void seed(ByteSpan first, ByteSpan second,
+            std::shared_ptr<const Table> table) {
+    const auto hash = hashBytes(second, hashBytes(first, kFNVOffset));
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert(hash, first, second, std::move(table));
+  }
+
+  // 0 disables caching, every lookup builds a new table
+  void setCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    evictToCapacity();
+  }
+
+  size_t getCapacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+  }
+
+  TableCacheStats getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = stats_;
+    stats.size = entries_.size();
+    return stats;
+  }
+
+  void resetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = {};
+  }
+
+  // tables in use stay alive with their users
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+  }
+
+private:
+  struct Entry {
+    uint64_t hash{0};
+    std::vector<uint8_t> bytes;
+    std::shared_ptr<const Table> table;
+  };
+
+  // FNV-1a
+  constexpr static uint64_t kFNVOffset = 14695981039346656037ull;
+  constexpr static uint64_t kFNVPrime = 1099511628211ull;
+
+  static uint64_t hashBytes(ByteSpan bytes, uint64_t hash) {
+    for (auto byte : bytes) {
+      hash = (hash ^ byte) * kFNVPrime;
+    }
+    return hash;
+  }
+
+  static bool matches(const Entry &entry, ByteSpan first, ByteSpan second) {
+    return entry.bytes.size() == first.size() + second.size() &&
+           std::equal(first.begin(), first.end(), entry.bytes.begin()) &&
+           std::equal(second.begin(), second.end(),
+                      entry.bytes.begin() + first.size());
+  }
+
+  // mutex_ is held
+  void insert(uint64_t hash, ByteSpan first, ByteSpan second,
+              std::shared_ptr<const Table> table) {
+    if (capacity_ == 0) {
+      return;
+    }
+    auto found = index_.find(hash);
+    if (found != index_.end()) {
+      // same bytes built twice, or a collision: the newer one wins
+      entries_.erase(found->second);
+      index_.erase(found);
+    }
+    Entry entry{hash, {}, std::move(table)};
+    entry.bytes.reserve(first.size() + second.size());
+    entry.bytes.insert(entry.bytes.end(), first.begin(), first.end());
+    entry.bytes.insert(entry.bytes.end(), second.begin(), second.end());
+    entries_.push_front(std::move(entry));
+    index_[hash] = entries_.begin();
+    evictToCapacity();
+  }
+
+  void evictToCapacity() {
+    while (entries_.size() > capacity_) {
+      index_.erase(entries_.back().hash);
+      entries_.pop_back();
+      ++stats_.evictions;
+    }
+  }
+
+  mutable std::mutex mutex_; // guards the members below
+  size_t capacity_;
+  std::list<Entry> entries_; // most recently used first
+  std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index_;
+  TableCacheStats stats_;
+};
+
+// Process-wide cache of the Huffman and dequantization tables built from
+// DHT and DQT segments. Images from the same camera or encoder share their
+// tables, most of them the Annex K ones the cache starts with, so decoding
+// them skips building the tables. Thread-safe, the decoders of all threads
+// share global().
+class TableCache {
+public:
+  constexpr static size_t kDefaultCapacity = 64;
+
+  explicit TableCache(size_t capacity = kDefaultCapacity)
+      : huffman_tables_(capacity), dequant_tables_(capacity) {
+    seedAnnexK();
+  }
+
+  static TableCache &global() {
+    static TableCache cache;
+    return cache;
+  }
+
+  // null if the DHT isn't a valid code
+  std::shared_ptr<const HuffmanTable>
+  getHuffmanTable(const std::vector<uint8_t> &symbol_counts,
+                  const std::vector<uint8_t> &symbols) {
+    return huffman_tables_.get(
+        {symbol_counts.data(), symbol_counts.size()},
+        {symbols.data(), symbols.size()},
+        [&]() -> std::shared_ptr<const HuffmanTable> {
+          if (!HuffmanTable::isValid(symbol_counts, symbols)) {
+            return nullptr;
+          }
+          return std::make_shared<const HuffmanTable>(symbol_counts, symbols);
+        });
+  }
+
+  // `zigzag_data` is the quantization table as stored in DQT
+  std::shared_ptr<const DequantTable>
+  getDequantTable(const std::vector<uint8_t> &zigzag_data) {
+    return dequant_tables_.get({zigzag_data.data(), zigzag_data.size()}, {},
+                               [&] {
+                                 return std::make_shared<const DequantTable>(
+                                     DequantTable::build(zigzag_data));
+                               });
+  }
+
+  // per kind of table, the Annex K tables are not counted as misses
+  TableCacheStats getHuffmanStats() const { return huffman_tables_.getStats(); }
+  TableCacheStats getDequantStats() const { return dequant_tables_.getStats(); }
+
+  void resetStats() {
+    huffman_tables_.resetStats();
+    dequant_tables_.resetStats();
+  }
+
+  // tables per kind, 0 disables caching
+  void setCapacity(size_t capacity) {
+    huffman_tables_.setCapacity(capacity);
+    dequant_tables_.setCapacity(capacity);
+  }
+  size_t getCapacity() const { return huffman_tables_.getCapacity(); }
+
+  // drops all tables and starts over from the Annex K ones
+  void clear() {
+    huffman_tables_.clear();
+    dequant_tables_.clear();
+    seedAnnexK();
+  }
+
+private:
+  void seedAnnexK() {
+    seedHuffman(annex_k::kDCLuminanceCounts, annex_k::kDCLuminanceSymbols);
+    seedHuffman(annex_k::kDCChrominanceCounts, annex_k::kDCChrominanceSymbols);
+    seedHuffman(annex_k::kACLuminanceCounts, annex_k::kACLuminanceSymbols);
+    seedHuffman(annex_k::kACChrominanceCounts, annex_k::kACChrominanceSymbols);
+    seedDequant(annex_k::kLuminanceQuantization);
+    seedDequant(annex_k::kChrominanceQuantization);
+  }
+
+  template <size_t kSymbolCount>
+  void seedHuffman(const uint8_t (&counts)[16],
+                   const uint8_t (&symbols)[kSymbolCount]) {
+    std::vector<uint8_t> count_bytes(std::begin(counts), std::end(counts));
+    std::vector<uint8_t> symbol_bytes(std::begin(symbols), std::end(symbols));
+    huffman_tables_.seed(
+        {counts, 16}, {symbols, kSymbolCount},
+        std::make_shared<const HuffmanTable>(count_bytes, symbol_bytes));
+  }
+
+  // `natural` is in natural order, DQT stores zigzag order
+  void seedDequant(const uint8_t (&natural)[64]) {
+    std::vector<uint8_t> zigzag(64);
+    for (int i = 0; i < 64; ++i) {
+      zigzag[i] = natural[kNaturalOrder[i]];
+    }
+    dequant_tables_.seed(
+        {zigzag.data(), zigzag.size()}, {},
+        std::make_shared<const DequantTable>(DequantTable::build(zigzag)));
+  }
+
+  LRUTableCache<HuffmanTable> huffman_tables_;
+  LRUTableCache<DequantTable> dequant_tables_;
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_TABLE_CACHE_H
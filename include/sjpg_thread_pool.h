@@ -0,0 +1,151 @@
+//
+// Created by user on 7/24/25.
+//
+
+#ifndef SJPG_THREAD_POOL_H
+#define SJPG_THREAD_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sjpg_codec {
+// Fixed-size pool of worker threads. A pool can be shared by several
+// decoders, the threads are joined when the pool is destroyed.
+class ThreadPool {
+public:
+  // 0 picks the number of hardware threads
+  explicit ThreadPool(size_t thread_count = 0) {
+    if (thread_count == 0) {
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+      workers_.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers_.size(); }
+
+  template <typename F> auto submit(F &&task) {
+    using Result = decltype(task());
+    auto packaged =
+        std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    auto future = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace_back([packaged] { (*packaged)(); });
+    }
+    cv_.notify_one();
+    return future;
+  }
+
+  // runs body(0) ... body(count - 1) and returns when all of them are done.
+  // The calling thread takes part, so this is safe to call from a worker
+  // of the same pool. The first exception thrown by body is rethrown.
+  void parallelFor(size_t count, const std::function<void(size_t)> &body) {
+    if (count == 0) {
+      return;
+    }
+    auto state = std::make_shared<ParallelForState>();
+    state->count = count;
+    state->body = &body;
+
+    const auto helpers = std::min(count - 1, size());
+    for (size_t i = 0; i < helpers; ++i) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace_back([state] { state->run(); });
+      }
+      cv_.notify_one();
+    }
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->done == state->count; });
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+  }
+
+private:
+  struct ParallelForState {
+    std::atomic<size_t> next{0};
+    size_t count{0};
+    size_t done{0}; // guarded by mutex
+    // only dereferenced while an index is claimed, i.e. before the caller
+    // of parallelFor returns
+    const std::function<void(size_t)> *body{nullptr};
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    void run() {
+      for (;;) {
+        auto index = next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= count) {
+          return;
+        }
+        std::exception_ptr failure;
+        try {
+          (*body)(index);
+        } catch (...) {
+          failure = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failure && !error) {
+          error = failure;
+        }
+        if (++done == count) {
+          cv.notify_all();
+        }
+      }
+    }
+  };
+
+  void workerLoop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (stopping_ && tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_THREAD_POOL_H
@@ -0,0 +1,414 @@
+//
+// Created by user on 7/25/25.
+//
+
+#ifndef SJPG_UPSAMPLE_H
+#define SJPG_UPSAMPLE_H
+#include "sjpg_color_convert.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace sjpg_codec {
+enum class UpsampleMode {
+  Fancy = 0, // triangle filter, libjpeg's do_fancy_upsampling
+  Fast = 1,  // sample replication
+};
+
+// one decoded component, rows are `stride` bytes apart
+struct PlaneView {
+  const uint8_t *data{nullptr};
+  size_t width{0}; // samples inside the image, the rows may hold more
+  size_t height{0};
+  size_t stride{0};
+  // non-zero if only a window of the plane is kept, row y is then stored
+  // at y % ring_rows
+  size_t ring_rows{0};
+
+  const uint8_t *row(size_t y) const {
+    return data + (ring_rows != 0 ? y % ring_rows : y) * stride;
+  }
+};
+
+// Brings one component to the image resolution a row at a time, so that the
+// color converter can consume it while it is still in cache. Fancy mode is
+// the triangle filter of libjpeg's jdsample.c for 2:1 ratios and produces
+// the same samples. Fast mode and every other integral ratio replicate.
+class Upsampler {
+public:
+  // `near` is the input row closest to the output row and `far` the other
+  // neighbour in the vertical direction, kernels that don't filter
+  // vertically ignore it. Writes 2 * in_width samples for horizontal 2:1.
+  using RowKernel = void (*)(const uint8_t *near, const uint8_t *far,
+                             size_t in_width, int bias, uint8_t *out);
+
+  struct Kernels {
+    RowKernel h2_fast;
+    RowKernel h2v1_fancy;
+    RowKernel h2v2_fancy;
+    RowKernel h1v2_fancy;
+  };
+
+  static Kernels select(SIMDLevel level) {
+#if defined(SJPG_ARCH_X86)
+    // rows are short and memory bound, AVX2 gains nothing over SSE2 here
+    if (level >= SIMDLevel::SSE2) {
+      return {&h2FastRowSSE2, &h2v1FancyRowSSE2, &h2v2FancyRowSSE2,
+              &h1v2FancyRowSSE2};
+    }
+#endif
+    (void)level;
+    return {&h2FastRowScalar, &h2v1FancyRowScalar, &h2v2FancyRowScalar,
+            &h1v2FancyRowScalar};
+  }
+
+  Upsampler(const PlaneView &plane, int h_expand, int v_expand,
+            UpsampleMode mode, size_t out_width,
+            SIMDLevel level = CPUFeatures::getSIMDLevel())
+      : plane_(plane), h_expand_(h_expand), v_expand_(v_expand),
+        mode_(mode), out_width_(out_width), kernels_(select(level)) {
+    if (h_expand_ != 1 || v_expand_ != 1) {
+      row_.resize(std::max(out_width_, plane_.width * h_expand_));
+    }
+  }
+
+  // the component at image row `y`, at least out_width samples
+  const uint8_t *row(size_t y) {
+    const auto last_row = plane_.height - 1;
+    if (h_expand_ == 1 && v_expand_ == 1) {
+      return plane_.row(std::min(y, last_row));
+    }
+
+    const auto in_y = std::min(y / v_expand_, last_row);
+    const auto *near = plane_.row(in_y);
+    if (mode_ == UpsampleMode::Fancy && h_expand_ <= 2 && v_expand_ <= 2) {
+      if (v_expand_ == 1) {
+        kernels_.h2v1_fancy(near, near, plane_.width, 0, row_.data());
+        return row_.data();
+      }
+      // even rows lean on the row above, odd rows on the row below
+      const bool upper = y % 2 == 0;
+      auto far_y = upper ? (in_y == 0 ? 0 : in_y - 1)
+                         : std::min(in_y + 1, last_row);
+      const auto *far = plane_.row(far_y);
+      if (h_expand_ == 2) {
+        kernels_.h2v2_fancy(near, far, plane_.width, 0, row_.data());
+      } else {
+        kernels_.h1v2_fancy(near, far, plane_.width, upper ? 1 : 2,
+                            row_.data());
+      }
+      return row_.data();
+    }
+
+    if (h_expand_ == 1) {
+      return near;
+    }
+    // replicated rows repeat, expand each input row once
+    if (in_y != cached_row_) {
+      if (h_expand_ == 2) {
+        kernels_.h2_fast(near, near, plane_.width, 0, row_.data());
+      } else {
+        for (size_t x = 0; x < out_width_; ++x) {
+          row_[x] = near[std::min(x / h_expand_, plane_.width - 1)];
+        }
+      }
+      cached_row_ = in_y;
+    }
+    return row_.data();
+  }
+
+  // upsamples and converts a YCbCr image one row at a time, full-size
+  // chroma planes are never built. `h_expand`/`v_expand` are the image size
+  // over the plane size in samples.
+  static void convert(const std::array<PlaneView, 3> &planes,
+                      const std::array<int, 3> &h_expand,
+                      const std::array<int, 3> &v_expand, UpsampleMode mode,
+                      size_t width, size_t height, uint8_t *out,
+                      size_t out_stride, PixelFormat format) {
+    convertRows(planes, h_expand, v_expand, mode, width, 0, height, out,
+                out_stride, format);
+  }
+
+  // image rows first_row ~ first_row + row_count - 1 of convert(), `out`
+  // receives the first of them. Bands of an image can be converted on
+  // different threads. The rows are `width` pixels from `first_column` on,
+  // the planes are upsampled from their first column still.
+  static void convertRows(const std::array<PlaneView, 3> &planes,
+                          const std::array<int, 3> &h_expand,
+                          const std::array<int, 3> &v_expand,
+                          UpsampleMode mode, size_t width, size_t first_row,
+                          size_t row_count, uint8_t *out, size_t out_stride,
+                          PixelFormat format, size_t first_column = 0) {
+    const auto level = CPUFeatures::getSIMDLevel();
+    auto kernel = ColorConverter::select(level);
+    const auto row_width = first_column + width;
+    Upsampler y(planes[0], h_expand[0], v_expand[0], mode, row_width, level);
+    Upsampler cb(planes[1], h_expand[1], v_expand[1], mode, row_width, level);
+    Upsampler cr(planes[2], h_expand[2], v_expand[2], mode, row_width, level);
+    for (size_t row = 0; row < row_count; ++row) {
+      const auto y_row = first_row + row;
+      kernel(y.row(y_row) + first_column, cb.row(y_row) + first_column,
+             cr.row(y_row) + first_column, out + row * out_stride, width,
+             format);
+    }
+  }
+
+  // convertRows() of a grayscale image, or of the luma of a color one
+  static void convertGrayRows(const PlaneView &plane, int h_expand,
+                              int v_expand, UpsampleMode mode, size_t width,
+                              size_t first_row, size_t row_count, uint8_t *out,
+                              size_t out_stride, PixelFormat format,
+                              size_t first_column = 0) {
+    const auto level = CPUFeatures::getSIMDLevel();
+    auto kernel = ColorConverter::selectGray(level);
+    Upsampler y(plane, h_expand, v_expand, mode, first_column + width, level);
+    for (size_t row = 0; row < row_count; ++row) {
+      kernel(y.row(first_row + row) + first_column, out + row * out_stride,
+             width, format);
+    }
+  }
+
+  static void h2FastRowScalar(const uint8_t *near, const uint8_t *,
+                              size_t in_width, int, uint8_t *out) {
+    h2FastRange(near, 0, in_width, out);
+  }
+
+  // out = (3 * nearer + further + bias) >> 2, the bias alternates 1, 2
+  static void h2v1FancyRowScalar(const uint8_t *near, const uint8_t *,
+                                 size_t in_width, int, uint8_t *out) {
+    if (in_width == 1) {
+      out[0] = out[1] = near[0];
+      return;
+    }
+    out[0] = near[0];
+    out[1] = static_cast<uint8_t>((near[0] * 3 + near[1] + 2) >> 2);
+    h2v1FancyRange(near, 1, in_width - 1, out);
+    h2v1FancyLast(near, in_width, out);
+  }
+
+  // vertical 3:1 column sums first, then the horizontal 3:1 filter on them
+  static void h2v2FancyRowScalar(const uint8_t *near, const uint8_t *far,
+                                 size_t in_width, int, uint8_t *out) {
+    if (in_width == 1) {
+      auto sum = near[0] * 3 + far[0];
+      out[0] = static_cast<uint8_t>((sum * 4 + 8) >> 4);
+      out[1] = static_cast<uint8_t>((sum * 4 + 7) >> 4);
+      return;
+    }
+    h2v2FancyFirst(near, far, out);
+    h2v2FancyRange(near, far, 1, in_width - 1, out);
+    h2v2FancyLast(near, far, in_width, out);
+  }
+
+  static void h1v2FancyRowScalar(const uint8_t *near, const uint8_t *far,
+                                 size_t in_width, int bias, uint8_t *out) {
+    h1v2FancyRange(near, far, 0, in_width, bias, out);
+  }
+
+#if defined(SJPG_ARCH_X86)
+  SJPG_TARGET_SSE2 static void h2FastRowSSE2(const uint8_t *near,
+                                             const uint8_t *, size_t in_width,
+                                             int, uint8_t *out) {
+    size_t x = 0;
+    for (; x + 16 <= in_width; x += 16) {
+      auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(near + x));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * x),
+                       _mm_unpacklo_epi8(v, v));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * x + 16),
+                       _mm_unpackhi_epi8(v, v));
+    }
+    h2FastRange(near, x, in_width, out);
+  }
+
+  SJPG_TARGET_SSE2 static void h2v1FancyRowSSE2(const uint8_t *near,
+                                                const uint8_t *,
+                                                size_t in_width, int,
+                                                uint8_t *out) {
+    if (in_width == 1) {
+      out[0] = out[1] = near[0];
+      return;
+    }
+    out[0] = near[0];
+    out[1] = static_cast<uint8_t>((near[0] * 3 + near[1] + 2) >> 2);
+    const auto zero = _mm_setzero_si128();
+    const auto one = _mm_set1_epi16(1);
+    const auto two = _mm_set1_epi16(2);
+    size_t x = 1;
+    // reads near[x - 1 .. x + 16], the last column is done separately
+    for (; x + 16 <= in_width - 1; x += 16) {
+      auto prev = _mm_loadu_si128(reinterpret_cast<const __m128i *>(near + x - 1));
+      auto curr = _mm_loadu_si128(reinterpret_cast<const __m128i *>(near + x));
+      auto next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(near + x + 1));
+      __m128i even[2];
+      __m128i odd[2];
+      for (int half = 0; half < 2; ++half) {
+        auto p = unpack8SSE2(half, prev, zero);
+        auto c = unpack8SSE2(half, curr, zero);
+        auto n = unpack8SSE2(half, next, zero);
+        auto c3 = _mm_add_epi16(_mm_add_epi16(c, c), c);
+        even[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(c3, p), one), 2);
+        odd[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(c3, n), two), 2);
+      }
+      storeInterleavedSSE2(_mm_packus_epi16(even[0], even[1]),
+                           _mm_packus_epi16(odd[0], odd[1]), out + 2 * x);
+    }
+    h2v1FancyRange(near, x, in_width - 1, out);
+    h2v1FancyLast(near, in_width, out);
+  }
+
+  SJPG_TARGET_SSE2 static void h2v2FancyRowSSE2(const uint8_t *near,
+                                                const uint8_t *far,
+                                                size_t in_width, int,
+                                                uint8_t *out) {
+    if (in_width == 1) {
+      h2v2FancyRowScalar(near, far, in_width, 0, out);
+      return;
+    }
+    h2v2FancyFirst(near, far, out);
+    const auto seven = _mm_set1_epi16(7);
+    const auto eight = _mm_set1_epi16(8);
+    size_t x = 1;
+    // reads column x - 1 .. x + 8, the last column is done separately
+    for (; x + 8 <= in_width - 1; x += 8) {
+      auto prev = columnSumSSE2(near + x - 1, far + x - 1);
+      auto curr = columnSumSSE2(near + x, far + x);
+      auto next = columnSumSSE2(near + x + 1, far + x + 1);
+      auto c3 = _mm_add_epi16(_mm_add_epi16(curr, curr), curr);
+      auto even = _mm_srli_epi16(
+          _mm_add_epi16(_mm_add_epi16(c3, prev), eight), 4);
+      auto odd = _mm_srli_epi16(
+          _mm_add_epi16(_mm_add_epi16(c3, next), seven), 4);
+      auto packed = _mm_packus_epi16(even, odd);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * x),
+                       _mm_unpacklo_epi8(packed, _mm_srli_si128(packed, 8)));
+    }
+    h2v2FancyRange(near, far, x, in_width - 1, out);
+    h2v2FancyLast(near, far, in_width, out);
+  }
+
+  SJPG_TARGET_SSE2 static void h1v2FancyRowSSE2(const uint8_t *near,
+                                                const uint8_t *far,
+                                                size_t in_width, int bias,
+                                                uint8_t *out) {
+    const auto zero = _mm_setzero_si128();
+    const auto bias16 = _mm_set1_epi16(static_cast<int16_t>(bias));
+    size_t x = 0;
+    for (; x + 16 <= in_width; x += 16) {
+      auto n = _mm_loadu_si128(reinterpret_cast<const __m128i *>(near + x));
+      auto f = _mm_loadu_si128(reinterpret_cast<const __m128i *>(far + x));
+      __m128i sum[2];
+      for (int half = 0; half < 2; ++half) {
+        auto n16 = unpack8SSE2(half, n, zero);
+        auto n3 = _mm_add_epi16(_mm_add_epi16(n16, n16), n16);
+        sum[half] = _mm_srli_epi16(
+            _mm_add_epi16(_mm_add_epi16(n3, unpack8SSE2(half, f, zero)),
+                          bias16),
+            2);
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x),
+                       _mm_packus_epi16(sum[0], sum[1]));
+    }
+    h1v2FancyRange(near, far, x, in_width, bias, out);
+  }
+#endif
+
+private:
+  static void h2FastRange(const uint8_t *in, size_t x0, size_t x1,
+                          uint8_t *out) {
+    for (auto x = x0; x < x1; ++x) {
+      out[2 * x] = out[2 * x + 1] = in[x];
+    }
+  }
+
+  static void h2v1FancyRange(const uint8_t *in, size_t x0, size_t x1,
+                             uint8_t *out) {
+    for (auto x = x0; x < x1; ++x) {
+      auto c3 = in[x] * 3;
+      out[2 * x] = static_cast<uint8_t>((c3 + in[x - 1] + 1) >> 2);
+      out[2 * x + 1] = static_cast<uint8_t>((c3 + in[x + 1] + 2) >> 2);
+    }
+  }
+
+  static void h2v1FancyLast(const uint8_t *in, size_t in_width,
+                            uint8_t *out) {
+    auto x = in_width - 1;
+    out[2 * x] = static_cast<uint8_t>((in[x] * 3 + in[x - 1] + 1) >> 2);
+    out[2 * x + 1] = in[x];
+  }
+
+  static int columnSum(const uint8_t *near, const uint8_t *far, size_t x) {
+    return near[x] * 3 + far[x];
+  }
+
+  static void h2v2FancyFirst(const uint8_t *near, const uint8_t *far,
+                             uint8_t *out) {
+    auto curr = columnSum(near, far, 0);
+    out[0] = static_cast<uint8_t>((curr * 4 + 8) >> 4);
+    out[1] = static_cast<uint8_t>((curr * 3 + columnSum(near, far, 1) + 7) >> 4);
+  }
+
+  static void h2v2FancyRange(const uint8_t *near, const uint8_t *far,
+                             size_t x0, size_t x1, uint8_t *out) {
+    for (auto x = x0; x < x1; ++x) {
+      auto c3 = columnSum(near, far, x) * 3;
+      out[2 * x] =
+          static_cast<uint8_t>((c3 + columnSum(near, far, x - 1) + 8) >> 4);
+      out[2 * x + 1] =
+          static_cast<uint8_t>((c3 + columnSum(near, far, x + 1) + 7) >> 4);
+    }
+  }
+
+  static void h2v2FancyLast(const uint8_t *near, const uint8_t *far,
+                            size_t in_width, uint8_t *out) {
+    auto x = in_width - 1;
+    auto curr = columnSum(near, far, x);
+    out[2 * x] =
+        static_cast<uint8_t>((curr * 3 + columnSum(near, far, x - 1) + 8) >> 4);
+    out[2 * x + 1] = static_cast<uint8_t>((curr * 4 + 7) >> 4);
+  }
+
+  static void h1v2FancyRange(const uint8_t *near, const uint8_t *far,
+                             size_t x0, size_t x1, int bias, uint8_t *out) {
+    for (auto x = x0; x < x1; ++x) {
+      out[x] = static_cast<uint8_t>((near[x] * 3 + far[x] + bias) >> 2);
+    }
+  }
+
+#if defined(SJPG_ARCH_X86)
+  SJPG_TARGET_SSE2 static __m128i unpack8SSE2(int half, __m128i a,
+                                              __m128i zero) {
+    return half == 0 ? _mm_unpacklo_epi8(a, zero) : _mm_unpackhi_epi8(a, zero);
+  }
+
+  // 3 * near + far for 8 columns
+  SJPG_TARGET_SSE2 static __m128i columnSumSSE2(const uint8_t *near,
+                                                const uint8_t *far) {
+    const auto zero = _mm_setzero_si128();
+    auto n = _mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(near)), zero);
+    auto f = _mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(far)), zero);
+    return _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(n, n), n), f);
+  }
+
+  SJPG_TARGET_SSE2 static void storeInterleavedSSE2(__m128i even, __m128i odd,
+                                                    uint8_t *out) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm_unpacklo_epi8(even, odd));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16),
+                     _mm_unpackhi_epi8(even, odd));
+  }
+#endif
+
+  PlaneView plane_;
+  int h_expand_{1};
+  int v_expand_{1};
+  UpsampleMode mode_{UpsampleMode::Fancy};
+  size_t out_width_{0};
+  Kernels kernels_;
+  std::vector<uint8_t> row_;
+  size_t cached_row_{static_cast<size_t>(-1)};
+};
+} // namespace sjpg_codec
+
+#endif // SJPG_UPSAMPLE_H
@@ -0,0 +1,203 @@
+//
+// Created by user on 7/27/25.
+//
+
+#include "sjpg_jpeg_decoder.h"
+#include "sjpg_probe.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <gmock/gmock.h>
+#include <iterator>
+#include <new>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+// every allocation of this binary goes through here, only the ones made by
+// the thread running the test are counted
+namespace {
+thread_local size_t allocation_count = 0;
+
+void *countedAllocation(size_t size) {
+  ++allocation_count;
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+// AlignedAllocator buffers, the planes and coefficients among them
+void *countedAlignedAllocation(size_t size, std::align_val_t alignment) {
+  ++allocation_count;
+  const auto align = static_cast<size_t>(alignment);
+  // aligned_alloc() takes whole multiples of the alignment
+  const auto rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+  return std::aligned_alloc(align, rounded);
+}
+} // namespace
+
+void *operator new(size_t size) { return countedAllocation(size); }
+void *operator new[](size_t size) { return countedAllocation(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  ++allocation_count;
+  return std::malloc(size == 0 ? 1 : size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  ++allocation_count;
+  return std::malloc(size == 0 ? 1 : size);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void *operator new(size_t size, std::align_val_t alignment) {
+  if (void *p = countedAlignedAllocation(size, alignment)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+void *operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return countedAlignedAllocation(size, alignment);
+}
+void *operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return countedAlignedAllocation(size, alignment);
+}
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(p);
+}
+
+class AllocationCounter {
+public:
+  AllocationCounter() : start_(allocation_count) {}
+  size_t count() const { return allocation_count - start_; }
+
+private:
+  size_t start_;
+};
+
+class ADecoderContext : public Test {
+public:
+  JFIFParser parser;
+  JFIFParser other_parser;
+  JPEGDecoder decoder;
+};
+
+TEST_F(ADecoderContext, FirstDecodeAllocatesThePlanes) {
+  parser.parseFile("./resources/lenna_256.jpg");
+
+  AllocationCounter counter;
+  decoder.decode(parser);
+
+  ASSERT_THAT(counter.count(), Gt(0));
+}
+
+TEST_F(ADecoderContext, CountsAlignedAllocations) {
+  AllocationCounter counter;
+  std::vector<int16_t, AlignedAllocator<int16_t, 64>> buffer(4096);
+
+  ASSERT_THAT(counter.count(), Eq(1));
+  ASSERT_THAT(reinterpret_cast<uintptr_t>(buffer.data()) % 64, Eq(0));
+}
+
+TEST_F(ADecoderContext, SecondDecodeDoesNotAllocate) {
+  parser.parseFile("./resources/lenna_256.jpg");
+  decoder.decode(parser);
+
+  AllocationCounter counter;
+  auto ret = decoder.decode(parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  ASSERT_THAT(counter.count(), Eq(0));
+}
+
+TEST_F(ADecoderContext, DecodeOfAnotherImageOfTheSameSizeDoesNotAllocate) {
+  parser.parseFile("./resources/lenna_256.jpg");
+  other_parser.parseFile("./resources/lenna_256_rst.jpg");
+  decoder.decode(parser);
+
+  AllocationCounter counter;
+  auto ret = decoder.decode(other_parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  ASSERT_THAT(counter.count(), Eq(0));
+}
+
+TEST_F(ADecoderContext, SecondCoefficientDecodeDoesNotAllocate) {
+  parser.parseFile("./resources/lenna_256_420.jpg");
+  decoder.decodeCoefficients(parser);
+
+  AllocationCounter counter;
+  auto ret = decoder.decodeCoefficients(parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  ASSERT_THAT(counter.count(), Eq(0));
+}
+
+TEST_F(ADecoderContext, ResetKeepsTheMemory) {
+  parser.parseFile("./resources/lenna_256_420.jpg");
+  decoder.decode(parser);
+  const auto *plane = decoder.getYDecodedData().data();
+
+  decoder.reset();
+  ASSERT_THAT(decoder.getYDecodedData(), IsEmpty());
+  AllocationCounter counter;
+  decoder.decode(parser);
+
+  ASSERT_THAT(counter.count(), Eq(0));
+  ASSERT_THAT(decoder.getYDecodedData().data(), Eq(plane));
+}
+
+TEST_F(ADecoderContext, DecodesTheSameAfterReset) {
+  parser.parseFile("./resources/lenna_256.jpg");
+  other_parser.parseFile("./resources/lenna_251x173_422.jpg");
+  JPEGDecoder fresh_decoder;
+  fresh_decoder.decode(parser);
+  decoder.decode(other_parser);
+
+  decoder.reset();
+  decoder.decode(parser);
+
+  ASSERT_THAT(decoder.getWidth(), Eq(256));
+  ASSERT_THAT(decoder.getYDecodedData(),
+              ElementsAreArray(fresh_decoder.getYDecodedData()));
+  ASSERT_THAT(decoder.getVDecodedData(),
+              ElementsAreArray(fresh_decoder.getVDecodedData()));
+}
+
+TEST(AJPEGProbeAllocations, ProbeDoesNotAllocate) {
+  std::ifstream stream("./resources/lenna_256_rst.jpg", std::ios::binary);
+  std::vector<uint8_t> data{std::istreambuf_iterator<char>(stream),
+                            std::istreambuf_iterator<char>()};
+  ImageInfo info;
+
+  AllocationCounter counter;
+  auto status = JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_THAT(status, Eq(ProbeStatus::Ok));
+  ASSERT_THAT(counter.count(), Eq(0));
+}
@@ -0,0 +1,245 @@
+//
+// Created by user on 7/28/25.
+//
+
+#include "sjpg_batch_decoder.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <gmock/gmock.h>
+#include <iterator>
+#include <stdexcept>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class ABatchDecoder : public Test {
+public:
+  std::vector<std::string> paths = {
+      "./resources/lenna_256.jpg", "./resources/lenna_256_420.jpg",
+      "./resources/lenna_251x173_422.jpg", "./resources/lenna_256_rst.jpg"};
+
+  static std::vector<uint8_t> readFile(const std::string &path) {
+    std::ifstream stream(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(stream),
+            std::istreambuf_iterator<char>()};
+  }
+
+  // what a JFIFParser and a JPEGDecoder of its own produce
+  static std::vector<uint8_t> decodeAlone(const std::string &path) {
+    JFIFParser parser;
+    JPEGDecoder decoder;
+    parser.parseFile(path);
+    decoder.decode(parser);
+    std::vector<uint8_t> rgb(decoder.getWidth() * 3 * decoder.getHeight());
+    decoder.convertColor(PixelFormat::RGB, rgb.data(), decoder.getWidth() * 3);
+    return rgb;
+  }
+
+  std::vector<BatchInput> fileInputs(int copies) {
+    std::vector<BatchInput> inputs;
+    for (int n = 0; n < copies; ++n) {
+      for (const auto &path : paths) {
+        inputs.push_back(BatchInput::fromFile(path));
+      }
+    }
+    return inputs;
+  }
+};
+
+TEST_F(ABatchDecoder, DecodesEveryInputLikeASingleDecoder) {
+  BatchDecoder batch_decoder(3);
+  auto inputs = fileInputs(3);
+  std::mutex mutex;
+  std::vector<BatchResult> results(inputs.size());
+
+  auto stats = batch_decoder.decode(inputs, [&](BatchResult &&result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    results[result.index] = std::move(result);
+  });
+
+  ASSERT_THAT(stats.images, Eq(inputs.size()));
+  ASSERT_THAT(stats.failed, Eq(0));
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    ASSERT_THAT(results[i].status, Eq(0));
+    ASSERT_THAT(results[i].pixels,
+                ElementsAreArray(decodeAlone(inputs[i].path)));
+  }
+}
+
+TEST_F(ABatchDecoder, DecodesBuffers) {
+  BatchDecoder batch_decoder(2);
+  auto data = readFile(paths[2]);
+  std::vector<BatchInput> inputs = {
+      BatchInput::fromMemory(data.data(), data.size())};
+  BatchResult result;
+
+  batch_decoder.decode(inputs, [&](BatchResult &&r) { result = std::move(r); });
+
+  ASSERT_THAT(result.status, Eq(0));
+  ASSERT_THAT(result.width, Eq(251));
+  ASSERT_THAT(result.stride, Eq(251 * 3));
+  ASSERT_THAT(result.pixels, ElementsAreArray(decodeAlone(paths[2])));
+}
+
+TEST_F(ABatchDecoder, DeliversResultsThroughFutures) {
+  BatchDecoder batch_decoder(2);
+  auto inputs = fileInputs(2);
+  auto stats = std::make_shared<BatchStats>();
+
+  auto futures = batch_decoder.submit(inputs, stats);
+
+  ASSERT_THAT(futures.size(), Eq(inputs.size()));
+  for (size_t i = 0; i < futures.size(); ++i) {
+    auto result = futures[i].get();
+    ASSERT_THAT(result.index, Eq(i));
+    ASSERT_THAT(result.status, Eq(0));
+  }
+  ASSERT_THAT(stats->images, Eq(inputs.size()));
+  ASSERT_THAT(stats->output_pixels, Eq(6 * 256 * 256 + 2 * 251 * 173));
+}
+
+TEST_F(ABatchDecoder, ReportsFailuresAndGoesOn) {
+  BatchDecoder batch_decoder(2);
+  std::vector<uint8_t> garbage(100, 0x42);
+  std::vector<BatchInput> inputs = {
+      BatchInput::fromFile("./resources/nonexistent.jpg"),
+      BatchInput::fromMemory(garbage.data(), garbage.size()),
+      BatchInput::fromFile(paths[0])};
+  std::vector<int> statuses(inputs.size(), 1);
+
+  auto stats = batch_decoder.decode(inputs, [&](BatchResult &&result) {
+    statuses[result.index] = result.status;
+  });
+
+  ASSERT_THAT(statuses[0], Eq(JFIFParser::StreamInvalid));
+  ASSERT_THAT(statuses[1], Eq(JFIFParser::NoSOIMark));
+  ASSERT_THAT(statuses[2], Eq(0));
+  ASSERT_THAT(stats.failed, Eq(2));
+  ASSERT_THAT(stats.output_pixels, Eq(256 * 256));
+}
+
+TEST_F(ABatchDecoder, StartsLargeImagesFirst) {
+  BatchDecoder batch_decoder(1);
+  auto inputs = fileInputs(1);
+  std::vector<uint64_t> sizes;
+
+  batch_decoder.decode(inputs, [&](BatchResult &&result) {
+    sizes.push_back(readFile(inputs[result.index].path).size());
+  });
+
+  ASSERT_THAT(sizes.size(), Eq(inputs.size()));
+  ASSERT_TRUE(std::is_sorted(sizes.rbegin(), sizes.rend()));
+}
+
+TEST_F(ABatchDecoder, AppliesTheOptions) {
+  BatchDecoder::Options options;
+  options.format = PixelFormat::BGRA;
+  options.scale = DecodeScale::Quarter;
+  BatchDecoder batch_decoder(2, options);
+  BatchResult result;
+
+  batch_decoder.decode({BatchInput::fromFile(paths[2])},
+                       [&](BatchResult &&r) { result = std::move(r); });
+
+  ASSERT_THAT(result.width, Eq(63));
+  ASSERT_THAT(result.height, Eq(44));
+  ASSERT_THAT(result.stride, Eq(63 * 4));
+  ASSERT_THAT(result.pixels.size(), Eq(63 * 4 * 44));
+}
+
+TEST_F(ABatchDecoder, EmptyBatchReturnsAtOnce) {
+  BatchDecoder batch_decoder(2);
+
+  auto stats = batch_decoder.decode({}, [](BatchResult &&) {});
+
+  ASSERT_THAT(stats.images, Eq(0));
+}
+
+TEST_F(ABatchDecoder, CountsTheImagesStolenFromAnotherWorker) {
+  BatchDecoder batch_decoder(2);
+  auto inputs = fileInputs(1); // two images a worker
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t delivered = 0;
+
+  // the first worker done is held until the other one has decoded the
+  // rest, the last image of its queue included
+  auto stats = batch_decoder.decode(inputs, [&](BatchResult &&) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (++delivered == 1) {
+      cv.wait_for(lock, std::chrono::seconds(10),
+                  [&] { return delivered == inputs.size(); });
+    } else if (delivered == inputs.size()) {
+      cv.notify_all();
+    }
+  });
+
+  ASSERT_THAT(stats.images, Eq(inputs.size()));
+  ASSERT_THAT(stats.steals, Eq(1));
+}
+
+TEST_F(ABatchDecoder, StealsTheLargestImageLeft) {
+  BatchDecoder batch_decoder(3);
+  auto data = readFile(paths[0]);
+  std::vector<BatchInput> inputs; // two images a worker, of distinct sizes
+  for (size_t i = 0; i < 6; ++i) {
+    inputs.push_back(BatchInput::fromMemory(data.data(), data.size() - i * 500));
+  }
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<size_t> sizes;
+
+  // the first two workers done are held, the third decodes the rest and
+  // steals the images left in their queues
+  auto stats = batch_decoder.decode(inputs, [&](BatchResult &&result) {
+    std::unique_lock<std::mutex> lock(mutex);
+    sizes.push_back(inputs[result.index].data.size());
+    if (sizes.size() <= 2) {
+      cv.wait_for(lock, std::chrono::seconds(10),
+                  [&] { return sizes.size() == inputs.size(); });
+    } else if (sizes.size() == inputs.size()) {
+      cv.notify_all();
+    }
+  });
+
+  ASSERT_THAT(stats.steals, Eq(2));
+  ASSERT_THAT(sizes, SizeIs(6));
+  ASSERT_THAT(sizes[4], Gt(sizes[5]));
+}
+
+TEST_F(ABatchDecoder, GoesOnWhenTheCallbackThrows) {
+  BatchDecoder batch_decoder(2);
+  auto inputs = fileInputs(2);
+  std::atomic<size_t> calls{0};
+
+  auto stats = batch_decoder.decode(inputs, [&](BatchResult &&) {
+    ++calls;
+    throw std::runtime_error("callback failed");
+  });
+
+  ASSERT_THAT(calls.load(), Eq(inputs.size()));
+  ASSERT_THAT(stats.images, Eq(inputs.size()));
+  ASSERT_THAT(stats.failed, Eq(0));
+}
+
+TEST_F(ABatchDecoder, DecodesNothingWithoutACallback) {
+  BatchDecoder batch_decoder(2);
+
+  auto stats = batch_decoder.decode(fileInputs(1), nullptr);
+
+  ASSERT_THAT(stats.images, Eq(0));
+}
+
+TEST_F(ABatchDecoder, RunsSeveralBatchesAtOnce) {
+  BatchDecoder batch_decoder(2);
+  auto first = batch_decoder.submit(fileInputs(2));
+  auto second = batch_decoder.submit(fileInputs(1));
+
+  for (auto *futures : {&first, &second}) {
+    for (auto &future : *futures) {
+      ASSERT_THAT(future.get().status, Eq(0));
+    }
+  }
+}
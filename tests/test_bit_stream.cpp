@@ -3,48 +3,108 @@
 //
 #include <gmock/gmock.h>
 #include "sjpg_bit_stream.h"
+#include <vector>
 using namespace testing;
 using namespace sjpg_codec;
 
 class ABitStream : public Test {
 public:
   BitStream s;
+  std::vector<uint8_t> data = {0b10100000};
+
+  void SetUp() override { s.reset(data.data(), data.size()); }
 };
 
 TEST_F(ABitStream, InitPositionIsZero) { ASSERT_THAT(s.getPosition(), Eq(0)); }
 
-TEST_F(ABitStream, InitSizeIsZero) { ASSERT_THAT(s.getSize(), Eq(0)); }
-
-TEST_F(ABitStream, AppendStringIncreaseSize) {
-  s.append("1010");
+TEST_F(ABitStream, InitSizeIsZero) {
+  BitStream empty;
 
-  ASSERT_THAT(s.getSize(), Eq(4));
+  ASSERT_THAT(empty.getSize(), Eq(0));
 }
 
+TEST_F(ABitStream, SizeIsTheNumberOfBytes) { ASSERT_THAT(s.getSize(), Eq(1)); }
+
 TEST_F(ABitStream, CanGet1Bit) {
-  s.append("1010");
   auto b = s.getBit();
 
-  ASSERT_THAT(b, Eq('1'));
+  ASSERT_THAT(b, Eq(1));
 }
 
 TEST_F(ABitStream, GetBitIncreasePosition) {
-  s.append("1010");
   s.getBit();
 
   ASSERT_THAT(s.getPosition(), Eq(1));
 }
 
 TEST_F(ABitStream, CanGetNBits) {
-  s.append("1010");
-  auto b = s.getBitN(2);
+  auto b = s.getBits(2);
 
-  ASSERT_THAT(b, Eq("10"));
+  ASSERT_THAT(b, Eq(0b10));
 }
 
 TEST_F(ABitStream, GetNBitsIncreasePosition) {
-  s.append("1010");
-  s.getBitN(2);
+  s.getBits(2);
 
   ASSERT_THAT(s.getPosition(), Eq(2));
 }
+
+TEST_F(ABitStream, GetZeroBitsReturnsZero) {
+  ASSERT_THAT(s.getBits(0), Eq(0));
+  ASSERT_THAT(s.getPosition(), Eq(0));
+}
+
+TEST_F(ABitStream, PeekDoesNotIncreasePosition) {
+  auto b = s.peek(4);
+
+  ASSERT_THAT(b, Eq(0b1010));
+  ASSERT_THAT(s.getPosition(), Eq(0));
+}
+
+TEST_F(ABitStream, CanGetBitsAcrossBytes) {
+  std::vector<uint8_t> bytes = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0, 0x11};
+  s.reset(bytes.data(), bytes.size());
+
+  ASSERT_THAT(s.getBits(4), Eq(0x1));
+  ASSERT_THAT(s.getBits(32), Eq(0x23456789u));
+  ASSERT_THAT(s.getBits(16), Eq(0xABCDu));
+  ASSERT_THAT(s.getBits(16), Eq(0xEF01u));
+}
+
+TEST_F(ABitStream, RemovesStuffedZeroAfterFF) {
+  std::vector<uint8_t> bytes = {0xFF, 0x00, 0x12};
+  s.reset(bytes.data(), bytes.size());
+
+  ASSERT_THAT(s.getBits(16), Eq(0xFF12u));
+}
+
+TEST_F(ABitStream, DataBitOffsetCountsStuffedBytes) {
+  std::vector<uint8_t> bytes = {0x12, 0xFF, 0x00, 0x34, 0x56};
+  s.reset(bytes.data(), bytes.size());
+
+  ASSERT_THAT(s.getDataBitOffset(), Eq(0u));
+  s.getBits(12);
+  ASSERT_THAT(s.getDataBitOffset(), Eq(12u));
+  s.getBits(4);
+  ASSERT_THAT(s.getDataBitOffset(), Eq(24u));
+  s.getBits(3);
+  ASSERT_THAT(s.getDataBitOffset(), Eq(27u));
+}
+
+TEST_F(ABitStream, StopsAtMarkerAndReadsZeros) {
+  std::vector<uint8_t> bytes = {0xAB, 0xFF, 0xD0, 0xCD};
+  s.reset(bytes.data(), bytes.size());
+
+  ASSERT_THAT(s.getBits(8), Eq(0xABu));
+  ASSERT_THAT(s.getBits(8), Eq(0u));
+  ASSERT_THAT(s.getMarker(), Eq(0xD0));
+  ASSERT_THAT(s.getBytePosition(), Eq(1));
+}
+
+TEST_F(ABitStream, ReadPastEndIsOverrunWithoutThrowing) {
+  s.getBits(8);
+  ASSERT_FALSE(s.isOverrun());
+
+  ASSERT_THAT(s.getBits(16), Eq(0u));
+  ASSERT_TRUE(s.isOverrun());
+}
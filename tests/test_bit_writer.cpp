@@ -0,0 +1,101 @@
+//
+// Created by user on 8/1/25.
+//
+#include "sjpg_bit_stream.h"
+#include "sjpg_bit_writer.h"
+
+#include <gmock/gmock.h>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class ABitWriter : public Test {
+public:
+  std::vector<uint8_t> out;
+};
+
+TEST_F(ABitWriter, WritesBitsMSBFirst) {
+  {
+    BitWriter writer(out);
+    writer.write(0b101, 3);
+    writer.write(0b00110, 5);
+  }
+
+  ASSERT_THAT(out, ElementsAre(0b10100110));
+}
+
+TEST_F(ABitWriter, PadsTheLastByteWithOnes) {
+  BitWriter writer(out);
+  writer.write(0b10, 2);
+  writer.flush();
+
+  ASSERT_THAT(out, ElementsAre(0b10111111));
+}
+
+TEST_F(ABitWriter, StuffsAZeroAfterFF) {
+  BitWriter writer(out);
+  writer.write(0xFF, 8);
+  writer.write(0x12, 8);
+  writer.flush();
+
+  ASSERT_THAT(out, ElementsAre(0xFF, 0x00, 0x12));
+}
+
+TEST_F(ABitWriter, StuffsAPaddedFF) {
+  BitWriter writer(out);
+  writer.write(0b1111, 4);
+  writer.flush();
+
+  ASSERT_THAT(out, ElementsAre(0xFF, 0x00));
+}
+
+TEST_F(ABitWriter, AppendsToTheBuffer) {
+  out = {1, 2};
+  BitWriter writer(out);
+  writer.write(0x34, 8);
+  writer.flush();
+
+  ASSERT_THAT(out, ElementsAre(1, 2, 0x34));
+}
+
+TEST_F(ABitWriter, WritesMarkersAtByteBoundaries) {
+  BitWriter writer(out);
+  writer.write(0b0, 1);
+  writer.writeMarker(0xD0);
+  writer.write(0xAB, 8);
+  writer.flush();
+
+  ASSERT_THAT(out, ElementsAre(0x7F, 0xFF, 0xD0, 0xAB));
+}
+
+TEST_F(ABitWriter, PositionCountsStuffedBytes) {
+  BitWriter writer(out);
+  writer.write(0xFFFF, 16);
+  writer.flush();
+
+  ASSERT_THAT(writer.getPosition(), Eq(4));
+}
+
+TEST_F(ABitWriter, BitStreamReadsBackWhatWasWritten) {
+  std::mt19937 rng(20250801);
+  std::vector<std::pair<uint32_t, int>> values;
+  {
+    BitWriter writer(out);
+    for (int i = 0; i < 10000; ++i) {
+      int count = std::uniform_int_distribution<int>(1, 16)(rng);
+      // runs of 1-bits produce plenty of 0xFF bytes
+      uint32_t bits = i % 3 == 0 ? (1u << count) - 1 : rng() >> (32 - count);
+      writer.write(bits, count);
+      values.emplace_back(bits, count);
+    }
+  }
+
+  BitStream stream;
+  stream.reset(out.data(), out.size());
+  for (const auto &[bits, count] : values) {
+    ASSERT_THAT(stream.getBits(count), Eq(bits));
+  }
+}
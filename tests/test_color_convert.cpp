@@ -0,0 +1,223 @@
+//
+// Created by user on 7/22/25.
+//
+#include "sjpg_color_convert.h"
+
+#include <cmath>
+#include <gmock/gmock.h>
+#include <random>
+#include <vector>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AColorConverter : public Test {
+public:
+  std::mt19937 rng{20250722};
+
+  std::vector<uint8_t> randomPlane(size_t size) {
+    std::vector<uint8_t> plane(size);
+    for (auto &v : plane) {
+      v = static_cast<uint8_t>(std::uniform_int_distribution<int>(0, 255)(rng));
+    }
+    return plane;
+  }
+};
+
+TEST_F(AColorConverter, BytesPerPixel) {
+  ASSERT_THAT(ColorConverter::getBytesPerPixel(PixelFormat::RGB), Eq(3));
+  ASSERT_THAT(ColorConverter::getBytesPerPixel(PixelFormat::BGR), Eq(3));
+  ASSERT_THAT(ColorConverter::getBytesPerPixel(PixelFormat::RGBA), Eq(4));
+  ASSERT_THAT(ColorConverter::getBytesPerPixel(PixelFormat::BGRA), Eq(4));
+  ASSERT_THAT(ColorConverter::getBytesPerPixel(PixelFormat::Gray), Eq(1));
+}
+
+TEST_F(AColorConverter, GrayStaysGray) {
+  uint8_t y[] = {0, 77, 255};
+  uint8_t c[] = {128, 128, 128};
+  uint8_t out[9];
+
+  ColorConverter::convertRowScalar(y, c, c, out, 3, PixelFormat::RGB);
+
+  ASSERT_THAT(out, ElementsAre(0, 0, 0, 77, 77, 77, 255, 255, 255));
+}
+
+TEST_F(AColorConverter, ScalarIsCloseToFloatingPoint) {
+  auto y = randomPlane(4096);
+  auto cb = randomPlane(4096);
+  auto cr = randomPlane(4096);
+  std::vector<uint8_t> out(4096 * 3);
+
+  ColorConverter::convertRowScalar(y.data(), cb.data(), cr.data(), out.data(),
+                                   4096, PixelFormat::RGB);
+
+  for (size_t i = 0; i < 4096; ++i) {
+    double r = y[i] + 1.402 * (cr[i] - 128);
+    double g = y[i] - 0.344136 * (cb[i] - 128) - 0.714136 * (cr[i] - 128);
+    double b = y[i] + 1.772 * (cb[i] - 128);
+    auto clamp = [](double v) { return std::min(255.0, std::max(0.0, v)); };
+    ASSERT_THAT(std::abs(out[i * 3] - clamp(r)), Le(0.51));
+    ASSERT_THAT(std::abs(out[i * 3 + 1] - clamp(g)), Le(0.51));
+    ASSERT_THAT(std::abs(out[i * 3 + 2] - clamp(b)), Le(0.51));
+  }
+}
+
+TEST_F(AColorConverter, GrayRowReplicatesLuma) {
+  uint8_t y[] = {0, 77};
+  uint8_t rgba[8];
+  uint8_t gray[2];
+
+  ColorConverter::convertGrayRowScalar(y, rgba, 2, PixelFormat::RGBA);
+  ColorConverter::convertGrayRowScalar(y, gray, 2, PixelFormat::Gray);
+
+  ASSERT_THAT(rgba, ElementsAre(0, 0, 0, 255, 77, 77, 77, 255));
+  ASSERT_THAT(gray, ElementsAre(0, 77));
+}
+
+TEST_F(AColorConverter, BGRAReordersChannelsAndSetsAlpha) {
+  uint8_t y[] = {100};
+  uint8_t cb[] = {90};
+  uint8_t cr[] = {200};
+  uint8_t rgb[3];
+  uint8_t bgra[4];
+
+  ColorConverter::convertRowScalar(y, cb, cr, rgb, 1, PixelFormat::RGB);
+  ColorConverter::convertRowScalar(y, cb, cr, bgra, 1, PixelFormat::BGRA);
+
+  ASSERT_THAT(bgra, ElementsAre(rgb[2], rgb[1], rgb[0], 255));
+}
+
+TEST_F(AColorConverter, ConvertKeepsRowPadding) {
+  auto y = randomPlane(4 * 2);
+  auto cb = randomPlane(4 * 2);
+  auto cr = randomPlane(4 * 2);
+  const size_t stride = 4 * 3 + 5;
+  std::vector<uint8_t> out(stride * 2, 0xAB);
+
+  ColorConverter::convert(y.data(), 4, cb.data(), 4, cr.data(), 4, 4, 2,
+                          out.data(), stride, PixelFormat::RGB);
+
+  for (size_t i = 12; i < stride; ++i) {
+    ASSERT_THAT(out[i], Eq(0xAB));
+  }
+}
+
+class AColorConverterKernel
+    : public AColorConverter,
+      public WithParamInterface<std::tuple<SIMDLevel, PixelFormat>> {};
+
+TEST_P(AColorConverterKernel, IsIdenticalToScalar) {
+  auto [level, format] = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << CPUFeatures::toString(level) << " is not supported";
+  }
+  auto kernel = ColorConverter::select(level);
+  const auto bpp = ColorConverter::getBytesPerPixel(format);
+
+  // widths around the vector step exercise the scalar tail
+  for (size_t width : {1, 15, 16, 17, 18, 31, 33, 100, 257}) {
+    auto y = randomPlane(width);
+    auto cb = randomPlane(width);
+    auto cr = randomPlane(width);
+    // guard bytes past the row must stay untouched
+    std::vector<uint8_t> expected(width * bpp + 8, 0xCD);
+    std::vector<uint8_t> out(width * bpp + 8, 0xCD);
+
+    ColorConverter::convertRowScalar(y.data(), cb.data(), cr.data(),
+                                     expected.data(), width, format);
+    kernel(y.data(), cb.data(), cr.data(), out.data(), width, format);
+
+    ASSERT_THAT(out, ElementsAreArray(expected)) << "width " << width;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllSIMDLevels, AColorConverterKernel,
+    Combine(Values(SIMDLevel::Scalar, SIMDLevel::SSE2, SIMDLevel::AVX2),
+            Values(PixelFormat::RGB, PixelFormat::BGR, PixelFormat::RGBA,
+                   PixelFormat::BGRA)));
+
+class AGrayConverterKernel : public AColorConverterKernel {};
+
+TEST_P(AGrayConverterKernel, IsIdenticalToScalar) {
+  auto [level, format] = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << CPUFeatures::toString(level) << " is not supported";
+  }
+  auto kernel = ColorConverter::selectGray(level);
+  const auto bpp = ColorConverter::getBytesPerPixel(format);
+
+  for (size_t width : {1, 15, 16, 17, 18, 31, 33, 100, 257}) {
+    auto y = randomPlane(width);
+    std::vector<uint8_t> expected(width * bpp + 8, 0xCD);
+    std::vector<uint8_t> out(width * bpp + 8, 0xCD);
+
+    ColorConverter::convertGrayRowScalar(y.data(), expected.data(), width,
+                                         format);
+    kernel(y.data(), out.data(), width, format);
+
+    ASSERT_THAT(out, ElementsAreArray(expected)) << "width " << width;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllSIMDLevels, AGrayConverterKernel,
+    Combine(Values(SIMDLevel::Scalar, SIMDLevel::SSE2, SIMDLevel::AVX2),
+            Values(PixelFormat::RGB, PixelFormat::BGR, PixelFormat::RGBA,
+                   PixelFormat::BGRA, PixelFormat::Gray)));
+
+TEST_F(AColorConverter, YCbCrIsCloseToFloatingPoint) {
+  auto in = randomPlane(300);
+  uint8_t y[100], cb[100], cr[100];
+
+  YCbCrConverter::convertRowScalar(in.data(), y, cb, cr, 100,
+                                   PixelFormat::RGB);
+
+  for (int i = 0; i < 100; ++i) {
+    double r = in[i * 3];
+    double g = in[i * 3 + 1];
+    double b = in[i * 3 + 2];
+    ASSERT_THAT(y[i], Eq(std::lround(0.299 * r + 0.587 * g + 0.114 * b)));
+    ASSERT_NEAR(cb[i], -0.16874 * r - 0.33126 * g + 0.5 * b + 128, 1);
+    ASSERT_NEAR(cr[i], 0.5 * r - 0.41869 * g - 0.08131 * b + 128, 1);
+  }
+}
+
+class AYCbCrConverterKernel
+    : public AColorConverter,
+      public WithParamInterface<std::tuple<SIMDLevel, PixelFormat>> {};
+
+TEST_P(AYCbCrConverterKernel, IsIdenticalToScalar) {
+  auto [level, format] = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << CPUFeatures::toString(level) << " is not supported";
+  }
+  auto kernel = YCbCrConverter::select(level);
+  const auto bpp = ColorConverter::getBytesPerPixel(format);
+
+  for (size_t width : {1, 15, 16, 17, 31, 33, 100, 257}) {
+    auto in = randomPlane(width * bpp);
+    std::vector<uint8_t> expected(width * 3);
+    // guard bytes past the rows must stay untouched
+    std::vector<uint8_t> out(width * 3 + 8, 0xCD);
+
+    YCbCrConverter::convertRowScalar(in.data(), expected.data(),
+                                     expected.data() + width,
+                                     expected.data() + width * 2, width,
+                                     format);
+    kernel(in.data(), out.data(), out.data() + width, out.data() + width * 2,
+           width, format);
+
+    ASSERT_THAT(std::vector<uint8_t>(out.begin(), out.begin() + width * 3),
+                ElementsAreArray(expected))
+        << "width " << width;
+    ASSERT_THAT(std::vector<uint8_t>(out.begin() + width * 3, out.end()),
+                Each(Eq(0xCD)));
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllSIMDLevels, AYCbCrConverterKernel,
+    Combine(Values(SIMDLevel::Scalar, SIMDLevel::AVX2),
+            Values(PixelFormat::RGB, PixelFormat::BGR, PixelFormat::RGBA,
+                   PixelFormat::BGRA)));
@@ -0,0 +1,44 @@
+//
+// Created by user on 7/21/25.
+//
+#include "sjpg_cpu_features.h"
+
+#include <gmock/gmock.h>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class ACPUFeatures : public Test {
+public:
+  SIMDLevel saved_level = CPUFeatures::getSIMDLevel();
+
+  void TearDown() override { CPUFeatures::setSIMDLevel(saved_level); }
+};
+
+TEST_F(ACPUFeatures, ActiveLevelIsNotAboveSupportedLevel) {
+  ASSERT_THAT(CPUFeatures::getSIMDLevel(),
+              Le(CPUFeatures::getSupportedSIMDLevel()));
+}
+
+TEST_F(ACPUFeatures, CanForceScalar) {
+  auto level = CPUFeatures::setSIMDLevel(SIMDLevel::Scalar);
+
+  ASSERT_THAT(level, Eq(SIMDLevel::Scalar));
+  ASSERT_THAT(CPUFeatures::getSIMDLevel(), Eq(SIMDLevel::Scalar));
+}
+
+TEST_F(ACPUFeatures, ForcedLevelIsLimitedToSupportedLevel) {
+  auto level = CPUFeatures::setSIMDLevel(SIMDLevel::AVX2);
+
+  ASSERT_THAT(level, Eq(CPUFeatures::getSupportedSIMDLevel()));
+}
+
+TEST_F(ACPUFeatures, CanParseLevelNames) {
+  SIMDLevel level;
+
+  ASSERT_TRUE(CPUFeatures::fromString("sse2", level));
+  ASSERT_THAT(level, Eq(SIMDLevel::SSE2));
+  ASSERT_TRUE(CPUFeatures::fromString("avx2", level));
+  ASSERT_THAT(level, Eq(SIMDLevel::AVX2));
+  ASSERT_FALSE(CPUFeatures::fromString("neon", level));
+}
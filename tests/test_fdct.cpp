@@ -0,0 +1,146 @@
+//
+// Created by user on 8/1/25.
+//
+#include "sjpg_fdct.h"
+#include "sjpg_idct_simd.h"
+
+#include <cstdlib>
+#include <gmock/gmock.h>
+#include <random>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AFDCT : public Test {
+public:
+  std::mt19937 rng{20250801};
+
+  // smooth gradients with some noise, like image blocks
+  std::array<uint8_t, 64> randomBlock() {
+    std::array<uint8_t, 64> block{};
+    int base = std::uniform_int_distribution<int>(0, 255)(rng);
+    int dx = std::uniform_int_distribution<int>(-12, 12)(rng);
+    int dy = std::uniform_int_distribution<int>(-12, 12)(rng);
+    int noise = std::uniform_int_distribution<int>(0, 64)(rng);
+    for (int i = 0; i < 64; ++i) {
+      int v = base + dx * (i % 8) + dy * (i / 8) +
+              std::uniform_int_distribution<int>(-noise, noise)(rng);
+      block[i] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+    }
+    return block;
+  }
+};
+
+TEST_F(AFDCT, FlatBlockHasOnlyDC) {
+  std::array<uint8_t, 64> block;
+  block.fill(200);
+  int32_t coef[64];
+
+  FDCT::computeIslow(block.data(), 8, coef);
+
+  // (200 - 128) * 64 / 8, scaled up by 8
+  ASSERT_THAT(coef[0], Eq(72 * 64));
+  for (int i = 1; i < 64; ++i) {
+    ASSERT_THAT(coef[i], Eq(0)) << i;
+  }
+}
+
+TEST_F(AFDCT, IDCTRestoresTheBlock) {
+  std::array<uint8_t, 64> ones;
+  ones.fill(1);
+  auto divisors = QuantDivisors::build(ones.data());
+  auto dequant = DequantTable::build(std::vector<uint8_t>(64, 1));
+  for (int n = 0; n < 100; ++n) {
+    auto block = randomBlock();
+    alignas(32) int16_t coef[64];
+    std::array<uint8_t, 64> restored{};
+
+    FDCTKernels::islowScalar(block.data(), 8, divisors, coef);
+    IDCT::computeIslow(coef, dequant.islow.data(), restored.data(), 8);
+
+    for (int i = 0; i < 64; ++i) {
+      ASSERT_THAT(std::abs(restored[i] - block[i]), Le(1)) << i;
+    }
+  }
+}
+
+TEST(AQuantDivisors, DividesLikeIntegerDivision) {
+  std::array<uint8_t, 64> table;
+  for (int i = 0; i < 64; ++i) {
+    table[i] = static_cast<uint8_t>(i == 0 ? 1 : i * 4 - 1);
+  }
+  auto divisors = QuantDivisors::build(table.data());
+
+  for (int i = 0; i < 64; ++i) {
+    int32_t d = table[i] * 8;
+    for (int32_t value = -32767; value <= 32767; value += 7) {
+      int32_t q = (std::abs(value) + d / 2) / d;
+      ASSERT_THAT(divisors.quantize(value, i), Eq(value < 0 ? -q : q))
+          << value << " / " << d;
+    }
+  }
+}
+
+class AFDCTKernel : public AFDCT, public WithParamInterface<SIMDLevel> {};
+
+TEST_P(AFDCTKernel, MatchesTheScalarKernel) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << "not supported by this CPU";
+  }
+  auto kernel = FDCTKernels::select(level);
+  for (int quality : {1, 50, 75, 100}) {
+    std::array<uint8_t, 64> table;
+    for (int i = 0; i < 64; ++i) {
+      table[i] =
+          static_cast<uint8_t>(std::clamp((i + 1) * 100 / quality, 1, 255));
+    }
+    auto divisors = QuantDivisors::build(table.data());
+    for (int n = 0; n < 1000; ++n) {
+      auto block = randomBlock();
+      // a wider row stride than the block
+      std::array<uint8_t, 8 * 24> rows{};
+      for (int y = 0; y < 8; ++y) {
+        std::copy_n(block.data() + y * 8, 8, rows.data() + y * 24);
+      }
+      alignas(32) int16_t expected[64];
+      alignas(32) int16_t actual[64];
+
+      auto expected_mask =
+          FDCTKernels::islowScalar(rows.data(), 24, divisors, expected);
+      auto actual_mask = kernel(rows.data(), 24, divisors, actual);
+
+      ASSERT_THAT(actual, ElementsAreArray(expected));
+      ASSERT_THAT(actual_mask, Eq(expected_mask));
+    }
+  }
+}
+
+TEST_P(AFDCTKernel, HandlesExtremeBlocks) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << "not supported by this CPU";
+  }
+  auto kernel = FDCTKernels::select(level);
+  std::array<uint8_t, 64> ones;
+  ones.fill(1);
+  auto divisors = QuantDivisors::build(ones.data());
+  // a checkerboard of 0 and 255 has the largest high frequencies
+  std::array<uint8_t, 64> block;
+  for (int i = 0; i < 64; ++i) {
+    block[i] = ((i / 8 + i % 8) & 1) != 0 ? 255 : 0;
+  }
+  alignas(32) int16_t expected[64];
+  alignas(32) int16_t actual[64];
+
+  auto expected_mask =
+      FDCTKernels::islowScalar(block.data(), 8, divisors, expected);
+  auto actual_mask = kernel(block.data(), 8, divisors, actual);
+
+  ASSERT_THAT(actual, ElementsAreArray(expected));
+  ASSERT_THAT(actual_mask, Eq(expected_mask));
+}
+
+INSTANTIATE_TEST_SUITE_P(AllSIMDLevels, AFDCTKernel,
+                         Values(SIMDLevel::Scalar, SIMDLevel::SSE2,
+                                SIMDLevel::AVX2));
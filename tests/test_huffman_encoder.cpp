@@ -0,0 +1,129 @@
+//
+// Created by user on 8/3/25.
+//
+#include "sjpg_huffman_encoder.h"
+
+#include <cmath>
+#include <gmock/gmock.h>
+#include <random>
+#include <tuple>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+TEST(AHuffmanCodes, OptimalTablesAreAtMost16BitsLong) {
+  // Fibonacci frequencies give the deepest Huffman tree
+  std::array<uint32_t, 256> frequencies{};
+  uint32_t a = 1;
+  uint32_t b = 1;
+  for (int i = 0; i < 40; ++i) {
+    frequencies[i] = a;
+    std::tie(a, b) = std::make_tuple(b, a + b);
+  }
+  segments::DHTSegment dht;
+
+  HuffmanCodes::buildOptimal(frequencies, dht);
+  HuffmanCodes codes;
+  codes.build(dht.symbol_counts, dht.symbols);
+
+  ASSERT_THAT(dht.symbol_counts, SizeIs(16));
+  ASSERT_THAT(dht.symbols, SizeIs(40));
+  // Kraft sum below 1: no code is all 1-bits
+  double kraft = 0;
+  for (int i = 0; i < 40; ++i) {
+    ASSERT_THAT(codes.length[i], AllOf(Ge(1), Le(16)));
+    kraft += std::ldexp(1.0, -codes.length[i]);
+  }
+  ASSERT_THAT(kraft, Lt(1.0));
+}
+
+TEST(AHuffmanCodes, FrequentSymbolsGetShorterCodes) {
+  std::array<uint32_t, 256> frequencies{};
+  frequencies[0x00] = 1000;
+  frequencies[0x11] = 100;
+  frequencies[0x22] = 10;
+  segments::DHTSegment dht;
+
+  HuffmanCodes::buildOptimal(frequencies, dht);
+  HuffmanCodes codes;
+  codes.build(dht.symbol_counts, dht.symbols);
+
+  ASSERT_THAT(codes.length[0x00], Lt(codes.length[0x11]));
+  ASSERT_THAT(codes.length[0x11], Le(codes.length[0x22]));
+}
+
+class AHuffmanEncoder : public Test {
+public:
+  HuffmanEncoder::SymbolCounter counter;
+  std::array<int16_t, 64> block{};
+  int16_t predictor = 0;
+
+  void code() {
+    HuffmanEncoder::codeBlock(block.data(),
+                              HuffmanEncoder::nonzeroMaskScalar(block.data()),
+                              predictor, HuffmanEncoder::kDCLuminance,
+                              HuffmanEncoder::kACLuminance, counter);
+  }
+
+  uint32_t count(int table, int symbol) const {
+    return counter.frequencies[table][symbol];
+  }
+};
+
+TEST_F(AHuffmanEncoder, CodesTheDCDifference) {
+  predictor = 10;
+  block[0] = 7;
+
+  code();
+
+  ASSERT_THAT(predictor, Eq(7));
+  // -3 is in category 2
+  ASSERT_THAT(count(HuffmanEncoder::kDCLuminance, 2), Eq(1));
+}
+
+TEST_F(AHuffmanEncoder, EndsABlockWithEOB) {
+  block[kNaturalOrder[1]] = 1;
+
+  code();
+
+  ASSERT_THAT(count(HuffmanEncoder::kACLuminance, 0x01), Eq(1));
+  ASSERT_THAT(count(HuffmanEncoder::kACLuminance, 0x00), Eq(1));
+}
+
+TEST_F(AHuffmanEncoder, CodesLongRunsWithZRL) {
+  // 39 zeros before zigzag index 40, the last one needs no EOB
+  block[kNaturalOrder[40]] = -300;
+  block[kNaturalOrder[63]] = 2;
+
+  code();
+
+  ASSERT_THAT(count(HuffmanEncoder::kACLuminance, 0xF0), Eq(3));
+  ASSERT_THAT(count(HuffmanEncoder::kACLuminance, 0x79), Eq(1));
+  ASSERT_THAT(count(HuffmanEncoder::kACLuminance, 0x62), Eq(1));
+  ASSERT_THAT(count(HuffmanEncoder::kACLuminance, 0x00), Eq(0));
+}
+
+class AHuffmanEncoderMask : public Test,
+                            public WithParamInterface<SIMDLevel> {};
+
+TEST_P(AHuffmanEncoderMask, MatchesTheScalarKernel) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << "not supported by this CPU";
+  }
+  auto kernel = HuffmanEncoder::selectMask(level);
+  std::mt19937 rng(20250803);
+  std::array<int16_t, 65> buffer{};
+  for (int n = 0; n < 1000; ++n) {
+    for (auto &c : buffer) {
+      c = rng() % 4 == 0 ? static_cast<int16_t>(rng()) : 0;
+    }
+    // unaligned blocks too
+    const auto *block = buffer.data() + n % 2;
+
+    ASSERT_THAT(kernel(block), Eq(HuffmanEncoder::nonzeroMaskScalar(block)));
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllSIMDLevels, AHuffmanEncoderMask,
+                         Values(SIMDLevel::Scalar, SIMDLevel::SSE2));
@@ -33,27 +33,27 @@ TEST_F(AHuffmanTable, CanPrintHuffmanCodesAndSymbols) {
 TEST_F(AHuffmanTable, CanCheckIsCantainsCodeOrNot) {
   auto htable = HuffmanTable(sym_counts, symbols);
 
-  ASSERT_TRUE(htable.contains("00"));
-  ASSERT_FALSE(htable.contains("111"));
+  ASSERT_TRUE(htable.contains(0b00, 2));
+  ASSERT_FALSE(htable.contains(0b111, 3));
 }
 
 TEST_F(AHuffmanTable, CanGetSymbolByCode) {
   auto htable = HuffmanTable(sym_counts, symbols);
 
-  ASSERT_THAT(htable.getSymbol("00"), Eq(0));
-  ASSERT_THAT(htable.getSymbol("110"), Eq(3));
+  ASSERT_THAT(htable.getSymbol(0b00, 2), Eq(0));
+  ASSERT_THAT(htable.getSymbol(0b110, 3), Eq(3));
 }
 
 TEST_F(AHuffmanTable, ThrowsIfCodeIsInvalid) {
   auto htable = HuffmanTable(sym_counts, symbols);
 
-  ASSERT_THROW(htable.getSymbol("111"), std::out_of_range);
+  ASSERT_THROW(htable.getSymbol(0b111, 3), std::out_of_range);
 }
 
 TEST_F(AHuffmanTable, CanGetSymbolFromBitStream) {
   auto htable = HuffmanTable(sym_counts, symbols);
-  BitStream bitStream;
-  bitStream.append("0001110"); // 0, 1, 3
+  std::vector<uint8_t> data = {0b00011100}; // 0, 1, 3
+  BitStream bitStream(data.data(), data.size());
 
   ASSERT_THAT(htable.getSymbol(bitStream), Eq(0));
   ASSERT_THAT(htable.getSymbol(bitStream), Eq(1));
@@ -62,9 +62,66 @@ TEST_F(AHuffmanTable, CanGetSymbolFromBitStream) {
 
 TEST_F(AHuffmanTable, GetSymbolFromBitStreamIncreaseStreamPosition) {
   auto htable = HuffmanTable(sym_counts, symbols);
-  BitStream st;
-  st.append("0001110"); // 0, 1, 3
+  std::vector<uint8_t> data = {0b00011100}; // 0, 1, 3
+  BitStream st(data.data(), data.size());
 
   htable.getSymbol(st);
   ASSERT_THAT(st.getPosition(), Eq(2));
-}
\ No newline at end of file
+}
+
+TEST_F(AHuffmanTable, CanGetSymbolLongerThanLookupBits) {
+  auto htable = HuffmanTable(sym_counts, symbols);
+  // 1111111110 (10 bits) 11111111110 (11 bits), 0xFF is stuffed with 0x00
+  std::vector<uint8_t> data = {0xFF, 0x00, 0b10111111, 0b11110000};
+  BitStream st(data.data(), data.size());
+
+  ASSERT_THAT(htable.getSymbol(st), Eq(10));
+  ASSERT_THAT(htable.getSymbol(st), Eq(11));
+  ASSERT_THAT(st.getPosition(), Eq(21));
+}
+
+TEST_F(AHuffmanTable, FastACDecodesRunAndValueInOneProbe) {
+  // symbol 0x12: 1 zero before a 2 bits coefficient
+  auto htable = HuffmanTable(sym_counts, {0x00, 0x12, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11});
+  std::vector<uint8_t> data = {0b01010000, 0x00}; // 01 01 00000
+  BitStream st(data.data(), data.size());
+
+  const auto &fast_ac = htable.getFastAC(st.peek(HuffmanTable::kLookupBits));
+
+  ASSERT_THAT(fast_ac.length, Eq(4));
+  ASSERT_THAT(fast_ac.run, Eq(1));
+  ASSERT_THAT(fast_ac.value, Eq(-2));
+}
+
+TEST_F(AHuffmanTable, FastACNotAvailableForEOB) {
+  auto htable = HuffmanTable(sym_counts, {0x00, 0x12, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11});
+  std::vector<uint8_t> data = {0x00, 0x00};
+  BitStream st(data.data(), data.size());
+
+  ASSERT_THAT(htable.getFastAC(st.peek(HuffmanTable::kLookupBits)).length, Eq(0));
+}
+
+TEST_F(AHuffmanTable, RejectsCodesThatDontFitTheirLength) {
+  // three codes of 1 bit, and 40 of them
+  std::vector<uint8_t> counts(16, 0);
+  counts[0] = 3;
+  auto three = HuffmanTable(counts, {0, 1, 2});
+  counts[0] = 40;
+  auto forty = HuffmanTable(counts, std::vector<uint8_t>(40, 7));
+
+  ASSERT_FALSE(three.isValid());
+  ASSERT_FALSE(forty.isValid());
+  std::vector<uint8_t> data = {0x00, 0x00, 0x00};
+  BitStream bitStream(data.data(), data.size());
+  ASSERT_THROW(forty.getSymbol(bitStream), std::out_of_range);
+}
+
+TEST_F(AHuffmanTable, RejectsSymbolsThatDontMatchTheCounts) {
+  auto missing = std::vector<uint8_t>(symbols.begin(), symbols.end() - 1);
+  std::vector<uint8_t> too_many_counts(16, 255);
+
+  ASSERT_TRUE(HuffmanTable(sym_counts, symbols).isValid());
+  ASSERT_FALSE(HuffmanTable(sym_counts, missing).isValid());
+  ASSERT_FALSE(HuffmanTable(too_many_counts, symbols).isValid());
+  ASSERT_FALSE(HuffmanTable({0, 3}, {0, 1, 2}).isValid());
+}
@@ -0,0 +1,331 @@
+//
+// Created by user on 7/20/25.
+//
+#include "sjpg_idct_simd.h"
+
+#include <cmath>
+#include <gmock/gmock.h>
+#include <random>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AIDCT : public Test {
+public:
+  // ITU-T.81 Annex K luminance table, zigzag order
+  std::vector<uint8_t> zigzag_qtable = {
+      16, 11, 12, 14, 12, 10, 16, 14, 13, 14, 18, 17, 16, 19, 24, 40,
+      26, 24, 22, 22, 24, 49, 35, 37, 29, 40, 58, 51, 61, 60, 57, 51,
+      56, 55, 64, 72, 92, 78, 64, 68, 87, 69, 55, 56, 80, 109, 81, 87,
+      95, 98, 103, 104, 103, 62, 77, 113, 121, 112, 100, 120, 92, 101, 103, 99};
+  DequantTable table = DequantTable::build(zigzag_qtable);
+  std::mt19937 rng{20250720};
+
+  // coefficients in natural order, magnitudes fall off with the frequency
+  // like in real images
+  std::array<int16_t, 64> randomBlock() {
+    std::array<int16_t, 64> coef{};
+    for (int i = 0; i < 64; ++i) {
+      int limit = i == 0 ? 64 : 16 / (1 + (i / 8 + i % 8) / 2);
+      coef[i] = static_cast<int16_t>(
+          std::uniform_int_distribution<int>(-limit, limit)(rng));
+    }
+    return coef;
+  }
+
+  // the original O(n^4) float IDCT of the decoder
+  std::array<uint8_t, 64> referenceIDCT(const std::array<int16_t, 64> &coef) {
+    std::array<uint8_t, 64> result{};
+    for (auto y = 0; y < 8; ++y) {
+      for (auto x = 0; x < 8; ++x) {
+        auto sum = 0.0f;
+
+        for (auto u = 0; u < 8; ++u) {
+          for (auto v = 0; v < 8; ++v) {
+            float cu = (u == 0) ? 1.0f / std::sqrt(2.0f) : 1.0f;
+            float cv = (v == 0) ? 1.0f / std::sqrt(2.0f) : 1.0f;
+            float t0 = cu * std::cos((2 * x + 1) * u * M_PI / 16.0);
+            float t1 = cv * std::cos((2 * y + 1) * v * M_PI / 16.0);
+
+            auto data_value = coef[u * 8 + v] * table.islow[u * 8 + v];
+
+            sum += (data_value * t0 * t1);
+          }
+        }
+
+        sum *= 0.25;
+        result[x * 8 + y] = IDCT::clampToByte(std::lround(sum + 128));
+      }
+    }
+    return result;
+  }
+
+  // max and mean absolute error against the reference over many blocks
+  std::pair<int, double> measureError(IDCTMethod method) {
+    constexpr int kNumBlocks = 2000;
+    int max_error = 0;
+    long total_error = 0;
+    for (int n = 0; n < kNumBlocks; ++n) {
+      auto coef = randomBlock();
+      auto expected = referenceIDCT(coef);
+      uint8_t out[64];
+      IDCT::transform(method, coef.data(), table, out, 8);
+      for (int i = 0; i < 64; ++i) {
+        auto error = std::abs(static_cast<int>(out[i]) - expected[i]);
+        max_error = std::max(max_error, error);
+        total_error += error;
+      }
+    }
+    return {max_error, static_cast<double>(total_error) / (kNumBlocks * 64)};
+  }
+};
+
+TEST_F(AIDCT, DequantTableIsInNaturalOrder) {
+  ASSERT_THAT(table.islow[0], Eq(16));
+  ASSERT_THAT(table.islow[1], Eq(11)); // zigzag 1
+  ASSERT_THAT(table.islow[8], Eq(12)); // zigzag 2
+  ASSERT_THAT(table.islow[63], Eq(99));
+}
+
+TEST_F(AIDCT, DCOnlyBlockIsFlat) {
+  std::array<int16_t, 64> coef{};
+  coef[0] = 5; // 5 * 16 / 8 = 10
+  for (auto method : {IDCTMethod::Islow, IDCTMethod::Ifast, IDCTMethod::Float}) {
+    uint8_t out[64];
+    IDCT::transform(method, coef.data(), table, out, 8);
+
+    ASSERT_THAT(out, Each(Eq(138)));
+  }
+}
+
+TEST_F(AIDCT, OutputIsClamped) {
+  std::array<int16_t, 64> coef{};
+  coef[0] = 100;
+  uint8_t out[64];
+
+  IDCT::transform(IDCTMethod::Islow, coef.data(), table, out, 8);
+  ASSERT_THAT(out, Each(Eq(255)));
+
+  coef[0] = -100;
+  IDCT::transform(IDCTMethod::Islow, coef.data(), table, out, 8);
+  ASSERT_THAT(out, Each(Eq(0)));
+}
+
+TEST_F(AIDCT, WritesWithStride) {
+  std::array<int16_t, 64> coef{};
+  std::vector<uint8_t> plane(16 * 8, 7);
+
+  IDCT::transform(IDCTMethod::Islow, coef.data(), table, plane.data(), 16);
+
+  for (int row = 0; row < 8; ++row) {
+    ASSERT_THAT(plane[row * 16], Eq(128));
+    ASSERT_THAT(plane[row * 16 + 8], Eq(7));
+  }
+}
+
+TEST_F(AIDCT, IslowIsAccurate) {
+  auto [max_error, mean_error] = measureError(IDCTMethod::Islow);
+
+  ASSERT_THAT(max_error, Le(1));
+  ASSERT_THAT(mean_error, Lt(0.02));
+}
+
+TEST_F(AIDCT, IfastIsCloseToReference) {
+  auto [max_error, mean_error] = measureError(IDCTMethod::Ifast);
+
+  ASSERT_THAT(max_error, Le(2));
+  ASSERT_THAT(mean_error, Lt(0.2));
+}
+
+TEST_F(AIDCT, FloatIsAccurate) {
+  auto [max_error, mean_error] = measureError(IDCTMethod::Float);
+
+  ASSERT_THAT(max_error, Le(1));
+  ASSERT_THAT(mean_error, Lt(0.01));
+}
+
+class AIDCTKernel : public AIDCT,
+                    public WithParamInterface<SIMDLevel> {};
+
+TEST_P(AIDCTKernel, IslowIsIdenticalToScalar) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << CPUFeatures::toString(level) << " is not supported";
+  }
+  auto kernel = IDCTKernels::select(IDCTMethod::Islow, level);
+
+  for (int n = 0; n < 2000; ++n) {
+    auto coef = randomBlock();
+    // sparse blocks take the dc only shortcut of the scalar code
+    if (n % 4 == 0) {
+      std::fill(coef.begin() + 1, coef.end(), 0);
+    }
+    alignas(16) uint8_t expected[8 * 16];
+    alignas(16) uint8_t out[8 * 16];
+    IDCT::computeIslow(coef.data(), table.islow.data(), expected, 16);
+    kernel(coef.data(), table, out, 16);
+
+    for (int row = 0; row < 8; ++row) {
+      for (int col = 0; col < 8; ++col) {
+        ASSERT_THAT(out[row * 16 + col], Eq(expected[row * 16 + col]));
+      }
+    }
+  }
+}
+
+TEST_P(AIDCTKernel, IslowClampsLikeScalar) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << CPUFeatures::toString(level) << " is not supported";
+  }
+  auto kernel = IDCTKernels::select(IDCTMethod::Islow, level);
+  std::array<int16_t, 64> coef{};
+  coef[0] = 120;
+  coef[1] = -40;
+  coef[8] = 35;
+  uint8_t expected[64];
+  uint8_t out[64];
+
+  IDCT::computeIslow(coef.data(), table.islow.data(), expected, 8);
+  kernel(coef.data(), table, out, 8);
+
+  ASSERT_THAT(out, ElementsAreArray(expected));
+}
+
+TEST_P(AIDCTKernel, CornerIsIdenticalToFull) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << CPUFeatures::toString(level) << " is not supported";
+  }
+  for (auto method : {IDCTMethod::Islow, IDCTMethod::Ifast, IDCTMethod::Float}) {
+    auto corner = IDCTKernels::selectCorner(method, level);
+
+    for (int n = 0; n < 500; ++n) {
+      auto coef = randomBlock();
+      for (int i = 0; i < 64; ++i) {
+        if (i / 8 >= 4 || i % 8 >= 4) {
+          coef[i] = 0;
+        }
+      }
+      uint8_t expected[64];
+      uint8_t out[64];
+      IDCT::transform(method, coef.data(), table, expected, 8);
+      corner(coef.data(), table, out, 8);
+
+      ASSERT_THAT(out, ElementsAreArray(expected));
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllSIMDLevels, AIDCTKernel,
+                         Values(SIMDLevel::Scalar, SIMDLevel::SSE2,
+                                SIMDLevel::AVX2));
+
+class AReducedIDCT : public AIDCT {
+public:
+  // libjpeg's reduced IDCTs output the average of the unrounded 8x8 IDCT
+  // over size x size cells
+  std::vector<uint8_t> referenceReducedIDCT(const std::array<int16_t, 64> &coef,
+                                            int size) {
+    int cell = 8 / size;
+    std::vector<double> sums(size * size);
+    for (auto y = 0; y < 8; ++y) {
+      for (auto x = 0; x < 8; ++x) {
+        auto sum = 0.0;
+        for (auto u = 0; u < 8; ++u) {
+          for (auto v = 0; v < 8; ++v) {
+            double cu = (u == 0) ? 1.0 / std::sqrt(2.0) : 1.0;
+            double cv = (v == 0) ? 1.0 / std::sqrt(2.0) : 1.0;
+            double t0 = cu * std::cos((2 * y + 1) * u * M_PI / 16.0);
+            double t1 = cv * std::cos((2 * x + 1) * v * M_PI / 16.0);
+            sum += coef[u * 8 + v] * table.islow[u * 8 + v] * t0 * t1;
+          }
+        }
+        sums[(y / cell) * size + x / cell] += sum * 0.25;
+      }
+    }
+    std::vector<uint8_t> result(size * size);
+    for (int i = 0; i < size * size; ++i) {
+      result[i] =
+          IDCT::clampToByte(std::lround(sums[i] / (cell * cell) + 128));
+    }
+    return result;
+  }
+
+  void expectAccurate(int size) {
+    auto kernel = IDCTKernels::select(IDCTMethod::Islow, SIMDLevel::Scalar, size);
+    for (int n = 0; n < 2000; ++n) {
+      auto coef = randomBlock();
+      auto expected = referenceReducedIDCT(coef, size);
+      uint8_t out[16];
+      kernel(coef.data(), table, out, size);
+
+      for (int i = 0; i < size * size; ++i) {
+        ASSERT_THAT(std::abs(out[i] - expected[i]), Le(1));
+      }
+    }
+  }
+};
+
+TEST_F(AReducedIDCT, DCOnlyBlockIsFlat) {
+  std::array<int16_t, 64> coef{};
+  coef[0] = 5;
+  for (int size : {4, 2, 1}) {
+    auto kernel = IDCTKernels::select(IDCTMethod::Islow, SIMDLevel::Scalar, size);
+    uint8_t out[16];
+    std::fill(std::begin(out), std::end(out), 0);
+    kernel(coef.data(), table, out, 4);
+
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        ASSERT_THAT(out[y * 4 + x], Eq(138));
+      }
+    }
+  }
+}
+
+TEST_F(AReducedIDCT, FourByFourIsAccurate) { expectAccurate(4); }
+
+TEST_F(AReducedIDCT, TwoByTwoIsAccurate) { expectAccurate(2); }
+
+TEST_F(AReducedIDCT, OneByOneIsAccurate) { expectAccurate(1); }
+
+TEST_F(AReducedIDCT, SelectsReducedKernelForEveryMethod) {
+  auto coef = randomBlock();
+  uint8_t expected[16];
+  IDCT::computeIslow4x4(coef.data(), table.islow.data(), expected, 4);
+
+  for (auto method : {IDCTMethod::Islow, IDCTMethod::Ifast, IDCTMethod::Float}) {
+    uint8_t out[16];
+    IDCTKernels::select(method, CPUFeatures::getSIMDLevel(), 4)(
+        coef.data(), table, out, 4);
+
+    ASSERT_THAT(out, ElementsAreArray(expected));
+  }
+}
+
+TEST_F(AIDCT, DCOnlyIsIdenticalToFull) {
+  for (auto method : {IDCTMethod::Islow, IDCTMethod::Ifast, IDCTMethod::Float}) {
+    for (int size : {8, 4, 2, 1}) {
+      auto full = IDCTKernels::select(method, SIMDLevel::Scalar, size);
+      auto dc_only = IDCTKernels::selectDCOnly(method, size);
+
+      // clamped at both ends as well
+      for (int dc = -300; dc <= 300; ++dc) {
+        std::array<int16_t, 64> coef{};
+        coef[0] = static_cast<int16_t>(dc);
+        uint8_t expected[64];
+        uint8_t out[64];
+        full(coef.data(), table, expected, 8);
+        dc_only(coef.data(), table, out, 8);
+
+        for (int y = 0; y < size; ++y) {
+          for (int x = 0; x < size; ++x) {
+            ASSERT_THAT(out[y * 8 + x], Eq(expected[y * 8 + x]))
+                << "dc " << dc << " size " << size;
+          }
+        }
+      }
+    }
+  }
+}
@@ -4,6 +4,7 @@
 
 #include <fstream>
 #include <gmock/gmock.h>
+#include <tuple>
 #include "sjpg_jfif_parser.h"
 
 using namespace testing;
@@ -129,4 +130,162 @@ TEST_F(AJFIFParser, ParseOKGetEOISegment) {
 
   auto *segment = parser.getEOISegment();
   ASSERT_THAT(segment, NotNull());
-}
\ No newline at end of file
+}
+
+class AJFIFParserOverMemory : public AJFIFParser {
+public:
+  std::vector<uint8_t> data;
+
+  void SetUp() override {
+    AJFIFParser::SetUp();
+    data.assign(std::istreambuf_iterator<char>(inputStream),
+                std::istreambuf_iterator<char>());
+  }
+};
+
+TEST_F(AJFIFParserOverMemory, ParseOKFromMemory) {
+  auto ret = parser.parse(data.data(), data.size());
+
+  ASSERT_THAT(ret, Eq(JFIFParser::Success));
+  ASSERT_THAT(parser.getSOF0Segment(), NotNull());
+  ASSERT_THAT(parser.getSOSSegment(), NotNull());
+  ASSERT_THAT(parser.getEOISegment(), NotNull());
+}
+
+TEST_F(AJFIFParserOverMemory, EncodedDataIsNotCopied) {
+  parser.parse(data.data(), data.size());
+
+  const auto &encoded = parser.getEncodedData();
+
+  ASSERT_THAT(encoded.data(), Ge(data.data()));
+  ASSERT_THAT(encoded.end(), Le(data.data() + data.size()));
+  // the scan starts right after the SOS segment
+  auto sos_end = parser.getSOSSegment()->file_pos + parser.getSOSSegment()->length;
+  ASSERT_THAT(encoded.data(), Eq(data.data() + sos_end));
+  // and stops on the EOI marker
+  ASSERT_THAT(encoded.end()[0], Eq(JFIF_BYTE_FF));
+  ASSERT_THAT(encoded.end()[1], Eq(JFIF_EOI));
+}
+
+TEST_F(AJFIFParserOverMemory, EncodedDataIsTheSameAsFromStream) {
+  JFIFParser stream_parser;
+  stream_parser.parse(inputStream.seekg(0));
+
+  parser.parse(data.data(), data.size());
+
+  const auto &from_stream = stream_parser.getEncodedData();
+  const auto &from_memory = parser.getEncodedData();
+  ASSERT_THAT(std::vector<uint8_t>(from_memory.begin(), from_memory.end()),
+              ElementsAreArray(from_stream.begin(), from_stream.end()));
+}
+
+TEST_F(AJFIFParserOverMemory, SegmentsAreViewsIntoTheData) {
+  parser.parse(data.data(), data.size());
+
+  const auto &segments = parser.getSegments();
+
+  ASSERT_THAT(segments.size(), Eq(11));
+  ASSERT_THAT(segments.front().marker, Eq(JFIF_APP0));
+  ASSERT_THAT(segments.back().marker, Eq(JFIF_EOI));
+  const auto &sof0 = segments[4];
+  ASSERT_THAT(sof0.marker, Eq(JFIF_SOF0));
+  ASSERT_THAT(sof0.offset, Eq(parser.getSOF0Segment()->file_pos));
+  ASSERT_THAT(sof0.length, Eq(parser.getSOF0Segment()->length));
+  auto bytes = parser.getSegmentData(sof0);
+  ASSERT_THAT(bytes.data(), Eq(data.data() + sof0.offset));
+  ASSERT_THAT(bytes.size(), Eq(sof0.length));
+}
+
+TEST_F(AJFIFParserOverMemory, UnknownSegmentsAreSkippedByLength) {
+  // an APP1 segment whose payload looks like markers
+  std::vector<uint8_t> app1 = {0xFF, 0xE1, 0x00, 0x06, 0xFF, 0xDA, 0xFF, 0xD9};
+  data.insert(data.begin() + 2, app1.begin(), app1.end());
+
+  auto ret = parser.parse(data.data(), data.size());
+
+  ASSERT_THAT(ret, Eq(JFIFParser::Success));
+  ASSERT_THAT(parser.getSegments()[0].marker, Eq(0xE1));
+  ASSERT_THAT(parser.getSOSSegment()->num_components, Eq(3));
+}
+
+TEST_F(AJFIFParserOverMemory, ParseFailedWithEmptyData) {
+  auto ret = parser.parse(nullptr, 0);
+
+  ASSERT_THAT(ret, Eq(JFIFParser::StreamEmpty));
+}
+
+TEST_F(AJFIFParserOverMemory, ParseFailedIfDataWithoutSOIMark) {
+  auto ret = parser.parse(data.data() + 2, data.size() - 2);
+
+  ASSERT_THAT(ret, Eq(JFIFParser::NoSOIMark));
+  ASSERT_THAT(parser.getSOISegment(), IsNull());
+}
+
+TEST_F(AJFIFParser, ParseOKFromMappedFile) {
+  auto ret = parser.parseFile(filepath);
+
+  ASSERT_THAT(ret, Eq(JFIFParser::Success));
+  ASSERT_THAT(parser.getEncodedData().size(), Eq(94895));
+}
+
+TEST_F(AJFIFParser, ParseFileFailedIfFileDoesNotExist) {
+  auto ret = parser.parseFile("nonexistent.jpg");
+
+  ASSERT_THAT(ret, Eq(JFIFParser::StreamInvalid));
+}
+
+TEST_F(AJFIFParser, ScanWithoutRestartMarkersIsOneInterval) {
+  parser.parse(inputStream);
+
+  const auto &intervals = parser.getRestartIntervals();
+
+  ASSERT_THAT(parser.getDRISegment(), IsNull());
+  ASSERT_THAT(intervals.size(), Eq(1));
+  ASSERT_THAT(intervals[0].data(), Eq(parser.getEncodedData().data()));
+  ASSERT_THAT(intervals[0].size(), Eq(parser.getEncodedData().size()));
+}
+
+TEST_F(AJFIFParser, ParseOKGetDRISegmentAndRestartIntervals) {
+  auto ret = parser.parseFile("./resources/lenna_256_rst.jpg");
+
+  auto *segment = parser.getDRISegment();
+  ASSERT_THAT(ret, Eq(JFIFParser::Success));
+  ASSERT_THAT(segment, NotNull());
+  ASSERT_THAT(segment->restart_interval, Eq(5));
+  // 32x32 MCUs, 5 MCUs per interval
+  const auto &intervals = parser.getRestartIntervals();
+  ASSERT_THAT(intervals.size(), Eq(205));
+  for (size_t i = 1; i < intervals.size(); ++i) {
+    // separated by exactly one RSTn marker, n counting modulo 8
+    const auto *marker = intervals[i - 1].end();
+    ASSERT_THAT(marker[0], Eq(JFIF_BYTE_FF));
+    ASSERT_THAT(marker[1], Eq(JFIF_RST0 + (i - 1) % 8));
+    ASSERT_THAT(intervals[i].data(), Eq(marker + 2));
+  }
+}
+
+TEST_F(AJFIFParser, ParseOKGetProgressiveScans) {
+  auto ret = parser.parseFile("./resources/lenna_256_420_progressive.jpg");
+
+  const auto &scans = parser.getScans();
+  ASSERT_THAT(ret, Eq(JFIFParser::Success));
+  ASSERT_THAT(parser.getSOF0Segment()->frame_marker, Eq(JFIF_SOF2));
+  ASSERT_TRUE(parser.getSOF0Segment()->isProgressive());
+  ASSERT_THAT(scans.size(), Eq(10));
+  // interleaved DC scan first, the last one refines the luma AC
+  const auto &first = scans.front().header;
+  ASSERT_THAT(first.num_components, Eq(3));
+  ASSERT_THAT(std::make_tuple(first.spectral_start, first.spectral_end,
+                              first.approx_high, first.approx_low),
+              Eq(std::make_tuple(0, 0, 0, 1)));
+  const auto &last = scans.back().header;
+  ASSERT_THAT(last.num_components, Eq(1));
+  ASSERT_THAT(std::make_tuple(last.spectral_start, last.spectral_end,
+                              last.approx_high, last.approx_low),
+              Eq(std::make_tuple(1, 63, 1, 0)));
+  // huffman tables are defined scan by scan
+  ASSERT_THAT(scans.back().dht_count, Eq(parser.getDHTSegments().size()));
+  ASSERT_THAT(scans.front().dht_count, Lt(scans.back().dht_count));
+  ASSERT_THAT(parser.getEncodedData().data(),
+              Eq(scans.front().encoded_data.data()));
+}
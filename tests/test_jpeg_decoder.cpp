@@ -5,6 +5,7 @@
 
 #include <fstream>
 #include <gmock/gmock.h>
+#include <tuple>
 #include <unordered_map>
 
 using namespace testing;
@@ -27,11 +28,12 @@ public:
   }
 };
 
-TEST_F(AJEPGDecoder, DecodeFailedIfIsNotYUV444) {
+TEST_F(AJEPGDecoder, DecodeFailedIfSamplingRatioIsNotIntegral) {
   auto* sof0 = parser.getSOF0Segment();
-  auto h_sample_factor = 2;
-  auto v_sample_factor = 2;
+  auto h_sample_factor = 3;
+  auto v_sample_factor = 3;
   sof0->sampling_factor[0] = (h_sample_factor << 4) | v_sample_factor;
+  sof0->sampling_factor[1] = (2 << 4) | 2;
   sof0->print();
 
   auto ret = decoder.decode(parser);
@@ -39,6 +41,15 @@ TEST_F(AJEPGDecoder, DecodeFailedIfIsNotYUV444) {
   ASSERT_THAT(ret, Not(0));
 }
 
+TEST_F(AJEPGDecoder, DecodeFailsIfAHuffmanTableIsOverSubscribed) {
+  auto &dht = parser.getDHTSegments()[0];
+  dht.symbol_counts.assign(16, 0);
+  dht.symbol_counts[0] = 40;
+  dht.symbols.assign(40, 0);
+
+  ASSERT_THAT(decoder.decode(parser), Eq(-1));
+}
+
 TEST_F(AJEPGDecoder, CanBuildHuffmanTablesIndex) {
   auto huffman_table_indies = decoder.buildHuffmanTableIndies(parser);
 
@@ -56,7 +67,8 @@ TEST_F(AJEPGDecoder, CanBuildBitStream) {
   auto data = std::vector<uint8_t>{0, 1, 2, 3};
   auto bs = JPEGDecoder::buildBitStream(data);
 
-  LOG_INFO("bs: %s", bs.getStringData().c_str());
+  ASSERT_THAT(bs.getSize(), Eq(4));
+  ASSERT_THAT(bs.getBits(32), Eq(0x00010203u));
 }
 
 TEST_F(AJEPGDecoder, DecodeSuccessGetYUVData) {
@@ -70,4 +82,1073 @@ TEST_F(AJEPGDecoder, DecodeSuccessGetYUVData) {
   ASSERT_THAT(y.size(), Eq(expected_size));
   ASSERT_THAT(u.size(), Eq(expected_size));
   ASSERT_THAT(v.size(), Eq(expected_size));
-}
\ No newline at end of file
+}
+TEST_F(AJEPGDecoder, IDCTMethodsDecodeCloseToEachOther) {
+  decoder.decode(parser);
+  auto islow_y = decoder.getYDecodedData();
+
+  for (auto method : {IDCTMethod::Ifast, IDCTMethod::Float}) {
+    JPEGDecoder other;
+    other.setIDCTMethod(method);
+    ASSERT_THAT(other.decode(parser), Eq(0));
+
+    const auto &y = other.getYDecodedData();
+    ASSERT_THAT(y.size(), Eq(islow_y.size()));
+    for (size_t i = 0; i < y.size(); ++i) {
+      ASSERT_THAT(std::abs(y[i] - islow_y[i]), Le(4));
+    }
+  }
+}
+
+TEST_F(AJEPGDecoder, ConvertColorWritesIntoCallerBuffer) {
+  decoder.decode(parser);
+  const auto width = decoder.getWidth();
+  const auto height = decoder.getHeight();
+  const auto stride = width * 4 + 16;
+  std::vector<uint8_t> rgba(stride * height, 0);
+
+  auto ret = decoder.convertColor(PixelFormat::RGBA, rgba.data(), stride);
+
+  ASSERT_THAT(ret, Eq(0));
+  const auto &y = decoder.getYDecodedData();
+  const auto &u = decoder.getUDecodedData();
+  const auto &v = decoder.getVDecodedData();
+  const auto last = (height - 1) * width + width - 1;
+  uint8_t expected[4];
+  ColorConverter::convertRowScalar(&y[last], &u[last], &v[last], expected, 1,
+                                   PixelFormat::RGBA);
+  const auto *pixel = rgba.data() + (height - 1) * stride + (width - 1) * 4;
+  ASSERT_THAT(std::vector<uint8_t>(pixel, pixel + 4),
+              ElementsAreArray(expected));
+}
+
+TEST_F(AJEPGDecoder, ConvertColorFailsIfStrideIsTooSmall) {
+  decoder.decode(parser);
+  std::vector<uint8_t> rgb(decoder.getWidth() * decoder.getHeight() * 3);
+
+  auto ret = decoder.convertColor(PixelFormat::RGB, rgb.data(),
+                                  decoder.getWidth() * 3 - 1);
+
+  ASSERT_THAT(ret, Not(0));
+}
+
+class AJEPGDecoderWithRestartMarkers : public Test {
+public:
+  JFIFParser parser;
+  JFIFParser reference_parser;
+  JPEGDecoder decoder;
+  JPEGDecoder reference_decoder;
+
+  void SetUp() override {
+    // the same image and tables, encoded with and without restart markers
+    ASSERT_THAT(parser.parseFile("./resources/lenna_256_rst.jpg"), Eq(0));
+    ASSERT_THAT(reference_parser.parseFile("./resources/lenna_256.jpg"), Eq(0));
+    ASSERT_THAT(reference_decoder.decode(reference_parser), Eq(0));
+  }
+
+  void expectSameAsReference() {
+    ASSERT_THAT(decoder.getYDecodedData(),
+                ElementsAreArray(reference_decoder.getYDecodedData()));
+    ASSERT_THAT(decoder.getUDecodedData(),
+                ElementsAreArray(reference_decoder.getUDecodedData()));
+    ASSERT_THAT(decoder.getVDecodedData(),
+                ElementsAreArray(reference_decoder.getVDecodedData()));
+  }
+};
+
+TEST_F(AJEPGDecoderWithRestartMarkers, DecodeResetsPredictorsPerInterval) {
+  auto ret = decoder.decode(parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  expectSameAsReference();
+}
+
+TEST_F(AJEPGDecoderWithRestartMarkers, DecodeIntervalsInParallel) {
+  ThreadPool pool(4);
+  decoder.setThreadPool(&pool);
+
+  auto ret = decoder.decode(parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  expectSameAsReference();
+}
+
+TEST_F(AJEPGDecoderWithRestartMarkers, ParallelDecodeWithoutRestartMarkers) {
+  ThreadPool pool(4);
+  decoder.setThreadPool(&pool);
+
+  auto ret = decoder.decode(reference_parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  expectSameAsReference();
+}
+
+class AJEPGDecoderWithSubsampling : public Test {
+public:
+  JFIFParser parser;
+  JPEGDecoder decoder;
+};
+
+TEST_F(AJEPGDecoderWithSubsampling, DecodeYUV420) {
+  parser.parseFile("./resources/lenna_256_420.jpg");
+
+  auto ret = decoder.decode(parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  ASSERT_THAT(decoder.getPlane(0).width, Eq(256));
+  ASSERT_THAT(decoder.getPlane(1).width, Eq(128));
+  ASSERT_THAT(decoder.getPlane(1).height, Eq(128));
+  ASSERT_THAT(decoder.getPlane(2).stride, Eq(128));
+}
+
+TEST_F(AJEPGDecoderWithSubsampling, LumaDoesNotDependOnChromaSubsampling) {
+  // the same image and quality, encoded as 4:4:4 and 4:2:0
+  JFIFParser reference_parser;
+  JPEGDecoder reference_decoder;
+  reference_parser.parseFile("./resources/lenna_256.jpg");
+  reference_decoder.decode(reference_parser);
+  parser.parseFile("./resources/lenna_256_420.jpg");
+
+  decoder.decode(parser);
+
+  ASSERT_THAT(decoder.getYDecodedData(),
+              ElementsAreArray(reference_decoder.getYDecodedData()));
+}
+
+TEST_F(AJEPGDecoderWithSubsampling, FancyUpsamplingIsCloserThanFast) {
+  JFIFParser reference_parser;
+  JPEGDecoder reference_decoder;
+  reference_parser.parseFile("./resources/lenna_256.jpg");
+  reference_decoder.decode(reference_parser);
+  std::vector<uint8_t> reference(256 * 256 * 3);
+  reference_decoder.convertColor(PixelFormat::RGB, reference.data(), 256 * 3);
+  parser.parseFile("./resources/lenna_256_420.jpg");
+  decoder.decode(parser);
+
+  auto error = [&](UpsampleMode mode) {
+    decoder.setUpsampleMode(mode);
+    std::vector<uint8_t> rgb(reference.size());
+    decoder.convertColor(PixelFormat::RGB, rgb.data(), 256 * 3);
+    double sum = 0;
+    for (size_t i = 0; i < rgb.size(); ++i) {
+      sum += std::abs(rgb[i] - reference[i]);
+    }
+    return sum / rgb.size();
+  };
+
+  auto fancy = error(UpsampleMode::Fancy);
+  auto fast = error(UpsampleMode::Fast);
+  ASSERT_THAT(fancy, Lt(fast));
+  ASSERT_THAT(fancy, Lt(3.0));
+}
+
+TEST_F(AJEPGDecoderWithSubsampling, DecodeYUV422WithPartialMCUs) {
+  parser.parseFile("./resources/lenna_251x173_422.jpg");
+
+  auto ret = decoder.decode(parser);
+
+  ASSERT_THAT(ret, Eq(0));
+  ASSERT_THAT(decoder.getWidth(), Eq(251));
+  ASSERT_THAT(decoder.getHeight(), Eq(173));
+  auto chroma = decoder.getPlane(1);
+  ASSERT_THAT(chroma.width, Eq(126));
+  ASSERT_THAT(chroma.height, Eq(173));
+  // 16x8 MCUs, 16 across and 22 down
+  ASSERT_THAT(chroma.stride, Eq(16 * 8));
+  ASSERT_THAT(decoder.getUDecodedData().size(), Eq(16 * 8 * 22 * 8));
+  std::vector<uint8_t> rgba(251 * 4 * 173);
+  ASSERT_THAT(decoder.convertColor(PixelFormat::RGBA, rgba.data(), 251 * 4),
+              Eq(0));
+}
+
+class AJEPGDecoderWithScaling : public Test {
+public:
+  JFIFParser parser;
+  JPEGDecoder decoder;
+};
+
+TEST_F(AJEPGDecoderWithScaling, OutputSizeIsRoundedUp) {
+  parser.parseFile("./resources/lenna_251x173_422.jpg");
+  std::vector<std::tuple<DecodeScale, int, int>> expected = {
+      {DecodeScale::Half, 126, 87},
+      {DecodeScale::Quarter, 63, 44},
+      {DecodeScale::Eighth, 32, 22}};
+
+  for (auto [scale, width, height] : expected) {
+    decoder.setScale(scale);
+    ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+    ASSERT_THAT(decoder.getWidth(), Eq(width));
+    ASSERT_THAT(decoder.getHeight(), Eq(height));
+    ASSERT_THAT(decoder.getPlane(0).width, Eq(width));
+    std::vector<uint8_t> rgb(width * 3 * height);
+    ASSERT_THAT(decoder.convertColor(PixelFormat::RGB, rgb.data(), width * 3),
+                Eq(0));
+  }
+}
+
+TEST_F(AJEPGDecoderWithScaling, ChromaIsScaledLessThanLuma) {
+  // like libjpeg, 4:2:0 chroma at 1/2 is decoded at full block size and
+  // needs no upsampling
+  parser.parseFile("./resources/lenna_256_420.jpg");
+  decoder.setScale(DecodeScale::Half);
+
+  decoder.decode(parser);
+
+  ASSERT_THAT(decoder.getPlane(0).width, Eq(128));
+  ASSERT_THAT(decoder.getPlane(1).width, Eq(128));
+  ASSERT_THAT(decoder.getPlane(1).height, Eq(128));
+}
+
+TEST_F(AJEPGDecoderWithScaling, EighthScaleIsTheBlockAverage) {
+  parser.parseFile("./resources/lenna_256.jpg");
+  JPEGDecoder full_decoder;
+  full_decoder.decode(parser);
+  decoder.setScale(DecodeScale::Eighth);
+
+  decoder.decode(parser);
+
+  auto full = full_decoder.getPlane(0);
+  auto scaled = decoder.getPlane(0);
+  ASSERT_THAT(scaled.width, Eq(32));
+  for (int by = 0; by < 32; ++by) {
+    for (int bx = 0; bx < 32; ++bx) {
+      int sum = 0;
+      for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+          sum += full.row(by * 8 + y)[bx * 8 + x];
+        }
+      }
+      ASSERT_THAT(std::abs(scaled.row(by)[bx] - sum / 64.0), Le(1.0));
+    }
+  }
+}
+
+TEST_F(AJEPGDecoderWithScaling, HalfScaleIsCloseToDownsampledFullDecode) {
+  parser.parseFile("./resources/lenna_256.jpg");
+  JPEGDecoder full_decoder;
+  full_decoder.decode(parser);
+  decoder.setScale(DecodeScale::Half);
+
+  decoder.decode(parser);
+
+  auto full = full_decoder.getPlane(0);
+  auto scaled = decoder.getPlane(0);
+  double error = 0;
+  for (int y = 0; y < 128; ++y) {
+    for (int x = 0; x < 128; ++x) {
+      int sum = full.row(2 * y)[2 * x] + full.row(2 * y)[2 * x + 1] +
+                full.row(2 * y + 1)[2 * x] + full.row(2 * y + 1)[2 * x + 1];
+      error += std::abs(scaled.row(y)[x] - sum / 4.0);
+    }
+  }
+  ASSERT_THAT(error / (128 * 128), Lt(2.0));
+}
+
+class AJEPGDecoderWithRowOutput : public Test {
+public:
+  JFIFParser parser;
+  JPEGDecoder decoder;
+
+  // decodeRows() output gathered into a whole image
+  std::vector<uint8_t> decodeByRows(PixelFormat format) {
+    std::vector<uint8_t> image;
+    size_t next_row = 0;
+    auto ret = decoder.decodeRows(
+        parser, format,
+        [&](size_t first_row, size_t row_count, const uint8_t *rows,
+            size_t stride) {
+          EXPECT_THAT(first_row, Eq(next_row));
+          image.insert(image.end(), rows, rows + row_count * stride);
+          next_row += row_count;
+        });
+    EXPECT_THAT(ret, Eq(0));
+    EXPECT_THAT(next_row, Eq(decoder.getHeight()));
+    return image;
+  }
+
+  std::vector<uint8_t> decodeWhole(PixelFormat format) {
+    JPEGDecoder whole_decoder;
+    whole_decoder.setScale(decoder.getScale());
+    whole_decoder.setUpsampleMode(decoder.getUpsampleMode());
+    whole_decoder.decode(parser);
+    auto stride = whole_decoder.getWidth() *
+                  ColorConverter::getBytesPerPixel(format);
+    std::vector<uint8_t> image(stride * whole_decoder.getHeight());
+    whole_decoder.convertColor(format, image.data(), stride);
+    return image;
+  }
+};
+
+TEST_F(AJEPGDecoderWithRowOutput, MatchesWholeImageDecode) {
+  for (const auto *path :
+       {"./resources/lenna_256.jpg", "./resources/lenna_256_420.jpg",
+        "./resources/lenna_251x173_422.jpg", "./resources/lenna_256_rst.jpg",
+        "./resources/lenna_251x173_422_progressive.jpg"}) {
+    parser.parseFile(path);
+
+    ASSERT_THAT(decodeByRows(PixelFormat::RGB),
+                ElementsAreArray(decodeWhole(PixelFormat::RGB)))
+        << path;
+  }
+}
+
+TEST_F(AJEPGDecoderWithRowOutput, MatchesWholeImageDecodeWhenScaled) {
+  parser.parseFile("./resources/lenna_251x173_422.jpg");
+  for (auto scale : {DecodeScale::Half, DecodeScale::Eighth}) {
+    decoder.setScale(scale);
+
+    ASSERT_THAT(decodeByRows(PixelFormat::BGRA),
+                ElementsAreArray(decodeWhole(PixelFormat::BGRA)));
+  }
+}
+
+TEST_F(AJEPGDecoderWithRowOutput, DeliversOneBandPerMCURow) {
+  parser.parseFile("./resources/lenna_256_420.jpg");
+  std::vector<size_t> row_counts;
+
+  decoder.decodeRows(parser, PixelFormat::RGB,
+                     [&](size_t, size_t row_count, const uint8_t *, size_t) {
+                       row_counts.push_back(row_count);
+                     });
+
+  ASSERT_THAT(row_counts, SizeIs(16));
+  ASSERT_THAT(row_counts, Each(Eq(16)));
+}
+
+TEST_F(AJEPGDecoderWithRowOutput, KeepsOnlyAWindowOfThePlanes) {
+  parser.parseFile("./resources/lenna_256_420.jpg");
+
+  decoder.decodeRows(parser, PixelFormat::RGB,
+                     [](size_t, size_t, const uint8_t *, size_t) {});
+
+  // three MCU rows of 16 luma and 8 chroma rows
+  ASSERT_THAT(decoder.getYDecodedData().size(), Eq(256 * 3 * 16));
+  ASSERT_THAT(decoder.getUDecodedData().size(), Eq(128 * 3 * 8));
+  std::vector<uint8_t> rgb(256 * 3 * 256);
+  ASSERT_THAT(decoder.convertColor(PixelFormat::RGB, rgb.data(), 256 * 3),
+              Eq(-1));
+}
+
+class AJEPGDecoderWithProgressiveImages : public Test {
+public:
+  JFIFParser parser;
+  JFIFParser baseline_parser;
+  JPEGDecoder decoder;
+  JPEGDecoder baseline_decoder;
+
+  // the progressive files are lossless transcodes of the baseline ones, the
+  // coefficients and so the decoded planes are the same
+  void decodeBoth(const std::string &name) {
+    ASSERT_THAT(parser.parseFile("./resources/" + name + "_progressive.jpg"),
+                Eq(0));
+    ASSERT_THAT(baseline_parser.parseFile("./resources/" + name + ".jpg"),
+                Eq(0));
+    ASSERT_THAT(decoder.decode(parser), Eq(0));
+    ASSERT_THAT(baseline_decoder.decode(baseline_parser), Eq(0));
+  }
+
+  void expectSamePlanes() {
+    ASSERT_THAT(decoder.getYDecodedData(),
+                ElementsAreArray(baseline_decoder.getYDecodedData()));
+    ASSERT_THAT(decoder.getUDecodedData(),
+                ElementsAreArray(baseline_decoder.getUDecodedData()));
+    ASSERT_THAT(decoder.getVDecodedData(),
+                ElementsAreArray(baseline_decoder.getVDecodedData()));
+  }
+};
+
+TEST_F(AJEPGDecoderWithProgressiveImages, DecodeSameAsBaseline) {
+  decodeBoth("lenna_256_420");
+
+  ASSERT_TRUE(decoder.isProgressive());
+  expectSamePlanes();
+}
+
+TEST_F(AJEPGDecoderWithProgressiveImages, DecodeWithRestartMarkers) {
+  decodeBoth("lenna_251x173_422");
+
+  ASSERT_THAT(parser.getScans().front().restart_interval, Eq(7));
+  expectSamePlanes();
+}
+
+TEST_F(AJEPGDecoderWithProgressiveImages, DecodeInParallel) {
+  ThreadPool pool(4);
+  decoder.setThreadPool(&pool);
+
+  decodeBoth("lenna_251x173_422");
+
+  expectSamePlanes();
+}
+
+TEST_F(AJEPGDecoderWithProgressiveImages, DecodeBaselineAfterProgressive) {
+  decodeBoth("lenna_256_420");
+
+  ASSERT_THAT(decoder.decode(baseline_parser), Eq(0));
+
+  ASSERT_FALSE(decoder.isProgressive());
+  expectSamePlanes();
+}
+
+TEST_F(AJEPGDecoderWithProgressiveImages, ScanLimitGivesAPreview) {
+  decoder.setScanLimit(1);
+
+  decodeBoth("lenna_256_420");
+
+  // the first scan holds the DC coefficients only, every block is flat
+  const auto plane = decoder.getPlane(0);
+  for (size_t y = 0; y < 8; ++y) {
+    for (size_t x = 0; x < 8; ++x) {
+      ASSERT_THAT(plane.row(y)[x], Eq(plane.row(0)[0]));
+      ASSERT_THAT(plane.row(8 + y)[16 + x], Eq(plane.row(8)[16]));
+    }
+  }
+  ASSERT_THAT(decoder.getYDecodedData(),
+              Not(ElementsAreArray(baseline_decoder.getYDecodedData())));
+}
+
+class AJEPGDecoderWithSpeculativeDecoding : public Test {
+public:
+  ThreadPool pool{4};
+  JFIFParser parser;
+  JPEGDecoder decoder;
+  JPEGDecoder sequential_decoder;
+
+  void SetUp() override { decoder.setThreadPool(&pool); }
+
+  void decodeBoth(const std::string &name, size_t min_chunk_size) {
+    ASSERT_THAT(parser.parseFile("./resources/" + name), Eq(0));
+    decoder.setSpeculativeDecoding(true, min_chunk_size);
+    ASSERT_THAT(decoder.decode(parser), Eq(0));
+    ASSERT_THAT(sequential_decoder.decode(parser), Eq(0));
+  }
+
+  void expectSamePlanes() {
+    ASSERT_THAT(decoder.getYDecodedData(),
+                ElementsAreArray(sequential_decoder.getYDecodedData()));
+    ASSERT_THAT(decoder.getUDecodedData(),
+                ElementsAreArray(sequential_decoder.getUDecodedData()));
+    ASSERT_THAT(decoder.getVDecodedData(),
+                ElementsAreArray(sequential_decoder.getVDecodedData()));
+  }
+};
+
+TEST_F(AJEPGDecoderWithSpeculativeDecoding, IsOffByDefault) {
+  ASSERT_FALSE(decoder.getSpeculativeDecoding());
+  ASSERT_THAT(parser.parseFile("./resources/lenna.jpg"), Eq(0));
+
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+  ASSERT_THAT(decoder.getSpeculativeStats().scans, Eq(0));
+}
+
+TEST_F(AJEPGDecoderWithSpeculativeDecoding, DecodeSameAsSequential) {
+  decodeBoth("lenna.jpg", 4096);
+
+  const auto &stats = decoder.getSpeculativeStats();
+  ASSERT_THAT(stats.scans, Eq(1));
+  ASSERT_THAT(stats.chunks, Eq(pool.size() + 1));
+  ASSERT_THAT(stats.fallbacks, Eq(0));
+  ASSERT_THAT(stats.discarded_bits, Gt(0));
+  expectSamePlanes();
+}
+
+TEST_F(AJEPGDecoderWithSpeculativeDecoding, DecodeSubsampledImage) {
+  decodeBoth("lenna_256_420.jpg", 1024);
+
+  ASSERT_THAT(decoder.getSpeculativeStats().fallbacks, Eq(0));
+  expectSamePlanes();
+}
+
+TEST_F(AJEPGDecoderWithSpeculativeDecoding, DecodeAScanPerComponent) {
+  // a baseline image with its components in separate scans
+  decodeBoth("lenna_251x173_422_scans.jpg", 512);
+
+  ASSERT_THAT(decoder.getSpeculativeStats().scans, Eq(3));
+  ASSERT_THAT(decoder.getSpeculativeStats().fallbacks, Eq(0));
+  expectSamePlanes();
+}
+
+TEST_F(AJEPGDecoderWithSpeculativeDecoding, FallsBackIfChunksDontLineUp) {
+  // chunks of about 500 bytes are too short to find the stream in
+  ThreadPool large_pool(40);
+  decoder.setThreadPool(&large_pool);
+
+  decodeBoth("lenna_256_420.jpg", 64);
+
+  ASSERT_THAT(decoder.getSpeculativeStats().fallbacks, Eq(1));
+  expectSamePlanes();
+}
+
+class AJEPGDecoderWithPipelinedDecoding : public AJEPGDecoderWithRowOutput {
+public:
+  ThreadPool pool{4};
+
+  void SetUp() override {
+    decoder.setThreadPool(&pool);
+    decoder.setPipelinedDecoding(true);
+  }
+};
+
+TEST_F(AJEPGDecoderWithPipelinedDecoding, DecodeSameAsSequential) {
+  for (const auto *path : {"./resources/lenna.jpg",
+                           "./resources/lenna_256_420.jpg",
+                           "./resources/lenna_251x173_422_scans.jpg"}) {
+    parser.parseFile(path);
+    JPEGDecoder sequential_decoder;
+    ASSERT_THAT(sequential_decoder.decode(parser), Eq(0));
+
+    ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+    ASSERT_THAT(decoder.getYDecodedData(),
+                ElementsAreArray(sequential_decoder.getYDecodedData()))
+        << path;
+    ASSERT_THAT(decoder.getUDecodedData(),
+                ElementsAreArray(sequential_decoder.getUDecodedData()))
+        << path;
+    ASSERT_THAT(decoder.getVDecodedData(),
+                ElementsAreArray(sequential_decoder.getVDecodedData()))
+        << path;
+  }
+}
+
+TEST_F(AJEPGDecoderWithPipelinedDecoding, ConvertColorSameAsSequential) {
+  parser.parseFile("./resources/lenna_251x173_422.jpg");
+  decoder.decode(parser);
+  const auto stride = decoder.getWidth() * 4;
+  std::vector<uint8_t> image(stride * decoder.getHeight());
+
+  ASSERT_THAT(decoder.convertColor(PixelFormat::BGRA, image.data(), stride),
+              Eq(0));
+
+  ASSERT_THAT(image, ElementsAreArray(decodeWhole(PixelFormat::BGRA)));
+}
+
+TEST_F(AJEPGDecoderWithPipelinedDecoding, DecodeRowsInOrder) {
+  for (const auto *path :
+       {"./resources/lenna_256_420.jpg", "./resources/lenna_251x173_422.jpg",
+        "./resources/lenna_256_rst.jpg",
+        "./resources/lenna_251x173_422_progressive.jpg"}) {
+    parser.parseFile(path);
+
+    ASSERT_THAT(decodeByRows(PixelFormat::RGB),
+                ElementsAreArray(decodeWhole(PixelFormat::RGB)))
+        << path;
+  }
+}
+
+TEST_F(AJEPGDecoderWithPipelinedDecoding, KeepsAWindowOfThePlanes) {
+  ThreadPool small_pool(1);
+  decoder.setThreadPool(&small_pool);
+  parser.parseFile("./resources/lenna_256_420.jpg");
+
+  decoder.decodeRows(parser, PixelFormat::RGB,
+                     [](size_t, size_t, const uint8_t *, size_t) {});
+
+  // two MCU rows between the entropy decoding and the IDCT, two converted
+  // bands and the row above the oldest band
+  ASSERT_THAT(decoder.getYDecodedData().size(), Eq(256 * 5 * 16));
+}
+
+class AJEPGDecoderWithCoefficientOutput : public Test {
+public:
+  JFIFParser parser;
+  JPEGDecoder decoder;
+
+  void decodeCoefficients(const std::string &name) {
+    ASSERT_THAT(parser.parseFile("./resources/" + name), Eq(0));
+    ASSERT_THAT(decoder.decodeCoefficients(parser), Eq(0));
+  }
+
+  // the blocks inside the image, the MCU padding is up to the encoder
+  static std::vector<int16_t> imageBlocks(const CoefficientView &view) {
+    std::vector<int16_t> coefficients;
+    for (size_t y = 0; y < view.height_in_blocks; ++y) {
+      for (size_t x = 0; x < view.width_in_blocks; ++x) {
+        coefficients.insert(coefficients.end(), view.block(x, y),
+                            view.block(x, y) + 64);
+      }
+    }
+    return coefficients;
+  }
+};
+
+TEST_F(AJEPGDecoderWithCoefficientOutput, AllocatesNoPlanes) {
+  decodeCoefficients("lenna_256_420.jpg");
+
+  ASSERT_THAT(decoder.getYDecodedData(), IsEmpty());
+  for (int i = 0; i < JPEGDecoder::kMaxComponents; ++i) {
+    auto view = decoder.getCoefficients(i);
+    ASSERT_THAT(reinterpret_cast<uintptr_t>(view.data) %
+                    CoefficientView::kCoefficientAlignment,
+                Eq(0));
+    ASSERT_THAT(view.width_in_blocks, Eq(i == 0 ? 32 : 16));
+    ASSERT_THAT(view.blocks_per_line, Eq(view.width_in_blocks));
+  }
+}
+
+TEST_F(AJEPGDecoderWithCoefficientOutput, GivesTheQuantizationTables) {
+  decodeCoefficients("lenna_256_420.jpg");
+
+  auto *sof0 = parser.getSOF0Segment();
+  for (int i = 0; i < JPEGDecoder::kMaxComponents; ++i) {
+    const auto *quant_table = decoder.getCoefficients(i).quant_table;
+    const auto &dqt =
+        parser.getQTableRefs()[sof0->quantization_table_id[i]]->data;
+    for (int k = 0; k < 64; ++k) {
+      ASSERT_THAT(quant_table[kNaturalOrder[k]], Eq(dqt[k])) << k;
+    }
+  }
+}
+
+TEST_F(AJEPGDecoderWithCoefficientOutput, InverseTransformIsTheDecodedImage) {
+  decodeCoefficients("lenna_256_420.jpg");
+  JPEGDecoder pixel_decoder;
+  ASSERT_THAT(pixel_decoder.decode(parser), Eq(0));
+  const auto plane = pixel_decoder.getPlane(0);
+  const auto view = decoder.getCoefficients(0);
+
+  for (size_t by = 0; by < view.height_in_blocks; ++by) {
+    for (size_t bx = 0; bx < view.width_in_blocks; ++bx) {
+      uint8_t block[64];
+      IDCT::computeIslow(view.block(bx, by), view.quant_table, block, 8);
+      for (size_t y = 0; y < 8; ++y) {
+        ASSERT_THAT(std::vector<uint8_t>(block + y * 8, block + y * 8 + 8),
+                    ElementsAreArray(plane.row(by * 8 + y) + bx * 8, 8))
+            << bx << ", " << by;
+      }
+    }
+  }
+}
+
+TEST_F(AJEPGDecoderWithCoefficientOutput, SameForProgressiveImages) {
+  decodeCoefficients("lenna_251x173_422.jpg");
+  std::vector<std::vector<int16_t>> baseline;
+  for (int i = 0; i < JPEGDecoder::kMaxComponents; ++i) {
+    baseline.push_back(imageBlocks(decoder.getCoefficients(i)));
+  }
+
+  decodeCoefficients("lenna_251x173_422_progressive.jpg");
+
+  for (int i = 0; i < JPEGDecoder::kMaxComponents; ++i) {
+    ASSERT_THAT(imageBlocks(decoder.getCoefficients(i)), Eq(baseline[i]));
+  }
+}
+
+TEST_F(AJEPGDecoderWithCoefficientOutput, DecodesAScanPerComponent) {
+  decodeCoefficients("lenna_251x173_422.jpg");
+  std::vector<std::vector<int16_t>> interleaved;
+  for (int i = 0; i < JPEGDecoder::kMaxComponents; ++i) {
+    interleaved.push_back(imageBlocks(decoder.getCoefficients(i)));
+  }
+
+  decodeCoefficients("lenna_251x173_422_scans.jpg");
+
+  for (int i = 0; i < JPEGDecoder::kMaxComponents; ++i) {
+    ASSERT_THAT(imageBlocks(decoder.getCoefficients(i)), Eq(interleaved[i]));
+  }
+}
+
+class AJEPGDecoderWithCrop : public Test {
+public:
+  JFIFParser parser;
+  JPEGDecoder decoder;
+
+  static std::vector<uint8_t> readFile(const std::string &path) {
+    std::ifstream stream(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(stream),
+            std::istreambuf_iterator<char>()};
+  }
+
+  static std::vector<uint8_t> decodeRGB(JPEGDecoder &jpeg_decoder,
+                                        JFIFParser &jpeg_parser) {
+    if (jpeg_decoder.decode(jpeg_parser) != 0) {
+      return {};
+    }
+    std::vector<uint8_t> rgb(jpeg_decoder.getWidth() *
+                             jpeg_decoder.getHeight() * 3);
+    jpeg_decoder.convertColor(PixelFormat::RGB, rgb.data(),
+                              jpeg_decoder.getWidth() * 3);
+    return rgb;
+  }
+
+  // the crop is the same as the pixels of the whole image
+  void expectCrop(size_t x, size_t y, size_t width, size_t height) {
+    JPEGDecoder whole_decoder;
+    whole_decoder.setScale(decoder.getScale());
+    auto whole = decodeRGB(whole_decoder, parser);
+    const auto whole_width = whole_decoder.getWidth();
+    decoder.setCrop(x, y, width, height);
+
+    auto crop = decodeRGB(decoder, parser);
+
+    const auto crop_width = decoder.getWidth();
+    ASSERT_THAT(crop, SizeIs(crop_width * decoder.getHeight() * 3));
+    for (size_t row = 0; row < decoder.getHeight(); ++row) {
+      const auto *expected = whole.data() + ((y + row) * whole_width + x) * 3;
+      ASSERT_THAT(std::vector<uint8_t>(crop.begin() + row * crop_width * 3,
+                                       crop.begin() +
+                                           (row + 1) * crop_width * 3),
+                  ElementsAreArray(expected, crop_width * 3))
+          << x << ", " << y << " row " << row;
+    }
+  }
+};
+
+TEST_F(AJEPGDecoderWithCrop, IsTheSameAsTheWholeImage) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420.jpg"), Eq(0));
+
+  expectCrop(16, 32, 64, 48); // on the MCU grid
+  expectCrop(37, 53, 101, 77);
+  expectCrop(255, 255, 1, 1);
+  expectCrop(0, 0, 256, 256);
+  ASSERT_THAT(decoder.getWidth(), Eq(256));
+}
+
+TEST_F(AJEPGDecoderWithCrop, SizeOfZeroExtendsToTheEdge) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420.jpg"), Eq(0));
+
+  expectCrop(200, 190, 0, 0);
+
+  ASSERT_THAT(decoder.getWidth(), Eq(56));
+  ASSERT_THAT(decoder.getHeight(), Eq(66));
+}
+
+TEST_F(AJEPGDecoderWithCrop, IsClippedToTheImage) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_251x173_422.jpg"), Eq(0));
+
+  expectCrop(200, 150, 100, 100);
+
+  ASSERT_THAT(decoder.getWidth(), Eq(51));
+  ASSERT_THAT(decoder.getHeight(), Eq(23));
+}
+
+TEST_F(AJEPGDecoderWithCrop, CropsScaledImages) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_251x173_422.jpg"), Eq(0));
+  decoder.setScale(DecodeScale::Half);
+
+  expectCrop(10, 21, 50, 40);
+}
+
+TEST_F(AJEPGDecoderWithCrop, CropsProgressiveImages) {
+  ASSERT_THAT(
+      parser.parseFile("./resources/lenna_251x173_422_progressive.jpg"),
+      Eq(0));
+
+  expectCrop(33, 17, 90, 60);
+}
+
+TEST_F(AJEPGDecoderWithCrop, CropsAScanPerComponent) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_251x173_422_scans.jpg"),
+              Eq(0));
+
+  expectCrop(33, 17, 90, 60);
+}
+
+TEST_F(AJEPGDecoderWithCrop, CropsOnTheThreadPool) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_rst.jpg"), Eq(0));
+  ThreadPool pool(4);
+  decoder.setThreadPool(&pool);
+  decoder.setPipelinedDecoding(true);
+
+  expectCrop(37, 53, 101, 77);
+}
+
+TEST_F(AJEPGDecoderWithCrop, PlanesHoldTheMCUsAroundTheCrop) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420.jpg"), Eq(0));
+  decoder.setCrop(40, 40, 20, 20);
+
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+  // 16x16 MCUs from 32, 32 to 64, 64, the filter margin included
+  ASSERT_THAT(decoder.getPlane(0).stride, Eq(32));
+  ASSERT_THAT(decoder.getYDecodedData(), SizeIs(32 * 32));
+  ASSERT_THAT(decoder.getUDecodedData(), SizeIs(16 * 16));
+}
+
+TEST_F(AJEPGDecoderWithCrop, DoesNotNeedRestartIntervalsOutsideTheCrop) {
+  auto data = readFile("./resources/lenna_256_rst.jpg");
+  ASSERT_THAT(parser.parse(data.data(), data.size()), Eq(0));
+  decoder.setCrop(66, 130, 190, 60);
+  auto expected = decodeRGB(decoder, parser);
+  // intervals of 5 MCUs of 8x8, the crop needs the MCUs from column 8 on of
+  // the rows 16 ~ 23 and the other intervals are zeroed
+  const auto &intervals = parser.getRestartIntervals();
+  for (size_t i = 0; i < intervals.size(); ++i) {
+    bool needed = false;
+    for (size_t mcu = i * 5; mcu < i * 5 + 5; ++mcu) {
+      needed |= mcu / 32 >= 16 && mcu / 32 < 24 && mcu % 32 >= 8;
+    }
+    if (!needed) {
+      const auto offset =
+          static_cast<size_t>(intervals[i].data() - parser.getData().data());
+      std::fill_n(data.begin() + offset, intervals[i].size(), 0);
+    }
+  }
+  JFIFParser damaged_parser;
+  ASSERT_THAT(damaged_parser.parse(data.data(), data.size()), Eq(0));
+
+  ASSERT_THAT(decodeRGB(decoder, damaged_parser), ElementsAreArray(expected));
+}
+
+TEST_F(AJEPGDecoderWithCrop, DoesNotNeedTheScanAfterTheCrop) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  ASSERT_THAT(parser.parse(data.data(), data.size()), Eq(0));
+  decoder.setCrop(16, 16, 64, 64);
+  auto expected = decodeRGB(decoder, parser);
+  // the crop ends in the 6th of 16 MCU rows, the last 3/8 of the scan are
+  // zeroed
+  const auto &scan = parser.getEncodedData();
+  const auto offset =
+      static_cast<size_t>(scan.data() - parser.getData().data());
+  std::fill(data.begin() + offset + scan.size() * 5 / 8,
+            data.begin() + offset + scan.size(), 0);
+  JFIFParser damaged_parser;
+  ASSERT_THAT(damaged_parser.parse(data.data(), data.size()), Eq(0));
+
+  ASSERT_THAT(decodeRGB(decoder, damaged_parser), ElementsAreArray(expected));
+}
+
+TEST_F(AJEPGDecoderWithCrop, FailsIfTheCropIsOutsideTheImage) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420.jpg"), Eq(0));
+  decoder.setCrop(256, 0, 10, 10);
+
+  ASSERT_THAT(decoder.decode(parser), Eq(-1));
+}
+
+TEST_F(AJEPGDecoderWithCrop, RowDecodingDoesNotCrop) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420.jpg"), Eq(0));
+  decoder.setCrop(16, 16, 64, 64);
+
+  ASSERT_THAT(decoder.decodeRows(parser, PixelFormat::RGB,
+                                 [](size_t, size_t, const uint8_t *, size_t) {}),
+              Eq(-1));
+}
+
+TEST_F(AJEPGDecoderWithCrop, CropsWithAScanIndex) {
+  ScanIndex index;
+  for (const auto *path :
+       {"./resources/lenna_256_420.jpg", "./resources/lenna_256_rst.jpg",
+        "./resources/lenna_256_gray_rst.jpg"}) {
+    ASSERT_THAT(parser.parseFile(path), Eq(0));
+    ASSERT_THAT(decoder.buildScanIndex(parser, 4, index), Eq(0));
+    ASSERT_TRUE(decoder.setScanIndex(&index, parser));
+
+    expectCrop(16, 32, 64, 48);
+    expectCrop(37, 53, 101, 77);
+    expectCrop(255, 255, 1, 1);
+    expectCrop(0, 0, 256, 256);
+  }
+}
+
+TEST_F(AJEPGDecoderWithCrop, CropsWithAScanIndexOnTheThreadPool) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420.jpg"), Eq(0));
+  ScanIndex index;
+  ASSERT_THAT(decoder.buildScanIndex(parser, 3, index), Eq(0));
+  ASSERT_TRUE(decoder.setScanIndex(&index, parser));
+  ThreadPool pool(4);
+  decoder.setThreadPool(&pool);
+
+  expectCrop(37, 53, 101, 77);
+}
+
+TEST_F(AJEPGDecoderWithCrop, DoesNotNeedTheScanBeforeTheCheckpoints) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  ASSERT_THAT(parser.parse(data.data(), data.size()), Eq(0));
+  ScanIndex index;
+  ASSERT_THAT(decoder.buildScanIndex(parser, 4, index), Eq(0));
+  ASSERT_TRUE(decoder.setScanIndex(&index, parser));
+  decoder.setCrop(100, 132, 64, 64);
+  auto expected = decodeRGB(decoder, parser);
+  // 16 MCUs of 16x16 a row, the crop and its margin start at MCU 8 * 16 + 6,
+  // after the checkpoint of MCU 8 * 16 + 4
+  const auto checkpoint = index.getCheckpoint(index.findCheckpoint(8 * 16 + 6));
+  ASSERT_THAT(checkpoint.mcu, Eq(8 * 16 + 4));
+  const auto &scan = parser.getEncodedData();
+  const auto offset =
+      static_cast<size_t>(scan.data() - parser.getData().data());
+  std::fill_n(data.begin() + offset, checkpoint.bit_offset / 8, 0);
+  JFIFParser damaged_parser;
+  ASSERT_THAT(damaged_parser.parse(data.data(), data.size()), Eq(0));
+
+  // the index was checked against the whole scan when it was set
+  ASSERT_THAT(decodeRGB(decoder, damaged_parser), ElementsAreArray(expected));
+}
+
+TEST_F(AJEPGDecoderWithCrop, IgnoresTheScanIndexOfAnotherImage) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_rst.jpg"), Eq(0));
+  ScanIndex index;
+  ASSERT_THAT(decoder.buildScanIndex(parser, 4, index), Eq(0));
+  ASSERT_TRUE(decoder.setScanIndex(&index, parser));
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420.jpg"), Eq(0));
+
+  expectCrop(37, 53, 101, 77);
+}
+
+TEST_F(AJEPGDecoderWithCrop, RefusesTheScanIndexOfAnotherScanOfTheSameSize) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  ASSERT_THAT(parser.parse(data.data(), data.size()), Eq(0));
+  ScanIndex index;
+  ASSERT_THAT(decoder.buildScanIndex(parser, 4, index), Eq(0));
+  // a bit of the scan flipped, far from any marker
+  auto pos = static_cast<size_t>(parser.getEncodedData().data() -
+                                 data.data()) +
+             parser.getEncodedData().size() / 2;
+  while (data[pos] >= 0xFE || data[pos - 1] == 0xFF) {
+    ++pos;
+  }
+  auto other_data = data;
+  other_data[pos] ^= 1;
+  JFIFParser other_parser;
+  ASSERT_THAT(other_parser.parse(other_data.data(), other_data.size()), Eq(0));
+
+  ASSERT_FALSE(decoder.setScanIndex(&index, other_parser));
+  ASSERT_THAT(decoder.getScanIndex(), IsNull());
+  ASSERT_TRUE(decoder.setScanIndex(&index, parser));
+}
+
+TEST_F(AJEPGDecoderWithCrop, ScanIndexNeedsASingleInterleavedScan) {
+  ScanIndex index;
+
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_420_progressive.jpg"),
+              Eq(0));
+  ASSERT_THAT(decoder.buildScanIndex(parser, 4, index), Eq(-1));
+  ASSERT_THAT(parser.parseFile("./resources/lenna_251x173_422_scans.jpg"),
+              Eq(0));
+  ASSERT_THAT(decoder.buildScanIndex(parser, 4, index), Eq(-1));
+}
+
+class AJEPGDecoderWithGrayscale : public Test {
+public:
+  JFIFParser parser;
+  JPEGDecoder decoder;
+
+  std::vector<uint8_t> decodePixels(const std::string &path,
+                                    PixelFormat format) {
+    JFIFParser image_parser;
+    JPEGDecoder image_decoder;
+    EXPECT_THAT(image_parser.parseFile(path), Eq(0));
+    EXPECT_THAT(image_decoder.decode(image_parser), Eq(0));
+    const auto stride = image_decoder.getWidth() *
+                        ColorConverter::getBytesPerPixel(format);
+    std::vector<uint8_t> pixels(stride * image_decoder.getHeight());
+    EXPECT_THAT(image_decoder.convertColor(format, pixels.data(), stride),
+                Eq(0));
+    return pixels;
+  }
+};
+
+TEST_F(AJEPGDecoderWithGrayscale, DecodesASinglePlane) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_gray.jpg"), Eq(0));
+
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+  ASSERT_THAT(decoder.getComponentCount(), Eq(1));
+  ASSERT_THAT(decoder.getPlane(0).width, Eq(256));
+  ASSERT_THAT(decoder.getPlane(0).height, Eq(256));
+  ASSERT_THAT(decoder.getUDecodedData(), IsEmpty());
+}
+
+TEST_F(AJEPGDecoderWithGrayscale, HasNoCoefficientsOfChroma) {
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_gray.jpg"), Eq(0));
+
+  ASSERT_THAT(decoder.decodeCoefficients(parser), Eq(0));
+
+  ASSERT_THAT(decoder.getCoefficients(0).blocks_per_line, Eq(32));
+  for (int i = 1; i < JPEGDecoder::kMaxComponents; ++i) {
+    ASSERT_THAT(decoder.getCoefficients(i).data, IsNull());
+    ASSERT_THAT(decoder.getCoefficients(i).blocks_per_line, Eq(0));
+    ASSERT_THAT(decoder.getCoefficients(i).block_rows, Eq(0));
+  }
+}
+
+TEST_F(AJEPGDecoderWithGrayscale, LumaIsThatOfTheImageSavedAsColor) {
+  // the same gray pixels, encoded as one component and as YCbCr 4:4:4
+  JFIFParser color_parser;
+  JPEGDecoder color_decoder;
+  parser.parseFile("./resources/lenna_256_gray.jpg");
+  color_parser.parseFile("./resources/lenna_256_gray_444.jpg");
+
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+  ASSERT_THAT(color_decoder.decode(color_parser), Eq(0));
+
+  ASSERT_THAT(decoder.getYDecodedData(),
+              ElementsAreArray(color_decoder.getYDecodedData()));
+}
+
+TEST_F(AJEPGDecoderWithGrayscale, ReplicatesLumaIntoEachChannel) {
+  auto gray = decodePixels("./resources/lenna_251x173_gray.jpg",
+                           PixelFormat::Gray);
+  auto rgba = decodePixels("./resources/lenna_251x173_gray.jpg",
+                           PixelFormat::RGBA);
+
+  ASSERT_THAT(gray, SizeIs(251 * 173));
+  ASSERT_THAT(rgba, SizeIs(251 * 173 * 4));
+  for (size_t i = 0; i < gray.size(); ++i) {
+    ASSERT_THAT(std::vector<uint8_t>(rgba.begin() + i * 4,
+                                     rgba.begin() + i * 4 + 4),
+                ElementsAre(gray[i], gray[i], gray[i], 255))
+        << i;
+  }
+}
+
+TEST_F(AJEPGDecoderWithGrayscale, GrayOutputOfAColorImageIsItsLuma) {
+  parser.parseFile("./resources/lenna_256_420.jpg");
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+  auto gray = decodePixels("./resources/lenna_256_420.jpg", PixelFormat::Gray);
+
+  ASSERT_THAT(gray, ElementsAreArray(decoder.getYDecodedData()));
+}
+
+TEST_F(AJEPGDecoderWithGrayscale, DecodesRestartAndProgressiveImages) {
+  auto expected =
+      decodePixels("./resources/lenna_256_gray.jpg", PixelFormat::Gray);
+
+  for (const auto *path : {"./resources/lenna_256_gray_rst.jpg",
+                           "./resources/lenna_256_gray_progressive.jpg"}) {
+    ASSERT_THAT(decodePixels(path, PixelFormat::Gray),
+                ElementsAreArray(expected))
+        << path;
+  }
+}
+
+TEST_F(AJEPGDecoderWithGrayscale, IgnoresTheSamplingFactors) {
+  // a lone component is coded block by block whatever its factors say
+  auto expected =
+      decodePixels("./resources/lenna_256_gray.jpg", PixelFormat::Gray);
+  parser.parseFile("./resources/lenna_256_gray.jpg");
+  parser.getSOF0Segment()->sampling_factor[0] = (2 << 4) | 2;
+
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+  ASSERT_THAT(decoder.getYDecodedData(), ElementsAreArray(expected));
+}
+
+TEST_F(AJEPGDecoderWithGrayscale, DecodesRowsAndCrops) {
+  auto expected =
+      decodePixels("./resources/lenna_251x173_gray.jpg", PixelFormat::RGB);
+  parser.parseFile("./resources/lenna_251x173_gray.jpg");
+  std::vector<uint8_t> rows;
+  ASSERT_THAT(decoder.decodeRows(parser, PixelFormat::RGB,
+                                 [&](size_t, size_t row_count,
+                                     const uint8_t *data, size_t stride) {
+                                   rows.insert(rows.end(), data,
+                                               data + row_count * stride);
+                                 }),
+              Eq(0));
+  ASSERT_THAT(rows, ElementsAreArray(expected));
+
+  decoder.setCrop(37, 53, 101, 77);
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+  std::vector<uint8_t> crop(101 * 77 * 3);
+  ASSERT_THAT(decoder.convertColor(PixelFormat::RGB, crop.data(), 101 * 3),
+              Eq(0));
+  for (size_t row = 0; row < 77; ++row) {
+    ASSERT_THAT(std::vector<uint8_t>(crop.begin() + row * 101 * 3,
+                                     crop.begin() + (row + 1) * 101 * 3),
+                ElementsAreArray(expected.data() + ((53 + row) * 251 + 37) * 3,
+                                 101 * 3))
+        << row;
+  }
+}
@@ -0,0 +1,308 @@
+//
+// Created by user on 8/1/25.
+//
+#include "sjpg_jpeg_decoder.h"
+#include "sjpg_jpeg_encoder.h"
+#include "sjpg_segment_writer.h"
+
+#include <cmath>
+#include <gmock/gmock.h>
+#include <tuple>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AJPEGEncoder : public Test {
+public:
+  size_t width = 101;
+  size_t height = 67;
+  std::vector<uint8_t> rgb;
+  JPEGEncoder encoder;
+  std::vector<uint8_t> jpeg;
+
+  void SetUp() override { rgb = makeImage(width, height, 3); }
+
+  // smooth colors with a few sharp edges
+  static std::vector<uint8_t> makeImage(size_t w, size_t h, int channels) {
+    std::vector<uint8_t> pixels(w * h * channels);
+    for (size_t y = 0; y < h; ++y) {
+      for (size_t x = 0; x < w; ++x) {
+        auto *p = pixels.data() + (y * w + x) * channels;
+        bool edge = (x / 16 + y / 16) % 3 == 0;
+        p[0] = static_cast<uint8_t>(x * 255 / w);
+        p[1] = static_cast<uint8_t>(edge ? 220 : y * 255 / h);
+        p[2] = static_cast<uint8_t>(128 + 100 * std::sin((x + y) * 0.1));
+        if (channels == 4) {
+          p[3] = 255;
+        }
+      }
+    }
+    return pixels;
+  }
+
+  std::vector<uint8_t> decode(const std::vector<uint8_t> &data,
+                              JFIFParser &parser) {
+    JPEGDecoder decoder;
+    if (parser.parse(data.data(), data.size()) != 0 ||
+        decoder.decode(parser) != 0) {
+      return {};
+    }
+    std::vector<uint8_t> pixels(decoder.getWidth() * decoder.getHeight() * 3);
+    decoder.convertColor(PixelFormat::RGB, pixels.data(),
+                         decoder.getWidth() * 3);
+    return pixels;
+  }
+
+  std::vector<uint8_t> decode(const std::vector<uint8_t> &data) {
+    JFIFParser parser;
+    return decode(data, parser);
+  }
+
+  static double psnr(const std::vector<uint8_t> &a,
+                     const std::vector<uint8_t> &b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+      double d = a[i] - b[i];
+      sum += d * d;
+    }
+    return 10 * std::log10(255.0 * 255.0 * a.size() / sum);
+  }
+
+  int encode() {
+    return encoder.encode(rgb.data(), width, height, width * 3,
+                          PixelFormat::RGB, jpeg);
+  }
+};
+
+TEST_F(AJPEGEncoder, WritesABaselineJFIFFile) {
+  ASSERT_THAT(encode(), Eq(0));
+  JFIFParser parser;
+
+  ASSERT_THAT(parser.parse(jpeg.data(), jpeg.size()), Eq(0));
+  ASSERT_THAT(std::string(parser.getAPP0Segment()->identifier), Eq("JFIF"));
+  auto *sof0 = parser.getSOF0Segment();
+  ASSERT_THAT(sof0->frame_marker, Eq(JFIF_SOF0));
+  ASSERT_THAT(sof0->width, Eq(width));
+  ASSERT_THAT(sof0->height, Eq(height));
+  ASSERT_THAT(sof0->num_components, Eq(3));
+  ASSERT_THAT(sof0->sampling_factor, ElementsAre(0x22, 0x11, 0x11));
+  ASSERT_THAT(sof0->quantization_table_id, ElementsAre(0, 1, 1));
+  ASSERT_THAT(parser.getDHTSegments(), SizeIs(4));
+  ASSERT_THAT(parser.getEOISegment(), NotNull());
+}
+
+TEST_F(AJPEGEncoder, AppendsToTheBuffer) {
+  jpeg = {1, 2, 3};
+
+  encode();
+
+  ASSERT_THAT(jpeg[0], Eq(1));
+  ASSERT_THAT(jpeg[3], Eq(0xFF));
+  ASSERT_THAT(jpeg[4], Eq(JFIF_SOI));
+}
+
+TEST_F(AJPEGEncoder, ScalesTheQuantTablesByQuality) {
+  uint8_t table[64];
+
+  JPEGEncoder::scaleQuantTable(annex_k::kLuminanceQuantization, 50, table);
+  ASSERT_THAT(table[0], Eq(annex_k::kLuminanceQuantization[0]));
+  JPEGEncoder::scaleQuantTable(annex_k::kLuminanceQuantization, 100, table);
+  ASSERT_THAT(table, Each(Eq(1)));
+  JPEGEncoder::scaleQuantTable(annex_k::kLuminanceQuantization, 1, table);
+  ASSERT_THAT(table, Each(Eq(255)));
+}
+
+TEST_F(AJPEGEncoder, HigherQualityIsLargerAndCloser) {
+  encoder.setQuality(30);
+  encode();
+  auto low = jpeg;
+  jpeg.clear();
+  encoder.setQuality(95);
+  encode();
+
+  ASSERT_THAT(jpeg.size(), Gt(low.size()));
+  ASSERT_THAT(psnr(rgb, decode(jpeg)), Gt(psnr(rgb, decode(low))));
+}
+
+TEST_F(AJPEGEncoder, OptimizedHuffmanTablesAreSmallerAndDecodeTheSame) {
+  encode();
+  auto standard = jpeg;
+  jpeg.clear();
+  encoder.setOptimizeHuffman(true);
+  encode();
+
+  ASSERT_THAT(jpeg.size(), Lt(standard.size()));
+  ASSERT_THAT(decode(jpeg), Eq(decode(standard)));
+}
+
+TEST_F(AJPEGEncoder, WritesRestartMarkers) {
+  encode();
+  auto expected = decode(jpeg);
+  for (bool optimize : {false, true}) {
+    jpeg.clear();
+    encoder.setOptimizeHuffman(optimize);
+    encoder.setRestartInterval(3);
+    encode();
+    JFIFParser parser;
+
+    auto decoded = decode(jpeg, parser);
+
+    ASSERT_THAT(parser.getDRISegment()->restart_interval, Eq(3));
+    // 7x5 MCUs of 16x16
+    ASSERT_THAT(parser.getRestartIntervals(), SizeIs(12));
+    ASSERT_THAT(decoded, Eq(expected));
+  }
+}
+
+TEST_F(AJPEGEncoder, ReadsEveryPixelFormat) {
+  encode();
+  auto expected = decode(jpeg);
+  auto rgba = makeImage(width, height, 4);
+  // BGRA with padded rows
+  size_t stride = width * 4 + 12;
+  std::vector<uint8_t> bgra(stride * height);
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < width; ++x) {
+      const auto *in = rgba.data() + (y * width + x) * 4;
+      auto *out = bgra.data() + y * stride + x * 4;
+      std::tie(out[0], out[1], out[2], out[3]) =
+          std::make_tuple(in[2], in[1], in[0], in[3]);
+    }
+  }
+  jpeg.clear();
+
+  ASSERT_THAT(encoder.encode(bgra.data(), width, height, stride,
+                             PixelFormat::BGRA, jpeg),
+              Eq(0));
+  ASSERT_THAT(decode(jpeg), Eq(expected));
+}
+
+TEST_F(AJPEGEncoder, RejectsInvalidArguments) {
+  ASSERT_THAT(encoder.encode(nullptr, width, height, width * 3,
+                             PixelFormat::RGB, jpeg),
+              Eq(-1));
+  ASSERT_THAT(encoder.encode(rgb.data(), 0, height, width * 3,
+                             PixelFormat::RGB, jpeg),
+              Eq(-1));
+  ASSERT_THAT(encoder.encode(rgb.data(), width, height, width * 3 - 1,
+                             PixelFormat::RGB, jpeg),
+              Eq(-1));
+  ASSERT_THAT(jpeg, IsEmpty());
+}
+
+TEST_F(AJPEGEncoder, ReusesTheEncoderForImagesOfOtherSizes) {
+  encode();
+  auto expected = jpeg;
+  auto small = makeImage(9, 5, 3);
+  jpeg.clear();
+  encoder.encode(small.data(), 9, 5, 27, PixelFormat::RGB, jpeg);
+  jpeg.clear();
+
+  encode();
+
+  ASSERT_THAT(jpeg, Eq(expected));
+}
+
+class AJPEGEncoderSubsampling
+    : public AJPEGEncoder,
+      public WithParamInterface<std::tuple<ChromaSubsampling, size_t, size_t>> {
+};
+
+TEST_P(AJPEGEncoderSubsampling, DecodesCloseToTheInput) {
+  auto [subsampling, w, h] = GetParam();
+  width = w;
+  height = h;
+  rgb = makeImage(width, height, 3);
+  encoder.setSubsampling(subsampling);
+  encoder.setQuality(90);
+
+  ASSERT_THAT(encode(), Eq(0));
+  auto decoded = decode(jpeg);
+
+  ASSERT_THAT(decoded, SizeIs(rgb.size()));
+  // downsampled chroma blurs the sharp edges of the tiny images
+  ASSERT_THAT(psnr(rgb, decoded), Gt(25));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllSubsamplings, AJPEGEncoderSubsampling,
+    Combine(Values(ChromaSubsampling::YCbCr444, ChromaSubsampling::YCbCr422,
+                   ChromaSubsampling::YCbCr420),
+            Values(1, 8, 17, 64), Values(1, 9, 16, 33)));
+
+class AJPEGEncoderLevel : public AJPEGEncoder,
+                          public WithParamInterface<SIMDLevel> {
+public:
+  SIMDLevel saved_level = CPUFeatures::getSIMDLevel();
+
+  void TearDown() override { CPUFeatures::setSIMDLevel(saved_level); }
+};
+
+TEST_P(AJPEGEncoderLevel, WritesTheSameFileAsScalar) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << "not supported by this CPU";
+  }
+  for (auto subsampling :
+       {ChromaSubsampling::YCbCr444, ChromaSubsampling::YCbCr420}) {
+    encoder.setSubsampling(subsampling);
+    CPUFeatures::setSIMDLevel(SIMDLevel::Scalar);
+    jpeg.clear();
+    encode();
+    auto expected = jpeg;
+    CPUFeatures::setSIMDLevel(level);
+    jpeg.clear();
+
+    encode();
+
+    ASSERT_THAT(jpeg, Eq(expected));
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllSIMDLevels, AJPEGEncoderLevel,
+                         Values(SIMDLevel::SSE2, SIMDLevel::AVX2));
+
+TEST(ASegmentWriter, WritesSegmentsTheParserReads) {
+  std::vector<uint8_t> data;
+  segments::SOF0Segment sof0;
+  sof0.bitPerSample = 8;
+  sof0.width = 300;
+  sof0.height = 200;
+  sof0.num_components = 3;
+  sof0.component_id = {1, 2, 3};
+  sof0.sampling_factor = {0x21, 0x11, 0x11};
+  sof0.quantization_table_id = {0, 1, 1};
+  segments::DQTSegment dqt;
+  dqt.tables.resize(2);
+  for (uint8_t id = 0; id < 2; ++id) {
+    dqt.tables[id].id = id;
+    dqt.tables[id].data.assign(64, static_cast<uint8_t>(id + 1));
+  }
+  segments::DRISegment dri;
+  dri.restart_interval = 20;
+  segments::SOSSegment sos;
+  sos.num_components = 3;
+  sos.component_id = {1, 2, 3};
+  sos.huffman_table_id_dc = {0, 1, 1};
+  sos.huffman_table_id_ac = {0, 1, 1};
+
+  SegmentWriter::writeSOI(data);
+  SegmentWriter::write(data, dqt);
+  SegmentWriter::write(data, sof0);
+  SegmentWriter::write(data, dri);
+  SegmentWriter::write(data, sos);
+  SegmentWriter::writeEOI(data);
+  JFIFParser parser;
+  parser.parse(data.data(), data.size());
+
+  auto *parsed_sof0 = parser.getSOF0Segment();
+  ASSERT_THAT(parsed_sof0->width, Eq(300));
+  ASSERT_THAT(parsed_sof0->height, Eq(200));
+  ASSERT_THAT(parsed_sof0->sampling_factor, Eq(sof0.sampling_factor));
+  ASSERT_THAT(parser.getQTableRefs()[1]->data, Eq(dqt.tables[1].data));
+  ASSERT_THAT(parser.getDRISegment()->restart_interval, Eq(20));
+  auto *parsed_sos = parser.getSOSSegment();
+  ASSERT_THAT(parsed_sos->component_id, Eq(sos.component_id));
+  ASSERT_THAT(parsed_sos->huffman_table_id_dc, Eq(sos.huffman_table_id_dc));
+  ASSERT_THAT(parsed_sos->spectral_end, Eq(63));
+}
@@ -0,0 +1,259 @@
+//
+// Created by user on 8/3/25.
+//
+#include "sjpg_jpeg_transform.h"
+
+#include <fstream>
+#include <gmock/gmock.h>
+#include <tuple>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AJPEGTransformer : public Test {
+public:
+  JPEGTransformer transformer;
+
+  static std::vector<uint8_t> readFile(const std::string &path) {
+    std::ifstream stream(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(stream),
+            std::istreambuf_iterator<char>()};
+  }
+
+  std::vector<uint8_t> transform(const std::vector<uint8_t> &data) {
+    JFIFParser parser;
+    parser.parse(data.data(), data.size());
+    std::vector<uint8_t> out;
+    if (transformer.transform(parser, out) != 0) {
+      return {};
+    }
+    return out;
+  }
+
+  // the luminance samples inside the image
+  static std::vector<uint8_t> decodeLuminance(const std::vector<uint8_t> &data,
+                                              size_t &width, size_t &height) {
+    JFIFParser parser;
+    JPEGDecoder decoder;
+    if (parser.parse(data.data(), data.size()) != 0 ||
+        decoder.decode(parser) != 0) {
+      return {};
+    }
+    auto plane = decoder.getPlane(0);
+    width = plane.width;
+    height = plane.height;
+    std::vector<uint8_t> samples;
+    for (size_t y = 0; y < height; ++y) {
+      samples.insert(samples.end(), plane.row(y), plane.row(y) + width);
+    }
+    return samples;
+  }
+
+  static std::vector<int16_t> decodeCoefficients(
+      const std::vector<uint8_t> &data) {
+    JFIFParser parser;
+    JPEGDecoder decoder;
+    parser.parse(data.data(), data.size());
+    if (decoder.decodeCoefficients(parser) != 0) {
+      return {};
+    }
+    std::vector<int16_t> coefficients;
+    for (int i = 0; i < JPEGDecoder::kMaxComponents; ++i) {
+      auto view = decoder.getCoefficients(i);
+      coefficients.insert(
+          coefficients.end(), view.data,
+          view.data + view.blocks_per_line * view.block_rows * 64);
+    }
+    return coefficients;
+  }
+};
+
+TEST_F(AJPEGTransformer, KeepsTheImageWithoutTransform) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+
+  auto out = transform(data);
+
+  ASSERT_THAT(out, Not(IsEmpty()));
+  ASSERT_THAT(decodeCoefficients(out), Eq(decodeCoefficients(data)));
+}
+
+TEST_F(AJPEGTransformer, WritesABaselineImageOfAProgressiveOne) {
+  auto data = readFile("./resources/lenna_256_420_progressive.jpg");
+
+  auto out = transform(data);
+  JFIFParser parser;
+  parser.parse(out.data(), out.size());
+
+  ASSERT_THAT(parser.getSOF0Segment()->frame_marker, Eq(JFIF_SOF0));
+  size_t width, height, expected_width, expected_height;
+  ASSERT_THAT(decodeLuminance(out, width, height),
+              Eq(decodeLuminance(data, expected_width, expected_height)));
+}
+
+TEST_F(AJPEGTransformer, CropsAtTheMCUGrid) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  transformer.setCrop(20, 40, 100, 50);
+  size_t width, height;
+  auto original = decodeLuminance(data, width, height);
+
+  auto out = transform(data);
+  size_t crop_width, crop_height;
+  auto cropped = decodeLuminance(out, crop_width, crop_height);
+
+  // the origin moves to 16, 32 and the size grows by as much
+  ASSERT_THAT(transformer.getWidth(), Eq(104));
+  ASSERT_THAT(transformer.getHeight(), Eq(58));
+  ASSERT_THAT(crop_width, Eq(104));
+  ASSERT_THAT(crop_height, Eq(58));
+  for (size_t y = 0; y < crop_height; ++y) {
+    for (size_t x = 0; x < crop_width; ++x) {
+      ASSERT_THAT(cropped[y * crop_width + x],
+                  Eq(original[(y + 32) * width + x + 16]))
+          << x << ", " << y;
+    }
+  }
+}
+
+TEST_F(AJPEGTransformer, ClipsTheCropToTheImage) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  transformer.setCrop(200, 0, 1000, 0);
+
+  transform(data);
+
+  ASSERT_THAT(transformer.getWidth(), Eq(64));
+  ASSERT_THAT(transformer.getHeight(), Eq(256));
+}
+
+TEST_F(AJPEGTransformer, FailsIfTheCropIsOutsideTheImage) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  transformer.setCrop(256, 0, 16, 16);
+
+  ASSERT_THAT(transform(data), IsEmpty());
+}
+
+TEST_F(AJPEGTransformer, TrimsPartialMCUsOfFlippedEdges) {
+  // 4:2:2, MCUs of 16x8
+  auto data = readFile("./resources/lenna_251x173_422.jpg");
+
+  transformer.setTransform(Transform::FlipHorizontal);
+  transform(data);
+  ASSERT_THAT(transformer.getWidth(), Eq(240));
+  ASSERT_THAT(transformer.getHeight(), Eq(173));
+
+  // MCUs of 8x16 once transposed, the flipped axis is the source's height
+  transformer.setTransform(Transform::Rotate90);
+  auto out = transform(data);
+  ASSERT_THAT(transformer.getWidth(), Eq(168));
+  ASSERT_THAT(transformer.getHeight(), Eq(251));
+  JFIFParser parser;
+  parser.parse(out.data(), out.size());
+  ASSERT_THAT(parser.getSOF0Segment()->sampling_factor,
+              ElementsAre(0x12, 0x11, 0x11));
+}
+
+TEST_F(AJPEGTransformer, OptimizedTablesAreSmaller) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  auto standard = transform(data);
+
+  transformer.setOptimizeHuffman(true);
+  auto optimized = transform(data);
+
+  ASSERT_THAT(optimized.size(), Lt(standard.size()));
+  ASSERT_THAT(decodeCoefficients(optimized), Eq(decodeCoefficients(data)));
+}
+
+TEST_F(AJPEGTransformer, OptimizesTheTablesOfAGrayscaleImage) {
+  auto data = readFile("./resources/lenna_256_gray.jpg");
+  transformer.setOptimizeHuffman(true);
+  transformer.setTransform(Transform::Rotate90);
+
+  auto rotated = transform(data);
+  transformer.setTransform(Transform::Rotate270);
+  auto out = transform(rotated);
+
+  // a single component is coded with the luminance tables only
+  JFIFParser parser;
+  parser.parse(rotated.data(), rotated.size());
+  ASSERT_THAT(parser.getDHTSegments(), SizeIs(2));
+  ASSERT_THAT(decodeCoefficients(out), Eq(decodeCoefficients(data)));
+}
+
+TEST_F(AJPEGTransformer, WritesRestartMarkers) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  transformer.setRestartInterval(10);
+
+  auto out = transform(data);
+  JFIFParser parser;
+  parser.parse(out.data(), out.size());
+
+  // 16x16 MCUs of 16x16
+  ASSERT_THAT(parser.getRestartIntervals(), SizeIs(26));
+  ASSERT_THAT(decodeCoefficients(out), Eq(decodeCoefficients(data)));
+}
+
+class AJPEGTransformerTransform
+    : public AJPEGTransformer,
+      public WithParamInterface<std::tuple<Transform, Transform>> {};
+
+TEST_P(AJPEGTransformerTransform, IsUndoneByItsInverse) {
+  auto [transform_op, inverse] = GetParam();
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  transformer.setTransform(transform_op);
+  auto out = transform(data);
+
+  transformer.setTransform(inverse);
+  auto restored = transform(out);
+
+  ASSERT_THAT(decodeCoefficients(restored), Eq(decodeCoefficients(data)));
+}
+
+// the pixels are moved with the blocks, up to the rounding of the IDCT,
+// which isn't symmetric
+TEST_P(AJPEGTransformerTransform, MovesThePixels) {
+  auto transform_op = std::get<0>(GetParam());
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  size_t width, height;
+  auto original = decodeLuminance(data, width, height);
+  transformer.setTransform(transform_op);
+
+  auto out = transform(data);
+  size_t out_width, out_height;
+  auto transformed = decodeLuminance(out, out_width, out_height);
+
+  ASSERT_THAT(transformed, SizeIs(original.size()));
+  const bool transpose = transform_op == Transform::Transpose ||
+                         transform_op == Transform::Transverse ||
+                         transform_op == Transform::Rotate90 ||
+                         transform_op == Transform::Rotate270;
+  const bool flip_x = transform_op == Transform::FlipHorizontal ||
+                      transform_op == Transform::Transverse ||
+                      transform_op == Transform::Rotate90 ||
+                      transform_op == Transform::Rotate180;
+  const bool flip_y = transform_op == Transform::FlipVertical ||
+                      transform_op == Transform::Transverse ||
+                      transform_op == Transform::Rotate180 ||
+                      transform_op == Transform::Rotate270;
+  int max_difference = 0;
+  for (size_t y = 0; y < out_height; ++y) {
+    for (size_t x = 0; x < out_width; ++x) {
+      size_t tx = flip_x ? out_width - 1 - x : x;
+      size_t ty = flip_y ? out_height - 1 - y : y;
+      if (transpose) {
+        std::swap(tx, ty);
+      }
+      int difference = transformed[y * out_width + x] - original[ty * width + tx];
+      max_difference = std::max(max_difference, std::abs(difference));
+    }
+  }
+  ASSERT_THAT(max_difference, Le(1));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllTransforms, AJPEGTransformerTransform,
+    Values(std::make_tuple(Transform::FlipHorizontal, Transform::FlipHorizontal),
+           std::make_tuple(Transform::FlipVertical, Transform::FlipVertical),
+           std::make_tuple(Transform::Transpose, Transform::Transpose),
+           std::make_tuple(Transform::Transverse, Transform::Transverse),
+           std::make_tuple(Transform::Rotate90, Transform::Rotate270),
+           std::make_tuple(Transform::Rotate180, Transform::Rotate180),
+           std::make_tuple(Transform::Rotate270, Transform::Rotate90)));
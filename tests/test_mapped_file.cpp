@@ -0,0 +1,58 @@
+//
+// Created by user on 7/23/25.
+//
+#include "sjpg_mapped_file.h"
+
+#include <fstream>
+#include <gmock/gmock.h>
+#include <iterator>
+#include <vector>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AMappedFile : public Test {
+public:
+  std::string filepath = "./resources/lenna.jpg";
+};
+
+TEST_F(AMappedFile, MapsTheWholeFile) {
+  std::ifstream stream(filepath, std::ios::binary);
+  std::vector<uint8_t> expected((std::istreambuf_iterator<char>(stream)),
+                                std::istreambuf_iterator<char>());
+
+  MappedFile file(filepath);
+
+  ASSERT_TRUE(file.isOpen());
+  ASSERT_THAT(file.size(), Eq(expected.size()));
+  ASSERT_THAT(std::vector<uint8_t>(file.span().begin(), file.span().end()),
+              ElementsAreArray(expected));
+}
+
+TEST_F(AMappedFile, OpenFailsIfFileDoesNotExist) {
+  MappedFile file;
+
+  ASSERT_FALSE(file.open("nonexistent.jpg"));
+  ASSERT_FALSE(file.isOpen());
+  ASSERT_THAT(file.data(), IsNull());
+}
+
+TEST_F(AMappedFile, MoveTransfersTheMapping) {
+  MappedFile file(filepath);
+  const auto *data = file.data();
+
+  MappedFile moved = std::move(file);
+
+  ASSERT_THAT(moved.data(), Eq(data));
+  ASSERT_FALSE(file.isOpen());
+  ASSERT_THAT(file.size(), Eq(0));
+}
+
+TEST_F(AMappedFile, CloseReleasesTheMapping) {
+  MappedFile file(filepath);
+
+  file.close();
+
+  ASSERT_FALSE(file.isOpen());
+  ASSERT_THAT(file.size(), Eq(0));
+}
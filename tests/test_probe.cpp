@@ -0,0 +1,184 @@
+//
+// Created by user on 7/26/25.
+//
+
+#include "sjpg_jfif_parser.h"
+#include "sjpg_probe.h"
+
+#include <fstream>
+#include <gmock/gmock.h>
+#include <iterator>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AJPEGProbe : public Test {
+public:
+  ImageInfo info;
+
+  static std::vector<uint8_t> readFile(const std::string &path) {
+    std::ifstream stream(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(stream),
+            std::istreambuf_iterator<char>()};
+  }
+
+  // SOI, a progressive frame header and a scan header
+  static std::vector<uint8_t> progressiveHeader() {
+    return {0xFF, 0xD8,
+            0xFF, 0xC2, 0x00, 0x0B, 0x08, 0x00, 0x10, 0x00, 0x20, 0x01,
+            0x01, 0x11, 0x00,
+            0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00};
+  }
+};
+
+TEST_F(AJPEGProbe, ReadsBaselineHeader) {
+  auto data = readFile("./resources/lenna_256.jpg");
+
+  auto status = JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_THAT(status, Eq(ProbeStatus::Ok));
+  ASSERT_THAT(info.width, Eq(256));
+  ASSERT_THAT(info.height, Eq(256));
+  ASSERT_THAT(info.precision, Eq(8));
+  ASSERT_THAT(info.component_count, Eq(3));
+  ASSERT_THAT(info.components[0].h_factor, Eq(1));
+  ASSERT_THAT(info.components[0].v_factor, Eq(1));
+  ASSERT_THAT(info.sof_marker, Eq(JFIF_SOF0));
+  ASSERT_FALSE(info.progressive);
+  ASSERT_FALSE(info.arithmetic);
+  ASSERT_FALSE(info.hasRestartMarkers());
+  ASSERT_TRUE(info.scan_found);
+}
+
+TEST_F(AJPEGProbe, ReadsSamplingFactors) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+
+  JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_THAT(info.components[0].h_factor, Eq(2));
+  ASSERT_THAT(info.components[0].v_factor, Eq(2));
+  ASSERT_THAT(info.components[1].h_factor, Eq(1));
+  ASSERT_THAT(info.components[2].v_factor, Eq(1));
+}
+
+TEST_F(AJPEGProbe, ReadsRestartInterval) {
+  auto data = readFile("./resources/lenna_256_rst.jpg");
+
+  JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_TRUE(info.hasRestartMarkers());
+  ASSERT_THAT(info.restart_interval, Eq(5));
+}
+
+TEST_F(AJPEGProbe, StopsAtTheScanHeader) {
+  auto data = readFile("./resources/lenna_251x173_422.jpg");
+  JFIFParser parser;
+  parser.parse(data.data(), data.size());
+  size_t sos_offset = 0;
+  for (auto &segment : parser.getSegments()) {
+    if (segment.marker == JFIF_SOS) {
+      sos_offset = segment.offset - 2;
+    }
+  }
+
+  JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_THAT(info.header_size, Eq(sos_offset));
+  ASSERT_THAT(info.width, Eq(parser.getSOF0Segment()->width));
+  ASSERT_THAT(info.height, Eq(parser.getSOF0Segment()->height));
+}
+
+TEST_F(AJPEGProbe, CanStopAtTheFrameHeader) {
+  auto data = readFile("./resources/lenna_256_rst.jpg");
+
+  auto status = JPEGProbe::probe(data.data(), data.size(), info,
+                                 JPEGProbe::StopAt::Frame);
+
+  ASSERT_THAT(status, Eq(ProbeStatus::Ok));
+  ASSERT_TRUE(info.frame_found);
+  ASSERT_FALSE(info.scan_found);
+  ASSERT_THAT(info.width, Eq(256));
+}
+
+TEST_F(AJPEGProbe, ReportsNeedMoreDataForEveryShortPrefix) {
+  auto data = readFile("./resources/lenna_256_rst.jpg");
+  JPEGProbe::probe(data.data(), data.size(), info);
+  auto header_size = info.header_size;
+
+  for (size_t size = 0; size < header_size; ++size) {
+    auto status = JPEGProbe::probe(data.data(), size, info);
+
+    ASSERT_THAT(status, Eq(ProbeStatus::NeedMoreData)) << size;
+    ASSERT_THAT(info.bytes_needed, Gt(size));
+  }
+}
+
+TEST_F(AJPEGProbe, ConvergesWhenGivenTheBytesNeeded) {
+  auto data = readFile("./resources/lenna_256.jpg");
+  size_t size = 0;
+  int attempts = 0;
+
+  auto status = ProbeStatus::NeedMoreData;
+  while (status == ProbeStatus::NeedMoreData) {
+    status = JPEGProbe::probe(data.data(), size, info);
+    if (status == ProbeStatus::NeedMoreData) {
+      ASSERT_THAT(info.bytes_needed, AllOf(Gt(size), Le(data.size())));
+      size = info.bytes_needed;
+    }
+    ++attempts;
+  }
+
+  // at most two rounds per segment, one for the length and one for the
+  // next marker
+  JFIFParser parser;
+  parser.parse(data.data(), data.size());
+  ASSERT_THAT(status, Eq(ProbeStatus::Ok));
+  ASSERT_THAT(attempts, Le(2 * parser.getSegments().size() + 2));
+}
+
+TEST_F(AJPEGProbe, SkipsLargeSegmentsByTheirLength) {
+  // an APP1 segment of 40000 bytes of which only the start is available
+  std::vector<uint8_t> data = {0xFF, 0xD8, 0xFF, 0xE1, 0x9C, 0x40, 'E', 'x'};
+
+  auto status = JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_THAT(status, Eq(ProbeStatus::NeedMoreData));
+  ASSERT_THAT(info.bytes_needed, Eq(4 + 40000 + 2));
+}
+
+TEST_F(AJPEGProbe, DetectsProgressiveFrames) {
+  auto data = progressiveHeader();
+
+  auto status = JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_THAT(status, Eq(ProbeStatus::Ok));
+  ASSERT_TRUE(info.progressive);
+  ASSERT_THAT(info.width, Eq(32));
+  ASSERT_THAT(info.height, Eq(16));
+  ASSERT_THAT(info.component_count, Eq(1));
+}
+
+TEST_F(AJPEGProbe, DetectsArithmeticCoding) {
+  auto data = progressiveHeader();
+  data[3] = JFIF_SOF9;
+
+  JPEGProbe::probe(data.data(), data.size(), info);
+
+  ASSERT_TRUE(info.arithmetic);
+  ASSERT_FALSE(info.progressive);
+}
+
+TEST_F(AJPEGProbe, FailsWithoutSOI) {
+  std::vector<uint8_t> data = {0x89, 'P', 'N', 'G'};
+
+  ASSERT_THAT(JPEGProbe::probe(data.data(), data.size(), info),
+              Eq(ProbeStatus::NotJPEG));
+}
+
+TEST_F(AJPEGProbe, FailsIfScanComesBeforeFrame) {
+  auto data = progressiveHeader();
+  data.erase(data.begin() + 2, data.begin() + 15);
+
+  ASSERT_THAT(JPEGProbe::probe(data.data(), data.size(), info),
+              Eq(ProbeStatus::Invalid));
+}
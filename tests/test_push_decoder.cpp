@@ -0,0 +1,149 @@
+//
+// Created by user on 8/6/25.
+//
+#include "sjpg_push_decoder.h"
+
+#include <fstream>
+#include <gmock/gmock.h>
+#include <vector>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class APushDecoder : public Test {
+public:
+  PushDecoder decoder;
+  std::vector<uint8_t> pixels;
+  size_t rows_out{0};
+
+  static std::vector<uint8_t> readFile(const std::string &path) {
+    std::ifstream stream(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(stream),
+            std::istreambuf_iterator<char>()};
+  }
+
+  // the rows in order, packed
+  JPEGDecoder::RowSink collect(std::vector<uint8_t> &out, size_t &rows) {
+    return [&](size_t first_row, size_t row_count, const uint8_t *data,
+               size_t stride) {
+      EXPECT_THAT(first_row, Eq(rows));
+      out.insert(out.end(), data, data + row_count * stride);
+      rows += row_count;
+    };
+  }
+
+  std::vector<uint8_t> decodeRows(const std::vector<uint8_t> &data) {
+    JFIFParser parser;
+    JPEGDecoder row_decoder;
+    parser.parse(data.data(), data.size());
+    std::vector<uint8_t> out;
+    size_t rows = 0;
+    row_decoder.decodeRows(parser, PixelFormat::RGB, collect(out, rows));
+    return out;
+  }
+
+  // feeds `data` in chunks of `chunk_size`, the last result
+  int push(const std::vector<uint8_t> &data, size_t chunk_size) {
+    pixels.clear();
+    rows_out = 0;
+    decoder.start(PixelFormat::RGB, collect(pixels, rows_out));
+    int result = PushDecoder::NeedMoreData;
+    for (size_t pos = 0; pos < data.size(); pos += chunk_size) {
+      result = decoder.feed(data.data() + pos,
+                            std::min(chunk_size, data.size() - pos));
+      if (result != PushDecoder::NeedMoreData) {
+        break;
+      }
+    }
+    return result;
+  }
+};
+
+TEST_F(APushDecoder, IsTheSameAsRowDecoding) {
+  for (const auto *path :
+       {"./resources/lenna_256_420.jpg", "./resources/lenna_256_rst.jpg",
+        "./resources/lenna_251x173_422.jpg",
+        "./resources/lenna_256_gray_rst.jpg"}) {
+    auto data = readFile(path);
+    auto expected = decodeRows(data);
+
+    for (size_t chunk_size : {size_t{1}, size_t{7}, size_t{4096}, data.size()}) {
+      ASSERT_THAT(push(data, chunk_size), Eq(PushDecoder::Finished))
+          << path << " " << chunk_size;
+      ASSERT_THAT(rows_out, Eq(decoder.getHeight()));
+      ASSERT_THAT(pixels, Eq(expected)) << path << " " << chunk_size;
+    }
+  }
+}
+
+TEST_F(APushDecoder, OutputsRowsBeforeTheDataEnds) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  decoder.start(PixelFormat::RGB, collect(pixels, rows_out));
+
+  ASSERT_THAT(decoder.feed(data.data(), data.size() / 2),
+              Eq(PushDecoder::NeedMoreData));
+  ASSERT_TRUE(decoder.hasHeaders());
+  ASSERT_THAT(rows_out, Gt(0));
+  ASSERT_THAT(rows_out, Lt(256));
+}
+
+TEST_F(APushDecoder, KeepsOnlyTheDataNotDecodedYet) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  decoder.start(PixelFormat::RGB, collect(pixels, rows_out));
+  JFIFParser parser;
+  parser.parse(data.data(), data.size());
+  const auto header_size = static_cast<size_t>(parser.getEncodedData().data() -
+                                               data.data());
+
+  size_t most_buffered = 0;
+  for (size_t pos = 0; pos < data.size(); pos += 256) {
+    decoder.feed(data.data() + pos, std::min<size_t>(256, data.size() - pos));
+    most_buffered = std::max(most_buffered, decoder.getBufferedSize());
+  }
+
+  // the headers, a chunk and a part of an MCU
+  ASSERT_THAT(rows_out, Eq(256));
+  ASSERT_THAT(most_buffered, Lt(header_size + 256 + 1024));
+}
+
+TEST_F(APushDecoder, FinishOutputsTheRowsOfATruncatedFile) {
+  auto data = readFile("./resources/lenna_256_rst.jpg");
+  data.resize(data.size() * 2 / 3);
+
+  ASSERT_THAT(push(data, 1000), Eq(PushDecoder::NeedMoreData));
+  const auto rows_decoded = rows_out;
+  ASSERT_THAT(decoder.finish(), Eq(PushDecoder::Finished));
+
+  ASSERT_THAT(rows_out, Eq(256));
+  ASSERT_THAT(pixels, SizeIs(256 * 256 * 3));
+  // the rows decoded are those of the whole file
+  auto expected = decodeRows(readFile("./resources/lenna_256_rst.jpg"));
+  ASSERT_THAT(std::vector<uint8_t>(pixels.begin(),
+                                   pixels.begin() + rows_decoded * 256 * 3),
+              ElementsAreArray(expected.data(), rows_decoded * 256 * 3));
+  // the samples of the missing MCUs are 0, Y = Cb = Cr = 0 is green
+  ASSERT_THAT(std::vector<uint8_t>(pixels.end() - 3, pixels.end()),
+              ElementsAre(0, 135, 0));
+}
+
+TEST_F(APushDecoder, ScalesWithTheDecoderSettings) {
+  auto data = readFile("./resources/lenna_256_420.jpg");
+  decoder.getDecoder().setScale(DecodeScale::Half);
+
+  ASSERT_THAT(push(data, 500), Eq(PushDecoder::Finished));
+
+  ASSERT_THAT(decoder.getWidth(), Eq(128));
+  ASSERT_THAT(rows_out, Eq(128));
+}
+
+TEST_F(APushDecoder, FailsWithoutSOI) {
+  std::vector<uint8_t> data = {0x00, 0xD8, 0xFF, 0xD9};
+
+  ASSERT_THAT(push(data, 1), Eq(PushDecoder::Failed));
+}
+
+TEST_F(APushDecoder, FailsOnProgressiveImages) {
+  auto data = readFile("./resources/lenna_256_420_progressive.jpg");
+
+  ASSERT_THAT(push(data, 4096), Eq(PushDecoder::Failed));
+}
@@ -0,0 +1,138 @@
+//
+// Created by user on 8/5/25.
+//
+#include "sjpg_jpeg_decoder.h"
+#include "sjpg_scan_index.h"
+
+#include <cstdio>
+#include <fstream>
+#include <gmock/gmock.h>
+#include <vector>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AScanIndex : public Test {
+public:
+  ScanIndex index;
+  ScanIndex::Header header;
+
+  void SetUp() override {
+    header.component_count = 3;
+    header.width = 256;
+    header.height = 128;
+    header.scan_size = 4096;
+    header.mcu_count = 128;
+    header.checkpoint_mcus = 16;
+    header.restart_interval = 0;
+    header.scan_hash = 0x0123456789ABCDEFull;
+    index.reset(header);
+    for (uint64_t mcu = 0; mcu < header.mcu_count; mcu += 16) {
+      index.add({mcu, mcu * 100 + 3,
+                 {static_cast<int16_t>(mcu), -1,
+                  static_cast<int16_t>(-1024)}});
+    }
+  }
+};
+
+TEST_F(AScanIndex, HoldsTheCheckpoints) {
+  ASSERT_THAT(index.getCheckpointCount(), Eq(8));
+  auto checkpoint = index.getCheckpoint(5);
+
+  ASSERT_THAT(checkpoint.mcu, Eq(80));
+  ASSERT_THAT(checkpoint.bit_offset, Eq(8003));
+  ASSERT_THAT(checkpoint.dc_predictors, ElementsAre(80, -1, -1024));
+  ASSERT_THAT(index.size(),
+              Eq(ScanIndex::kHeaderSize + 8 * ScanIndex::kCheckpointSize));
+}
+
+TEST_F(AScanIndex, FindsTheLastCheckpointAtOrBeforeAnMCU) {
+  ASSERT_THAT(index.findCheckpoint(0), Eq(0));
+  ASSERT_THAT(index.findCheckpoint(15), Eq(0));
+  ASSERT_THAT(index.findCheckpoint(16), Eq(1));
+  ASSERT_THAT(index.findCheckpoint(100), Eq(6));
+  ASSERT_THAT(index.findCheckpoint(1000), Eq(7));
+}
+
+TEST_F(AScanIndex, LoadsItsDataInPlace) {
+  std::vector<uint8_t> data(index.data(), index.data() + index.size());
+  ScanIndex loaded;
+
+  ASSERT_TRUE(loaded.load(data.data(), data.size()));
+  ASSERT_THAT(loaded.data(), Eq(data.data()));
+  ASSERT_THAT(loaded.getHeader().checkpoint_mcus, Eq(16));
+  ASSERT_THAT(loaded.getHeader().scan_hash, Eq(0x0123456789ABCDEFull));
+  ASSERT_TRUE(loaded.getHeader() == header);
+  ASSERT_THAT(loaded.getCheckpoint(7).bit_offset, Eq(11203));
+}
+
+TEST_F(AScanIndex, OpensASavedFile) {
+  const std::string path = "./scan_index_test.idx";
+  ASSERT_TRUE(index.save(path));
+  ScanIndex opened;
+
+  ASSERT_TRUE(opened.open(path));
+  std::remove(path.c_str());
+  ASSERT_THAT(opened.getCheckpointCount(), Eq(8));
+  ASSERT_THAT(std::vector<uint8_t>(opened.data(), opened.data() + opened.size()),
+              ElementsAreArray(index.data(), index.size()));
+}
+
+TEST_F(AScanIndex, RejectsOtherData) {
+  std::vector<uint8_t> data(index.data(), index.data() + index.size());
+  ScanIndex loaded;
+
+  data[0] = 'X';
+  ASSERT_FALSE(loaded.load(data.data(), data.size()));
+  data[0] = 'S';
+  data[8] = ScanIndex::kVersion + 1;
+  ASSERT_FALSE(loaded.load(data.data(), data.size()));
+  data[8] = ScanIndex::kVersion;
+  ASSERT_FALSE(loaded.load(data.data(), data.size() - 1));
+  ASSERT_TRUE(loaded.empty());
+  ASSERT_TRUE(loaded.load(data.data(), data.size()));
+}
+
+TEST_F(AScanIndex, IsBuiltWithACheckpointAtEveryRestartInterval) {
+  JFIFParser parser;
+  JPEGDecoder decoder;
+  ASSERT_THAT(parser.parseFile("./resources/lenna_256_rst.jpg"), Eq(0));
+
+  ASSERT_THAT(decoder.buildScanIndex(parser, 64, index), Eq(0));
+
+  // 1024 MCUs in intervals of 5, 205 of them and 12 more checkpoints at
+  // multiples of 64 but not of 5
+  ASSERT_THAT(index.getCheckpointCount(), Eq(205 + 12));
+  ASSERT_TRUE(index.getHeader() == ScanIndex::headerOf(parser));
+  for (size_t i = 0; i < index.getCheckpointCount(); ++i) {
+    auto checkpoint = index.getCheckpoint(i);
+    ASSERT_TRUE(checkpoint.mcu % 5 == 0 || checkpoint.mcu % 64 == 0);
+    if (checkpoint.mcu % 5 == 0) {
+      ASSERT_THAT(checkpoint.dc_predictors, Each(Eq(0)));
+    }
+  }
+}
+
+TEST_F(AScanIndex, TellsApartScansOfTheSameLength) {
+  std::ifstream stream("./resources/lenna_256_420.jpg", std::ios::binary);
+  std::vector<uint8_t> data{std::istreambuf_iterator<char>(stream),
+                            std::istreambuf_iterator<char>()};
+  JFIFParser parser;
+  ASSERT_THAT(parser.parse(data.data(), data.size()), Eq(0));
+  const auto original = ScanIndex::headerOf(parser);
+  // a bit of the scan flipped, far from any marker
+  auto pos = static_cast<size_t>(parser.getEncodedData().data() -
+                                 data.data()) +
+             parser.getEncodedData().size() / 2;
+  while (data[pos] >= 0xFE || data[pos - 1] == 0xFF) {
+    ++pos;
+  }
+  data[pos] ^= 1;
+
+  ASSERT_THAT(parser.parse(data.data(), data.size()), Eq(0));
+  auto other = ScanIndex::headerOf(parser);
+
+  ASSERT_THAT(other.scan_size, Eq(original.scan_size));
+  ASSERT_THAT(other.scan_hash, Ne(original.scan_hash));
+  ASSERT_FALSE(other == original);
+}
@@ -0,0 +1,201 @@
+//
+// Created by user on 7/30/25.
+//
+#include "sjpg_jpeg_decoder.h"
+#include "sjpg_table_cache.h"
+
+#include <gmock/gmock.h>
+#include <thread>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class ATableCache : public Test {
+public:
+  TableCache cache;
+
+  static std::vector<uint8_t> bytes(const uint8_t *data, size_t size) {
+    return {data, data + size};
+  }
+
+  std::vector<uint8_t> dc_counts =
+      bytes(annex_k::kDCLuminanceCounts, sizeof(annex_k::kDCLuminanceCounts));
+  std::vector<uint8_t> dc_symbols = bytes(annex_k::kDCLuminanceSymbols,
+                                          sizeof(annex_k::kDCLuminanceSymbols));
+  // a table that is not in Annex K
+  std::vector<uint8_t> counts = {0, 2, 2, 0, 0, 0, 0, 0,
+                                 0, 0, 0, 0, 0, 0, 0, 0};
+  std::vector<uint8_t> symbols = {0, 1, 2, 3};
+};
+
+TEST_F(ATableCache, StartsWithTheAnnexKTables) {
+  auto table = cache.getHuffmanTable(dc_counts, dc_symbols);
+
+  ASSERT_THAT(table, NotNull());
+  ASSERT_THAT(table->getSymbols(), ElementsAreArray(dc_symbols));
+  ASSERT_THAT(cache.getHuffmanStats().hits, Eq(1));
+  ASSERT_THAT(cache.getHuffmanStats().misses, Eq(0));
+  ASSERT_THAT(cache.getHuffmanStats().size, Eq(4));
+  ASSERT_THAT(cache.getDequantStats().size, Eq(2));
+}
+
+TEST_F(ATableCache, BuildsATableOnceAndSharesIt) {
+  auto first = cache.getHuffmanTable(counts, symbols);
+  auto second = cache.getHuffmanTable(counts, symbols);
+
+  ASSERT_THAT(first.get(), Eq(second.get()));
+  ASSERT_THAT(first->getSymbols(), ElementsAreArray(symbols));
+  ASSERT_THAT(cache.getHuffmanStats().misses, Eq(1));
+  ASSERT_THAT(cache.getHuffmanStats().hits, Eq(1));
+}
+
+TEST_F(ATableCache, TablesOfDifferentBytesAreDifferent) {
+  auto first = cache.getHuffmanTable(counts, symbols);
+  auto other_symbols = symbols;
+  other_symbols[3] = 4;
+
+  auto second = cache.getHuffmanTable(counts, other_symbols);
+
+  ASSERT_THAT(first.get(), Ne(second.get()));
+  ASSERT_THAT(second->getSymbols(), ElementsAreArray(other_symbols));
+}
+
+TEST_F(ATableCache, KeepsNoInvalidHuffmanTable) {
+  counts[1] = 5; // 5 codes of 2 bits
+
+  ASSERT_THAT(cache.getHuffmanTable(counts, {0, 1, 2, 3, 4, 5, 6}), IsNull());
+  ASSERT_THAT(cache.getHuffmanStats().size, Eq(4));
+}
+
+TEST_F(ATableCache, BuildsDequantTables) {
+  std::vector<uint8_t> qtable(64, 7);
+
+  auto table = cache.getDequantTable(qtable);
+
+  ASSERT_THAT(table->islow, Each(Eq(7)));
+  ASSERT_THAT(cache.getDequantTable(qtable).get(), Eq(table.get()));
+  ASSERT_THAT(cache.getDequantStats().misses, Eq(1));
+}
+
+TEST_F(ATableCache, ZeroCapacityDisablesCaching) {
+  cache.setCapacity(0);
+
+  auto first = cache.getHuffmanTable(dc_counts, dc_symbols);
+  auto second = cache.getHuffmanTable(dc_counts, dc_symbols);
+
+  ASSERT_THAT(first.get(), Ne(second.get()));
+  ASSERT_THAT(cache.getHuffmanStats().size, Eq(0));
+  ASSERT_THAT(cache.getHuffmanStats().misses, Eq(2));
+}
+
+TEST_F(ATableCache, ClearStartsOverFromAnnexK) {
+  cache.getHuffmanTable(counts, symbols);
+
+  cache.clear();
+
+  ASSERT_THAT(cache.getHuffmanStats().size, Eq(4));
+}
+
+TEST_F(ATableCache, SharesTablesBetweenThreads) {
+  std::vector<std::shared_ptr<const HuffmanTable>> tables(4);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < tables.size(); ++i) {
+    threads.emplace_back([&, i] {
+      for (int n = 0; n < 100; ++n) {
+        tables[i] = cache.getHuffmanTable(dc_counts, dc_symbols);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_THAT(tables, Each(Eq(tables[0])));
+  ASSERT_THAT(cache.getHuffmanStats().hits, Eq(400));
+}
+
+class AnLRUTableCache : public Test {
+public:
+  LRUTableCache<int> cache{2};
+  uint8_t keys[3] = {1, 2, 3};
+
+  std::shared_ptr<const int> get(int i) {
+    return cache.get({&keys[i], 1}, {},
+                     [&] { return std::make_shared<const int>(i); });
+  }
+};
+
+TEST_F(AnLRUTableCache, EvictsTheLeastRecentlyUsedTable) {
+  get(0);
+  get(1);
+  get(0);
+
+  get(2);
+
+  ASSERT_THAT(cache.getStats().evictions, Eq(1));
+  cache.resetStats();
+  get(0);
+  get(2);
+  ASSERT_THAT(cache.getStats().hits, Eq(2));
+  get(1);
+  ASSERT_THAT(cache.getStats().misses, Eq(1));
+}
+
+TEST_F(AnLRUTableCache, ShrinkingEvicts) {
+  get(0);
+  get(1);
+
+  cache.setCapacity(1);
+
+  ASSERT_THAT(cache.getStats().size, Eq(1));
+  ASSERT_THAT(*get(1), Eq(1));
+  ASSERT_THAT(cache.getStats().hits, Eq(1));
+}
+
+class AJPEGDecoderWithTableCache : public Test {
+public:
+  TableCache cache;
+  JFIFParser parser;
+  JPEGDecoder decoder;
+
+  void SetUp() override {
+    decoder.setTableCache(&cache);
+    parser.parseFile("./resources/lenna_256.jpg");
+  }
+};
+
+TEST_F(AJPEGDecoderWithTableCache, FindsTheAnnexKHuffmanTables) {
+  ASSERT_THAT(decoder.decode(parser), Eq(0));
+
+  // the DHT segments of the image are the Annex K ones, its DQT are not
+  ASSERT_THAT(cache.getHuffmanStats().hits, Eq(4));
+  ASSERT_THAT(cache.getHuffmanStats().misses, Eq(0));
+  ASSERT_THAT(cache.getDequantStats().misses, Eq(2));
+}
+
+TEST_F(AJPEGDecoderWithTableCache, NextImageReusesTheTables) {
+  decoder.decode(parser);
+  cache.resetStats();
+  JPEGDecoder other_decoder;
+  other_decoder.setTableCache(&cache);
+
+  ASSERT_THAT(other_decoder.decode(parser), Eq(0));
+
+  ASSERT_THAT(cache.getHuffmanStats().misses, Eq(0));
+  ASSERT_THAT(cache.getDequantStats().misses, Eq(0));
+  ASSERT_THAT(cache.getDequantStats().hits, Eq(3));
+}
+
+TEST_F(AJPEGDecoderWithTableCache, DecodesTheSameWithoutCaching) {
+  decoder.decode(parser);
+  JPEGDecoder uncached_decoder;
+  TableCache no_cache(0);
+  uncached_decoder.setTableCache(&no_cache);
+
+  ASSERT_THAT(uncached_decoder.decode(parser), Eq(0));
+
+  ASSERT_THAT(uncached_decoder.getYDecodedData(),
+              ElementsAreArray(decoder.getYDecodedData()));
+  ASSERT_THAT(uncached_decoder.getVDecodedData(),
+              ElementsAreArray(decoder.getVDecodedData()));
+}
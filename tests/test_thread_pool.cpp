@@ -0,0 +1,64 @@
+//
+// Created by user on 7/24/25.
+//
+#include "sjpg_thread_pool.h"
+
+#include <gmock/gmock.h>
+#include <stdexcept>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AThreadPool : public Test {
+public:
+  ThreadPool pool{4};
+};
+
+TEST_F(AThreadPool, HasTheRequestedNumberOfThreads) {
+  ASSERT_THAT(pool.size(), Eq(4));
+  ASSERT_THAT(ThreadPool().size(), Ge(1));
+}
+
+TEST_F(AThreadPool, SubmitReturnsTheResult) {
+  auto future = pool.submit([] { return 42; });
+
+  ASSERT_THAT(future.get(), Eq(42));
+}
+
+TEST_F(AThreadPool, ParallelForRunsEveryIndexOnce) {
+  std::vector<std::atomic<int>> hits(1000);
+
+  pool.parallelFor(hits.size(), [&](size_t i) { hits[i]++; });
+
+  for (auto &hit : hits) {
+    ASSERT_THAT(hit.load(), Eq(1));
+  }
+}
+
+TEST_F(AThreadPool, ParallelForWithoutWorkReturns) {
+  pool.parallelFor(0, [](size_t) { FAIL(); });
+}
+
+TEST_F(AThreadPool, ParallelForRethrowsTheException) {
+  std::atomic<int> runs{0};
+
+  ASSERT_THROW(pool.parallelFor(100,
+                                [&](size_t i) {
+                                  runs++;
+                                  if (i == 50) {
+                                    throw std::runtime_error("failed");
+                                  }
+                                }),
+               std::runtime_error);
+  ASSERT_THAT(runs.load(), Eq(100));
+}
+
+TEST_F(AThreadPool, ParallelForCanBeNestedInAWorker) {
+  std::atomic<int> total{0};
+
+  pool.parallelFor(8, [&](size_t) {
+    pool.parallelFor(8, [&](size_t) { total++; });
+  });
+
+  ASSERT_THAT(total.load(), Eq(64));
+}
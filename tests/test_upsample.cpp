@@ -0,0 +1,131 @@
+//
+// Created by user on 7/25/25.
+//
+#include "sjpg_upsample.h"
+
+#include <gmock/gmock.h>
+#include <random>
+#include <vector>
+
+using namespace testing;
+using namespace sjpg_codec;
+
+class AUpsampler : public Test {
+public:
+  std::mt19937 rng{20250725};
+
+  std::vector<uint8_t> randomRow(size_t size) {
+    std::vector<uint8_t> row(size);
+    for (auto &v : row) {
+      v = static_cast<uint8_t>(std::uniform_int_distribution<int>(0, 255)(rng));
+    }
+    return row;
+  }
+};
+
+TEST_F(AUpsampler, FastReplicatesSamples) {
+  uint8_t in[] = {10, 20, 30};
+  uint8_t out[6];
+
+  Upsampler::h2FastRowScalar(in, in, 3, 0, out);
+
+  ASSERT_THAT(out, ElementsAre(10, 10, 20, 20, 30, 30));
+}
+
+TEST_F(AUpsampler, FancyH2V1WeightsTheNearerSampleThreeToOne) {
+  uint8_t in[] = {0, 100, 200};
+  uint8_t out[6];
+
+  Upsampler::h2v1FancyRowScalar(in, in, 3, 0, out);
+
+  // edges keep the outer samples, inner ones are (3 * a + b + 1|2) / 4
+  ASSERT_THAT(out, ElementsAre(0, 25, 75, 125, 175, 200));
+}
+
+TEST_F(AUpsampler, FancyH2V2FiltersBothDirections) {
+  uint8_t near[] = {100, 100};
+  uint8_t far[] = {20, 20};
+  uint8_t out[4];
+
+  Upsampler::h2v2FancyRowScalar(near, far, 2, 0, out);
+
+  // (3 * 100 + 20) / 4 = 80 in every column
+  ASSERT_THAT(out, ElementsAre(80, 80, 80, 80));
+}
+
+TEST_F(AUpsampler, FancyRowsLeanOnTheirVerticalNeighbour) {
+  uint8_t samples[] = {0, 0, 100, 100, 200, 200};
+  PlaneView plane{samples, 2, 3, 2};
+  Upsampler upsampler(plane, 1, 2, UpsampleMode::Fancy, 2);
+
+  std::vector<uint8_t> rows;
+  for (size_t y = 0; y < 6; ++y) {
+    rows.push_back(upsampler.row(y)[0]);
+  }
+
+  // the first and the last row only see themselves
+  ASSERT_THAT(rows, ElementsAre(0, 25, 75, 125, 175, 200));
+}
+
+TEST_F(AUpsampler, FastModeReplicatesRowsAndColumns) {
+  uint8_t samples[] = {1, 2, 3, 4};
+  PlaneView plane{samples, 2, 2, 2};
+  Upsampler upsampler(plane, 2, 2, UpsampleMode::Fast, 3);
+
+  std::vector<uint8_t> rows;
+  for (size_t y = 0; y < 3; ++y) {
+    rows.insert(rows.end(), upsampler.row(y), upsampler.row(y) + 3);
+  }
+
+  ASSERT_THAT(rows, ElementsAre(1, 1, 2, 1, 1, 2, 3, 3, 4));
+}
+
+TEST_F(AUpsampler, OtherRatiosAreReplicated) {
+  uint8_t samples[] = {1, 2};
+  PlaneView plane{samples, 2, 1, 2};
+  Upsampler upsampler(plane, 4, 1, UpsampleMode::Fancy, 7);
+
+  const auto *row = upsampler.row(0);
+
+  ASSERT_THAT(std::vector<uint8_t>(row, row + 7),
+              ElementsAre(1, 1, 1, 1, 2, 2, 2));
+}
+
+class AUpsamplerKernel : public AUpsampler,
+                         public WithParamInterface<SIMDLevel> {};
+
+TEST_P(AUpsamplerKernel, IsIdenticalToScalar) {
+  auto level = GetParam();
+  if (level > CPUFeatures::getSupportedSIMDLevel()) {
+    GTEST_SKIP() << CPUFeatures::toString(level) << " is not supported";
+  }
+  auto scalar = Upsampler::select(SIMDLevel::Scalar);
+  auto simd = Upsampler::select(level);
+  using Kernel = Upsampler::RowKernel;
+  std::vector<std::pair<Kernel, Kernel>> kernels = {
+      {scalar.h2_fast, simd.h2_fast},
+      {scalar.h2v1_fancy, simd.h2v1_fancy},
+      {scalar.h2v2_fancy, simd.h2v2_fancy},
+      {scalar.h1v2_fancy, simd.h1v2_fancy}};
+
+  for (size_t width : {1, 2, 3, 8, 9, 10, 17, 18, 33, 100, 257}) {
+    auto near = randomRow(width);
+    auto far = randomRow(width);
+    for (auto [reference, kernel] : kernels) {
+      for (int bias : {1, 2}) {
+        // guard bytes past the row must stay untouched
+        std::vector<uint8_t> expected(2 * width + 8, 0xCD);
+        std::vector<uint8_t> out(2 * width + 8, 0xCD);
+
+        reference(near.data(), far.data(), width, bias, expected.data());
+        kernel(near.data(), far.data(), width, bias, out.data());
+
+        ASSERT_THAT(out, ElementsAreArray(expected)) << "width " << width;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(AllSIMDLevels, AUpsamplerKernel,
+                         Values(SIMDLevel::Scalar, SIMDLevel::SSE2,
+                                SIMDLevel::AVX2));